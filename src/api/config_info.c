@@ -1416,12 +1416,12 @@ extern void *slurm_ctl_conf_2_key_pairs (slurm_ctl_conf_t* slurm_ctl_conf_ptr)
 
 	key_pair = xmalloc(sizeof(config_key_pair_t));
 	key_pair->name = xstrdup("PowerAllocatorInterval");
-	key_pair->value = xstrdup(slurm_ctl_conf_ptr->power_allocatorinterval);
+	key_pair->value = xstrdup_printf("%u", slurm_ctl_conf_ptr->power_allocatorinterval);
 	list_append(ret_list, key_pair);	
 
 	key_pair = xmalloc(sizeof(config_key_pair_t));
 	key_pair->name = xstrdup("PowerMonitorInterval");
-	key_pair->value = xstrdup(slurm_ctl_conf_ptr->power_monitorinterval);
+	key_pair->value = xstrdup_printf("%u", slurm_ctl_conf_ptr->power_monitorinterval);
 	list_append(ret_list, key_pair);
 	
 	key_pair = xmalloc(sizeof(config_key_pair_t));
@@ -1431,12 +1431,12 @@ extern void *slurm_ctl_conf_2_key_pairs (slurm_ctl_conf_t* slurm_ctl_conf_ptr)
 
 	key_pair = xmalloc(sizeof(config_key_pair_t));
 	key_pair->name = xstrdup("PowerAnalyzerInterval");
-	key_pair->value = xstrdup(slurm_ctl_conf_ptr->power_analyzerinterval);
+	key_pair->value = xstrdup_printf("%u", slurm_ctl_conf_ptr->power_analyzerinterval);
 	list_append(ret_list, key_pair);	
 	
 	key_pair = xmalloc(sizeof(config_key_pair_t));
 	key_pair->name = xstrdup("PowerAlert");
-	key_pair->value = xstrdup(slurm_ctl_conf_ptr->power_alert);
+	key_pair->value = xstrdup_printf("%u", slurm_ctl_conf_ptr->power_alert);
 	list_append(ret_list, key_pair);
 
 	key_pair = xmalloc(sizeof(config_key_pair_t));
@@ -1446,7 +1446,7 @@ extern void *slurm_ctl_conf_2_key_pairs (slurm_ctl_conf_t* slurm_ctl_conf_ptr)
 	
 	key_pair = xmalloc(sizeof(config_key_pair_t));
 	key_pair->name = xstrdup("PowerBudget");
-	key_pair->value = xstrdup(slurm_ctl_conf_ptr->z_32);
+	key_pair->value = xstrdup_printf("%u", slurm_ctl_conf_ptr->z_32);
 	list_append(ret_list, key_pair);	
 	
 	key_pair = xmalloc(sizeof(config_key_pair_t));
@@ -961,6 +961,12 @@ slurm_sprint_job_info ( job_info_t * job_ptr, int one_liner )
 	/****** Line 37 ******/
 	xstrcat(out, line_end);
 	xstrfmtcat(out, "Power=%s", power_flags_str(job_ptr->power_flags));
+	if (job_ptr->power_pkg_watts || job_ptr->power_dram_watts ||
+	    job_ptr->power_freq) {
+		xstrfmtcat(out, " PowerPkgWatts=%u PowerDramWatts=%u "
+			   "PowerFreq=%u", job_ptr->power_pkg_watts,
+			   job_ptr->power_dram_watts, job_ptr->power_freq);
+	}
 
 	/****** Line 38 (optional) ******/
 	if (job_ptr->bitflags) {
@@ -610,6 +610,55 @@ extern int slurm_load_node_single (node_info_msg_t **resp,
 	return SLURM_PROTOCOL_SUCCESS;
 }
 
+/*
+ * slurm_load_node_power - issue RPC to get the power and PMC samples of the
+ *	nodes which changed since the previous call
+ * IN watts_update_time - watts_update_time of the previous response, 0
+ *	for every node
+ * IN cache_update_time - cache_update_time of the previous response, 0
+ *	for every node
+ * OUT resp - place to store the node power records
+ * RET 0 or a slurm error code
+ * NOTE: free the response using slurm_free_node_power_info_msg
+ */
+extern int slurm_load_node_power(time_t watts_update_time,
+				 time_t cache_update_time,
+				 node_power_info_msg_t **resp)
+{
+	int rc;
+	slurm_msg_t req_msg;
+	slurm_msg_t resp_msg;
+	node_power_info_request_msg_t req;
+
+	slurm_msg_t_init(&req_msg);
+	slurm_msg_t_init(&resp_msg);
+	req.watts_update_time = watts_update_time;
+	req.cache_update_time = cache_update_time;
+	req_msg.msg_type = REQUEST_NODE_POWER_INFO;
+	req_msg.data     = &req;
+
+	if (slurm_send_recv_controller_msg(&req_msg, &resp_msg) < 0)
+		return SLURM_ERROR;
+
+	switch (resp_msg.msg_type) {
+	case RESPONSE_NODE_POWER_INFO:
+		*resp = (node_power_info_msg_t *) resp_msg.data;
+		break;
+	case RESPONSE_SLURM_RC:
+		rc = ((return_code_msg_t *) resp_msg.data)->return_code;
+		slurm_free_return_code_msg(resp_msg.data);
+		if (rc)
+			slurm_seterrno_ret(rc);
+		*resp = NULL;
+		break;
+	default:
+		slurm_seterrno_ret(SLURM_UNEXPECTED_MSG_ERROR);
+		break;
+	}
+
+	return SLURM_PROTOCOL_SUCCESS;
+}
+
 /*
  * slurm_get_node_energy_n - issue RPC to get the energy data of all
  * configured sensors on the target machine
@@ -119,6 +119,7 @@ strong_alias(bit_set_all,	slurm_bit_set_all);
 strong_alias(bit_clear_all,	slurm_bit_clear_all);
 strong_alias(bit_ffc,		slurm_bit_ffc);
 strong_alias(bit_ffs,		slurm_bit_ffs);
+strong_alias(bit_get_word,	slurm_bit_get_word);
 strong_alias(bit_free,		slurm_bit_free);
 strong_alias(bit_realloc,	slurm_bit_realloc);
 strong_alias(bit_size,		slurm_bit_size);
@@ -492,6 +493,42 @@ bit_ffs(bitstr_t *b)
 	return value;
 }
 
+/*
+ * Get the word of b holding bit n, to scan b a word at a time.
+ *   b (IN)		bitstring to read
+ *   n (IN)		first bit of the word, a multiple of 64
+ *   RETURN 		bit i is bit n + i of b, bits past the end of b are
+ *			zero (0 if n is past the end)
+ */
+uint64_t
+bit_get_word(bitstr_t *b, bitoff_t n)
+{
+	uint64_t word;
+	bitoff_t nbits;
+#ifdef SLURM_BIGENDIAN
+	uint64_t rev = 0;
+	int i;
+#endif
+
+	_assert_bitstr_valid(b);
+	assert((n & BITSTR_MAXPOS) == 0);
+
+	if ((n < 0) || (n >= _bitstr_bits(b)))
+		return 0;
+	word = b[_bit_word(n)];
+#ifdef SLURM_BIGENDIAN
+	for (i = 0; i <= BITSTR_MAXPOS; i++) {
+		if (word & _bit_mask(i))
+			rev |= (uint64_t) 1 << i;
+	}
+	word = rev;
+#endif
+	nbits = _bitstr_bits(b) - n;
+	if (nbits <= BITSTR_MAXPOS)
+		word &= ((uint64_t) 1 << nbits) - 1;
+	return word;
+}
+
 /*
  * Find last bit set in b.
  *   b (IN)		bitstring to search
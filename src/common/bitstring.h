@@ -106,6 +106,7 @@ bitoff_t bit_ffc(bitstr_t *b);
 bitoff_t bit_ffs(bitstr_t *b);
 
 /* new */
+uint64_t bit_get_word(bitstr_t *b, bitoff_t n);
 bitoff_t bit_nffs(bitstr_t *b, int32_t n);
 bitoff_t bit_nffc(bitstr_t *b, int32_t n);
 bitoff_t bit_noc(bitstr_t *b, int32_t n, int32_t seed);
@@ -137,6 +137,8 @@ typedef struct layout_plugin_st {
 	layout_t* layout;
 	char* name;
 	layout_ops_t* ops;
+	bool synced;	/* aggregated keys are up to date, no need for a full
+			 * autoupdate on push/pull */
 } layout_plugin_t;
 
 static void _layout_plugins_destroy(layout_plugin_t *lp)
@@ -174,9 +176,19 @@ typedef struct layouts_keydef_st {
 	char*			ref_shortkey; /* original ref key as defined in
 						 the layout keys definition,
 						 might be null too. */
-
+	struct layouts_keydef_st** sum_keydefs; /* CHILDREN_SUM keys using
+						   this key as reference */
+	uint32_t		sum_keydefs_cnt;
+	int			deps; /* KEYDEF_DEPS_* */
+	uint32_t		kv_gen; /* bumped when a value of the key
+					   changes */
 } layouts_keydef_t;
 
+/* how the keys depending on a keydef can be kept up to date when it changes */
+#define KEYDEF_DEPS_UNKNOWN	0	/* not yet evaluated */
+#define KEYDEF_DEPS_DELTA	1	/* delta propagation to parents sums */
+#define KEYDEF_DEPS_FULL	2	/* full autoupdate of the layout */
+
 /*
  * layouts_keydef_idfunc - identity function to build an hash table of
  *        layouts_keydef_t
@@ -187,6 +199,22 @@ static const char* layouts_keydef_idfunc(void* item)
 	return keydef->key;
 }
 
+/*
+ * layouts_column_t - dense copy of a numeric key of the node entities,
+ *       indexed like node_record_table_ptr. Columns are referenced by
+ *       handle (index in the mgr columns array) and rebuilt on access when
+ *       the kv generation of their keydef or the mgr kv generation moved
+ *       since their last build.
+ */
+typedef struct layouts_column_st {
+	layouts_keydef_t*	keydef;
+	uint32_t*		values;   /* 0 for nodes without the key */
+	bitstr_t*		set_bitmap; /* nodes having the key */
+	int			node_cnt;
+	uint32_t		gen;      /* keydef kv_gen at the last build */
+	uint32_t		mgr_gen;  /* mgr kv_gen at the last build */
+} layouts_column_t;
+
 /*
  * layouts_mgr_t - the main structure holding all the layouts, entities and
  *        shared keydefs as well as conf elements and plugins details.
@@ -199,6 +227,11 @@ typedef struct layouts_mgr_st {
 	xhash_t *layouts;      /* hash tbl of loaded layout structs (by type) */
 	xhash_t *entities;     /* hash tbl of loaded entity structs (by name) */
 	xhash_t *keydefs;      /* info on key types, how to free them etc */
+	layouts_column_t *columns; /* compiled key handles, see above */
+	uint32_t columns_count;
+	uint32_t kv_gen;       /* bumped on layout wide kv modifications,
+				* loads and autoupdates */
+	uint32_t conf_gen;     /* bumped on configuration load and update */
 } layouts_mgr_t;
 
 /*****************************************************************************\
@@ -240,6 +273,7 @@ static void _layouts_keydef_free(void* x)
 	xfree(keydef->shortkey);
 	xfree(keydef->ref_key);
 	xfree(keydef->ref_shortkey);
+	xfree(keydef->sum_keydefs);
 	xfree(keydef);
 }
 
@@ -397,6 +431,190 @@ static void _entity_add_data(entity_t* e, const char* key, void* data)
 
 static int _layouts_autoupdate_layout(layout_t* layout);
 static int _layouts_autoupdate_layout_if_allowed(layout_t* layout);
+layouts_keydef_t* _layouts_entity_get_kv_keydef(layout_t* l, entity_t* e,
+						char* key);
+
+/* scratch copy of a numeric value */
+typedef union {
+	long		l;
+	uint16_t	u16;
+	uint32_t	u32;
+	float		f;
+	double		d;
+	long double	ld;
+} _kv_value_t;
+
+static size_t _kv_type_size(layouts_keydef_types_t type)
+{
+	switch (type) {
+	case L_T_LONG:
+		return sizeof(long);
+	case L_T_UINT16:
+		return sizeof(uint16_t);
+	case L_T_UINT32:
+		return sizeof(uint32_t);
+	case L_T_FLOAT:
+		return sizeof(float);
+	case L_T_DOUBLE:
+		return sizeof(double);
+	case L_T_LONG_DOUBLE:
+		return sizeof(long double);
+	default:
+		return 0;
+	}
+}
+
+static void _keydef_deps_walk(void* item, void* arg)
+{
+	layouts_keydef_t* dep = (layouts_keydef_t*) item;
+	layouts_keydef_t* keydef = (layouts_keydef_t*) arg;
+	uint32_t action;
+	char* ref_key;
+
+	if (dep->plugin != keydef->plugin)
+		return;
+	ref_key = dep->ref_key ? dep->ref_key : dep->key;
+	if (xstrcmp(ref_key, keydef->key))
+		return;
+
+	action = dep->flags & KEYSPEC_UPDATE_CHILDREN_MASK;
+	if (action == KEYSPEC_UPDATE_CHILDREN_SUM &&
+	    !(dep->flags & KEYSPEC_UPDATE_PARENTS_MASK) &&
+	    _kv_type_size(keydef->type) && (dep->type == keydef->type)) {
+		xrealloc(keydef->sum_keydefs, sizeof(layouts_keydef_t*) *
+			 (keydef->sum_keydefs_cnt + 1));
+		keydef->sum_keydefs[keydef->sum_keydefs_cnt++] = dep;
+	} else if ((action && action != KEYSPEC_UPDATE_CHILDREN_COUNT) ||
+		   (dep->flags & KEYSPEC_UPDATE_PARENTS_MASK)) {
+		keydef->deps = KEYDEF_DEPS_FULL;
+	}
+}
+
+/* look for the keys of the layout computed from keydef values */
+static int _layouts_keydef_deps(layouts_keydef_t* keydef)
+{
+	if (keydef->deps == KEYDEF_DEPS_UNKNOWN) {
+		keydef->deps = KEYDEF_DEPS_DELTA;
+		xhash_walk(mgr->keydefs, _keydef_deps_walk, keydef);
+	}
+	return keydef->deps;
+}
+
+/*
+ * push the change of a numeric key value of an entity to the CHILDREN_SUM
+ * keys of its ancestors, adding (new - old) at each level. This keeps the
+ * sums exact without walking the whole layout tree, O(depth) per update.
+ */
+static void _layouts_propagate_delta(layout_t* l, entity_t* e,
+				     layouts_keydef_t* keydef,
+				     void* oldvalue, void* newvalue)
+{
+	entity_node_t* enode;
+	xtree_node_t* parent;
+	entity_t* pe;
+	layouts_keydef_t* pkeydef;
+	void* pvalue;
+	_kv_value_t pold;
+	uint32_t i;
+
+	if (keydef->sum_keydefs_cnt == 0 ||
+	    l->struct_type != LAYOUT_STRUCT_TREE)
+		return;
+	enode = entity_get_node(e, l);
+	if (!enode || !enode->node)
+		return;
+	parent = ((xtree_node_t*) enode->node)->parent;
+	if (!parent)
+		return;
+	enode = (entity_node_t*) xtree_node_get_data(parent);
+	if (!enode)
+		return;
+	pe = enode->entity;
+
+	for (i = 0; i < keydef->sum_keydefs_cnt; i++) {
+		pkeydef = keydef->sum_keydefs[i];
+		pvalue = entity_get_data_ref(pe, pkeydef->key);
+		if (!pvalue)
+			continue;
+		memcpy(&pold, pvalue, _kv_type_size(pkeydef->type));
+		switch (pkeydef->type) {
+		case L_T_LONG:
+			*(long*) pvalue += *(long*) newvalue -
+					   *(long*) oldvalue;
+			break;
+		case L_T_UINT16:
+			*(uint16_t*) pvalue += *(uint16_t*) newvalue -
+					       *(uint16_t*) oldvalue;
+			break;
+		case L_T_UINT32:
+			*(uint32_t*) pvalue += *(uint32_t*) newvalue -
+					       *(uint32_t*) oldvalue;
+			break;
+		case L_T_FLOAT:
+			*(float*) pvalue += *(float*) newvalue -
+					    *(float*) oldvalue;
+			break;
+		case L_T_DOUBLE:
+			*(double*) pvalue += *(double*) newvalue -
+					     *(double*) oldvalue;
+			break;
+		case L_T_LONG_DOUBLE:
+			*(long double*) pvalue += *(long double*) newvalue -
+						  *(long double*) oldvalue;
+			break;
+		default:
+			continue;
+		}
+		pkeydef->kv_gen++;
+		if (_layouts_keydef_deps(pkeydef) == KEYDEF_DEPS_FULL)
+			pkeydef->plugin->synced = false;
+		_layouts_propagate_delta(l, pe, pkeydef, &pold, pvalue);
+	}
+}
+
+/*
+ * called after a numeric key of an entity was set to a new value, keep the
+ * keys depending on it up to date or flag the layout for a full autoupdate
+ * at the next push/pull
+ */
+static void _layouts_kv_changed(layout_t* l, entity_t* e,
+				layouts_keydef_t* keydef,
+				void* oldvalue, void* newvalue)
+{
+	layout_plugin_t* plugin = keydef->plugin;
+
+	if (!plugin->ops->spec->autoupdate || !plugin->synced)
+		return;
+	if (_layouts_keydef_deps(keydef) == KEYDEF_DEPS_FULL) {
+		plugin->synced = false;
+		return;
+	}
+	if (keydef->sum_keydefs_cnt == 0)
+		return;
+	/* a sum does not include a child until it has a value, let a full
+	 * autoupdate take care of the first value */
+	if (!oldvalue) {
+		plugin->synced = false;
+		return;
+	}
+	_layouts_propagate_delta(l, e, keydef, oldvalue, newvalue);
+}
+
+/* a value of keydef changed, the column built from it is stale */
+static void _layouts_keydef_changed(layouts_keydef_t* keydef)
+{
+	if (keydef)
+		keydef->kv_gen++;
+}
+
+/* a key of the layout was modified in a way that delta propagation can not
+ * follow, force a full autoupdate at the next push/pull */
+static void _layouts_kv_unsync(layout_t* l, entity_t* e, char* key)
+{
+	layouts_keydef_t* keydef = _layouts_entity_get_kv_keydef(l, e, key);
+	if (keydef)
+		keydef->plugin->synced = false;
+}
 
 /*****************************************************************************\
  *                       LAYOUTS INTERNAL LOCKLESS API                       *
@@ -489,15 +707,15 @@ bool _layouts_entity_check_kv_keytype(layout_t* l, entity_t* e, char* key,
 
 int _layouts_entity_push_kv(layout_t* l, entity_t* e, char* key)
 {
-	/* a more advanced implementation should only pull what is necessary
-	 * instead of forcing a full autoupdate */
+	/* values set with _layouts_entity_set_kv were already pushed to the
+	 * parents sums, a full autoupdate is only done when the layout was
+	 * modified in a way that delta propagation can not follow */
 	return _layouts_autoupdate_layout_if_allowed(l);
 }
 
 int _layouts_entity_pull_kv(layout_t* l, entity_t* e, char* key)
 {
-	/* a more advanced implementation should only pull what is necessary
-	 * instead of forcing a full autoupdate */
+	/* see _layouts_entity_push_kv */
 	return _layouts_autoupdate_layout_if_allowed(l);
 }
 
@@ -508,6 +726,9 @@ int _layouts_entity_set_kv(layout_t* l, entity_t* e, char* key, void* value,
 	size_t size;
 	layouts_keydef_types_t real_type;
 	char key_keydef[PATHLEN];
+	layouts_keydef_t* keydef;
+	_kv_value_t old;
+	int rc;
 
 	if (l == NULL || e == NULL || key == NULL || value == NULL)
 		return SLURM_ERROR;
@@ -517,6 +738,7 @@ int _layouts_entity_set_kv(layout_t* l, entity_t* e, char* key, void* value,
 		return SLURM_ERROR;
 
 	_normalize_keydef_key(key_keydef, PATHLEN, key, l->type);
+	keydef = _layouts_entity_get_kv_keydef(l, e, key);
 
 	switch(real_type) {
 	case L_T_ERROR:
@@ -551,7 +773,25 @@ int _layouts_entity_set_kv(layout_t* l, entity_t* e, char* key, void* value,
 		size = sizeof(long double);
 		break;
 	}
-	return entity_set_data(e, key_keydef, value, size);
+
+	if (real_type == L_T_BOOLEAN) {
+		_layouts_keydef_changed(keydef);
+		_layouts_kv_unsync(l, e, key);
+		return entity_set_data(e, key_keydef, value, size);
+	}
+
+	/* keep a copy of the old value to propagate the change */
+	data = entity_get_data_ref(e, key_keydef);
+	if (data) {
+		if (!memcmp(data, value, size))
+			return SLURM_SUCCESS;
+		memcpy(&old, data, size);
+	}
+	_layouts_keydef_changed(keydef);
+	rc = entity_set_data(e, key_keydef, value, size);
+	if (rc == SLURM_SUCCESS && keydef)
+		_layouts_kv_changed(l, e, keydef, data ? &old : NULL, value);
+	return rc;
 }
 
 int _layouts_entity_set_kv_ref(layout_t* l, entity_t* e, char* key, void* value,
@@ -567,6 +807,8 @@ int _layouts_entity_set_kv_ref(layout_t* l, entity_t* e, char* key, void* value,
 		return rc;
 
 	_normalize_keydef_key(key_keydef, PATHLEN, key, l->type);
+	_layouts_keydef_changed(_layouts_entity_get_kv_keydef(l, e, key));
+	_layouts_kv_unsync(l, e, key);
 	return entity_set_data_ref(e, key_keydef, value, xfree_as_callback);
 }
 
@@ -704,6 +946,10 @@ int _layouts_entity_get_kv_ref(layout_t* l, entity_t* e,
 	_normalize_keydef_key(key_keydef, PATHLEN, key, l->type);
 	data = entity_get_data_ref(e, key_keydef);
 	if (data != NULL) {
+		/* the caller may modify the value through the reference */
+		_layouts_keydef_changed(_layouts_entity_get_kv_keydef(l, e,
+								      key));
+		_layouts_kv_unsync(l, e, key);
 		*value = data;
 		rc = SLURM_SUCCESS;
 	}
@@ -928,9 +1174,19 @@ static void layouts_mgr_init(layouts_mgr_t* mgr)
 
 static void layouts_mgr_free(layouts_mgr_t* mgr)
 {
+	uint32_t i;
+
 	/* free the configuration details */
 	FREE_NULL_LIST(mgr->layouts_desc);
 
+	/* columns reference the keydefs, free them first */
+	for (i = 0; i < mgr->columns_count; i++) {
+		xfree(mgr->columns[i].values);
+		FREE_NULL_BITMAP(mgr->columns[i].set_bitmap);
+	}
+	xfree(mgr->columns);
+	mgr->columns_count = 0;
+
 	/* FIXME: can we do a faster free here ? since each node removal will
 	 * modify either the entities or layouts for back (or forward)
 	 * references. */
@@ -1196,6 +1452,9 @@ static int _layouts_load_config_common(layout_plugin_t* plugin,
 	char* e_name = NULL;
 	char* e_type = NULL;
 
+	mgr->kv_gen++;
+	plugin->synced = false;
+
 	if (!plugin->ops->spec->options) {
 		/* no option in this layout plugin, nothing to parse */
 		return SLURM_SUCCESS;
@@ -2106,6 +2365,14 @@ static uint8_t _autoupdate_layout_tree(xtree_node_t* node, uint8_t which,
  * entities KVs based on inheritance relations (parents/children) */
 static int _layouts_autoupdate_layout(layout_t* layout)
 {
+	int i;
+
+	mgr->kv_gen++;
+	for (i = 0; i < mgr->plugins_count; i++) {
+		if (mgr->plugins[i].layout == layout)
+			mgr->plugins[i].synced = true;
+	}
+
 	/* autoupdate according to the layout struct type */
 	switch(layout->struct_type) {
 	case LAYOUT_STRUCT_TREE:
@@ -2127,8 +2394,10 @@ static int _layouts_autoupdate_layout_if_allowed(layout_t* layout)
 	/* look if the corresponding layout plugin enables autoupdate */
 	for (i = 0; i < mgr->plugins_count; i++) {
 		if (mgr->plugins[i].layout == layout) {
-			/* no autoupdate allowed, return success */
-			if (!mgr->plugins[i].ops->spec->autoupdate)
+			/* no autoupdate allowed or aggregated keys already
+			 * up to date, return success */
+			if (!mgr->plugins[i].ops->spec->autoupdate ||
+			    mgr->plugins[i].synced)
 				rc = SLURM_SUCCESS;
 			else
 				rc = _layouts_autoupdate_layout(layout);
@@ -2353,6 +2622,7 @@ int layouts_load_config(int recover)
 		slurm_mutex_unlock(&mgr->lock);
 		return rc;
 	}
+	mgr->conf_gen++;
 
 	/*
 	 * create a base layout to contain the configured nodes
@@ -2605,6 +2875,7 @@ int layouts_update_layout(char *l_type, Buf buffer)
 			rc = _layouts_update_state((layout_plugin_t*)
 						   &mgr->plugins[i],
 						   buffer);
+			mgr->conf_gen++;
 			slurm_mutex_unlock(&mgr->lock);
 			return rc;
 		}
@@ -2823,3 +3094,284 @@ int layouts_entity_pullget_kv_ref(char* l, char* e, char* key, void** value,
 	_layouts_entity_wrapper(_layouts_entity_pullget_kv_ref, l, e,
 				key, value, key_type);
 }
+
+/*****************************************************************************\
+ *                            COMPILED KEY HANDLES                           *
+\*****************************************************************************/
+
+/* (re)build a column from the node entities values, mgr lock must be held */
+static void _layouts_column_build(layouts_column_t* col)
+{
+	struct node_record *node_ptr;
+	entity_t* e;
+	void* data;
+	uint32_t val;
+	int i;
+
+	if (col->node_cnt != node_record_count) {
+		xfree(col->values);
+		FREE_NULL_BITMAP(col->set_bitmap);
+		col->node_cnt = node_record_count;
+		col->values = xmalloc(sizeof(uint32_t) * (col->node_cnt + 1));
+		col->set_bitmap = bit_alloc(MAX(col->node_cnt, 1));
+	} else {
+		memset(col->values, 0, sizeof(uint32_t) * col->node_cnt);
+		bit_clear_all(col->set_bitmap);
+	}
+
+	for (i = 0, node_ptr = node_record_table_ptr; i < col->node_cnt;
+	     i++, node_ptr++) {
+		e = xhash_get(mgr->entities, node_ptr->name);
+		if (!e)
+			continue;
+		data = entity_get_data_ref(e, col->keydef->key);
+		if (!data)
+			continue;
+		switch (col->keydef->type) {
+		case L_T_LONG:
+			val = (*(long*) data < 0) ? 0 : *(long*) data;
+			break;
+		case L_T_UINT16:
+			val = *(uint16_t*) data;
+			break;
+		case L_T_UINT32:
+			val = *(uint32_t*) data;
+			break;
+		case L_T_BOOLEAN:
+			val = *(bool*) data;
+			break;
+		case L_T_FLOAT:
+			val = *(float*) data;
+			break;
+		case L_T_DOUBLE:
+			val = *(double*) data;
+			break;
+		case L_T_LONG_DOUBLE:
+			val = *(long double*) data;
+			break;
+		default:
+			continue;
+		}
+		col->values[i] = val;
+		bit_set(col->set_bitmap, i);
+	}
+	col->gen = col->keydef->kv_gen;
+	col->mgr_gen = mgr->kv_gen;
+}
+
+/* return an up to date column, mgr lock must be held */
+static layouts_column_t* _layouts_column_get(int handle)
+{
+	layouts_column_t* col;
+
+	if ((handle < 0) || (handle >= mgr->columns_count))
+		return NULL;
+	col = &mgr->columns[handle];
+	if ((col->gen != col->keydef->kv_gen) ||
+	    (col->mgr_gen != mgr->kv_gen) ||
+	    (col->node_cnt != node_record_count) || !col->values)
+		_layouts_column_build(col);
+	return col;
+}
+
+uint32_t layouts_conf_gen(void)
+{
+	uint32_t gen;
+
+	slurm_mutex_lock(&mgr->lock);
+	gen = mgr->conf_gen;
+	slurm_mutex_unlock(&mgr->lock);
+	return gen;
+}
+
+int layouts_key_handle(char* layout, char* key)
+{
+	char keytmp[PATHLEN];
+	layouts_keydef_t* keydef;
+	layouts_column_t* col;
+	int handle = SLURM_ERROR;
+	uint32_t i;
+
+	if (layout == NULL || key == NULL)
+		return SLURM_ERROR;
+
+	_normalize_keydef_key(keytmp, PATHLEN, key, layout);
+
+	slurm_mutex_lock(&mgr->lock);
+	keydef = mgr->keydefs ? xhash_get(mgr->keydefs, keytmp) : NULL;
+	if (!keydef || (keydef->type == L_T_ERROR) ||
+	    (keydef->type == L_T_STRING) || (keydef->type == L_T_CUSTOM))
+		goto end_it;
+
+	for (i = 0; i < mgr->columns_count; i++) {
+		if (mgr->columns[i].keydef == keydef) {
+			handle = i;
+			goto end_it;
+		}
+	}
+	xrealloc(mgr->columns,
+		 sizeof(layouts_column_t) * (mgr->columns_count + 1));
+	col = &mgr->columns[mgr->columns_count];
+	memset(col, 0, sizeof(layouts_column_t));
+	col->keydef = keydef;
+	col->node_cnt = -1;
+	handle = mgr->columns_count++;
+
+end_it:
+	slurm_mutex_unlock(&mgr->lock);
+	return handle;
+}
+
+int layouts_key_get(int handle, int node_inx, uint32_t* value)
+{
+	layouts_column_t* col;
+	int rc = SLURM_ERROR;
+
+	slurm_mutex_lock(&mgr->lock);
+	col = _layouts_column_get(handle);
+	if (col && (node_inx >= 0) && (node_inx < col->node_cnt) &&
+	    bit_test(col->set_bitmap, node_inx)) {
+		*value = col->values[node_inx];
+		rc = SLURM_SUCCESS;
+	}
+	slurm_mutex_unlock(&mgr->lock);
+	return rc;
+}
+
+int layouts_key_sum(int handle, bitstr_t* bitmap, uint64_t* sum)
+{
+	layouts_column_t* col;
+	uint64_t total = 0, word;
+	int i, j, nbits;
+
+	slurm_mutex_lock(&mgr->lock);
+	col = _layouts_column_get(handle);
+	if (!col) {
+		slurm_mutex_unlock(&mgr->lock);
+		return SLURM_ERROR;
+	}
+
+	if (bitmap == NULL) {
+		for (i = 0; i < col->node_cnt; i++)
+			total += col->values[i];
+		goto done;
+	}
+
+	/* a word at a time, most words of a job or domain bitmap are empty */
+	nbits = MIN(bit_size(bitmap), col->node_cnt);
+	for (i = 0; i < nbits; i += 64) {
+		word = bit_get_word(bitmap, i);
+		for (j = 0; word; j++, word >>= 1) {
+			if ((word & 1) && (i + j < nbits))
+				total += col->values[i + j];
+		}
+	}
+
+done:
+	slurm_mutex_unlock(&mgr->lock);
+	*sum = total;
+	return SLURM_SUCCESS;
+}
+
+int layouts_key_first_unset(int handle, bitstr_t* bitmap)
+{
+	layouts_column_t* col;
+	int i, rc = -1;
+
+	slurm_mutex_lock(&mgr->lock);
+	col = _layouts_column_get(handle);
+	if (!col) {
+		slurm_mutex_unlock(&mgr->lock);
+		return -1;
+	}
+	for (i = 0; i < col->node_cnt; i++) {
+		if (bitmap && ((i >= bit_size(bitmap)) || !bit_test(bitmap, i)))
+			continue;
+		if (!bit_test(col->set_bitmap, i)) {
+			rc = i;
+			break;
+		}
+	}
+	slurm_mutex_unlock(&mgr->lock);
+	return rc;
+}
+
+typedef struct _layouts_tree_flatten_st {
+	layouts_tree_entry_t* entries;
+	int count;
+	int* stack;		/* entry index of the current node per level */
+	uint32_t stack_size;
+} _layouts_tree_flatten_t;
+
+static uint8_t _layouts_tree_flatten_walk(xtree_node_t* node, uint8_t which,
+					  uint32_t level, void* arg)
+{
+	_layouts_tree_flatten_t* p = (_layouts_tree_flatten_t*) arg;
+	entity_node_t* enode;
+	layouts_tree_entry_t* entry;
+
+	/* entries are added once, parents before their children */
+	if (which != XTREE_PREORDER && which != XTREE_LEAF)
+		return 1;
+
+	enode = (entity_node_t*) xtree_node_get_data(node);
+	if (!enode || !enode->entity)
+		return 1;
+
+	if (level >= p->stack_size) {
+		p->stack_size = level + 8;
+		xrealloc(p->stack, sizeof(int) * p->stack_size);
+	}
+	entry = &p->entries[p->count];
+	entry->name = xstrdup(entity_get_name(enode->entity));
+	entry->type = xstrdup(entity_get_type(enode->entity));
+	entry->parent = (level > 0) ? p->stack[level - 1] : -1;
+	p->stack[level] = p->count++;
+	return 1;
+}
+
+int layouts_tree_flatten(char* layout, layouts_tree_entry_t** entries,
+			 int* count)
+{
+	_layouts_tree_flatten_t p;
+	layout_t* l;
+	uint32_t tree_cnt;
+
+	*entries = NULL;
+	*count = 0;
+	if (layout == NULL)
+		return SLURM_ERROR;
+
+	slurm_mutex_lock(&mgr->lock);
+	l = layouts_get_layout_nolock(layout);
+	if (!l || (l->struct_type != LAYOUT_STRUCT_TREE)) {
+		slurm_mutex_unlock(&mgr->lock);
+		return SLURM_ERROR;
+	}
+	memset(&p, 0, sizeof(_layouts_tree_flatten_t));
+	tree_cnt = xtree_get_count(l->tree);
+	if (tree_cnt && (tree_cnt != UINT32_MAX)) {
+		p.entries = xmalloc(sizeof(layouts_tree_entry_t) * tree_cnt);
+		xtree_walk(l->tree, NULL, 0, XTREE_LEVEL_MAX,
+			   _layouts_tree_flatten_walk, &p);
+	}
+	slurm_mutex_unlock(&mgr->lock);
+
+	xfree(p.stack);
+	*entries = p.entries;
+	*count = p.count;
+	return SLURM_SUCCESS;
+}
+
+void layouts_tree_entries_free(layouts_tree_entry_t* entries, int count)
+{
+	int i;
+
+	if (!entries)
+		return;
+	for (i = 0; i < count; i++) {
+		xfree(entries[i].name);
+		xfree(entries[i].type);
+	}
+	xfree(entries);
+}
@@ -39,6 +39,7 @@
 #ifndef __LAYOUTS_MGR_1NRINRSD__INC__
 #define __LAYOUTS_MGR_1NRINRSD__INC__
 
+#include "src/common/bitstring.h"
 #include "src/common/list.h"
 #include "src/common/xhash.h"
 #include "src/common/xtree.h"
@@ -495,4 +496,90 @@ int layouts_entity_get_mkv_ref(char* layout, char* entity,
 			       char* keys, void* buffer, size_t length,
 			       layouts_keydef_types_t key_type);
 
+/*
+ * layouts_key_handle - resolve a numeric key of a layout to a handle usable
+ *        with the layouts_key_* calls below.
+ *
+ * The values of the key for the node entities are kept in a dense array
+ * indexed like node_record_table_ptr, refreshed on access after a value of
+ * the key changed. Resolve the handle once and then use it for each
+ * node or bitmap query to avoid the key normalization and hash lookups of
+ * the layouts_entity_get_kv() calls.
+ *
+ * Values are converted to uint32_t. L_T_STRING and L_T_CUSTOM keys are
+ * not supported.
+ *
+ * Note: handles are valid until layouts_fini().
+ *
+ * Return the handle (>= 0) or SLURM_ERROR if the key is unknown
+ */
+int layouts_key_handle(char* layout, char* key);
+
+/*
+ * layouts_key_get - get the value of a key handle for one node
+ *
+ * IN node_inx - index of the node in node_record_table_ptr
+ *
+ * Return SLURM_SUCCESS or SLURM_ERROR if the node has no value for the key
+ */
+int layouts_key_get(int handle, int node_inx, uint32_t* value);
+
+/*
+ * layouts_key_sum - sum the values of a key handle over the nodes set in a
+ *        node bitmap, or over all the nodes if bitmap is NULL.
+ *
+ * Nodes without a value for the key count as zero.
+ *
+ * Return SLURM_SUCCESS or SLURM_ERROR if the handle is invalid
+ */
+int layouts_key_sum(int handle, bitstr_t* bitmap, uint64_t* sum);
+
+/*
+ * layouts_key_first_unset - find the first node without a value for a key
+ *        handle among the nodes set in bitmap, or all the nodes if bitmap
+ *        is NULL.
+ *
+ * Return the node index, -1 if all the nodes have a value or if the handle
+ * is invalid
+ */
+int layouts_key_first_unset(int handle, bitstr_t* bitmap);
+
+/*
+ * layouts_conf_gen - count of configuration loads and layouts updates
+ *        (layouts_update_layout()) so far
+ *
+ * Unlike the values behind the key handles, which change whenever an entity
+ * key/value is set, configured keys only change when this count moves. Use
+ * it to know when structures derived from them must be rebuilt.
+ */
+uint32_t layouts_conf_gen(void);
+
+/*
+ * layouts_tree_flatten - copy the structure of a tree layout into an array
+ *        of entries, each parent stored before its children.
+ *
+ * The array is a snapshot: it does not follow later layout updates. Use
+ * it to build derived structures (e.g. per-subtree aggregates) once and
+ * read the key values through the other calls of this API.
+ *
+ * OUT entries - array of count entries, free with
+ *        layouts_tree_entries_free()
+ *
+ * Return SLURM_SUCCESS or SLURM_ERROR if the layout is unknown or is not
+ * a tree
+ */
+typedef struct layouts_tree_entry {
+	char* name;	/* entity name */
+	char* type;	/* entity type */
+	int parent;	/* index of the parent entry, -1 for the root */
+} layouts_tree_entry_t;
+
+int layouts_tree_flatten(char* layout, layouts_tree_entry_t** entries,
+			 int* count);
+
+/*
+ * layouts_tree_entries_free - free the array of layouts_tree_flatten()
+ */
+void layouts_tree_entries_free(layouts_tree_entry_t* entries, int count);
+
 #endif /* end of include guard: __LAYOUTS_MGR_1NRINRSD__INC__ */
@@ -0,0 +1,306 @@
+/*****************************************************************************\
+ *  power_delta.c - zigzag varint delta encoding of power samples
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include <string.h>
+
+#include "slurm/slurm_errno.h"
+#include "src/common/hostlist.h"
+#include "src/common/power_delta.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+
+#define NODE_POWER_WATTS	0x01
+#define NODE_POWER_CACHE	0x02
+#define POWER_FIELD_CNT		8
+#define CACHE_FIELD_CNT		6
+
+extern uint8_t *power_delta_put(uint8_t *p, uint64_t value, uint64_t prev)
+{
+	int64_t delta = (int64_t) (value - prev);
+	uint64_t zz = ((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63);
+
+	while (zz >= 0x80) {
+		*p++ = (uint8_t) (zz | 0x80);
+		zz >>= 7;
+	}
+	*p++ = (uint8_t) zz;
+	return p;
+}
+
+extern const uint8_t *power_delta_get(const uint8_t *p, const uint8_t *end,
+				      uint64_t prev, uint64_t *value)
+{
+	uint64_t zz = 0;
+	int shift = 0;
+
+	while (p < end) {
+		zz |= (uint64_t) (*p & 0x7f) << shift;
+		if (!(*p++ & 0x80)) {
+			*value = prev + ((zz >> 1) ^ (~(zz & 1) + 1));
+			return p;
+		}
+		if ((shift += 7) > 63)
+			break;
+	}
+	return NULL;
+}
+
+static void _power_get(power_current_data_t *power, uint64_t *v)
+{
+	v[0] = power->enable_monitor;
+	v[1] = power->cpu_current_watts;
+	v[2] = power->dram_current_watts;
+	v[3] = power->cpu_current_frequency;
+	v[4] = power->dram_current_frequency;
+	v[5] = (uint64_t) power->poll_time;
+	v[6] = power->cpu_current_cap_watts;
+	v[7] = power->dram_current_cap_watts;
+}
+
+static void _power_set(power_current_data_t *power, uint64_t *v)
+{
+	power->enable_monitor = (uint32_t) v[0];
+	power->cpu_current_watts = (uint32_t) v[1];
+	power->dram_current_watts = (uint32_t) v[2];
+	power->cpu_current_frequency = (uint32_t) v[3];
+	power->dram_current_frequency = (uint32_t) v[4];
+	power->poll_time = (time_t) v[5];
+	power->cpu_current_cap_watts = (uint32_t) v[6];
+	power->dram_current_cap_watts = (uint32_t) v[7];
+}
+
+static void _cache_get(cache_ref_t *cache, uint64_t *v)
+{
+	v[0] = cache->cache_mode;
+	v[1] = cache->all_cache_ref;
+	v[2] = cache->l1_miss;
+	v[3] = cache->l2_miss;
+	v[4] = cache->l3_miss;
+	v[5] = (uint64_t) cache->poll_time;
+}
+
+static void _cache_set(cache_ref_t *cache, uint64_t *v)
+{
+	cache->cache_mode = (uint32_t) v[0];
+	cache->all_cache_ref = v[1];
+	cache->l1_miss = v[2];
+	cache->l2_miss = v[3];
+	cache->l3_miss = v[4];
+	cache->poll_time = (time_t) v[5];
+}
+
+/* Fields of socket inx of the previous power record, zero if it had none */
+static void _power_prev(node_power_info_t *prev, int inx, uint64_t *v)
+{
+	if (prev && (inx < prev->socket_cnt))
+		_power_get(&prev->power[inx], v);
+	else
+		memset(v, 0, sizeof(uint64_t) * POWER_FIELD_CNT);
+}
+
+static void _cache_prev(node_power_info_t *prev, int inx, uint64_t *v)
+{
+	if (prev && (inx < prev->cache_socket_cnt))
+		_cache_get(&prev->cache[inx], v);
+	else
+		memset(v, 0, sizeof(uint64_t) * CACHE_FIELD_CNT);
+}
+
+extern void power_delta_pack_nodes(node_power_info_t *nodes, uint32_t cnt,
+				   Buf buffer)
+{
+	node_power_info_t *node, *prev_w = NULL, *prev_c = NULL;
+	uint64_t v[POWER_FIELD_CNT], pv[POWER_FIELD_CNT];
+	uint8_t *blob, *p;
+	hostlist_t hl;
+	char *names;
+	size_t len = 0;
+	uint32_t i;
+	int f, s;
+
+	hl = hostlist_create(NULL);
+	for (i = 0; i < cnt; i++) {
+		hostlist_push_host(hl, nodes[i].name);
+		len += 3;
+		if (nodes[i].watts_update_time)
+			len += 2 + nodes[i].socket_cnt * POWER_FIELD_CNT;
+		if (nodes[i].cache_update_time)
+			len += 2 + nodes[i].cache_socket_cnt * CACHE_FIELD_CNT;
+	}
+	names = hostlist_ranged_string_xmalloc(hl);
+	hostlist_destroy(hl);
+
+	p = blob = xmalloc(len * POWER_DELTA_MAX_BYTES + 1);
+	for (i = 0, node = nodes; i < cnt; i++, node++) {
+		p = power_delta_put(p, (node->watts_update_time ?
+					NODE_POWER_WATTS : 0) |
+				       (node->cache_update_time ?
+					NODE_POWER_CACHE : 0), 0);
+		if (node->watts_update_time) {
+			p = power_delta_put(p, node->watts_update_time,
+					    prev_w ? prev_w->watts_update_time :
+					    0);
+			p = power_delta_put(p, node->socket_cnt, 0);
+			for (s = 0; s < node->socket_cnt; s++) {
+				_power_get(&node->power[s], v);
+				_power_prev(prev_w, s, pv);
+				for (f = 0; f < POWER_FIELD_CNT; f++)
+					p = power_delta_put(p, v[f], pv[f]);
+			}
+			prev_w = node;
+		}
+		if (node->cache_update_time) {
+			p = power_delta_put(p, node->cache_update_time,
+					    prev_c ? prev_c->cache_update_time :
+					    0);
+			p = power_delta_put(p, node->cache_socket_cnt, 0);
+			for (s = 0; s < node->cache_socket_cnt; s++) {
+				_cache_get(&node->cache[s], v);
+				_cache_prev(prev_c, s, pv);
+				for (f = 0; f < CACHE_FIELD_CNT; f++)
+					p = power_delta_put(p, v[f], pv[f]);
+			}
+			prev_c = node;
+		}
+	}
+
+	pack32(cnt, buffer);
+	packstr(names, buffer);
+	packmem((char *) blob, (uint32_t) (p - blob), buffer);
+	xfree(names);
+	xfree(blob);
+}
+
+extern int power_delta_unpack_nodes(node_power_info_t **nodes_ptr,
+				    uint32_t *cnt_ptr, Buf buffer)
+{
+	node_power_info_t *nodes = NULL, *node, *prev_w = NULL, *prev_c = NULL;
+	uint64_t v[POWER_FIELD_CNT], pv[POWER_FIELD_CNT], flags, val;
+	const uint8_t *p, *end;
+	hostlist_t hl = NULL;
+	char *names = NULL, *blob = NULL, *host;
+	uint32_t cnt = 0, uint32_tmp, blob_len, i;
+	int f, s;
+
+	safe_unpack32(&cnt, buffer);
+	safe_unpackstr_xmalloc(&names, &uint32_tmp, buffer);
+	safe_unpackmem_xmalloc(&blob, &blob_len, buffer);
+	/* every record takes at least one byte */
+	if (cnt > blob_len)
+		goto unpack_error;
+
+	hl = hostlist_create(names);
+	if (!hl || (hostlist_count(hl) != cnt))
+		goto unpack_error;
+	nodes = xmalloc(sizeof(node_power_info_t) * (cnt + 1));
+	p = (const uint8_t *) blob;
+	end = p + blob_len;
+	for (i = 0, node = nodes; i < cnt; i++, node++) {
+		host = hostlist_shift(hl);
+		node->name = xstrdup(host);
+		free(host);
+		if (!(p = power_delta_get(p, end, 0, &flags)))
+			goto unpack_error;
+		if (flags & NODE_POWER_WATTS) {
+			if (!(p = power_delta_get(p, end, prev_w ?
+					(uint64_t) prev_w->watts_update_time :
+					0, &val)))
+				goto unpack_error;
+			node->watts_update_time = (time_t) val;
+			if (!(p = power_delta_get(p, end, 0, &val)) ||
+			    (val > (uint64_t) (end - p)))
+				goto unpack_error;
+			node->socket_cnt = (uint16_t) val;
+			node->power = xmalloc(sizeof(power_current_data_t) *
+					      (node->socket_cnt + 1));
+			for (s = 0; s < node->socket_cnt; s++) {
+				_power_prev(prev_w, s, pv);
+				for (f = 0; f < POWER_FIELD_CNT; f++) {
+					if (!(p = power_delta_get(p, end, pv[f],
+								  &v[f])))
+						goto unpack_error;
+				}
+				_power_set(&node->power[s], v);
+			}
+			prev_w = node;
+		}
+		if (flags & NODE_POWER_CACHE) {
+			if (!(p = power_delta_get(p, end, prev_c ?
+					(uint64_t) prev_c->cache_update_time :
+					0, &val)))
+				goto unpack_error;
+			node->cache_update_time = (time_t) val;
+			if (!(p = power_delta_get(p, end, 0, &val)) ||
+			    (val > (uint64_t) (end - p)))
+				goto unpack_error;
+			node->cache_socket_cnt = (uint16_t) val;
+			node->cache = xmalloc(sizeof(cache_ref_t) *
+					      (node->cache_socket_cnt + 1));
+			for (s = 0; s < node->cache_socket_cnt; s++) {
+				_cache_prev(prev_c, s, pv);
+				for (f = 0; f < CACHE_FIELD_CNT; f++) {
+					if (!(p = power_delta_get(p, end, pv[f],
+								  &v[f])))
+						goto unpack_error;
+				}
+				_cache_set(&node->cache[s], v);
+			}
+			prev_c = node;
+		}
+	}
+	hostlist_destroy(hl);
+	xfree(names);
+	xfree(blob);
+	*nodes_ptr = nodes;
+	*cnt_ptr = cnt;
+	return SLURM_SUCCESS;
+
+unpack_error:
+	for (i = 0; nodes && (i < cnt); i++) {
+		xfree(nodes[i].name);
+		xfree(nodes[i].power);
+		xfree(nodes[i].cache);
+	}
+	xfree(nodes);
+	if (hl)
+		hostlist_destroy(hl);
+	xfree(names);
+	xfree(blob);
+	*nodes_ptr = NULL;
+	*cnt_ptr = 0;
+	return SLURM_ERROR;
+}
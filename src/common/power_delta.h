@@ -0,0 +1,98 @@
+/*****************************************************************************\
+ *  power_delta.h - zigzag varint delta encoding of power samples
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _POWER_DELTA_H
+#define _POWER_DELTA_H
+
+#include <stdint.h>
+
+#include "slurm/slurm.h"
+#include "src/common/pack.h"
+
+/* A value never takes more than this many bytes */
+#define POWER_DELTA_MAX_BYTES	10
+
+/*
+ * Power samples of neighbouring rows or nodes differ little, so they are
+ * stored as the difference with a previous value. Deltas are taken modulo
+ * 2^64 and zigzag mapped so that small negative steps also encode in one
+ * or two bytes of a little endian base 128 varint.
+ */
+
+/*
+ * power_delta_put - encode value as its delta from prev
+ * IN p - where to write, with POWER_DELTA_MAX_BYTES of room
+ * RET the byte after the encoded value
+ */
+extern uint8_t *power_delta_put(uint8_t *p, uint64_t value, uint64_t prev);
+
+/*
+ * power_delta_get - decode a value encoded by power_delta_put()
+ * IN p - where to read
+ * IN end - end of the encoded data
+ * IN prev - the value the delta was taken from
+ * OUT value - decoded value
+ * RET the byte after the encoded value, NULL if it is truncated or invalid
+ */
+extern const uint8_t *power_delta_get(const uint8_t *p, const uint8_t *end,
+				      uint64_t prev, uint64_t *value);
+
+/*
+ * power_delta_pack_nodes - pack node power records, the names as one ranged
+ *	hostlist expression and every field as its delta from the same field
+ *	of the previous record
+ * IN nodes - records in node table order. A record carries its power if
+ *	watts_update_time is set and its PMC counts if cache_update_time is.
+ * IN cnt - number of records
+ * IN/OUT buffer - where to pack
+ */
+extern void power_delta_pack_nodes(node_power_info_t *nodes, uint32_t cnt,
+				   Buf buffer);
+
+/*
+ * power_delta_unpack_nodes - unpack records packed by
+ *	power_delta_pack_nodes()
+ * OUT nodes - the records, free with slurm_free_node_power_info_msg() or
+ *	one by one with xfree()
+ * OUT cnt - number of records
+ * IN/OUT buffer - where to unpack from
+ * RET SLURM_SUCCESS or SLURM_ERROR
+ */
+extern int power_delta_unpack_nodes(node_power_info_t **nodes, uint32_t *cnt,
+				    Buf buffer);
+
+#endif /* !_POWER_DELTA_H */
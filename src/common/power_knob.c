@@ -60,6 +60,7 @@ typedef struct slurm_power_knob_ops {
 	int (*get_cache_data)     (enum cache_type data_type, void *data);
 	int (*set_data)           (void *data);
 	void (*conf_set)          (void);
+	int (*refresh)            (void);
 } slurm_power_knob_ops_t;
 /*
  * These strings must be kept in the same order as the fields
@@ -70,6 +71,7 @@ static const char *syms[] = {
 	"power_knob_p_get_cache_data",
 	"power_knob_p_set_data",
 	"power_knob_p_conf_set",
+	"power_knob_p_refresh",
 };
 
 static slurm_power_knob_ops_t ops;
@@ -487,3 +489,13 @@ extern void power_knob_g_conf_set(void)
 
 }
 
+/* Ask the knob for a fresh sample now and closer sampling for a while,
+ * e.g. when a job starts on the node */
+extern int power_knob_g_refresh(void)
+{
+	if (slurm_power_knob_init() < 0)
+		return SLURM_ERROR;
+
+	return (*(ops.refresh))();
+}
+
@@ -92,5 +92,6 @@ extern int power_knob_g_get_data(enum  power_knob_type data_type, void *data);
 extern int power_knob_g_get_cache_data(enum cache_type data_type, void *data);
 extern int power_knob_g_set_data(void *data);
 extern void power_knob_g_conf_set(void);
+extern int power_knob_g_refresh(void);
 
 #endif /*__SLURM_POWER_KNOB_H__*/
@@ -0,0 +1,180 @@
+/*****************************************************************************\
+ *  power_knob_perf.c - perf_event_open based performance counter groups
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "slurm/slurm_errno.h"
+#include "src/common/fd.h"
+#include "src/common/log.h"
+#include "src/common/power_knob_perf.h"
+#include "src/common/xmalloc.h"
+
+struct pmc_perf_group {
+	int event_cnt;
+	int fd[PMC_PERF_MAX_EVENTS];	/* fd[0] leads the group */
+};
+
+#ifdef __linux__
+/* Layout of a PERF_FORMAT_GROUP read with both time fields */
+typedef struct pmc_perf_read {
+	uint64_t nr;
+	uint64_t time_enabled;
+	uint64_t time_running;
+	uint64_t value[PMC_PERF_MAX_EVENTS];
+} pmc_perf_read_t;
+
+static int _perf_event_open(struct perf_event_attr *attr, pid_t pid,
+			    int cpu, int group_fd)
+{
+	return syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, 0);
+}
+#endif
+
+extern pmc_perf_group_t *pmc_perf_group_open(pid_t pid, int cpu,
+					     const pmc_perf_event_t *events,
+					     int event_cnt)
+{
+#ifdef __linux__
+	struct perf_event_attr attr;
+	pmc_perf_group_t *group;
+	int i, save_errno;
+
+	if (!events || (event_cnt < 1) || (event_cnt > PMC_PERF_MAX_EVENTS)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	group = xmalloc(sizeof(pmc_perf_group_t));
+	for (i = 0; i < PMC_PERF_MAX_EVENTS; i++)
+		group->fd[i] = -1;
+
+	for (i = 0; i < event_cnt; i++) {
+		memset(&attr, 0, sizeof(struct perf_event_attr));
+		attr.size = sizeof(struct perf_event_attr);
+		attr.type = events[i].type;
+		attr.config = events[i].config;
+		attr.read_format = PERF_FORMAT_GROUP |
+				   PERF_FORMAT_TOTAL_TIME_ENABLED |
+				   PERF_FORMAT_TOTAL_TIME_RUNNING;
+		attr.disabled = (i == 0);	/* leader starts the group */
+		attr.exclude_hv = 1;
+		group->fd[i] = _perf_event_open(&attr, pid, cpu,
+						 (i == 0) ? -1 : group->fd[0]);
+		if (group->fd[i] < 0) {
+			save_errno = errno;
+			debug2("%s: event %d type %u config 0x%"PRIx64
+			       " on cpu %d: %m", __func__, i, events[i].type,
+			       events[i].config, cpu);
+			group->event_cnt = i;
+			pmc_perf_group_close(group);
+			errno = save_errno;
+			return NULL;
+		}
+		fd_set_close_on_exec(group->fd[i]);
+	}
+	group->event_cnt = event_cnt;
+
+	if (ioctl(group->fd[0], PERF_EVENT_IOC_RESET,
+		  PERF_IOC_FLAG_GROUP) ||
+	    ioctl(group->fd[0], PERF_EVENT_IOC_ENABLE,
+		  PERF_IOC_FLAG_GROUP)) {
+		save_errno = errno;
+		pmc_perf_group_close(group);
+		errno = save_errno;
+		return NULL;
+	}
+
+	return group;
+#else
+	errno = ENOSYS;
+	return NULL;
+#endif
+}
+
+extern int pmc_perf_group_read(pmc_perf_group_t *group, uint64_t *values)
+{
+#ifdef __linux__
+	pmc_perf_read_t data;
+	ssize_t want, got;
+	int i;
+
+	if (!group || !values)
+		return SLURM_ERROR;
+
+	want = sizeof(uint64_t) * (3 + group->event_cnt);
+	got = read(group->fd[0], &data, want);
+	if ((got != want) || (data.nr != group->event_cnt)) {
+		debug2("%s: short read %zd of %zd: %m", __func__, got, want);
+		return SLURM_ERROR;
+	}
+
+	for (i = 0; i < group->event_cnt; i++) {
+		values[i] = data.value[i];
+		/* the group shared the counters with someone else */
+		if (data.time_running &&
+		    (data.time_running < data.time_enabled)) {
+			values[i] = (uint64_t) ((long double) values[i] *
+						data.time_enabled /
+						data.time_running);
+		}
+	}
+	return SLURM_SUCCESS;
+#else
+	return SLURM_ERROR;
+#endif
+}
+
+extern void pmc_perf_group_close(pmc_perf_group_t *group)
+{
+	int i;
+
+	if (!group)
+		return;
+	/* members first, the leader last */
+	for (i = group->event_cnt - 1; i >= 0; i--) {
+		if (group->fd[i] >= 0)
+			close(group->fd[i]);
+	}
+	xfree(group);
+}
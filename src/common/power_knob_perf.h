@@ -0,0 +1,83 @@
+/*****************************************************************************\
+ *  power_knob_perf.h - perf_event_open based performance counter groups
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _POWER_KNOB_PERF_H
+#define _POWER_KNOB_PERF_H
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>	/* PERF_TYPE_* and PERF_COUNT_* */
+#endif
+
+/* Most events in one counter group */
+#define PMC_PERF_MAX_EVENTS	8
+
+typedef struct pmc_perf_event {
+	uint32_t type;		/* PERF_TYPE_RAW, PERF_TYPE_SOFTWARE, ... */
+	uint64_t config;	/* event code, for PERF_TYPE_RAW on Intel
+				 * (umask << 8) | event */
+} pmc_perf_event_t;
+
+typedef struct pmc_perf_group pmc_perf_group_t;
+
+/*
+ * pmc_perf_group_open - open a group of counters read together
+ * IN pid - task to count, -1 for every task on cpu
+ * IN cpu - cpu to count on, -1 for any cpu pid runs on
+ * IN events - events of the group, the first one leads it
+ * IN event_cnt - entries in events, at most PMC_PERF_MAX_EVENTS
+ * RET enabled group, NULL on error with errno set
+ */
+extern pmc_perf_group_t *pmc_perf_group_open(pid_t pid, int cpu,
+					     const pmc_perf_event_t *events,
+					     int event_cnt);
+
+/*
+ * pmc_perf_group_read - read every counter of a group with one read()
+ * IN group - from pmc_perf_group_open()
+ * OUT values - event_cnt counts, scaled up by enabled/running time when
+ *	the kernel multiplexed the group with other users of the counters
+ * RET SLURM_SUCCESS or SLURM_ERROR
+ */
+extern int pmc_perf_group_read(pmc_perf_group_t *group, uint64_t *values);
+
+/* pmc_perf_group_close - close the counters and free the group */
+extern void pmc_perf_group_close(pmc_perf_group_t *group);
+
+#endif /* !_POWER_KNOB_PERF_H */
@@ -0,0 +1,859 @@
+/*****************************************************************************\
+ *  power_tsdb.c - columnar power telemetry store
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "slurm/slurm.h"
+#include "slurm/slurm_errno.h"
+#include "src/common/fd.h"
+#include "src/common/log.h"
+#include "src/common/macros.h"
+#include "src/common/power_delta.h"
+#include "src/common/power_tsdb.h"
+#include "src/common/slurm_protocol_api.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+
+#define TSDB_MAGIC		0x53545750	/* "PWTS" */
+#define TSDB_BLOCK_MAGIC	0x4b4c4250	/* "PBLK" */
+#define TSDB_VERSION		1
+#define TSDB_MAX_BEHIND		16	/* blocks queued before rows drop */
+
+#define TSDB_BLOCK_TYPE_ROWS	1
+#define TSDB_BLOCK_TYPE_NODES	2
+
+enum {
+	COL_TIME,
+	COL_NODE,
+	COL_SOCKET,
+	COL_JOB,
+	COL_PKG,
+	COL_DRAM,
+	COL_PKG_CAP,
+	COL_DRAM_CAP,
+	COL_FREQ,
+	COL_CACHE_REF,
+	COL_L3_MISS,
+	COL_CNT
+};
+
+/* Integers are in host byte order, a foreign file fails the magic test */
+typedef struct tsdb_file_hdr {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t hdr_len;
+	int64_t  create_time;
+} tsdb_file_hdr_t;
+
+typedef struct tsdb_block_hdr {
+	uint32_t magic;
+	uint16_t type;
+	uint16_t col_cnt;
+	uint32_t byte_len;		/* whole block, this header included */
+	uint32_t row_cnt;		/* rows, or names of a node block */
+	int64_t  time_min;
+	int64_t  time_max;
+	uint32_t node_min;
+	uint32_t node_max;
+	uint32_t job_min;
+	uint32_t job_max;
+	uint32_t watts_min;		/* pkg + dram watts of one row */
+	uint32_t watts_max;
+	uint32_t col_off[COL_CNT];	/* from the start of the block */
+	uint32_t pad;
+} tsdb_block_hdr_t;
+
+struct power_tsdb_writer {
+	char *path;
+	int fd;
+	off_t size;			/* bytes in the file */
+	uint64_t max_bytes;		/* rotate past this, 0 for never */
+	int block_rows;
+	int flush_secs;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool shutdown;
+	power_tsdb_row_t *rows;		/* queued rows */
+	int row_cnt;
+	int row_size;
+	time_t oldest;			/* when rows[0] was queued */
+	char *names;			/* queued node block payload */
+	int names_len;
+	int name_cnt;
+	int names_at;			/* rows queued before the names */
+	uint32_t dropped;
+	char *file_names;		/* last node block written, for the
+					 * start of a rotated file */
+	int file_names_len;
+	int file_name_cnt;
+};
+
+struct power_tsdb_reader {
+	int fd;
+	char *map;
+	size_t size;
+	uint16_t hdr_len;
+};
+
+static uint64_t _col_value(const power_tsdb_row_t *row, int col)
+{
+	switch (col) {
+	case COL_TIME:
+		return (uint64_t) row->time;
+	case COL_NODE:
+		return row->node_inx;
+	case COL_SOCKET:
+		return row->socket;
+	case COL_JOB:
+		return row->job_id;
+	case COL_PKG:
+		return row->pkg_watts;
+	case COL_DRAM:
+		return row->dram_watts;
+	case COL_PKG_CAP:
+		return row->pkg_cap_watts;
+	case COL_DRAM_CAP:
+		return row->dram_cap_watts;
+	case COL_FREQ:
+		return row->freq;
+	case COL_CACHE_REF:
+		return row->cache_ref;
+	default:
+		return row->l3_miss;
+	}
+}
+
+static void _col_set(power_tsdb_row_t *row, int col, uint64_t value)
+{
+	switch (col) {
+	case COL_TIME:
+		row->time = (time_t) (int64_t) value;
+		break;
+	case COL_NODE:
+		row->node_inx = (uint32_t) value;
+		break;
+	case COL_SOCKET:
+		row->socket = (uint32_t) value;
+		break;
+	case COL_JOB:
+		row->job_id = (uint32_t) value;
+		break;
+	case COL_PKG:
+		row->pkg_watts = (uint32_t) value;
+		break;
+	case COL_DRAM:
+		row->dram_watts = (uint32_t) value;
+		break;
+	case COL_PKG_CAP:
+		row->pkg_cap_watts = (uint32_t) value;
+		break;
+	case COL_DRAM_CAP:
+		row->dram_cap_watts = (uint32_t) value;
+		break;
+	case COL_FREQ:
+		row->freq = (uint32_t) value;
+		break;
+	case COL_CACHE_REF:
+		row->cache_ref = value;
+		break;
+	default:
+		row->l3_miss = value;
+		break;
+	}
+}
+
+static int _write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t n;
+
+	while (len) {
+		n = write(fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return SLURM_ERROR;
+		}
+		p += n;
+		len -= n;
+	}
+	return SLURM_SUCCESS;
+}
+
+static void _write_block(power_tsdb_writer_t *writer, uint8_t *buf,
+			 size_t len)
+{
+	if (_write_all(writer->fd, buf, len) != SLURM_SUCCESS)
+		error("power_tsdb: write to %s: %m", writer->path);
+	else
+		writer->size += len;
+}
+
+static void _write_rows(power_tsdb_writer_t *writer,
+			const power_tsdb_row_t *rows, int row_cnt)
+{
+	tsdb_block_hdr_t blk;
+	uint8_t *buf, *p;
+	uint64_t prev, value;
+	uint32_t watts;
+	int c, r;
+
+	if (row_cnt <= 0)
+		return;
+
+	memset(&blk, 0, sizeof(blk));
+	blk.magic = TSDB_BLOCK_MAGIC;
+	blk.type = TSDB_BLOCK_TYPE_ROWS;
+	blk.col_cnt = COL_CNT;
+	blk.row_cnt = row_cnt;
+	blk.time_min = blk.time_max = rows[0].time;
+	blk.node_min = blk.node_max = rows[0].node_inx;
+	blk.job_min = blk.job_max = rows[0].job_id;
+	blk.watts_min = blk.watts_max = rows[0].pkg_watts + rows[0].dram_watts;
+	for (r = 1; r < row_cnt; r++) {
+		blk.time_min = MIN(blk.time_min, rows[r].time);
+		blk.time_max = MAX(blk.time_max, rows[r].time);
+		blk.node_min = MIN(blk.node_min, rows[r].node_inx);
+		blk.node_max = MAX(blk.node_max, rows[r].node_inx);
+		blk.job_min = MIN(blk.job_min, rows[r].job_id);
+		blk.job_max = MAX(blk.job_max, rows[r].job_id);
+		watts = rows[r].pkg_watts + rows[r].dram_watts;
+		blk.watts_min = MIN(blk.watts_min, watts);
+		blk.watts_max = MAX(blk.watts_max, watts);
+	}
+
+	buf = xmalloc(sizeof(blk) +
+		      (size_t) row_cnt * COL_CNT * POWER_DELTA_MAX_BYTES);
+	p = buf + sizeof(blk);
+	for (c = 0; c < COL_CNT; c++) {
+		blk.col_off[c] = p - buf;
+		prev = 0;
+		for (r = 0; r < row_cnt; r++) {
+			value = _col_value(&rows[r], c);
+			p = power_delta_put(p, value, prev);
+			prev = value;
+		}
+	}
+	blk.byte_len = p - buf;
+	memcpy(buf, &blk, sizeof(blk));
+	_write_block(writer, buf, blk.byte_len);
+	xfree(buf);
+}
+
+static void _write_nodes(power_tsdb_writer_t *writer, const char *names,
+			 int names_len, int name_cnt)
+{
+	tsdb_block_hdr_t blk;
+	uint8_t *buf;
+
+	memset(&blk, 0, sizeof(blk));
+	blk.magic = TSDB_BLOCK_MAGIC;
+	blk.type = TSDB_BLOCK_TYPE_NODES;
+	blk.row_cnt = name_cnt;
+	blk.byte_len = sizeof(blk) + names_len;
+	buf = xmalloc(blk.byte_len);
+	memcpy(buf, &blk, sizeof(blk));
+	memcpy(buf + sizeof(blk), names, names_len);
+	_write_block(writer, buf, blk.byte_len);
+	xfree(buf);
+}
+
+/* Split row_cnt rows into equal blocks of at most block_rows */
+static void _write_row_blocks(power_tsdb_writer_t *writer,
+			      const power_tsdb_row_t *rows, int row_cnt)
+{
+	int blocks, per_block, n;
+
+	if (row_cnt <= 0)
+		return;
+	blocks = (row_cnt + writer->block_rows - 1) / writer->block_rows;
+	per_block = (row_cnt + blocks - 1) / blocks;
+	while (row_cnt > 0) {
+		n = MIN(per_block, row_cnt);
+		_write_rows(writer, rows, n);
+		rows += n;
+		row_cnt -= n;
+	}
+}
+
+static bool _flush_due(power_tsdb_writer_t *writer)
+{
+	if (writer->shutdown || writer->names)
+		return true;
+	if (writer->row_cnt >= writer->block_rows)
+		return true;
+	if (writer->row_cnt &&
+	    (time(NULL) >= writer->oldest + writer->flush_secs))
+		return true;
+	return false;
+}
+
+/* Length of the valid prefix of a store: its header and every complete
+ * block.  A block cut short by a crash and anything after it is dropped
+ * so that new blocks are appended where readers will find them. */
+static off_t _valid_len(int fd, off_t size, uint16_t hdr_len)
+{
+	tsdb_block_hdr_t blk;
+	off_t off = hdr_len;
+
+	while (off + (off_t) sizeof(blk) <= size) {
+		if (pread(fd, &blk, sizeof(blk), off) != sizeof(blk))
+			break;
+		if ((blk.magic != TSDB_BLOCK_MAGIC) ||
+		    (blk.byte_len < sizeof(blk)) ||
+		    (blk.byte_len > size - off))
+			break;
+		off += blk.byte_len;
+	}
+	return off;
+}
+
+/* Open or create a store positioned for appending.
+ * OUT len - bytes in the file
+ * RET file descriptor or -1 on error */
+static int _open_store(const char *path, off_t *len)
+{
+	tsdb_file_hdr_t hdr;
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		error("power_tsdb: open %s: %m", path);
+		return -1;
+	}
+	if (fstat(fd, &st) < 0) {
+		error("power_tsdb: stat %s: %m", path);
+		close(fd);
+		return -1;
+	}
+
+	if (st.st_size == 0) {
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.magic = TSDB_MAGIC;
+		hdr.version = TSDB_VERSION;
+		hdr.hdr_len = sizeof(hdr);
+		hdr.create_time = time(NULL);
+		if (_write_all(fd, &hdr, sizeof(hdr)) != SLURM_SUCCESS) {
+			error("power_tsdb: write %s: %m", path);
+			close(fd);
+			return -1;
+		}
+		*len = sizeof(hdr);
+	} else {
+		if ((pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) ||
+		    (hdr.magic != TSDB_MAGIC) ||
+		    (hdr.version != TSDB_VERSION) ||
+		    (hdr.hdr_len < sizeof(hdr))) {
+			error("power_tsdb: %s is not a power telemetry store",
+			      path);
+			close(fd);
+			return -1;
+		}
+		*len = _valid_len(fd, st.st_size, hdr.hdr_len);
+		if (*len < st.st_size) {
+			info("power_tsdb: dropping %"PRIu64" bytes of "
+			     "incomplete block from %s",
+			     (uint64_t) (st.st_size - *len), path);
+			if (ftruncate(fd, *len) < 0) {
+				error("power_tsdb: truncate %s: %m", path);
+				close(fd);
+				return -1;
+			}
+		}
+		if (lseek(fd, *len, SEEK_SET) < 0) {
+			error("power_tsdb: seek %s: %m", path);
+			close(fd);
+			return -1;
+		}
+	}
+	fd_set_close_on_exec(fd);
+	return fd;
+}
+
+/* Move a full store to "<path>.1" and continue in a new file, which starts
+ * with the last node block so that its rows keep their names.  On error
+ * the writer keeps appending to the file it has. */
+static void _rotate(power_tsdb_writer_t *writer)
+{
+	char *old_path = NULL;
+	off_t len;
+	int fd;
+
+	if (fsync(writer->fd) < 0)
+		error("power_tsdb: fsync %s: %m", writer->path);
+	xstrfmtcat(old_path, "%s.1", writer->path);
+	if (rename(writer->path, old_path) < 0) {
+		error("power_tsdb: rename %s to %s: %m", writer->path,
+		      old_path);
+		xfree(old_path);
+		writer->max_bytes = 0;	/* do not retry every block */
+		return;
+	}
+	xfree(old_path);
+	if ((fd = _open_store(writer->path, &len)) < 0) {
+		writer->max_bytes = 0;
+		return;
+	}
+	close(writer->fd);
+	writer->fd = fd;
+	writer->size = len;
+	verbose("power_tsdb: rotated %s", writer->path);
+
+	if (writer->file_names) {
+		_write_nodes(writer, writer->file_names,
+			     writer->file_names_len, writer->file_name_cnt);
+	}
+}
+
+static void *_writer_thread(void *arg)
+{
+	power_tsdb_writer_t *writer = (power_tsdb_writer_t *) arg;
+	power_tsdb_row_t *rows;
+	char *names;
+	int row_cnt, names_len, name_cnt, names_at;
+	uint32_t dropped;
+	struct timespec ts;
+
+	slurm_mutex_lock(&writer->mutex);
+	while (1) {
+		while (!_flush_due(writer)) {
+			if (writer->row_cnt) {
+				ts.tv_sec = writer->oldest +
+					    writer->flush_secs;
+				ts.tv_nsec = 0;
+				pthread_cond_timedwait(&writer->cond,
+						       &writer->mutex, &ts);
+			} else
+				pthread_cond_wait(&writer->cond,
+						  &writer->mutex);
+		}
+		if (!writer->row_cnt && !writer->names)
+			break;		/* shutdown with nothing queued */
+
+		rows = writer->rows;
+		row_cnt = writer->row_cnt;
+		names = writer->names;
+		names_len = writer->names_len;
+		name_cnt = writer->name_cnt;
+		names_at = names ? writer->names_at : row_cnt;
+		dropped = writer->dropped;
+		writer->rows = NULL;
+		writer->row_cnt = writer->row_size = 0;
+		writer->names = NULL;
+		writer->dropped = 0;
+		slurm_mutex_unlock(&writer->mutex);
+
+		/* Encoding and I/O happen without the lock so that
+		 * power_tsdb_append() never waits on the disk */
+		if (dropped) {
+			error("power_tsdb: writer behind, %u rows dropped",
+			      dropped);
+		}
+		if (writer->max_bytes && (writer->size >= writer->max_bytes))
+			_rotate(writer);
+		_write_row_blocks(writer, rows, names_at);
+		if (names) {
+			_write_nodes(writer, names, names_len, name_cnt);
+			_write_row_blocks(writer, rows + names_at,
+					  row_cnt - names_at);
+			xfree(writer->file_names);
+			writer->file_names = names;
+			writer->file_names_len = names_len;
+			writer->file_name_cnt = name_cnt;
+		}
+		xfree(rows);
+
+		slurm_mutex_lock(&writer->mutex);
+	}
+	slurm_mutex_unlock(&writer->mutex);
+	return NULL;
+}
+
+extern char *power_tsdb_conf_path(uint64_t *max_bytes)
+{
+	char *power_params, *path = NULL, *tmp_ptr;
+	int max_mb = POWER_TSDB_MAX_MB;
+
+	power_params = slurm_get_power_parameters();
+	if (power_params &&
+	    (tmp_ptr = strstr(power_params, "telemetry_file="))) {
+		path = xstrdup(tmp_ptr + 15);
+		if ((tmp_ptr = strchr(path, ',')))
+			tmp_ptr[0] = '\0';
+	}
+	/*                                                  12345678901234567 */
+	if (power_params &&
+	    (tmp_ptr = strstr(power_params, "telemetry_max_mb=")))
+		max_mb = MAX(atoi(tmp_ptr + 17), 0);
+	xfree(power_params);
+
+	if (path && !path[0])
+		xfree(path);
+	if (max_bytes)
+		*max_bytes = (uint64_t) max_mb * 1024 * 1024;
+	return path;
+}
+
+extern power_tsdb_writer_t *power_tsdb_writer_open(const char *path,
+						   int block_rows,
+						   int flush_secs,
+						   uint64_t max_bytes)
+{
+	power_tsdb_writer_t *writer;
+	pthread_attr_t attr;
+	off_t len;
+	int fd;
+
+	if ((fd = _open_store(path, &len)) < 0)
+		return NULL;
+
+	writer = xmalloc(sizeof(power_tsdb_writer_t));
+	writer->path = xstrdup(path);
+	writer->fd = fd;
+	writer->size = len;
+	writer->max_bytes = max_bytes;
+	writer->block_rows = block_rows ? block_rows : POWER_TSDB_BLOCK_ROWS;
+	writer->flush_secs = MAX(flush_secs, 1);
+	slurm_mutex_init(&writer->mutex);
+	pthread_cond_init(&writer->cond, NULL);
+
+	slurm_attr_init(&attr);
+	if (pthread_create(&writer->thread, &attr, _writer_thread, writer)) {
+		error("power_tsdb: pthread_create: %m");
+		slurm_attr_destroy(&attr);
+		close(fd);
+		xfree(writer->path);
+		xfree(writer);
+		return NULL;
+	}
+	slurm_attr_destroy(&attr);
+	return writer;
+}
+
+extern void power_tsdb_set_nodes(power_tsdb_writer_t *writer,
+				 char **names, int name_cnt)
+{
+	char *buf;
+	int i, len = 0, n;
+
+	if (!writer)
+		return;
+	for (i = 0; i < name_cnt; i++)
+		len += strlen(names[i]) + 1;
+	buf = xmalloc(len ? len : 1);
+	for (i = 0, len = 0; i < name_cnt; i++) {
+		n = strlen(names[i]) + 1;
+		memcpy(buf + len, names[i], n);
+		len += n;
+	}
+
+	slurm_mutex_lock(&writer->mutex);
+	if (!writer->names)
+		writer->names_at = writer->row_cnt;
+	xfree(writer->names);
+	writer->names = buf;
+	writer->names_len = len;
+	writer->name_cnt = name_cnt;
+	pthread_cond_signal(&writer->cond);
+	slurm_mutex_unlock(&writer->mutex);
+}
+
+extern void power_tsdb_append(power_tsdb_writer_t *writer,
+			      const power_tsdb_row_t *rows, int row_cnt)
+{
+	if (!writer || (row_cnt <= 0))
+		return;
+
+	slurm_mutex_lock(&writer->mutex);
+	if (writer->row_cnt + row_cnt >
+	    writer->block_rows * TSDB_MAX_BEHIND) {
+		writer->dropped += row_cnt;
+		slurm_mutex_unlock(&writer->mutex);
+		return;
+	}
+	if (writer->row_cnt + row_cnt > writer->row_size) {
+		writer->row_size = MAX(writer->row_cnt + row_cnt,
+				       writer->block_rows);
+		xrealloc(writer->rows,
+			 sizeof(power_tsdb_row_t) * writer->row_size);
+	}
+	memcpy(writer->rows + writer->row_cnt, rows,
+	       sizeof(power_tsdb_row_t) * row_cnt);
+	if (writer->row_cnt == 0) {
+		/* Arm the flush timer */
+		writer->oldest = time(NULL);
+		pthread_cond_signal(&writer->cond);
+	}
+	writer->row_cnt += row_cnt;
+	if (writer->row_cnt >= writer->block_rows)
+		pthread_cond_signal(&writer->cond);
+	slurm_mutex_unlock(&writer->mutex);
+}
+
+extern void power_tsdb_writer_close(power_tsdb_writer_t *writer)
+{
+	if (!writer)
+		return;
+
+	slurm_mutex_lock(&writer->mutex);
+	writer->shutdown = true;
+	pthread_cond_signal(&writer->cond);
+	slurm_mutex_unlock(&writer->mutex);
+	pthread_join(writer->thread, NULL);
+
+	if (fsync(writer->fd) < 0)
+		error("power_tsdb: fsync %s: %m", writer->path);
+	close(writer->fd);
+	xfree(writer->rows);
+	xfree(writer->names);
+	xfree(writer->file_names);
+	xfree(writer->path);
+	slurm_mutex_destroy(&writer->mutex);
+	pthread_cond_destroy(&writer->cond);
+	xfree(writer);
+}
+
+extern power_tsdb_reader_t *power_tsdb_open(const char *path)
+{
+	power_tsdb_reader_t *reader;
+	tsdb_file_hdr_t hdr;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if ((fstat(fd, &st) < 0) || (st.st_size < sizeof(hdr))) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+	memcpy(&hdr, map, sizeof(hdr));
+	if ((hdr.magic != TSDB_MAGIC) || (hdr.version != TSDB_VERSION) ||
+	    (hdr.hdr_len < sizeof(hdr)) || (hdr.hdr_len > st.st_size)) {
+		munmap(map, st.st_size);
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	reader = xmalloc(sizeof(power_tsdb_reader_t));
+	reader->fd = fd;
+	reader->map = map;
+	reader->size = st.st_size;
+	reader->hdr_len = hdr.hdr_len;
+	return reader;
+}
+
+extern void power_tsdb_close(power_tsdb_reader_t *reader)
+{
+	if (!reader)
+		return;
+	munmap(reader->map, reader->size);
+	close(reader->fd);
+	xfree(reader);
+}
+
+/* Point names at the NUL terminated names of a node block */
+static int _read_nodes(const char *buf, uint32_t len, uint32_t name_cnt,
+		       const char ***names)
+{
+	const char *p = buf, *end = buf + len, *nul;
+	uint32_t i;
+
+	/* each name takes at least its NUL */
+	name_cnt = MIN(name_cnt, len);
+	xrealloc(*names, sizeof(char *) * (name_cnt ? name_cnt : 1));
+	for (i = 0; i < name_cnt; i++) {
+		if (!(nul = memchr(p, '\0', end - p)))
+			return i;
+		(*names)[i] = p;
+		p = nul + 1;
+	}
+	return name_cnt;
+}
+
+static bool _block_match(const tsdb_block_hdr_t *blk,
+			 const power_tsdb_query_t *query, uint32_t node_inx)
+{
+	if (query->start && (blk->time_max < query->start))
+		return false;
+	if (query->end && (blk->time_min > query->end))
+		return false;
+	if (query->job_id &&
+	    ((query->job_id < blk->job_min) || (query->job_id > blk->job_max)))
+		return false;
+	if (query->node_name &&
+	    ((node_inx < blk->node_min) || (node_inx > blk->node_max)))
+		return false;
+	if (query->min_watts && (blk->watts_max < query->min_watts))
+		return false;
+	return true;
+}
+
+static bool _row_match(const power_tsdb_row_t *row,
+		       const power_tsdb_query_t *query, uint32_t node_inx)
+{
+	if (query->start && (row->time < query->start))
+		return false;
+	if (query->end && (row->time > query->end))
+		return false;
+	if (query->job_id && (row->job_id != query->job_id))
+		return false;
+	if (query->node_name && (row->node_inx != node_inx))
+		return false;
+	if (query->min_watts &&
+	    (row->pkg_watts + row->dram_watts < query->min_watts))
+		return false;
+	return true;
+}
+
+/* Decode the columns of a row block, RET rows or NULL if corrupt */
+static power_tsdb_row_t *_read_rows(const uint8_t *buf,
+				    const tsdb_block_hdr_t *blk)
+{
+	power_tsdb_row_t *rows;
+	const uint8_t *p, *end;
+	uint64_t value;
+	uint32_t r;
+	int c;
+
+	if ((blk->col_cnt != COL_CNT) || !blk->row_cnt)
+		return NULL;
+	/* every value takes at least one byte, so row_cnt can not exceed
+	 * the block, itself checked against the file size by the caller */
+	if (blk->row_cnt > (blk->byte_len - sizeof(tsdb_block_hdr_t)) /
+			   COL_CNT)
+		return NULL;
+	rows = xmalloc(sizeof(power_tsdb_row_t) * blk->row_cnt);
+	for (c = 0; c < COL_CNT; c++) {
+		if ((blk->col_off[c] < sizeof(tsdb_block_hdr_t)) ||
+		    (blk->col_off[c] > blk->byte_len))
+			goto corrupt;
+		p = buf + blk->col_off[c];
+		if (c + 1 < COL_CNT)
+			end = buf + MIN(blk->col_off[c + 1], blk->byte_len);
+		else
+			end = buf + blk->byte_len;
+		value = 0;
+		for (r = 0; r < blk->row_cnt; r++) {
+			if (!(p = power_delta_get(p, end, value, &value)))
+				goto corrupt;
+			_col_set(&rows[r], c, value);
+		}
+	}
+	return rows;
+
+corrupt:
+	xfree(rows);
+	return NULL;
+}
+
+extern int power_tsdb_scan(power_tsdb_reader_t *reader,
+			   const power_tsdb_query_t *query,
+			   power_tsdb_row_f row_f, void *arg)
+{
+	tsdb_block_hdr_t blk;
+	power_tsdb_row_t *rows;
+	const char **names = NULL;
+	uint32_t name_cnt = 0, node_inx = NO_VAL, i, r;
+	size_t off;
+	int rc = SLURM_SUCCESS;
+
+	if (!reader)
+		return SLURM_ERROR;
+
+	for (off = reader->hdr_len;
+	     off + sizeof(blk) <= reader->size; off += blk.byte_len) {
+		memcpy(&blk, reader->map + off, sizeof(blk));
+		if ((blk.magic != TSDB_BLOCK_MAGIC) ||
+		    (blk.byte_len < sizeof(blk)) ||
+		    (blk.byte_len > reader->size - off))
+			break;		/* incomplete tail */
+
+		if (blk.type == TSDB_BLOCK_TYPE_NODES) {
+			name_cnt = _read_nodes(reader->map + off + sizeof(blk),
+					       blk.byte_len - sizeof(blk),
+					       blk.row_cnt, &names);
+			node_inx = NO_VAL;
+			for (i = 0; query->node_name && (i < name_cnt); i++) {
+				if (!strcmp(names[i], query->node_name)) {
+					node_inx = i;
+					break;
+				}
+			}
+			continue;
+		}
+		if ((blk.type != TSDB_BLOCK_TYPE_ROWS) ||
+		    !_block_match(&blk, query, node_inx))
+			continue;
+
+		rows = _read_rows((const uint8_t *) reader->map + off, &blk);
+		if (!rows) {
+			debug("power_tsdb: corrupt block at offset %"PRIu64,
+			      (uint64_t) off);
+			continue;
+		}
+		for (r = 0; r < blk.row_cnt; r++) {
+			if (!_row_match(&rows[r], query, node_inx))
+				continue;
+			if (rows[r].node_inx < name_cnt)
+				rows[r].node_name = names[rows[r].node_inx];
+			if ((*row_f)(&rows[r], arg))
+				break;
+		}
+		xfree(rows);
+		if (r < blk.row_cnt)
+			break;		/* stopped by row_f */
+	}
+	xfree(names);
+	return rc;
+}
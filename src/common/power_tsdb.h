@@ -0,0 +1,151 @@
+/*****************************************************************************\
+ *  power_tsdb.h - columnar power telemetry store
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _POWER_TSDB_H
+#define _POWER_TSDB_H
+
+#include <inttypes.h>
+#include <time.h>
+
+/*
+ * Append-only file of per-socket power samples.
+ *
+ * A short file header is followed by blocks.  A row block holds up to
+ * block_rows samples stored column by column; each column is a run of
+ * zigzag varints of the difference to the previous row, so the node and
+ * time columns of a sweep cost about one byte per row.  The block header
+ * carries the min/max of time, node index, job id and row watts so that
+ * readers skip blocks outside a query without decoding them.  A node
+ * block maps node indexes to names for the row blocks that follow it.
+ * Readers mmap the file and stop at the first incomplete block, so a file
+ * being written or cut short by a crash is always readable.
+ *
+ * Once the file reaches its size limit the writer renames it to
+ * "<path>.1", replacing the previous one, and starts a new file with the
+ * current node block, so at most two files are kept.
+ */
+
+#define POWER_TSDB_BLOCK_ROWS	4096	/* default rows per block */
+#define POWER_TSDB_MAX_MB	1024	/* default file size limit */
+
+typedef struct power_tsdb_row {
+	time_t   time;		/* sweep time */
+	uint32_t node_inx;	/* index in the node table */
+	uint32_t socket;
+	uint32_t job_id;	/* job on the node, 0 if idle */
+	uint32_t pkg_watts;
+	uint32_t dram_watts;
+	uint32_t pkg_cap_watts;
+	uint32_t dram_cap_watts;
+	uint32_t freq;		/* average cpu frequency, kHz */
+	uint64_t cache_ref;
+	uint64_t l3_miss;
+	const char *node_name;	/* set by readers only, NULL if unknown */
+} power_tsdb_row_t;
+
+typedef struct power_tsdb_writer power_tsdb_writer_t;
+typedef struct power_tsdb_reader power_tsdb_reader_t;
+
+/*
+ * power_tsdb_conf_path - file named by "telemetry_file=" in PowerParameters
+ * OUT max_bytes - if not NULL, set to the size at which the file rotates,
+ *	"telemetry_max_mb=" in PowerParameters else POWER_TSDB_MAX_MB,
+ *	0 for no limit
+ * RET path, xfree() it, NULL if no store is configured
+ */
+extern char *power_tsdb_conf_path(uint64_t *max_bytes);
+
+/*
+ * power_tsdb_writer_open - open or create a store and start its writer
+ * IN path - store file, appended to if it exists
+ * IN block_rows - rows per block, 0 for POWER_TSDB_BLOCK_ROWS
+ * IN flush_secs - longest time a row waits in memory before its block
+ *	is written even if not full
+ * IN max_bytes - size at which the file rotates, 0 for no limit
+ * RET writer or NULL on error
+ */
+extern power_tsdb_writer_t *power_tsdb_writer_open(const char *path,
+						   int block_rows,
+						   int flush_secs,
+						   uint64_t max_bytes);
+
+/*
+ * power_tsdb_set_nodes - name the node indexes of the rows appended after
+ *	this call, must be called before the first append
+ */
+extern void power_tsdb_set_nodes(power_tsdb_writer_t *writer,
+				 char **names, int name_cnt);
+
+/*
+ * power_tsdb_append - queue rows for writing
+ * This only copies the rows, encoding and disk I/O happen in the writer
+ * thread.  Rows are dropped, and counted, if the writer falls more than
+ * 16 blocks behind.
+ */
+extern void power_tsdb_append(power_tsdb_writer_t *writer,
+			      const power_tsdb_row_t *rows, int row_cnt);
+
+/* power_tsdb_writer_close - write any queued rows and free the writer */
+extern void power_tsdb_writer_close(power_tsdb_writer_t *writer);
+
+/* power_tsdb_open - map a store for reading, NULL on error */
+extern power_tsdb_reader_t *power_tsdb_open(const char *path);
+
+extern void power_tsdb_close(power_tsdb_reader_t *reader);
+
+typedef struct power_tsdb_query {
+	time_t   start;		/* 0 for no lower bound */
+	time_t   end;		/* 0 for no upper bound */
+	uint32_t job_id;	/* 0 for any job */
+	char    *node_name;	/* NULL for any node */
+	uint32_t min_watts;	/* rows with pkg + dram watts below this
+				 * are skipped */
+} power_tsdb_query_t;
+
+/* Return non-zero to stop the scan */
+typedef int (*power_tsdb_row_f) (const power_tsdb_row_t *row, void *arg);
+
+/*
+ * power_tsdb_scan - call row_f on every row matching the query, in the
+ *	order they were written
+ * RET SLURM_SUCCESS or SLURM_ERROR if the file is not a store
+ */
+extern int power_tsdb_scan(power_tsdb_reader_t *reader,
+			   const power_tsdb_query_t *query,
+			   power_tsdb_row_f row_f, void *arg);
+
+#endif /* !_POWER_TSDB_H */
@@ -333,6 +333,8 @@ static slurm_errtab_t slurm_errtab[] = {
 	  "Job update not available right now, the DB index is being set, try again in a bit" },
 	{ ESLURM_RSV_ALREADY_STARTED,
 	  "Reservation already started"	},
+	{ ESLURM_INVALID_POWER,
+	  "Invalid job power request, check watts and frequency"	},
 
 	/* slurmd error codes */
 	{ ESLRUMD_PIPE_ERROR_ON_TASK_SPAWN,
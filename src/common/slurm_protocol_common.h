@@ -79,7 +79,11 @@
 #define SLURM_16_05_PROTOCOL_VERSION ((30 << 8) | 0)
 #define SLURM_15_08_PROTOCOL_VERSION ((29 << 8) | 0)
 
-#define SLURM_PROTOCOL_VERSION SLURM_17_02_PROTOCOL_VERSION
+/* 17.02 plus the job power request fields. The minor number keeps it apart
+ * from the protocol version of the next Slurm release. */
+#define SLURM_17_02_POWER_PROTOCOL_VERSION ((31 << 8) | 1)
+
+#define SLURM_PROTOCOL_VERSION SLURM_17_02_POWER_PROTOCOL_VERSION
 #define SLURM_ONE_BACK_PROTOCOL_VERSION SLURM_16_05_PROTOCOL_VERSION
 #define SLURM_MIN_PROTOCOL_VERSION SLURM_15_08_PROTOCOL_VERSION
 
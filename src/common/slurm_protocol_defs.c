@@ -1067,10 +1067,50 @@ extern void slurm_free_power_knob_cap_resp_msg(
 
 
 
+extern void slurm_free_power_knob_sample_req_msg(
+	power_knob_sample_req_msg_t *msg)
+{
+	if (msg) {
+		xfree(msg);
+	}
+}
+
+extern void slurm_free_power_knob_sample_resp_msg(
+	power_knob_sample_resp_msg_t *msg)
+{
+	if (msg) {
+		xfree(msg->node_name);
+		power_knob_current_destroy(msg->power_info);
+		xfree(msg->perf_info);
+		xfree(msg);
+	}
+}
+
+extern void slurm_free_power_cap_nodes_req_msg(
+	power_cap_nodes_req_msg_t *msg)
+{
+	if (msg) {
+		xfree(msg->node_list);
+		xfree(msg->cap_info);
+		xfree(msg->cap_info2);
+		xfree(msg);
+	}
+}
+
+extern void slurm_free_power_watermark_msg(power_watermark_msg_t *msg)
+{
+	if (msg) {
+		xfree(msg->node_name);
+		xfree(msg);
+	}
+}
+
 extern void slurm_free_power_schedule_slurmd_req_msg(
 	power_schedule_slurmd_req_msg_t *msg)
 {
 	if (msg) {
+		xfree(msg->node_list);
+		xfree(msg->node_watts);
 		xfree(msg);
 	}
 }
@@ -3523,6 +3563,27 @@ extern void slurm_free_node_info_msg(node_info_msg_t * msg)
 	}
 }
 
+extern void slurm_free_node_power_info_msg(node_power_info_msg_t *msg)
+{
+	int i;
+
+	if (msg) {
+		for (i = 0; msg->node_array && (i < msg->record_count); i++) {
+			xfree(msg->node_array[i].name);
+			xfree(msg->node_array[i].power);
+			xfree(msg->node_array[i].cache);
+		}
+		xfree(msg->node_array);
+		xfree(msg);
+	}
+}
+
+extern void slurm_free_node_power_info_request_msg(
+	node_power_info_request_msg_t *msg)
+{
+	xfree(msg);
+}
+
 static void _free_all_node_info(node_info_msg_t *msg)
 {
 	int i;
@@ -4378,6 +4439,34 @@ extern int slurm_free_msg_data(slurm_msg_type_t type, void *data)
 	case REQUEST_EVENT_LOG:
 		slurm_free_event_log_msg(data);
 		break;
+	case RESPONSE_POWER_KNOB_GET_INFO:
+		slurm_free_power_knob_get_info_node_resp_msg(data);
+		break;
+	case RESPONSE_POWER_KNOB_GET_CACHE_INFO:
+		slurm_free_power_knob_get_cache_info_node_resp_msg(data);
+		break;
+	case REQUEST_POWER_KNOB_SAMPLE:
+		slurm_free_power_knob_sample_req_msg(data);
+		break;
+	case RESPONSE_POWER_KNOB_SAMPLE:
+	case MESSAGE_POWER_SAMPLE:
+		slurm_free_power_knob_sample_resp_msg(data);
+		break;
+	case REQUEST_POWER_CAP_SET_NODES:
+		slurm_free_power_cap_nodes_req_msg(data);
+		break;
+	case REQUEST_POWER_WATERMARK:
+		slurm_free_power_watermark_msg(data);
+		break;
+	case REQUEST_NODE_POWER_INFO:
+		slurm_free_node_power_info_request_msg(data);
+		break;
+	case RESPONSE_NODE_POWER_INFO:
+		slurm_free_node_power_info_msg(data);
+		break;
+	case RESPONSE_POWER_SCHEDULE_SLURMD:
+		slurm_free_power_schedule_slurmd_resp_msg(data);
+		break;
 /*
 	case REQUEST_POWER_KNOB_GET_INFO:
 		slurm_free_power_knob_get_info_req_msg(data);
@@ -4443,6 +4532,10 @@ extern uint32_t slurm_get_return_code(slurm_msg_type_t type, void *data)
 	case RESPONSE_POWER_CAP_SET:
 		rc = SLURM_SUCCESS;
 		break;		
+	case RESPONSE_POWER_KNOB_SAMPLE:
+	case RESPONSE_POWER_SCHEDULE_SLURMD:
+		rc = SLURM_SUCCESS;
+		break;
 	case RESPONSE_FORWARD_FAILED:
 		/* There may be other reasons for the failure, but
 		 * this may be a slurm_msg_t data type lacking the
@@ -4953,6 +5046,20 @@ rpc_num2string(uint16_t opcode)
 		
 	case RESPONSE_POWER_SCHEDULE_SLURMD:
 		return "RESPONSE_POWER_SCHEDULE_SLURMD";		
+	case REQUEST_POWER_KNOB_SAMPLE:
+		return "REQUEST_POWER_KNOB_SAMPLE";
+	case RESPONSE_POWER_KNOB_SAMPLE:
+		return "RESPONSE_POWER_KNOB_SAMPLE";
+	case MESSAGE_POWER_SAMPLE:
+		return "MESSAGE_POWER_SAMPLE";
+	case REQUEST_NODE_POWER_INFO:
+		return "REQUEST_NODE_POWER_INFO";
+	case RESPONSE_NODE_POWER_INFO:
+		return "RESPONSE_NODE_POWER_INFO";
+	case REQUEST_POWER_CAP_SET_NODES:
+		return "REQUEST_POWER_CAP_SET_NODES";
+	case REQUEST_POWER_WATERMARK:
+		return "REQUEST_POWER_WATERMARK";
 	default:
 		(void) snprintf(buf, sizeof(buf), "%u", opcode);
 		return buf;
@@ -206,6 +206,14 @@ typedef enum {
 	RESPONSE_POWER_CAP_SET,
 	REQUEST_POWER_SCHEDULE_SLURMD,
 	RESPONSE_POWER_SCHEDULE_SLURMD,
+	REQUEST_POWER_KNOB_SAMPLE,
+	RESPONSE_POWER_KNOB_SAMPLE,
+	REQUEST_POWER_CAP_SET_NODES,	/* answered with RESPONSE_SLURM_RC */
+	REQUEST_POWER_WATERMARK,	/* slurmd to slurmctld, no reply */
+	MESSAGE_POWER_SAMPLE,		/* pushed power_knob_sample_resp_msg_t,
+					 * no reply */
+	REQUEST_NODE_POWER_INFO,
+	RESPONSE_NODE_POWER_INFO,
 	DBD_MESSAGES_START = 1400, /* We can't repalce this with
 				    * REQUEST_PERSIST_INIT since DBD_INIT is
 				    * packed in a way we can't tell the
@@ -632,6 +640,11 @@ typedef struct node_info_request_msg {
 	uint16_t show_flags;
 } node_info_request_msg_t;
 
+typedef struct node_power_info_request_msg {
+	time_t watts_update_time;
+	time_t cache_update_time;
+} node_power_info_request_msg_t;
+
 typedef struct node_info_single_msg {
 	char *node_name;
 	uint16_t show_flags;
@@ -1474,6 +1487,19 @@ extern void slurm_free_power_knob_set_req_msg(
 	power_knob_set_req_msg_t *msg);
 extern void slurm_free_power_knob_set_node_resp_msg(
 	power_knob_set_node_resp_msg_t *msg);
+extern void slurm_free_power_knob_sample_req_msg(
+	power_knob_sample_req_msg_t *msg);
+extern void slurm_free_power_knob_sample_resp_msg(
+	power_knob_sample_resp_msg_t *msg);
+extern void slurm_free_power_cap_nodes_req_msg(
+	power_cap_nodes_req_msg_t *msg);
+extern void slurm_free_power_watermark_msg(power_watermark_msg_t *msg);
+extern void slurm_free_power_schedule_slurmd_req_msg(
+	power_schedule_slurmd_req_msg_t *msg);
+extern void slurm_free_power_schedule_slurmd_resp_msg(
+	power_schedule_slurmd_resp_msg_t *msg);
+extern void slurm_free_node_power_info_request_msg(
+	node_power_info_request_msg_t *msg);
 	
 extern void slurm_free_accounting_update_msg(accounting_update_msg_t *msg);
 extern void slurm_free_spank_env_request_msg(spank_env_request_msg_t *msg);
@@ -51,6 +51,7 @@
 #include "src/common/node_select.h"
 #include "src/common/pack.h"
 #include "src/common/power.h"
+#include "src/common/power_delta.h"
 #include "src/common/power_knob.h"
 #include "src/common/read_config.h"
 #include "src/common/slurm_accounting_storage.h"
@@ -75,6 +76,7 @@
 #define _pack_burst_buffer_info_resp_msg(msg,buf) _pack_buffer_msg(msg,buf)
 #define _pack_front_end_info_msg(msg,buf)	_pack_buffer_msg(msg,buf)
 #define _pack_node_info_msg(msg,buf)		_pack_buffer_msg(msg,buf)
+#define _pack_node_power_info_msg(msg,buf)	_pack_buffer_msg(msg,buf)
 #define _pack_partition_info_msg(msg,buf)	_pack_buffer_msg(msg,buf)
 #define _pack_stats_response_msg(msg,buf)	_pack_buffer_msg(msg,buf)
 #define _pack_reserve_info_msg(msg,buf)		_pack_buffer_msg(msg,buf)
@@ -818,6 +820,39 @@ static void _pack_power_schedule_slurmd_resp_msg(
 static int _unpack_power_schedule_slurmd_resp_msg(
 			power_schedule_slurmd_resp_msg_t **msg, Buf buffer,
 			uint16_t protocol_version);		
+static void _pack_power_knob_sample_req_msg(
+			power_knob_sample_req_msg_t *msg, Buf buffer,
+			uint16_t protocol_version);
+static void _pack_power_cap_nodes_req_msg(
+			power_cap_nodes_req_msg_t *msg, Buf buffer,
+			uint16_t protocol_version);
+static int _unpack_power_cap_nodes_req_msg(
+			power_cap_nodes_req_msg_t **msg, Buf buffer,
+			uint16_t protocol_version);
+static void _pack_power_watermark_msg(
+			power_watermark_msg_t *msg, Buf buffer,
+			uint16_t protocol_version);
+static int _unpack_power_watermark_msg(
+			power_watermark_msg_t **msg, Buf buffer,
+			uint16_t protocol_version);
+static void _pack_node_power_info_request_msg(
+			node_power_info_request_msg_t *msg, Buf buffer,
+			uint16_t protocol_version);
+static int _unpack_node_power_info_request_msg(
+			node_power_info_request_msg_t **msg, Buf buffer,
+			uint16_t protocol_version);
+static int _unpack_node_power_info_msg(
+			node_power_info_msg_t **msg, Buf buffer,
+			uint16_t protocol_version);
+static int _unpack_power_knob_sample_req_msg(
+			power_knob_sample_req_msg_t **msg, Buf buffer,
+			uint16_t protocol_version);
+static void _pack_power_knob_sample_resp_msg(
+			power_knob_sample_resp_msg_t *msg, Buf buffer,
+			uint16_t protocol_version);
+static int _unpack_power_knob_sample_resp_msg(
+			power_knob_sample_resp_msg_t **msg, Buf buffer,
+			uint16_t protocol_version);
 			
 			
 static void _pack_event_log_msg(slurm_event_log_msg_t *msg, Buf buffer,
@@ -1677,6 +1712,36 @@ pack_msg(slurm_msg_t const *msg, Buf buffer)
 						  msg->data, buffer,
 						  msg->protocol_version);
 		break;			
+	case REQUEST_POWER_KNOB_SAMPLE:
+		_pack_power_knob_sample_req_msg((power_knob_sample_req_msg_t *)
+						msg->data, buffer,
+						msg->protocol_version);
+		break;
+	case RESPONSE_POWER_KNOB_SAMPLE:
+	case MESSAGE_POWER_SAMPLE:
+		_pack_power_knob_sample_resp_msg((power_knob_sample_resp_msg_t *)
+						 msg->data, buffer,
+						 msg->protocol_version);
+		break;
+	case REQUEST_POWER_CAP_SET_NODES:
+		_pack_power_cap_nodes_req_msg((power_cap_nodes_req_msg_t *)
+					      msg->data, buffer,
+					      msg->protocol_version);
+		break;
+	case REQUEST_POWER_WATERMARK:
+		_pack_power_watermark_msg((power_watermark_msg_t *)
+					  msg->data, buffer,
+					  msg->protocol_version);
+		break;
+	case REQUEST_NODE_POWER_INFO:
+		_pack_node_power_info_request_msg(
+					(node_power_info_request_msg_t *)
+					msg->data, buffer,
+					msg->protocol_version);
+		break;
+	case RESPONSE_NODE_POWER_INFO:
+		_pack_node_power_info_msg((slurm_msg_t *) msg, buffer);
+		break;
 		
 	default:
 		debug("No pack method for msg type %u", msg->msg_type);
@@ -2487,6 +2552,43 @@ unpack_msg(slurm_msg_t * msg, Buf buffer)
 						  &(msg->data), buffer,
 						  msg->protocol_version);
 		break;
+	case REQUEST_POWER_KNOB_SAMPLE:
+		rc = _unpack_power_knob_sample_req_msg(
+						(power_knob_sample_req_msg_t **)
+						&(msg->data), buffer,
+						msg->protocol_version);
+		break;
+	case RESPONSE_POWER_KNOB_SAMPLE:
+	case MESSAGE_POWER_SAMPLE:
+		rc = _unpack_power_knob_sample_resp_msg(
+						(power_knob_sample_resp_msg_t **)
+						&(msg->data), buffer,
+						msg->protocol_version);
+		break;
+	case REQUEST_POWER_CAP_SET_NODES:
+		rc = _unpack_power_cap_nodes_req_msg(
+						(power_cap_nodes_req_msg_t **)
+						&(msg->data), buffer,
+						msg->protocol_version);
+		break;
+	case REQUEST_POWER_WATERMARK:
+		rc = _unpack_power_watermark_msg(
+						(power_watermark_msg_t **)
+						&(msg->data), buffer,
+						msg->protocol_version);
+		break;
+	case REQUEST_NODE_POWER_INFO:
+		rc = _unpack_node_power_info_request_msg(
+						(node_power_info_request_msg_t **)
+						&(msg->data), buffer,
+						msg->protocol_version);
+		break;
+	case RESPONSE_NODE_POWER_INFO:
+		rc = _unpack_node_power_info_msg(
+						(node_power_info_msg_t **)
+						&(msg->data), buffer,
+						msg->protocol_version);
+		break;
 		
 	default:
 		debug("No unpack method for msg type %u", msg->msg_type);
@@ -6300,6 +6402,11 @@ _unpack_job_info_members(job_info_t * job, Buf buffer,
 		safe_unpack16(&job->batch_flag,   buffer);
 		safe_unpack16(&job->state_reason, buffer);
 		safe_unpack8 (&job->power_flags,  buffer);
+		if (protocol_version >= SLURM_17_02_POWER_PROTOCOL_VERSION) {
+			safe_unpack32(&job->power_pkg_watts, buffer);
+			safe_unpack32(&job->power_dram_watts, buffer);
+			safe_unpack32(&job->power_freq, buffer);
+		}
 		safe_unpack8 (&job->reboot,       buffer);
 		safe_unpack16(&job->restart_cnt,  buffer);
 		safe_unpack16(&job->show_flags,   buffer);
@@ -8932,6 +9039,11 @@ _pack_job_desc_msg(job_desc_msg_t * job_desc_ptr, Buf buffer,
 		pack64(job_desc_ptr->pn_min_memory, buffer);
 		pack32(job_desc_ptr->pn_min_tmp_disk, buffer);
 		pack8(job_desc_ptr->power_flags, buffer);
+		if (protocol_version >= SLURM_17_02_POWER_PROTOCOL_VERSION) {
+			pack32(job_desc_ptr->power_pkg_watts, buffer);
+			pack32(job_desc_ptr->power_dram_watts, buffer);
+			pack32(job_desc_ptr->power_freq, buffer);
+		}
 
 		pack32(job_desc_ptr->cpu_freq_min, buffer);
 		pack32(job_desc_ptr->cpu_freq_max, buffer);
@@ -9451,6 +9563,15 @@ _unpack_job_desc_msg(job_desc_msg_t ** job_desc_buffer_ptr, Buf buffer,
 		safe_unpack64(&job_desc_ptr->pn_min_memory, buffer);
 		safe_unpack32(&job_desc_ptr->pn_min_tmp_disk, buffer);
 		safe_unpack8(&job_desc_ptr->power_flags,   buffer);
+		if (protocol_version >= SLURM_17_02_POWER_PROTOCOL_VERSION) {
+			safe_unpack32(&job_desc_ptr->power_pkg_watts, buffer);
+			safe_unpack32(&job_desc_ptr->power_dram_watts, buffer);
+			safe_unpack32(&job_desc_ptr->power_freq, buffer);
+		} else {
+			job_desc_ptr->power_pkg_watts = NO_VAL;
+			job_desc_ptr->power_dram_watts = NO_VAL;
+			job_desc_ptr->power_freq = NO_VAL;
+		}
 
 		safe_unpack32(&job_desc_ptr->cpu_freq_min, buffer);
 		safe_unpack32(&job_desc_ptr->cpu_freq_max, buffer);
@@ -9621,6 +9742,9 @@ _unpack_job_desc_msg(job_desc_msg_t ** job_desc_buffer_ptr, Buf buffer,
 		job_desc_ptr->pn_min_memory = xlate_mem_old2new(tmp_mem);
 		safe_unpack32(&job_desc_ptr->pn_min_tmp_disk, buffer);
 		safe_unpack8(&job_desc_ptr->power_flags,   buffer);
+		job_desc_ptr->power_pkg_watts = NO_VAL;
+		job_desc_ptr->power_dram_watts = NO_VAL;
+		job_desc_ptr->power_freq = NO_VAL;
 
 		safe_unpack32(&job_desc_ptr->cpu_freq_min, buffer);
 		safe_unpack32(&job_desc_ptr->cpu_freq_max, buffer);
@@ -9781,6 +9905,9 @@ _unpack_job_desc_msg(job_desc_msg_t ** job_desc_buffer_ptr, Buf buffer,
 		job_desc_ptr->pn_min_memory = xlate_mem_old2new(tmp_mem);
 		safe_unpack32(&job_desc_ptr->pn_min_tmp_disk, buffer);
 		safe_unpack8(&job_desc_ptr->power_flags,   buffer);
+		job_desc_ptr->power_pkg_watts = NO_VAL;
+		job_desc_ptr->power_dram_watts = NO_VAL;
+		job_desc_ptr->power_freq = NO_VAL;
 
 		safe_unpack32(&job_desc_ptr->cpu_freq_min, buffer);
 		safe_unpack32(&job_desc_ptr->cpu_freq_max, buffer);
@@ -15514,55 +15641,390 @@ static int _unpack_power_knob_cap_resp_msg(
 				return SLURM_ERROR;
 			}			
 				
-static void _pack_power_schedule_slurmd_req_msg(
-			power_schedule_slurmd_req_msg_t *msg, Buf buffer,
-			uint16_t protocol_version)
+static void
+_pack_power_schedule_slurmd_req_msg(power_schedule_slurmd_req_msg_t *msg,
+				    Buf buffer, uint16_t protocol_version)
 {
-	int i;
 	xassert(msg != NULL);
 
-	pack32(msg->dummy,buffer);
-//	pack32(msg->cap_info2,buffer);
-	
-}			
+	if (protocol_version >= SLURM_MIN_PROTOCOL_VERSION) {
+		packstr(msg->node_list, buffer);
+		pack32_array(msg->node_watts, msg->watts_cnt, buffer);
+		pack32(msg->period_msec, buffer);
+	} else {
+		error("%s: protocol_version %hu not supported",
+		      __func__, protocol_version);
+	}
+}
 
-static int _unpack_power_schedule_slurmd_req_msg(
-			power_schedule_slurmd_req_msg_t **msg, Buf buffer,
-			uint16_t protocol_version)
+static int
+_unpack_power_schedule_slurmd_req_msg(power_schedule_slurmd_req_msg_t **msg,
+				      Buf buffer, uint16_t protocol_version)
 {
-	int i;
-	power_schedule_slurmd_req_msg_t	*msg_ptr;
-	uint32_t dummy;
-	debug ("inside unpack of slurm_protocol_pack");
-	xassert(msg!=NULL);
+	power_schedule_slurmd_req_msg_t *msg_ptr;
+	uint32_t uint32_tmp;
+
+	xassert(msg != NULL);
 
 	msg_ptr = xmalloc(sizeof(power_schedule_slurmd_req_msg_t));
-	*msg = msg_ptr;	
-	
-	safe_unpack32(&msg_ptr->dummy,buffer);
-//	safe_unpack32(&msg_ptr->cap_info2,buffer);
-	
+	*msg = msg_ptr;
+
+	if (protocol_version >= SLURM_MIN_PROTOCOL_VERSION) {
+		safe_unpackstr_xmalloc(&msg_ptr->node_list, &uint32_tmp,
+				       buffer);
+		safe_unpack32_array(&msg_ptr->node_watts,
+				    &msg_ptr->watts_cnt, buffer);
+		safe_unpack32(&msg_ptr->period_msec, buffer);
+	} else {
+		error("%s: protocol_version %hu not supported",
+		      __func__, protocol_version);
+		goto unpack_error;
+	}
 	return SLURM_SUCCESS;
 
 unpack_error:
 	slurm_free_power_schedule_slurmd_req_msg(msg_ptr);
-	*msg=NULL;
+	*msg = NULL;
 	return SLURM_ERROR;
 }
-	
-static void _pack_power_schedule_slurmd_resp_msg(
-			power_schedule_slurmd_resp_msg_t *msg, Buf buffer,
-			uint16_t protocol_version)
-			{
-				return SLURM_ERROR;
-			}
-static int _unpack_power_schedule_slurmd_resp_msg(
-			power_schedule_slurmd_resp_msg_t **msg, Buf buffer,
-			uint16_t protocol_version)		
-			{
-				return SLURM_ERROR;
-			}	
-	
+
+static void
+_pack_power_schedule_slurmd_resp_msg(power_schedule_slurmd_resp_msg_t *msg,
+				     Buf buffer, uint16_t protocol_version)
+{
+	xassert(msg != NULL);
+
+	if (protocol_version >= SLURM_MIN_PROTOCOL_VERSION) {
+		pack32(msg->node_watts, buffer);
+		pack32(msg->cap_watts, buffer);
+		pack32(msg->avg_watts, buffer);
+		pack32(msg->peak_watts, buffer);
+		pack32(msg->exceeded_cnt, buffer);
+	} else {
+		error("%s: protocol_version %hu not supported",
+		      __func__, protocol_version);
+	}
+}
+
+static int
+_unpack_power_schedule_slurmd_resp_msg(power_schedule_slurmd_resp_msg_t **msg,
+				       Buf buffer, uint16_t protocol_version)
+{
+	power_schedule_slurmd_resp_msg_t *msg_ptr;
+
+	xassert(msg != NULL);
+
+	msg_ptr = xmalloc(sizeof(power_schedule_slurmd_resp_msg_t));
+	*msg = msg_ptr;
+
+	if (protocol_version >= SLURM_MIN_PROTOCOL_VERSION) {
+		safe_unpack32(&msg_ptr->node_watts, buffer);
+		safe_unpack32(&msg_ptr->cap_watts, buffer);
+		safe_unpack32(&msg_ptr->avg_watts, buffer);
+		safe_unpack32(&msg_ptr->peak_watts, buffer);
+		safe_unpack32(&msg_ptr->exceeded_cnt, buffer);
+	} else {
+		error("%s: protocol_version %hu not supported",
+		      __func__, protocol_version);
+		goto unpack_error;
+	}
+	return SLURM_SUCCESS;
+
+unpack_error:
+	slurm_free_power_schedule_slurmd_resp_msg(msg_ptr);
+	*msg = NULL;
+	return SLURM_ERROR;
+}
+
+static void
+_pack_power_knob_sample_req_msg(power_knob_sample_req_msg_t *msg, Buf buffer,
+				uint16_t protocol_version)
+{
+	xassert(msg != NULL);
+
+	if (protocol_version >= SLURM_MIN_PROTOCOL_VERSION) {
+		pack32(msg->seq, buffer);
+	} else {
+		error("%s: protocol_version %hu not supported",
+		      __func__, protocol_version);
+	}
+}
+
+static int
+_unpack_power_knob_sample_req_msg(power_knob_sample_req_msg_t **msg,
+				  Buf buffer, uint16_t protocol_version)
+{
+	power_knob_sample_req_msg_t *msg_ptr;
+
+	xassert(msg != NULL);
+
+	msg_ptr = xmalloc(sizeof(power_knob_sample_req_msg_t));
+	*msg = msg_ptr;
+
+	if (protocol_version >= SLURM_MIN_PROTOCOL_VERSION) {
+		safe_unpack32(&msg_ptr->seq, buffer);
+	} else {
+		error("%s: protocol_version %hu not supported",
+		      __func__, protocol_version);
+		goto unpack_error;
+	}
+	return SLURM_SUCCESS;
+
+unpack_error:
+	slurm_free_power_knob_sample_req_msg(msg_ptr);
+	*msg = NULL;
+	return SLURM_ERROR;
+}
+
+static void
+_pack_power_cap_nodes_req_msg(power_cap_nodes_req_msg_t *msg, Buf buffer,
+			      uint16_t protocol_version)
+{
+	xassert(msg != NULL);
+
+	if (protocol_version >= SLURM_MIN_PROTOCOL_VERSION) {
+		packstr(msg->node_list, buffer);
+		pack32_array(msg->cap_info, msg->cap_cnt, buffer);
+		pack32_array(msg->cap_info2, msg->cap_cnt, buffer);
+	} else {
+		error("%s: protocol_version %hu not supported",
+		      __func__, protocol_version);
+	}
+}
+
+static int
+_unpack_power_cap_nodes_req_msg(power_cap_nodes_req_msg_t **msg,
+				Buf buffer, uint16_t protocol_version)
+{
+	power_cap_nodes_req_msg_t *msg_ptr;
+	uint32_t uint32_tmp;
+
+	xassert(msg != NULL);
+
+	msg_ptr = xmalloc(sizeof(power_cap_nodes_req_msg_t));
+	*msg = msg_ptr;
+
+	if (protocol_version >= SLURM_MIN_PROTOCOL_VERSION) {
+		safe_unpackstr_xmalloc(&msg_ptr->node_list, &uint32_tmp,
+				       buffer);
+		safe_unpack32_array(&msg_ptr->cap_info, &msg_ptr->cap_cnt,
+				    buffer);
+		safe_unpack32_array(&msg_ptr->cap_info2, &uint32_tmp, buffer);
+		if (uint32_tmp != msg_ptr->cap_cnt)
+			goto unpack_error;
+	} else {
+		error("%s: protocol_version %hu not supported",
+		      __func__, protocol_version);
+		goto unpack_error;
+	}
+	return SLURM_SUCCESS;
+
+unpack_error:
+	slurm_free_power_cap_nodes_req_msg(msg_ptr);
+	*msg = NULL;
+	return SLURM_ERROR;
+}
+
+static void
+_pack_power_watermark_msg(power_watermark_msg_t *msg, Buf buffer,
+			  uint16_t protocol_version)
+{
+	xassert(msg != NULL);
+
+	if (protocol_version >= SLURM_MIN_PROTOCOL_VERSION) {
+		packstr(msg->node_name, buffer);
+		pack32(msg->watts, buffer);
+		pack32(msg->watermark, buffer);
+	} else {
+		error("%s: protocol_version %hu not supported",
+		      __func__, protocol_version);
+	}
+}
+
+static int
+_unpack_power_watermark_msg(power_watermark_msg_t **msg, Buf buffer,
+			    uint16_t protocol_version)
+{
+	power_watermark_msg_t *msg_ptr;
+	uint32_t uint32_tmp;
+
+	xassert(msg != NULL);
+
+	msg_ptr = xmalloc(sizeof(power_watermark_msg_t));
+	*msg = msg_ptr;
+
+	if (protocol_version >= SLURM_MIN_PROTOCOL_VERSION) {
+		safe_unpackstr_xmalloc(&msg_ptr->node_name, &uint32_tmp,
+				       buffer);
+		safe_unpack32(&msg_ptr->watts, buffer);
+		safe_unpack32(&msg_ptr->watermark, buffer);
+	} else {
+		error("%s: protocol_version %hu not supported",
+		      __func__, protocol_version);
+		goto unpack_error;
+	}
+	return SLURM_SUCCESS;
+
+unpack_error:
+	slurm_free_power_watermark_msg(msg_ptr);
+	*msg = NULL;
+	return SLURM_ERROR;
+}
+
+static void
+_pack_node_power_info_request_msg(node_power_info_request_msg_t *msg,
+				  Buf buffer, uint16_t protocol_version)
+{
+	xassert(msg != NULL);
+
+	if (protocol_version >= SLURM_MIN_PROTOCOL_VERSION) {
+		pack_time(msg->watts_update_time, buffer);
+		pack_time(msg->cache_update_time, buffer);
+	} else {
+		error("%s: protocol_version %hu not supported",
+		      __func__, protocol_version);
+	}
+}
+
+static int
+_unpack_node_power_info_request_msg(node_power_info_request_msg_t **msg,
+				    Buf buffer, uint16_t protocol_version)
+{
+	node_power_info_request_msg_t *msg_ptr;
+
+	xassert(msg != NULL);
+
+	msg_ptr = xmalloc(sizeof(node_power_info_request_msg_t));
+	*msg = msg_ptr;
+
+	if (protocol_version >= SLURM_MIN_PROTOCOL_VERSION) {
+		safe_unpack_time(&msg_ptr->watts_update_time, buffer);
+		safe_unpack_time(&msg_ptr->cache_update_time, buffer);
+	} else {
+		error("%s: protocol_version %hu not supported",
+		      __func__, protocol_version);
+		goto unpack_error;
+	}
+	return SLURM_SUCCESS;
+
+unpack_error:
+	slurm_free_node_power_info_request_msg(msg_ptr);
+	*msg = NULL;
+	return SLURM_ERROR;
+}
+
+/* The body is packed by pack_node_power() in slurmctld, see
+ * power_delta_pack_nodes() for the record encoding */
+static int
+_unpack_node_power_info_msg(node_power_info_msg_t **msg, Buf buffer,
+			    uint16_t protocol_version)
+{
+	node_power_info_msg_t *msg_ptr;
+
+	xassert(msg != NULL);
+
+	msg_ptr = xmalloc(sizeof(node_power_info_msg_t));
+	*msg = msg_ptr;
+
+	if (protocol_version >= SLURM_MIN_PROTOCOL_VERSION) {
+		safe_unpack_time(&msg_ptr->watts_update_time, buffer);
+		safe_unpack_time(&msg_ptr->cache_update_time, buffer);
+		if (power_delta_unpack_nodes(&msg_ptr->node_array,
+					     &msg_ptr->record_count,
+					     buffer) != SLURM_SUCCESS)
+			goto unpack_error;
+	} else {
+		error("%s: protocol_version %hu not supported",
+		      __func__, protocol_version);
+		goto unpack_error;
+	}
+	return SLURM_SUCCESS;
+
+unpack_error:
+	slurm_free_node_power_info_msg(msg_ptr);
+	*msg = NULL;
+	return SLURM_ERROR;
+}
+
+static void
+_pack_power_knob_sample_resp_msg(power_knob_sample_resp_msg_t *msg,
+				 Buf buffer, uint16_t protocol_version)
+{
+	unsigned int i;
+
+	xassert(msg != NULL);
+
+	if (protocol_version >= SLURM_MIN_PROTOCOL_VERSION) {
+		packstr(msg->node_name, buffer);
+		pack32(msg->seq, buffer);
+		pack32(msg->req_seq, buffer);
+		pack64(msg->sample_usec, buffer);
+		pack16(msg->socket_cnt, buffer);
+		for (i = 0; i < msg->socket_cnt; i++)
+			power_knob_current_pack(&msg->power_info[i], buffer);
+		pack16(msg->cache_socket_cnt, buffer);
+		for (i = 0; i < msg->cache_socket_cnt; i++)
+			power_knob_cache_pack(&msg->perf_info[i], buffer);
+	} else {
+		error("%s: protocol_version %hu not supported",
+		      __func__, protocol_version);
+	}
+}
+
+static int
+_unpack_power_knob_sample_resp_msg(power_knob_sample_resp_msg_t **msg,
+				   Buf buffer, uint16_t protocol_version)
+{
+	unsigned int i;
+	uint32_t uint32_tmp;
+	power_knob_sample_resp_msg_t *msg_ptr;
+
+	xassert(msg != NULL);
+
+	msg_ptr = xmalloc(sizeof(power_knob_sample_resp_msg_t));
+	*msg = msg_ptr;
+
+	if (protocol_version >= SLURM_MIN_PROTOCOL_VERSION) {
+		safe_unpackstr_xmalloc(&msg_ptr->node_name, &uint32_tmp,
+				       buffer);
+		safe_unpack32(&msg_ptr->seq, buffer);
+		safe_unpack32(&msg_ptr->req_seq, buffer);
+		safe_unpack64(&msg_ptr->sample_usec, buffer);
+		safe_unpack16(&msg_ptr->socket_cnt, buffer);
+		if (msg_ptr->socket_cnt) {
+			msg_ptr->power_info = power_knob_current_alloc(
+						msg_ptr->socket_cnt);
+		}
+		for (i = 0; i < msg_ptr->socket_cnt; i++) {
+			if (power_knob_current_unpack(&msg_ptr->power_info[i],
+						      buffer, 0)
+			    != SLURM_SUCCESS)
+				goto unpack_error;
+		}
+		safe_unpack16(&msg_ptr->cache_socket_cnt, buffer);
+		if (msg_ptr->cache_socket_cnt) {
+			msg_ptr->perf_info = xmalloc(sizeof(cache_ref_t) *
+						     msg_ptr->cache_socket_cnt);
+		}
+		for (i = 0; i < msg_ptr->cache_socket_cnt; i++) {
+			if (power_knob_cache_unpack(&msg_ptr->perf_info[i],
+						    buffer, 0)
+			    != SLURM_SUCCESS)
+				goto unpack_error;
+		}
+	} else {
+		error("%s: protocol_version %hu not supported",
+		      __func__, protocol_version);
+		goto unpack_error;
+	}
+	return SLURM_SUCCESS;
+
+unpack_error:
+	slurm_free_power_knob_sample_resp_msg(msg_ptr);
+	*msg = NULL;
+	return SLURM_ERROR;
+}
+
 static void
 _pack_event_log_msg(slurm_event_log_msg_t *msg, Buf buffer,
 		   uint16_t protocol_version)
@@ -50,6 +50,16 @@
 #include "src/common/xmalloc.h"
 #include "src/slurmdbd/read_config.h"
 
+/* RET true if version is one which this node can talk. Unpatched 17.02
+ * peers do not know SLURM_17_02_POWER_PROTOCOL_VERSION. */
+static bool _valid_version(uint16_t version)
+{
+	return ((version == SLURM_PROTOCOL_VERSION) ||
+		(version == SLURM_17_02_PROTOCOL_VERSION) ||
+		(version == SLURM_ONE_BACK_PROTOCOL_VERSION) ||
+		(version == SLURM_MIN_PROTOCOL_VERSION));
+}
+
 /*
  * check_header_version checks to see that the specified header was sent
  * from a node running the same version of the protocol as the current node
@@ -64,9 +74,7 @@ int check_header_version(header_t * header)
 		check_version = working_cluster_rec->rpc_version;
 
 	if (slurmdbd_conf) {
-		if ((header->version != SLURM_PROTOCOL_VERSION)     &&
-		    (header->version != SLURM_ONE_BACK_PROTOCOL_VERSION) &&
-		    (header->version != SLURM_MIN_PROTOCOL_VERSION)) {
+		if (!_valid_version(header->version)) {
 			debug("unsupported RPC version %hu msg type %s(%u)",
 			      header->version, rpc_num2string(header->msg_type),
 			      header->msg_type);
@@ -89,10 +97,7 @@ int check_header_version(header_t * header)
 				break;
 			}
 		default:
-			if ((header->version != SLURM_PROTOCOL_VERSION)     &&
-			    (header->version !=
-			     SLURM_ONE_BACK_PROTOCOL_VERSION) &&
-			    (header->version != SLURM_MIN_PROTOCOL_VERSION)) {
+			if (!_valid_version(header->version)) {
 				debug("Unsupported RPC version %hu "
 				      "msg type %s(%u)", header->version,
 				      rpc_num2string(header->msg_type),
@@ -81,6 +81,7 @@
 #define	bit_clear_all		slurm_bit_clear_all
 #define	bit_ffc			slurm_bit_ffc
 #define	bit_ffs			slurm_bit_ffs
+#define	bit_get_word		slurm_bit_get_word
 #define	bit_free		slurm_bit_free
 #define	bit_realloc		slurm_bit_realloc
 #define	bit_size		slurm_bit_size
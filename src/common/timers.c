@@ -40,6 +40,7 @@
 #include <unistd.h>
 #include <sys/time.h>
 #include "src/common/log.h"
+#include "src/common/timers.h"
 #include "src/common/slurm_time.h"
 
 /* Return the number of micro-seconds between now and argument "tv",
@@ -114,6 +115,25 @@ extern void slurm_diff_tv_str(struct timeval *tv1, struct timeval *tv2,
 	}
 }
 
+/* Advance "ts" by "msec" milliseconds, used for CLOCK_MONOTONIC deadlines */
+extern void slurm_ts_add_msec(struct timespec *ts, uint32_t msec)
+{
+	ts->tv_sec  += msec / 1000;
+	ts->tv_nsec += (long) (msec % 1000) * 1000000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+/* Return true if "a" is earlier than "b" */
+extern bool slurm_ts_before(struct timespec *a, struct timespec *b)
+{
+	if (a->tv_sec != b->tv_sec)
+		return (a->tv_sec < b->tv_sec);
+	return (a->tv_nsec < b->tv_nsec);
+}
+
 /* block_daemon()
  *
  * This function allows to block any daemon
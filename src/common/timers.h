@@ -39,7 +39,10 @@
 #ifndef _HAVE_TIMERS_H
 #define _HAVE_TIMERS_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <sys/time.h>
+#include <time.h>
 
 #define DEF_TIMERS	struct timeval tv1, tv2; char tv_str[20] = ""; long delta_t;
 #define START_TIMER	gettimeofday(&tv1, NULL)
@@ -71,6 +74,12 @@ extern void slurm_diff_tv_str(struct timeval *tv1,struct timeval *tv2,
 			      char *tv_str, int len_tv_str, const char *from,
 			      long limit, long *delta_t);
 
+/* Advance "ts" by "msec" milliseconds, used for CLOCK_MONOTONIC deadlines */
+extern void slurm_ts_add_msec(struct timespec *ts, uint32_t msec);
+
+/* Return true if "a" is earlier than "b" */
+extern bool slurm_ts_before(struct timespec *a, struct timespec *b);
+
 /* Block daemon indefinitely.
  */
 extern void block_daemon(void);
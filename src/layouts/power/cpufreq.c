@@ -39,6 +39,7 @@ s_p_options_t entity_options[] = {
 	{"DownWatts",S_P_UINT32},
 	{"PowerSaveWatts",S_P_UINT32},
 	{"LastCore",S_P_UINT32},
+	{"LimitWatts", S_P_UINT32},
 	/* children aggregated keys */
 	{"CurrentSumPower", S_P_UINT32},
 	{"IdleSumWatts", S_P_UINT32},
@@ -78,6 +79,7 @@ const layouts_keyspec_t keyspec[] = {
 	{"Cpufreq8Watts", L_T_UINT32},
 	{"DownWatts",L_T_UINT32},
 	{"PowerSaveWatts",L_T_UINT32},
+	{"LimitWatts", L_T_UINT32},	/* breaker limit of a subtree */
 	{"NumFreqChoices",L_T_UINT16},
 	{"LastCore",L_T_UINT32},
 	/* parents aggregated keys */
@@ -101,6 +103,8 @@ const layouts_keyspec_t keyspec[] = {
 /* types allowed in the entity's "type" field */
 const char* etypes[] = {
 	"Center",
+	"Rack",
+	"PDU",
 	"Node",
 	"Core",
 	NULL
@@ -20,6 +20,7 @@ s_p_options_t entity_options[] = {
 	{"MaxWatts", S_P_UINT32},
 	{"DownWatts",S_P_UINT32},
 	{"PowerSaveWatts",S_P_UINT32},
+	{"LimitWatts", S_P_UINT32},
 	/* parents aggregated keys */
 	{"CurrentSumPower", S_P_UINT32},
 	{"IdleSumWatts", S_P_UINT32},
@@ -38,6 +39,7 @@ const layouts_keyspec_t keyspec[] = {
 	{"MaxWatts", L_T_UINT32},
 	{"DownWatts",L_T_UINT32},
 	{"PowerSaveWatts",L_T_UINT32},
+	{"LimitWatts", L_T_UINT32},	/* breaker limit of a subtree */
 	{"NumFreqChoices",L_T_UINT32},
 	/* parents aggregated keys */
 	{"CurrentSumPower", L_T_UINT32,
@@ -53,6 +55,8 @@ const layouts_keyspec_t keyspec[] = {
 /* types allowed in the entity's "type" field */
 const char* etypes[] = {
 	"Center",
+	"Rack",
+	"PDU",
 	"Node",
 	NULL
 };
@@ -36,6 +36,8 @@
 \*****************************************************************************/
 #include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "slurm/slurm.h"
@@ -46,10 +48,24 @@
 #include "src/common/log.h"
 #include "src/common/slurm_priority.h"
 #include "src/common/macros.h"
+#include "src/common/slurm_protocol_api.h"
+#include "src/common/timers.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
 #include "src/slurmctld/slurmctld.h"
 
 #include "src/slurmctld/locks.h"
-#define Number_of_Socket 2
+#include "src/slurmctld/power_collect.h"
+#include "src/slurmctld/power_shed.h"
+#include "src/slurmctld/power_telemetry.h"
+
+#include "power_solver.h"
+
+#define DEFAULT_MIN_SOCKET_WATTS	40
+#define DEFAULT_MAX_SOCKET_WATTS	150
+#define DEFAULT_DEADBAND_WATTS		2
+#define DEFAULT_ELASTICITY		0.5
+#define JOB_HIST_DEPTH			8	/* samples kept per job */
 
 
 const char		plugin_name[]	= "SLURM Power Allocator plugin";
@@ -65,6 +81,10 @@ static pthread_t powerallocator_thread1 = 0;
 
 static pthread_mutex_t thread_flag_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+static power_pace_t allocator_pace;	/* node_power_schedule() */
+
+static power_pace_t allocator_pace1;	/* power_allocator_p_do_power_safe() */
+
 static void *_get_allocator_dynamic_loop(void);
 
 static void stop_get_allocator_dynamic_loop(void);
@@ -73,13 +93,20 @@ static void *_get_allocator_dynamic_loop1(void);
 
 static void stop_get_allocator_dynamic_loop1(void);
 
-static void slurm_set_power_cap2(int *power_cap_value[], char *node_name[], int number_of_node);
+static void _load_config(void);
+static void _free_state(void);
+
+/* PowerParameters, see _load_config() */
+static uint32_t min_socket_watts = DEFAULT_MIN_SOCKET_WATTS;
+static uint32_t max_socket_watts = DEFAULT_MAX_SOCKET_WATTS;
+static uint32_t deadband_watts = DEFAULT_DEADBAND_WATTS;
 
 int init( void )
 {
 	pthread_attr_t attr;
 	pthread_attr_t attr1;
 	verbose( "power_allocator: Power allocator DYNAMIC plugin loaded" );
+	_load_config();
 
 //	while (1){
 //		sleep (30);
@@ -93,6 +120,7 @@ int init( void )
 		return SLURM_ERROR;
 	}
 
+	power_pace_init(&allocator_pace);
 	slurm_attr_init( &attr );
 	/* since we do a join on this later we don't make it detached */
 	if (pthread_create( &powerallocator_thread, &attr, _get_allocator_dynamic_loop, NULL))
@@ -108,6 +136,7 @@ int init( void )
 		return SLURM_ERROR;
 	}
 
+	power_pace_init(&allocator_pace1);
 	slurm_attr_init( &attr1 );
 	/* since we do a join on this later we don't make it detached */
 	if (pthread_create( &powerallocator_thread1, &attr1, _get_allocator_dynamic_loop1, NULL))
@@ -125,6 +154,7 @@ void fini( void )
 		verbose( "Power allocator plugin shutting down" );
 		stop_get_allocator_dynamic_loop();
 		pthread_join( powerallocator_thread, NULL);
+		power_pace_destroy(&allocator_pace);
 		 powerallocator_thread = 0;
 	}
 	slurm_pthread_mutex_unlock( &thread_flag_mutex );
@@ -134,277 +164,384 @@ void fini( void )
 		verbose( "Power allocator plugin shutting down" );
 		stop_get_allocator_dynamic_loop1();
 		pthread_join( powerallocator_thread1, NULL);
+		power_pace_destroy(&allocator_pace1);
 		 powerallocator_thread1 = 0;
 	}
+	_free_state();
 	slurm_pthread_mutex_unlock( &thread_flag_mutex );
 	
 }
 
+/*
+ * Power history of a running job, carried from one node_power_schedule()
+ * pass to the next. The arrays are rings of the per node watts and
+ * performance (PMC0 count per sample) averaged over the job's nodes.
+ */
+typedef struct job_power_hist {
+	uint32_t job_id;
+	uint32_t sample_cnt;		/* samples ever added */
+	double watts[JOB_HIST_DEPTH];
+	double perf[JOB_HIST_DEPTH];
+	double weight;			/* smoothed power elasticity */
+} job_power_hist_t;
+
+/* Sorted by job_id, replaced on each pass */
+static job_power_hist_t *hist_array = NULL;
+static int hist_cnt = 0;
+
+/* Package cap per socket last pushed to each node, 0 if none */
+static uint32_t *node_caps = NULL;
+static int node_caps_cnt = 0;
+static uint32_t node_caps_gen = 0;	/* power_shed_generation() */
+
+/* Parse PowerParameters configuration */
+static void _load_config(void)
+{
+	char *power_params, *tmp_ptr;
+	long val;
+
+	power_params = slurm_get_power_parameters();
+	if (!power_params)
+		power_params = xmalloc(1);	/* Set defaults below */
+
+	min_socket_watts = DEFAULT_MIN_SOCKET_WATTS;
+	/*                                   12345678901234567890 */
+	if ((tmp_ptr = strstr(power_params, "dynamic_min_watts="))) {
+		val = strtol(tmp_ptr + 18, NULL, 10);
+		if (val < 1)
+			error("PowerParameters: dynamic_min_watts=%ld invalid",
+			      val);
+		else
+			min_socket_watts = val;
+	}
+	max_socket_watts = DEFAULT_MAX_SOCKET_WATTS;
+	if ((tmp_ptr = strstr(power_params, "dynamic_max_watts="))) {
+		val = strtol(tmp_ptr + 18, NULL, 10);
+		if (val < min_socket_watts)
+			error("PowerParameters: dynamic_max_watts=%ld invalid",
+			      val);
+		else
+			max_socket_watts = val;
+	}
+	if (max_socket_watts < min_socket_watts)
+		max_socket_watts = min_socket_watts;
+	deadband_watts = DEFAULT_DEADBAND_WATTS;
+	if ((tmp_ptr = strstr(power_params, "dynamic_deadband="))) {
+		val = strtol(tmp_ptr + 17, NULL, 10);
+		if (val < 0)
+			error("PowerParameters: dynamic_deadband=%ld invalid",
+			      val);
+		else
+			deadband_watts = val;
+	}
+	xfree(power_params);
+}
+
+static int _hist_cmp(const void *x, const void *y)
+{
+	const job_power_hist_t *h1 = x, *h2 = y;
+
+	if (h1->job_id < h2->job_id)
+		return -1;
+	return (h1->job_id > h2->job_id);
+}
+
+static uint16_t _node_sockets(struct node_record *node_ptr)
+{
+	uint16_t sockets;
+
+	if (slurmctld_conf.fast_schedule)
+		sockets = node_ptr->config_ptr->sockets;
+	else
+		sockets = node_ptr->sockets;
+	return MAX(sockets, 1);
+}
+
+/* DRAM watts of a node in a sweep, zero if the node was not sampled */
+static uint32_t _node_dram_watts(power_sweep_t *sweep, int node_inx)
+{
+	power_node_sample_t *sample = &sweep->samples[node_inx];
+	uint32_t watts = 0;
+	int k;
+
+	if (!sample->power)
+		return 0;
+	for (k = 0; k < sample->socket_cnt; k++)
+		watts += sample->power[k].dram_current_watts;
+	return watts;
+}
+
+/*
+ * Add this pass' sample of a job to its history and return its updated
+ * power elasticity estimate
+ */
+static double _job_hist_update(job_power_hist_t *hist, double watts,
+			       double perf)
+{
+	double est;
+	int cnt;
+
+	if ((watts > 0.0) && (perf > 0.0)) {
+		hist->watts[hist->sample_cnt % JOB_HIST_DEPTH] = watts;
+		hist->perf[hist->sample_cnt % JOB_HIST_DEPTH] = perf;
+		hist->sample_cnt++;
+	}
+	cnt = MIN(hist->sample_cnt, JOB_HIST_DEPTH);
+	est = power_solver_elasticity(hist->watts, hist->perf, cnt,
+				      hist->weight);
+	hist->weight = (hist->weight + est) / 2.0;
+	return hist->weight;
+}
+
+/*
+ * Watts the running jobs may share: PowerBudget less what the nodes
+ * without jobs last drew
+ */
+static uint64_t _job_budget(bitstr_t *run_bitmap)
+{
+	power_telemetry_sample_t sample;
+	uint64_t idle_watts = 0;
+	int i;
+
+	for (i = 0; i < node_record_count; i++) {
+		if (bit_test(run_bitmap, i) ||
+		    (power_telemetry_latest(i, &sample) != SLURM_SUCCESS))
+			continue;
+		idle_watts += power_telemetry_sample_watts(&sample);
+	}
+	if (idle_watts >= slurmctld_conf.z_32)
+		return 0;
+	return slurmctld_conf.z_32 - idle_watts;
+}
+
+/*
+ * Split PowerBudget between the running jobs in proportion to their
+ * measured power elasticity (see power_solver.h), then push the package
+ * caps which moved by at least the dead band. The solver hands out node
+ * watts, packages plus DRAM. DRAM cannot be capped, so each node's
+ * measured DRAM watts come off its share before the rest is split into
+ * package caps.
+ */
 static void node_power_schedule(void)
 {
-	debug ("Dummy inside node_power_schedule");
+	/* Locks: Read job, read node */
+	slurmctld_lock_t job_read_lock = {
+		NO_LOCK, READ_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
 	ListIterator job_iterator;
-	struct job_record *job_ptr = NULL;	
-
-	struct node_record *node_ptr;
-	int i, j, k, count, first, last;
-	power_current_data_t *powers;
-	cache_ref_t *caches;
-	int **power_consumption_value_pkg;
-	int **power_consumption_value_dram;
-	int **PMC0;
-	int **PMC1;
-	int sum_pkg, sum_dram, sum_PMC0, sum_PMC1;
-	int number_of_node;	
-	int counter;
-	int counter1, counter2;
-	uint16_t  socket_cnt, socket_number;	
-	char *node_name[1024];	
-	int *cap_values[2];
-	float perf_function;
-	
-	float avg_pkg, avg_dram, avg_PMC0, avg_PMC1;
-	
+	struct job_record *job_ptr = NULL, **job_ptrs;
+	power_sweep_t *sweep;
+	power_node_sample_t *sample;
+	power_solver_job_t *solver_jobs;
+	job_power_hist_t *new_hist, *hist, key;
+	bitstr_t *run_bitmap = NULL, *push_bitmap;
+	uint64_t budget, sum_watts, sum_dram, sum_perf, allocated;
+	uint32_t cap, dram, watts;
+	uint16_t sockets;
+	int i, j, k, first, last, job_cnt = 0, sampled, push_cnt = 0;
+	DEF_TIMERS;
+
+	/* Collect every running job's nodes in one sweep */
+	lock_slurmctld(job_read_lock);
 	job_iterator = list_iterator_create(job_list);
-
-	debug ("Dummy inside node_power_schedule 2");
-	
 	while ((job_ptr = (struct job_record *) list_next(job_iterator))) {
-		
-		debug ("Dummy inside node_power_schedule 3");
-		//Name of Nodes allocated for this job is job_ptr->nodes
-		//Number of Nodes allocated for this job is job_ptr->node_cnt
-		// bitstr_t *node_bitmap;		/* bitmap of nodes allocated to job */
-	
-		sum_pkg = 0;
-		sum_dram = 0;
-		sum_PMC0 = 0;
-		sum_PMC1 = 0 ;
-
-		count = 0;
-		counter1= 0;
-		counter2 = 0;
-		
-		if (job_ptr->node_bitmap == NULL) break;
-		first = bit_ffs(job_ptr->node_bitmap);	
+		if (!IS_JOB_RUNNING(job_ptr) || !job_ptr->node_bitmap)
+			continue;
+		if (!run_bitmap)
+			run_bitmap = bit_copy(job_ptr->node_bitmap);
+		else
+			bit_or(run_bitmap, job_ptr->node_bitmap);
+	}
+	list_iterator_destroy(job_iterator);
+	unlock_slurmctld(job_read_lock);
+	if (!run_bitmap)
+		return;
+
+	sweep = power_collect_sweep(run_bitmap,
+				    POWER_COLLECT_POWER | POWER_COLLECT_CACHE,
+				    0);
+	power_collect_store(sweep);
+
+	lock_slurmctld(job_read_lock);
+	job_ptrs = xmalloc(sizeof(struct job_record *) *
+			   (list_count(job_list) + 1));
+	job_iterator = list_iterator_create(job_list);
+	while ((job_ptr = (struct job_record *) list_next(job_iterator))) {
+		if (IS_JOB_RUNNING(job_ptr) && job_ptr->node_bitmap &&
+		    (bit_size(job_ptr->node_bitmap) == sweep->node_cnt) &&
+		    (bit_ffs(job_ptr->node_bitmap) >= 0))
+			job_ptrs[job_cnt++] = job_ptr;
+	}
+	list_iterator_destroy(job_iterator);
+
+	solver_jobs = xmalloc(sizeof(power_solver_job_t) * (job_cnt + 1));
+	new_hist = xmalloc(sizeof(job_power_hist_t) * (job_cnt + 1));
+	for (j = 0; j < job_cnt; j++) {
+		job_ptr = job_ptrs[j];
+		key.job_id = job_ptr->job_id;
+		hist = hist_cnt ? bsearch(&key, hist_array, hist_cnt,
+					  sizeof(job_power_hist_t),
+					  _hist_cmp) : NULL;
+		if (hist) {
+			new_hist[j] = *hist;
+		} else {
+			new_hist[j].job_id = job_ptr->job_id;
+			new_hist[j].weight = DEFAULT_ELASTICITY;
+		}
+
+		/* per node averages of the job's sampled nodes */
+		sum_watts = sum_dram = sum_perf = 0;
+		sampled = 0;
+		first = bit_ffs(job_ptr->node_bitmap);
 		last = bit_fls(job_ptr->node_bitmap);
-		
-		//Get node names for the job
+		sockets = _node_sockets(node_record_table_ptr + first);
 		for (i = first; i <= last; i++) {
-			if (bit_test(job_ptr->node_bitmap, i) == 1){
-				node_name[count] = node_record_table_ptr[i].name;
-				debug("BIT_SET NODE NAME IS %s", node_name[count]);
-				count = count +1;	
-			}
+			if (!bit_test(job_ptr->node_bitmap, i))
+				continue;
+			sample = &sweep->samples[i];
+			if (!sample->power || !sample->cache)
+				continue;
+			sum_watts += power_sweep_node_watts(sweep, i);
+			sum_dram += _node_dram_watts(sweep, i);
+			for (k = 0; k < sample->cache_socket_cnt; k++)
+				sum_perf += sample->cache[k].all_cache_ref;
+			sampled++;
 		}
-		
-		debug ("Dummy inside node_power_schedule 4");
-		
-		//Get number of nodes
-		  number_of_node =  bit_set_count(job_ptr->node_bitmap);
-		  debug ("Number of node %d", number_of_node);
-		//or  number_of_node = job_ptr->node_cnt
-			debug ("Dummy inside node_power_schedule 4.5");
-		
-		/* Locks: Read nodes */
-        slurmctld_lock_t node_read_lock = {
-            NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
-        /* Locks: Write nodes */
-        slurmctld_lock_t node_write_lock = {
-            NO_LOCK, WRITE_LOCK, NO_LOCK, NO_LOCK };
-							
-		for(i=0, node_ptr = node_record_table_ptr;
-	    i<node_record_count; i++, node_ptr++){
-				debug ("Dummy inside node_power_schedule 4.6");		
-			if (slurm_get_node_power(node_ptr->name, &socket_cnt, &powers)) {
-				debug ("Dummy inside node_power_schedule 4.75");
-				debug ("Dummy inside node_power_schedule 5");
-				debug("_get_node_power_task: can't get info from slurmd(NODE : %s)", node_ptr->name);
-			}else{				
-				socket_number = socket_cnt;
-				debug("socket_number", socket_number);				
-				for (j=0; j < number_of_node; j++) {
-					debug ("Dummy inside node_power_schedule 5.1");				 
-					 if (strcmp(node_name[j], node_ptr->name) == 0){
-						 counter1 = counter1 + 1;
-						 debug ("Dummy inside node_power_schedule 6");
-						 debug ("counter1 =  %d", counter1);
-						 for(k=0;k<socket_cnt;k++){
-							sum_pkg = sum_pkg + powers[k].cpu_current_watts;
-							sum_dram = sum_dram + powers[k].dram_current_watts;
-							debug ("sum_pkg =  %d", sum_pkg);
-							debug ("sum_dram =  %d", sum_dram);
-						 }				   
-					 }
-				 }		
-				xfree(powers);
-				powers = NULL;
-				debug ("Dummy inside node_power_schedule 6.4");
-				lock_slurmctld(node_write_lock);
-				debug ("Dummy inside node_power_schedule 6.5");
-				unlock_slurmctld(node_write_lock);	
-				debug ("Dummy inside node_power_schedule 7");
-			}	
-		   		
-		    if (slurm_get_cache(node_ptr->name, &socket_cnt, &caches)) {
-				debug("_get_cache: can't get info from slurmd(NODE : %s)", node_ptr->name);
-						 debug ("Dummy inside node_power_schedule 7");
-						 debug ("counter2 =  %d", counter2);
-			}else{				
-				 for (j=0; j < number_of_node; j++) {
-
-					 if (strcmp(node_name[j], node_ptr->name) == 0){
-						counter2 = counter2 + 1;
-						for(k=0;k<socket_cnt;k++){
-							
-							sum_PMC0 = sum_PMC0 +  caches[k].all_cache_ref;
-							sum_PMC1 = sum_PMC1 +  caches[k].l1_miss;
-
-							debug ("sum_PMC0 =  %d", sum_PMC0);
-							debug ("sum_PMC1 =  %d", sum_PMC1);							
-							//power_PMC0[j][k] = (int) caches[k].all_cache_ref;
-							//power_PMC1[j][k] = (int) caches[k].l1_miss;						 
-						}		 
-						
-					 }
-				 }				 
-					debug ("Dummy inside node_power_schedule 8");
-				xfree(caches);
-				caches = NULL;
-				lock_slurmctld(node_write_lock);
-
-				unlock_slurmctld(node_write_lock);	
-			}
-			debug ("Dummy inside node_power_schedule 9");
+		solver_jobs[j].node_cnt = bit_set_count(job_ptr->node_bitmap);
+		dram = sampled ? sum_dram / sampled : 0;
+		solver_jobs[j].min_watts = min_socket_watts * sockets + dram;
+		solver_jobs[j].max_watts = max_socket_watts * sockets + dram;
+		solver_jobs[j].weight = _job_hist_update(&new_hist[j],
+			sampled ? (double) sum_watts / sampled : 0.0,
+			sampled ? (double) sum_perf / sampled : 0.0);
+	}
+
+	START_TIMER;
+	budget = _job_budget(run_bitmap);
+	allocated = power_solver_waterfill(solver_jobs, job_cnt, budget);
+	END_TIMER;
+	debug("node_power_schedule: %d jobs, %"PRIu64" of %"PRIu64" W "
+	      "allocated in %ld usec", job_cnt, allocated, budget,
+	      DELTA_TIMER);
+
+	/* collect the nodes whose cap moved */
+	if (node_caps_gen != power_shed_generation()) {
+		/* a shed overwrote caps, push them all again */
+		node_caps_gen = power_shed_generation();
+		node_caps_cnt = 0;
+	}
+	if (node_caps_cnt != sweep->node_cnt) {
+		xfree(node_caps);
+		node_caps_cnt = sweep->node_cnt;
+		node_caps = xmalloc(sizeof(uint32_t) * (node_caps_cnt + 1));
+	}
+	push_bitmap = bit_alloc(sweep->node_cnt);
+	for (j = 0; j < job_cnt; j++) {
+		job_ptr = job_ptrs[j];
+		first = bit_ffs(job_ptr->node_bitmap);
+		last = bit_fls(job_ptr->node_bitmap);
+		for (i = first; i <= last; i++) {
+			if (!bit_test(job_ptr->node_bitmap, i))
+				continue;
+			sockets = _node_sockets(node_record_table_ptr + i);
+			dram = _node_dram_watts(sweep, i);
+			watts = solver_jobs[j].watts;
+			if (watts > dram + min_socket_watts * sockets)
+				cap = (watts - dram) / sockets;
+			else
+				cap = min_socket_watts;
+			if (node_caps[i] &&
+			    (cap + deadband_watts >= node_caps[i]) &&
+			    (cap <= node_caps[i] + deadband_watts))
+				continue;
+			node_caps[i] = cap;
+			bit_set(push_bitmap, i);
+			push_cnt++;
 		}
-		
-		//All have same socket_number (normally 2)
-		debug ("Dummy inside node_power_schedule 10");
-		avg_pkg = sum_pkg / counter1 / socket_number;
-		debug ("Avg_pkg is %f", avg_pkg );	
-		avg_dram = sum_dram / counter1 / socket_number;
-		debug ("Avg_dram is %f", avg_dram );	
-		avg_PMC0 = sum_PMC0 / counter2/ socket_number;
-		debug ("Avg_PMC0 is %f", avg_PMC0 );
-		avg_PMC1 = sum_PMC1 / counter2/ socket_number;
-		debug ("Avg_PMC1 is %f", avg_PMC1 );
-		perf_function = 0.1 * avg_pkg + 0.3  * avg_dram + 0.5 * avg_PMC0 + 0.7 * avg_PMC1;
-		
-		debug("****************************");
-		debug("****************************");
-		debug("****************************");
-		debug("%f", perf_function);
-		debug("****************************");
-		debug("****************************");
-		debug("****************************");
-		cap_values[0] = (int) perf_function;
-		cap_values[1] = (int) perf_function;
-	
-		slurm_set_power_cap2(cap_values, node_name,number_of_node);
-		debug ("Finish node_power_schedule" );
 	}
-	
-    list_iterator_destroy(job_iterator);	
-}	
+	unlock_slurmctld(job_read_lock);
+
+	/* keep the history of the running jobs only */
+	qsort(new_hist, job_cnt, sizeof(job_power_hist_t), _hist_cmp);
+	xfree(hist_array);
+	hist_array = new_hist;
+	hist_cnt = job_cnt;
+	xfree(job_ptrs);
+	xfree(solver_jobs);
+	FREE_NULL_BITMAP(run_bitmap);
+	power_sweep_free(sweep);
+
+	/* Push the caps with no locks held, one message for every node */
+	debug2("node_power_schedule: %d node caps changed", push_cnt);
+	if (push_cnt)
+		power_collect_set_caps(push_bitmap, node_caps, NULL, 0, NULL);
+	FREE_NULL_BITMAP(push_bitmap);
+}
+
+/* Free the state of node_power_schedule(), its thread must have exited */
+static void _free_state(void)
+{
+	xfree(hist_array);
+	hist_cnt = 0;
+	xfree(node_caps);
+	node_caps_cnt = 0;
+}
 
 static void *_get_allocator_dynamic_loop(void){
-	while(1){
+	do {
 		node_power_schedule();
-		//sleep(30);
-		sleep (slurmctld_conf.power_allocatorinterval);
-	}
+	} while (power_pace_wait(&allocator_pace,
+			slurmctld_conf.power_allocatorinterval * 1000));
+	return NULL;
 }
 
 /* Terminate power thread */
 static void stop_get_allocator_dynamic_loop(void)
 {
-	slurm_mutex_lock(&thread_flag_mutex );
-//	stop_power = true;
-//	slurm_cond_signal(&term_cond);
-	slurm_mutex_unlock(&thread_flag_mutex );
+	power_pace_stop(&allocator_pace);
 }
 
 int power_allocator_p_do_power_safe(){
-	power_current_data_t *powers;
-	uint16_t  socket_cnt;
-	int i,j,k;
-	uint32_t sum;
-	sum = 0;
-	uint32_t sum1;
-	sum1 = 0;
+	power_sweep_t *sweep;
+	uint32_t sum1 = 0;
 	float percentage_dif;
-	struct node_record *node_ptr;
-	
-    /* Locks: Read nodes */
-    slurmctld_lock_t node_read_lock = {
-        NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
-    /* Locks: Write nodes */
-    slurmctld_lock_t node_write_lock = {
-        NO_LOCK, WRITE_LOCK, NO_LOCK, NO_LOCK };	
-//	while (1){				
-	for(i=0, node_ptr = node_record_table_ptr;
-	    i<node_record_count; i++, node_ptr++){
-		debug3(" PMON node name : %s",node_ptr->name);
-		if (slurm_get_node_power(node_ptr->name, &socket_cnt, &powers)) {
-			debug("_get_node_power_task: can't get info from slurmd(NODE : %s)", node_ptr->name);
-		}else{
-			for(k=0;k<socket_cnt;k++){	
-				sum =  sum + (uint32_t)((node_ptr->power_info->current_power+k)->dram_current_watts + (node_ptr->power_info->current_power+k)->cpu_current_watts);
-				debug(" power_consumption_value CPU is %d",(node_ptr->power_info->current_power+k)->cpu_current_watts);
-					
-				sum1 =  sum1 + powers[k].cpu_current_watts + powers[k].dram_current_watts;	
-				debug(" NOW power_consumption_value CPU is %d",powers[k].cpu_current_watts);				
-				debug(" NOW dram_consumption_value CPU is %d",powers[k].dram_current_watts);
-			 }
-			node_ptr->power_info->socket_cnt = socket_cnt;
-			lock_slurmctld(node_write_lock);
-			memcpy(node_ptr->power_info->current_power, powers, sizeof(power_current_data_t) * socket_cnt);			
-			unlock_slurmctld(node_write_lock);
-
-			xfree(powers);
-			powers = NULL;			
-	
-		}
-//		}			
-	}
-	
-	debug("Power alert is %d", slurmctld_conf.power_alert);
-	debug("Power usage is %d", sum1);
-	
-	
-	if (sum1 >slurmctld_conf.power_alert){
-		percentage_dif = ((float)sum1 /slurmctld_conf.power_alert)	*100;
-		printf ("Alert, power is %f%% of power budget \n", percentage_dif);
-	}
-	else {	
-		percentage_dif = ((float)sum1 /slurmctld_conf.power_alert)	*100;
-		printf ("NO Alert, power is %f%% of power budget \n", percentage_dif);
+	int i;
+
+	/* One parallel sweep of every node, no locks held while waiting */
+	sweep = power_collect_sweep(NULL, POWER_COLLECT_POWER, 0);
+	for (i = 0; i < sweep->node_cnt; i++)
+		sum1 += power_sweep_node_watts(sweep, i);
+	power_collect_store(sweep);
+	power_sweep_free(sweep);
+
+	if ((slurmctld_conf.power_alert == 0) ||
+	    (slurmctld_conf.power_alert == NO_VAL)) {
+		debug("Power usage is %u W", sum1);
+		return SLURM_SUCCESS;
 	}
+	percentage_dif = ((float) sum1 / slurmctld_conf.power_alert) * 100;
+	debug("Power usage is %u W, %.1f%% of PowerAlert %u W", sum1,
+	      percentage_dif, slurmctld_conf.power_alert);
 	return SLURM_SUCCESS;
 }
 
 
 static void *_get_allocator_dynamic_loop1(void){
-	while(1){
+	do {
 		power_allocator_p_do_power_safe();
-		sleep(10);
-		//sleep (slurmctld_conf.power_allocatorinterval);
-	}
+	} while (power_pace_wait(&allocator_pace1, 10000));
+	return NULL;
 }
 
 /* Terminate power thread */
 static void stop_get_allocator_dynamic_loop1(void)
 {
-	slurm_mutex_lock(&thread_flag_mutex );
-//	stop_power = true;
-//	slurm_cond_signal(&term_cond);
-	slurm_mutex_unlock(&thread_flag_mutex );
+	power_pace_stop(&allocator_pace1);
 }
 
 
 int power_allocator_p_reconfig( void )
 {
-	//backfill_reconfig();
+	_load_config();
 	return SLURM_SUCCESS;
 }
 
@@ -486,7 +623,12 @@ int power_allocator_p_schedule(void)
 	return SLURM_SUCCESS;
 }
 
+/*
+ * Called by the shedding path (power_shed.c) after it overwrote caps. The
+ * next pass notices the new shed generation and pushes all its caps again.
+ */
 int power_allocator_p_alert(uint32_t current_power){
+	debug("power_allocator/dynamic: shed down to %u W", current_power);
 	return SLURM_SUCCESS;
 }
 
@@ -513,60 +655,3 @@ int power_allocator_p_job_suspend(struct job_record *job , bool i){
 int power_allocator_p_job_resume(struct job_record *job, bool i){
 	return SLURM_SUCCESS;
 }
-
-static void slurm_set_power_cap2(int *power_cap_value[], char *node_name[], int number_of_node)
-{
-	debug(" LINH: SET POWER CAP");
-
-	power_current_data_t *powers;
-	power_capping_data_t *powers_cap;
-	powers_cap = (power_capping_data_t*)malloc(sizeof(power_capping_data_t));
-
-	uint16_t  socket_cnt;
-	int i,j,k;
-	struct node_record *node_ptr;
-
-	/* Locks: Read nodes */
-    slurmctld_lock_t node_read_lock = {
-        NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
-    /* Locks: Write nodes */
-    slurmctld_lock_t node_write_lock = {
-        NO_LOCK, WRITE_LOCK, NO_LOCK, NO_LOCK };	
-					
-	debug(" LINH: node_record_count: %d", node_record_count);		
-	for(i=0, node_ptr = node_record_table_ptr;
-	    i<node_record_count; i++, node_ptr++){
-		debug3(" PMON node name : %s",node_ptr->name);
-		if (slurm_get_node_power(node_ptr->name, &socket_cnt, &powers)) {
-			debug("_get_node_power_task: can't get info from slurmd(NODE : %s)", node_ptr->name);
-		}else{		
-			//Check  whether node is called
-			debug3(" Get socket_cnt : %d",socket_cnt);
-			 for (j=0; j < number_of_node; j++) {
-				 debug(" LINH: ___Set power cap node PTR %s", node_ptr->name);
-				 debug(" LINH:  Set power cap node_name %s", node_name[j]);
-				 if (strcmp(node_name[j], node_ptr->name) == 0){
-					debug("Inside compare set power)");
-					debug("Before assign set power");
-					debug(" LINH: Before Set power cap node PTR %s", node_ptr->name);					
-					if (slurm_set_node_power4(node_ptr->name, power_cap_value[0], power_cap_value[1] )) 
-						debug("_get_node_power_task: can't get info from slurmd(NODE : %s)", node_ptr->name);							
-						debug("After assign of set power");
-				 }
-				debug("Outside if");		 
-			}
-			
-			debug("Socket is %d", socket_cnt);						
-			lock_slurmctld(node_write_lock);	
-			debug("before memcpy");
-			//memcpy(node_ptr->power_info->power_cap, powers_cap, sizeof(power_capping_data_t) * socket_cnt);			
-			debug("after memcpy");
-			unlock_slurmctld(node_write_lock);
-
-			xfree(powers);
-			free(powers_cap);
-			powers = NULL;	
-			powers_cap = NULL;
-		}
-	}
-}
\ No newline at end of file
@@ -0,0 +1,152 @@
+/*****************************************************************************\
+ *  power_solver.c - Budget-constrained power cap allocation across jobs
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include <math.h>
+
+#include "src/common/macros.h"
+#include "power_solver.h"
+
+#define WATERFILL_STEPS		64	/* bisection steps on the marginal */
+#define ELASTICITY_MIN_SPREAD	0.02	/* ln(watts) range needed to fit */
+
+/* Per node watts of a job for a marginal value lambda */
+static inline double _job_watts(power_solver_job_t *job, double lambda)
+{
+	double w = job->weight / lambda;
+
+	if (w < job->min_watts)
+		return job->min_watts;
+	if (w > job->max_watts)
+		return job->max_watts;
+	return w;
+}
+
+static double _total_watts(power_solver_job_t *jobs, int job_cnt,
+			   double lambda)
+{
+	double total = 0.0;
+	int i;
+
+	for (i = 0; i < job_cnt; i++)
+		total += _job_watts(&jobs[i], lambda) * jobs[i].node_cnt;
+	return total;
+}
+
+extern uint64_t power_solver_waterfill(power_solver_job_t *jobs, int job_cnt,
+				       uint64_t budget)
+{
+	double lo = 0.0, hi, mid, m, floor_sum = 0.0, ceil_sum = 0.0;
+	double weight_sum = 0.0;
+	uint64_t total = 0;
+	int i, step;
+
+	for (i = 0; i < job_cnt; i++) {
+		if (jobs[i].weight < POWER_SOLVER_MIN_WEIGHT)
+			jobs[i].weight = POWER_SOLVER_MIN_WEIGHT;
+		if (jobs[i].max_watts < jobs[i].min_watts)
+			jobs[i].max_watts = jobs[i].min_watts;
+		floor_sum += (double) jobs[i].min_watts * jobs[i].node_cnt;
+		ceil_sum += (double) jobs[i].max_watts * jobs[i].node_cnt;
+		weight_sum += jobs[i].weight * jobs[i].node_cnt;
+		/* below this marginal value every job is at its ceiling */
+		m = jobs[i].weight / MAX(jobs[i].max_watts, 1);
+		if ((lo == 0.0) || (m < lo))
+			lo = m;
+	}
+
+	if ((floor_sum >= budget) || (ceil_sum <= budget)) {
+		for (i = 0; i < job_cnt; i++) {
+			jobs[i].watts = (floor_sum >= budget) ?
+					jobs[i].min_watts : jobs[i].max_watts;
+			total += (uint64_t) jobs[i].watts * jobs[i].node_cnt;
+		}
+		return total;
+	}
+
+	/* the total is non increasing in lambda: find the smallest lambda
+	 * whose allocation fits. No job gets more than its floor plus
+	 * weight / lambda, so the total at hi is at most the budget. */
+	hi = weight_sum / ((double) budget - floor_sum);
+	for (step = 0; step < WATERFILL_STEPS; step++) {
+		mid = (lo + hi) / 2.0;
+		if (_total_watts(jobs, job_cnt, mid) > budget)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	for (i = 0; i < job_cnt; i++) {
+		jobs[i].watts = (uint32_t) floor(_job_watts(&jobs[i], hi));
+		total += (uint64_t) jobs[i].watts * jobs[i].node_cnt;
+	}
+	return total;
+}
+
+extern double power_solver_elasticity(const double *watts, const double *perf,
+				      int cnt, double prior)
+{
+	double x, y, sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+	double x_min = 0.0, x_max = 0.0, slope, var;
+	int i, n = 0;
+
+	for (i = 0; i < cnt; i++) {
+		if ((watts[i] <= 0.0) || (perf[i] <= 0.0))
+			continue;
+		x = log(watts[i]);
+		y = log(perf[i]);
+		if (!n || (x < x_min))
+			x_min = x;
+		if (!n || (x > x_max))
+			x_max = x;
+		sx += x;
+		sy += y;
+		sxx += x * x;
+		sxy += x * y;
+		n++;
+	}
+	if ((n < 3) || ((x_max - x_min) < ELASTICITY_MIN_SPREAD))
+		return prior;
+
+	var = sxx - sx * sx / n;
+	if (var <= 0.0)
+		return prior;
+	slope = (sxy - sx * sy / n) / var;
+	if (slope < POWER_SOLVER_MIN_WEIGHT)
+		return POWER_SOLVER_MIN_WEIGHT;
+	if (slope > 1.0)
+		return 1.0;
+	return slope;
+}
@@ -0,0 +1,84 @@
+/*****************************************************************************\
+ *  power_solver.h - Budget-constrained power cap allocation across jobs
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _POWER_SOLVER_H
+#define _POWER_SOLVER_H
+
+#include <inttypes.h>
+
+/*
+ * Each job is modeled as gaining weight * ln(watts) of relative
+ * performance per node, where weight is the job's power elasticity: the
+ * fraction by which its performance grows when its power grows by a given
+ * fraction. Memory bound jobs have a weight close to 0, compute bound jobs
+ * close to 1. Maximizing the sum over all nodes under a budget gives every
+ * job watts proportional to its weight, clamped to its range, which is
+ * found by water-filling on the common marginal value.
+ */
+typedef struct power_solver_job {
+	uint32_t node_cnt;	/* nodes of the job */
+	double weight;		/* power elasticity of the job, > 0 */
+	uint32_t min_watts;	/* per node floor */
+	uint32_t max_watts;	/* per node ceiling, >= min_watts */
+	uint32_t watts;		/* OUT: per node allocation */
+} power_solver_job_t;
+
+/*
+ * power_solver_waterfill - split a power budget between jobs
+ * IN/OUT jobs - the jobs, their watts field is set
+ * IN job_cnt - entries in jobs
+ * IN budget - watts available to all the nodes of all the jobs
+ * RET watts allocated, which is at most budget unless the budget is below
+ *	the sum of the floors, in which case every job gets its floor
+ * NOTE: O(job_cnt) per bisection step, with a fixed number of steps
+ */
+extern uint64_t power_solver_waterfill(power_solver_job_t *jobs, int job_cnt,
+				       uint64_t budget);
+
+/*
+ * power_solver_elasticity - estimate the power elasticity of a job from
+ *	samples of its per node watts and performance, as the least squares
+ *	slope of ln(perf) against ln(watts)
+ * IN watts, perf - cnt samples each, non positive samples are skipped
+ * IN prior - value to return if the watts did not vary enough to tell
+ * RET the elasticity, within [POWER_SOLVER_MIN_WEIGHT, 1]
+ */
+#define POWER_SOLVER_MIN_WEIGHT	0.05
+extern double power_solver_elasticity(const double *watts, const double *perf,
+				      int cnt, double prior);
+
+#endif /* !_POWER_SOLVER_H */
@@ -44,12 +44,16 @@
 #include "src/common/log.h"
 #include "src/common/slurm_priority.h"
 #include "src/common/macros.h"
+#include "src/common/xmalloc.h"
 #include "src/slurmctld/slurmctld.h"
 #include "slurm/slurm.h"
 
 #define CPU_POWER 70 
 #define Number_of_Socket 2
 #include "src/slurmctld/locks.h"
+#include "src/slurmctld/power_budget.h"
+#include "src/slurmctld/power_collect.h"
+#include "src/slurmctld/power_shed.h"
 
 
 const char		plugin_name[]	= "SLURM Power Allocator plugin";
@@ -61,7 +65,13 @@ static int plugin_errno = SLURM_SUCCESS;
 
 static pthread_t powerallocator_thread = 0;
 static pthread_mutex_t thread_flag_mutex = PTHREAD_MUTEX_INITIALIZER;
+static power_pace_t allocator_pace;
 
+/* caps last pushed from the power budget, indexed like
+ * node_record_table_ptr */
+static uint32_t *budget_caps = NULL;
+static int budget_cap_cnt = 0;
+static uint32_t budget_shed_gen = 0;	/* power_shed_generation() */
 
 static void *_get_allocator_linear_loop(void);
 
@@ -83,6 +93,7 @@ int init( void )
 		return SLURM_ERROR;
 	}	
 	
+	power_pace_init(&allocator_pace);
 	slurm_attr_init( &attr );
 	/* since we do a join on this later we don't make it detached */
 	if (pthread_create( &powerallocator_thread, &attr, _get_allocator_linear_loop, NULL))
@@ -101,94 +112,115 @@ void fini( void )
 		verbose( "Power allocator plugin shutting down" );
 		stop_get_allocator_linear_loop();
 		pthread_join( powerallocator_thread, NULL);
+		power_pace_destroy(&allocator_pace);
 		powerallocator_thread = 0;
 	}
+	xfree(budget_caps);
+	budget_cap_cnt = 0;
 	slurm_pthread_mutex_unlock( &thread_flag_mutex );
 	
 }
 
 
-int power_allocator_p_do_power_safe(){
-	power_current_data_t *powers;
-	uint16_t  socket_cnt;
-	int i,j,k;
-	uint32_t sum;
-	sum = 0;
-	
-	uint32_t sum1;
-	sum1 = 0;
-	
-	float percentage_dif;
-	
+/*
+ * Split the LimitWatts of the racks and PDUs of the power layout between
+ * their nodes and push the package caps which changed since the last
+ * pass, all of them in one message through the forwarding tree.
+ */
+static void _push_budget_caps(void)
+{
+	/* Locks: Read job, read node */
+	slurmctld_lock_t job_node_read_lock = {
+		NO_LOCK, READ_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
 	struct node_record *node_ptr;
-	
-    /* Locks: Read nodes */
-    slurmctld_lock_t node_read_lock = {
-        NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
-    /* Locks: Write nodes */
-    slurmctld_lock_t node_write_lock = {
-        NO_LOCK, WRITE_LOCK, NO_LOCK, NO_LOCK };	
-//	while (1){				
-	for(i=0, node_ptr = node_record_table_ptr;
-	    i<node_record_count; i++, node_ptr++){
-		debug3(" PMON node name : %s",node_ptr->name);
-		if (slurm_get_node_power(node_ptr->name, &socket_cnt, &powers)) {
-			debug("_get_node_power_task: can't get info from slurmd(NODE : %s)", node_ptr->name);
-		}else{
-			for(k=0;k<socket_cnt;k++){	
-					sum =  sum + (uint32_t)((node_ptr->power_info->current_power+k)->dram_current_watts + (node_ptr->power_info->current_power+k)->cpu_current_watts);
-					debug(" power_consumption_value CPU is %d",(node_ptr->power_info->current_power+k)->cpu_current_watts);
-					
-					sum1 =  sum1 + powers[k].cpu_current_watts + powers[k].dram_current_watts;
-					
-					debug(" NOW power_consumption_value CPU is %d",powers[k].cpu_current_watts);
-					
-					
-					debug(" NOW dram_consumption_value CPU is %d",powers[k].dram_current_watts);
-			 }
-			node_ptr->power_info->socket_cnt = socket_cnt;
-			lock_slurmctld(node_write_lock);
-			memcpy(node_ptr->power_info->current_power, powers, sizeof(power_current_data_t) * socket_cnt);			
-			unlock_slurmctld(node_write_lock);
-
-			xfree(powers);
-			powers = NULL;			
-	
-		}
-//		}			
+	bitstr_t *push_bitmap;
+	uint32_t *caps, *socket_caps;
+	uint16_t sockets;
+	int i, push_cnt;
+
+	lock_slurmctld(job_node_read_lock);
+	power_budget_refresh();
+	caps = xmalloc(sizeof(uint32_t) * (node_record_count + 1));
+	if (power_budget_node_caps(caps) == 0) {
+		unlock_slurmctld(job_node_read_lock);
+		xfree(caps);
+		return;
 	}
-	
-	debug("Power alert is %d", slurmctld_conf.power_alert);
-	debug("Power usage is %d", sum1);
-	
-	
-	if (sum1 >slurmctld_conf.power_alert){
-		percentage_dif = ((float)sum1 /slurmctld_conf.power_alert)	*100;
-		printf ("Alert, power is %f%% of power budget \n", percentage_dif);
+	if (budget_shed_gen != power_shed_generation()) {
+		/* a shed overwrote caps, push them all again */
+		budget_shed_gen = power_shed_generation();
+		budget_cap_cnt = 0;
+	}
+	if (budget_cap_cnt != node_record_count) {
+		xfree(budget_caps);
+		budget_cap_cnt = node_record_count;
+		budget_caps = xmalloc(sizeof(uint32_t) * (budget_cap_cnt + 1));
+	}
+	socket_caps = xmalloc(sizeof(uint32_t) * (node_record_count + 1));
+	push_bitmap = bit_alloc(node_record_count);
+	for (i = 0, node_ptr = node_record_table_ptr; i < node_record_count;
+	     i++, node_ptr++) {
+		if (!caps[i] || (caps[i] == budget_caps[i]))
+			continue;
+		budget_caps[i] = caps[i];
+		if (slurmctld_conf.fast_schedule)
+			sockets = node_ptr->config_ptr->sockets;
+		else
+			sockets = node_ptr->sockets;
+		socket_caps[i] = caps[i] / MAX(sockets, 1);
+		bit_set(push_bitmap, i);
 	}
-	else {	
-		percentage_dif = ((float)sum1 /slurmctld_conf.power_alert)	*100;
-		printf ("NO Alert, power is %f%% of power budget \n", percentage_dif);
+	unlock_slurmctld(job_node_read_lock);
+	xfree(caps);
+
+	push_cnt = bit_set_count(push_bitmap);
+	if (push_cnt) {
+		debug("power_allocator/linear: budget caps changed on %d nodes",
+		      push_cnt);
+		power_collect_set_caps(push_bitmap, socket_caps, NULL, 0,
+				       NULL);
+	}
+	FREE_NULL_BITMAP(push_bitmap);
+	xfree(socket_caps);
+}
+
+int power_allocator_p_do_power_safe(){
+	power_sweep_t *sweep;
+	uint32_t sum1 = 0;
+	float percentage_dif;
+	int i;
+
+	/* One parallel sweep of every node, no locks held while waiting */
+	sweep = power_collect_sweep(NULL, POWER_COLLECT_POWER, 0);
+	for (i = 0; i < sweep->node_cnt; i++)
+		sum1 += power_sweep_node_watts(sweep, i);
+	power_collect_store(sweep);
+	power_sweep_free(sweep);
+	_push_budget_caps();
+
+	if ((slurmctld_conf.power_alert == 0) ||
+	    (slurmctld_conf.power_alert == NO_VAL)) {
+		debug("Power usage is %u W", sum1);
+		return SLURM_SUCCESS;
 	}
+	percentage_dif = ((float) sum1 / slurmctld_conf.power_alert) * 100;
+	debug("Power usage is %u W, %.1f%% of PowerAlert %u W", sum1,
+	      percentage_dif, slurmctld_conf.power_alert);
 	return SLURM_SUCCESS;
 }
 
 
 static void *_get_allocator_linear_loop(void){
-	while(1){
+	do {
 		power_allocator_p_do_power_safe();
-		sleep(10);
-		//sleep (slurmctld_conf.power_allocatorinterval);
-	}
+	} while (power_pace_wait(&allocator_pace, 10000));
+	return NULL;
 }
 
 /* Terminate power thread */
 static void stop_get_allocator_linear_loop(void)
 {
-	slurm_mutex_lock(&thread_flag_mutex );
-//	stop_power = true;
-//	slurm_cond_signal(&term_cond);
-	slurm_mutex_unlock(&thread_flag_mutex );
+	power_pace_stop(&allocator_pace);
 }
 
 
@@ -204,8 +236,9 @@ int power_allocator_p_job_test_power(struct job_record *job_ptr, bitstr_t *bitma
 			uint32_t cpu_cap, uint32_t dram_cap, uint32_t frequency, 
 			uint32_t job_power)
 {
-	//slurmctld_conf.z_32: power_budget
-	uint32_t power_of_nodes;
+	/* LimitWatts of every rack and PDU above the nodes, see
+	 * power_budget.h */
+	return power_budget_job_test(job_ptr, bitmap);
 }
 	
 	
@@ -282,7 +315,12 @@ int power_allocator_p_schedule(void)
 	return SLURM_SUCCESS;
 }
 
+/*
+ * Called by the shedding path (power_shed.c) after it overwrote caps. The
+ * next pass notices the new shed generation and pushes all its caps again.
+ */
 int power_allocator_p_alert(uint32_t current_power){
+	debug("power_allocator/linear: shed down to %u W", current_power);
 	return SLURM_SUCCESS;
 }
 
@@ -47,6 +47,7 @@
 #include "src/slurmctld/slurmctld.h"
 
 #include "src/slurmctld/locks.h"
+#include "src/slurmctld/power_collect.h"
 #define Number_of_Socket 2
 const char		plugin_name[]	= "SLURM Power Allocator plugin";
 const char		plugin_type[]	= "power_allocator/none";
@@ -57,6 +58,7 @@ static int plugin_errno = SLURM_SUCCESS;
 
 static pthread_t powerallocator_thread = 0;
 static pthread_mutex_t thread_flag_mutex = PTHREAD_MUTEX_INITIALIZER;
+static power_pace_t allocator_pace;
 
 
 static void *_get_allocator_none_loop(void);
@@ -86,6 +88,7 @@ int init( void )
 		return SLURM_ERROR;
 	}
 
+	power_pace_init(&allocator_pace);
 	slurm_attr_init( &attr );
 	/* since we do a join on this later we don't make it detached */
 	//if (pthread_create( &backfill_thread, &attr, backfill_agent, NULL))
@@ -117,6 +120,7 @@ void fini( void )
 		verbose( "Power allocator plugin shutting down" );
 		stop_get_allocator_none_loop();
 		pthread_join( powerallocator_thread, NULL);
+		power_pace_destroy(&allocator_pace);
 		 powerallocator_thread = 0;
 	}
 	slurm_pthread_mutex_unlock( &thread_flag_mutex );
@@ -189,20 +193,16 @@ int power_allocator_p_do_power_safe(){
 }
 
 static void *_get_allocator_none_loop(void){
-	while(1){
+	do {
 		power_allocator_p_do_power_safe();
-		sleep(10);
-		//sleep (slurmctld_conf.power_allocatorinterval);
-	}
+	} while (power_pace_wait(&allocator_pace, 10000));
+	return NULL;
 }
 
 /* Terminate power thread */
 static void stop_get_allocator_none_loop(void)
 {
-	slurm_mutex_lock(&thread_flag_mutex );
-//	stop_power = true;
-//	slurm_cond_signal(&term_cond);
-	slurm_mutex_unlock(&thread_flag_mutex );
+	power_pace_stop(&allocator_pace);
 }
 
 
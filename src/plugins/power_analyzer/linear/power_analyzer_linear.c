@@ -1,5 +1,5 @@
 /*****************************************************************************\
- *  power_analyzer_none.c - power analyzer plugin for none
+ *  power_analyzer_linear.c - power analyzer plugin for linear
  *****************************************************************************
  *  Copyright (C) "The PomPP research team" supported by the JST, 
  *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
@@ -35,23 +35,34 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
 \*****************************************************************************/
 
+#include <math.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
+#include "slurm/slurm.h"
 #include "slurm/slurm_errno.h"
 
-#include "src/common/plugin.h"
+#include "src/common/bitstring.h"
 #include "src/common/log.h"
-#include "src/common/slurm_priority.h"
 #include "src/common/macros.h"
+#include "src/common/plugin.h"
+#include "src/common/read_config.h"
+#include "src/common/xmalloc.h"
+#include "src/slurmctld/locks.h"
+#include "src/slurmctld/power_analyzer_plugin.h"
+#include "src/slurmctld/power_collect.h"
+#include "src/slurmctld/power_telemetry.h"
 #include "src/slurmctld/slurmctld.h"
-#include "slurm/slurm.h"
 
+#include "power_model.h"
+
+/* Closed form fallback for jobs the model has not seen */
 #define MaxCPUPower 130
 #define MinCpuPower 51
 #define Number_of_Socket 2
-#include "src/slurmctld/locks.h"
 
 const char		plugin_name[]	= "SLURM Power Analyzer plugin";
 const char		plugin_type[]	= "power_analyzer/linear";
@@ -62,10 +73,30 @@ static int plugin_errno = SLURM_SUCCESS;
 
 static pthread_t poweranalyzer_thread = 0;
 static pthread_mutex_t thread_flag_mutex = PTHREAD_MUTEX_INITIALIZER;
+static power_pace_t analyzer_pace;
 
-static void *_get_analyzer_linear_loop(void);
+/*
+ * What the telemetry says about a running job, gathered every analyzer
+ * interval and folded into the model when the job ends. Sorted by job_id,
+ * replaced on each pass so that jobs which ended unseen drop out.
+ */
+typedef struct job_power_acc {
+	uint32_t job_id;
+	uint32_t sample_cnt;
+	double sum_watts;		/* mean node watts of each sample */
+	double peak_watts;
+	double sum_dram;
+	uint32_t freq_cnt;
+	double sum_freq;
+	uint32_t miss_cnt;
+	double sum_miss;
+} job_power_acc_t;
 
+static pthread_mutex_t acc_mutex = PTHREAD_MUTEX_INITIALIZER;
+static job_power_acc_t *acc_array = NULL;
+static int acc_cnt = 0;
 
+static void *_get_analyzer_linear_loop(void *arg);
 static void stop_get_analyzer_linear_loop(void);
 
 int init( void )
@@ -73,15 +104,16 @@ int init( void )
 	pthread_attr_t attr;
 
 	verbose( "power_analyzer: Power analyzer LINEAR plugin loaded" );
-	debug ("Hello from plugin LINEAR init");
+	power_model_restore();
 
 	slurm_mutex_lock( &thread_flag_mutex );
 	if ( poweranalyzer_thread ) {
 		debug2( "power analyzer thread already running, not starting another" );
 		slurm_mutex_unlock( &thread_flag_mutex );
 		return SLURM_ERROR;
-	}		
-	
+	}
+
+	power_pace_init(&analyzer_pace);
 	slurm_attr_init( &attr );
 	/* since we do a join on this later we don't make it detached */
 	if (pthread_create( &poweranalyzer_thread, &attr, _get_analyzer_linear_loop, NULL))
@@ -95,48 +127,223 @@ int init( void )
 void fini( void )
 {
 	verbose( "Power analyzer plugin shutting down" );
-	debug ("Goodbye from plugin fini");
-	
+
 	slurm_mutex_lock( &thread_flag_mutex );
 	if ( poweranalyzer_thread ) {
-		verbose( "Power analyzer plugin shutting down" );
 		stop_get_analyzer_linear_loop();
 		pthread_join( poweranalyzer_thread, NULL);
-		 poweranalyzer_thread = 0;
+		power_pace_destroy(&analyzer_pace);
+		poweranalyzer_thread = 0;
 	}
-	slurm_pthread_mutex_unlock( &thread_flag_mutex );
+	slurm_mutex_unlock( &thread_flag_mutex );
+
+	power_model_save();
+	power_model_fini();
+	slurm_mutex_lock(&acc_mutex);
+	xfree(acc_array);
+	acc_cnt = 0;
+	slurm_mutex_unlock(&acc_mutex);
 }
 
+static int _acc_cmp(const void *x, const void *y)
+{
+	const job_power_acc_t *a1 = x, *a2 = y;
 
-void do_analysis_power_log(void)
+	if (a1->job_id < a2->job_id)
+		return -1;
+	if (a1->job_id > a2->job_id)
+		return 1;
+	return 0;
+}
+
+/* Call with acc_mutex held */
+static job_power_acc_t *_acc_find(uint32_t job_id)
 {
-	printf("do_analysis_power_log\n");	
+	job_power_acc_t key;
+
+	if (!acc_cnt)
+		return NULL;
+	key.job_id = job_id;
+	return bsearch(&key, acc_array, acc_cnt, sizeof(job_power_acc_t),
+		       _acc_cmp);
 }
 
-static void *_get_analyzer_linear_loop(void){
-	while(1){
-		sleep(slurmctld_conf.power_analyzerinterval);
-		debug3(" ************************");
-		debug3(" Start of power_analyzer");
-		do_analysis_power_log();
+/*
+ * Add one sample to a job: the mean over its nodes of the newest
+ * telemetry, skipping nodes whose readings are older than max_age.
+ */
+static void _acc_sample(job_power_acc_t *acc, struct job_record *job_ptr,
+			time_t max_age)
+{
+	power_telemetry_sample_t sample;
+	double watts = 0.0, dram = 0.0, freq = 0.0, miss = 0.0;
+	uint64_t refs = 0, l3 = 0;
+	int i, j, node_cnt = 0, freq_cnt = 0;
+
+	for (i = bit_ffs(job_ptr->node_bitmap);
+	     (i >= 0) && (i < node_record_count); i++) {
+		if (!bit_test(job_ptr->node_bitmap, i))
+			continue;
+		if ((power_telemetry_latest(i, &sample) != SLURM_SUCCESS) ||
+		    (sample.power_time < max_age))
+			continue;
+		node_cnt++;
+		watts += power_telemetry_sample_watts(&sample);
+		for (j = 0; j < sample.socket_cnt; j++) {
+			dram += sample.power[j].dram_current_watts;
+			if (sample.power[j].cpu_current_frequency) {
+				freq += sample.power[j].cpu_current_frequency;
+				freq_cnt++;
+			}
+		}
+		if (sample.cache_time >= max_age) {
+			for (j = 0; j < sample.cache_socket_cnt; j++) {
+				refs += sample.cache[j].all_cache_ref;
+				l3 += sample.cache[j].l3_miss;
+			}
+		}
+	}
+	if (!node_cnt)
+		return;
+
+	watts /= node_cnt;
+	acc->sample_cnt++;
+	acc->sum_watts += watts;
+	acc->peak_watts = MAX(acc->peak_watts, watts);
+	acc->sum_dram += dram / node_cnt;
+	if (freq_cnt) {
+		acc->freq_cnt++;
+		acc->sum_freq += freq / freq_cnt;
+	}
+	if (refs) {
+		miss = (double) l3 / (double) refs;
+		acc->miss_cnt++;
+		acc->sum_miss += MIN(miss, 1.0);
 	}
 }
 
+/* Sample every running job, then save the model if it changed */
+static void _analyze_pass(time_t now, uint32_t interval)
+{
+	/* Locks: Read job, read node */
+	slurmctld_lock_t job_read_lock = {
+		NO_LOCK, READ_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
+	struct job_record *job_ptr;
+	ListIterator job_iterator;
+	job_power_acc_t *new_acc, *acc;
+	int new_cnt = 0;
+
+	lock_slurmctld(job_read_lock);
+	slurm_mutex_lock(&acc_mutex);
+	new_acc = xmalloc(sizeof(job_power_acc_t) *
+			  (list_count(job_list) + 1));
+	job_iterator = list_iterator_create(job_list);
+	while ((job_ptr = (struct job_record *) list_next(job_iterator))) {
+		if (!IS_JOB_RUNNING(job_ptr) || !job_ptr->node_bitmap)
+			continue;
+		if ((acc = _acc_find(job_ptr->job_id))) {
+			new_acc[new_cnt] = *acc;
+		} else {
+			memset(&new_acc[new_cnt], 0, sizeof(job_power_acc_t));
+			new_acc[new_cnt].job_id = job_ptr->job_id;
+		}
+		_acc_sample(&new_acc[new_cnt], job_ptr, now - 2 * interval);
+		new_cnt++;
+	}
+	list_iterator_destroy(job_iterator);
+	qsort(new_acc, new_cnt, sizeof(job_power_acc_t), _acc_cmp);
+	xfree(acc_array);
+	acc_array = new_acc;
+	acc_cnt = new_cnt;
+	slurm_mutex_unlock(&acc_mutex);
+	unlock_slurmctld(job_read_lock);
+
+	power_model_save();
+}
+
+static uint32_t _interval(void)
+{
+	uint32_t interval = slurmctld_conf.power_analyzerinterval;
+
+	if ((interval == 0) || (interval == NO_VAL))
+		interval = DEFAULT_POWER_ANALYZER_INTERVAL;
+	return interval;
+}
+
+static void *_get_analyzer_linear_loop(void *arg)
+{
+	while (power_pace_wait(&analyzer_pace, _interval() * 1000))
+		_analyze_pass(time(NULL), _interval());
+	return NULL;
+}
+
 /* Terminate power thread */
 static void stop_get_analyzer_linear_loop(void)
 {
-	slurm_mutex_lock(&thread_flag_mutex );
-//	stop_power = true;
-//	slurm_cond_signal(&term_cond);
-	slurm_mutex_unlock(&thread_flag_mutex );
+	power_pace_stop(&analyzer_pace);
 }
 
 int power_analyzer_p_reconfig( void )
 {
-	//backfill_reconfig();
 	return SLURM_SUCCESS;
 }
 
+/* Node count an estimate is for */
+static uint32_t _est_node_cnt(struct job_record *job_ptr, bitstr_t *bitmap,
+			      uint32_t min_nodes, uint32_t req_nodes)
+{
+	uint32_t node_cnt = 0;
+
+	if (bitmap)
+		node_cnt = bit_set_count(bitmap);
+	if (!node_cnt)
+		node_cnt = req_nodes;
+	if (!node_cnt)
+		node_cnt = job_ptr->node_cnt;
+	if (!node_cnt && job_ptr->details)
+		node_cnt = job_ptr->details->min_nodes;
+	if (!node_cnt)
+		node_cnt = min_nodes;
+	return MAX(node_cnt, 1);
+}
+
+/*
+ * Relative run time of a profiled job under the constraints. The compute
+ * bound share of the job, estimated as one less its L3 miss ratio, slows
+ * down with the CPU frequency, which goes roughly as the square root of
+ * package power under a cap.
+ */
+static double _profile_slowdown(power_model_profile_t *p, uint32_t node_cnt,
+				uint32_t constraint_mode, uint32_t job_limit,
+				uint32_t cpu_cap, uint32_t frequency)
+{
+	double pkg, cap, bound, slowdown = 1.0;
+
+	bound = 1.0 - MIN(MAX(p->miss_ratio, 0.0), 1.0);
+	pkg = (p->node_watts - p->dram_watts) / Number_of_Socket;
+
+	if ((constraint_mode & PA_FLAG_CPU_CAP) && cpu_cap &&
+	    (cpu_cap < pkg)) {
+		slowdown = MAX(slowdown,
+			       1.0 + bound * (sqrt(pkg / cpu_cap) - 1.0));
+	}
+	if ((constraint_mode & PA_FLAG_FREQ) && frequency &&
+	    (p->freq > 0.0) && (frequency < p->freq)) {
+		slowdown = MAX(slowdown,
+			       1.0 + bound * (p->freq / frequency - 1.0));
+	}
+	if ((constraint_mode & PA_FLAG_JOB) && job_limit) {
+		cap = ((double) job_limit / node_cnt - p->dram_watts) /
+		      Number_of_Socket;
+		cap = MAX(cap, 1.0);
+		if (cap < pkg) {
+			slowdown = MAX(slowdown,
+				       1.0 + bound * (sqrt(pkg / cap) - 1.0));
+		}
+	}
+	return slowdown;
+}
+
 /**
  * Estimate a job power consumption under specified constraints
  * IN job_ptr - pointer to job being considered for estimation
@@ -155,7 +362,11 @@ int power_analyzer_p_reconfig( void )
  *            currently sopported Intel RAPL
  * IN frequency - maximum number of frequency to a cpu
  * OUT job_power - estimated power consumption by under constraints
- * RET zero on success, EINVAL otherwise
+ * RET zero on success, SLURM_ERROR if the job was never profiled and no
+ *     cpu_cap was given
+ *
+ * Profiled jobs are charged the peak of their mean node power, which is
+ * what they were seen to draw, rather than the worst case of their nodes.
  */
 int power_analyzer_p_estimate_job_power(struct job_record *job_ptr, bitstr_t *bitmap, 
 			uint32_t min_nodes, uint32_t max_nodes, uint32_t req_nodes,
@@ -163,18 +374,32 @@ int power_analyzer_p_estimate_job_power(struct job_record *job_ptr, bitstr_t *bi
 			uint32_t cpu_cap, uint32_t dram_cap, uint32_t frequency, 
 			uint32_t *job_power)
 {
-	//job_power is calculate according to formular
-	//job_power = (cpu_cap + dram_cap) * job_ptr->number_of_node * number_of_socket (per node)
-    
-	struct node_record *node_ptr;
-	power_current_data_t *powers;
-		
-	debug ("number of nodes is %d ", job_ptr->node_cnt);
-	debug ("");	
-	
-	*job_power = ((cpu_cap + dram_cap) * job_ptr->node_cnt * Number_of_Socket);
-	   
-	   return SLURM_SUCCESS;
+	power_model_profile_t p;
+	uint32_t node_cnt;
+	double pkg, dram, ratio;
+
+	node_cnt = _est_node_cnt(job_ptr, bitmap, min_nodes, req_nodes);
+	if (power_model_find(job_ptr->user_id, job_ptr->name, node_cnt, &p) ==
+	    SLURM_SUCCESS) {
+		dram = p.dram_watts;
+		pkg = MAX(p.peak_watts - dram, 0.0);
+		if ((constraint_mode & PA_FLAG_FREQ) && frequency &&
+		    (p.freq > 0.0) && (frequency < p.freq)) {
+			ratio = frequency / p.freq;
+			pkg *= ratio * ratio;
+		}
+		if ((constraint_mode & PA_FLAG_CPU_CAP) && cpu_cap)
+			pkg = MIN(pkg, (double) cpu_cap * Number_of_Socket);
+		if ((constraint_mode & PA_FLAG_DRAM_CAP) && dram_cap)
+			dram = MIN(dram, (double) dram_cap * Number_of_Socket);
+		*job_power = (uint32_t) ceil(pkg + dram) * node_cnt;
+		return SLURM_SUCCESS;
+	}
+
+	if (!(constraint_mode & PA_FLAG_CPU_CAP) || !cpu_cap)
+		return SLURM_ERROR;
+	*job_power = (cpu_cap + dram_cap) * node_cnt * Number_of_Socket;
+	return SLURM_SUCCESS;
 }
 
 /**
@@ -196,7 +421,7 @@ int power_analyzer_p_estimate_job_power(struct job_record *job_ptr, bitstr_t *bi
  * IN dram_cap - maximum number of power to allocate to a memory channel
  *            currently sopported Intel RAPL
  * IN frequency - maximum number of frequency to a cpu
- * OUT time - estimated job time. Determined by under constraints
+ * OUT time - estimated job time relative to the unconstrained run time
  * RET zero on success, EINVAL otherwise
  */
 int power_analyzer_p_estimate_job_time(struct job_record *job_ptr, bitstr_t *bitmap, 
@@ -205,11 +430,20 @@ int power_analyzer_p_estimate_job_time(struct job_record *job_ptr, bitstr_t *bit
 			uint32_t cpu_cap, uint32_t dram_cap, uint32_t frequency, 
 			 float *time)
 {
-	
-	//calculate relative excution time của job, according to the fomular
-    //time = (MaxCPUPower - MinCpuPower)/(cpu_cap - MinCpuPower);
-			
-	*time = (MaxCPUPower - MinCpuPower)/(cpu_cap - MinCpuPower);		
+	power_model_profile_t p;
+	uint32_t node_cnt;
+
+	node_cnt = _est_node_cnt(job_ptr, bitmap, min_nodes, req_nodes);
+	if (power_model_find(job_ptr->user_id, job_ptr->name, node_cnt, &p) ==
+	    SLURM_SUCCESS) {
+		*time = _profile_slowdown(&p, node_cnt, constraint_mode,
+					  job_limit, cpu_cap, frequency);
+		return SLURM_SUCCESS;
+	}
+
+	if (cpu_cap <= MinCpuPower)
+		return EINVAL;
+	*time = (float) (MaxCPUPower - MinCpuPower) / (cpu_cap - MinCpuPower);
 	return SLURM_SUCCESS;
 }
 
@@ -241,8 +475,21 @@ int power_analyzer_p_estimate_job_performance(struct job_record *job_ptr, bitstr
 			uint32_t cpu_cap, uint32_t dram_cap, uint32_t frequency, 
 			 float *degradation)
 {
-	*degradation = 1.0 - (cpu_cap - MinCpuPower)/(MaxCPUPower - MinCpuPower);
-	
+	power_model_profile_t p;
+	uint32_t node_cnt;
+
+	node_cnt = _est_node_cnt(job_ptr, bitmap, min_nodes, req_nodes);
+	if (power_model_find(job_ptr->user_id, job_ptr->name, node_cnt, &p) ==
+	    SLURM_SUCCESS) {
+		*degradation = 1.0 - 1.0 /
+			       _profile_slowdown(&p, node_cnt,
+						 constraint_mode, job_limit,
+						 cpu_cap, frequency);
+		return SLURM_SUCCESS;
+	}
+
+	*degradation = 1.0 - (float) (cpu_cap - MinCpuPower) /
+			     (MaxCPUPower - MinCpuPower);
 	return SLURM_SUCCESS;
 }
 
@@ -250,9 +497,47 @@ int power_analyzer_p_estimate_job_performance(struct job_record *job_ptr, bitstr
  * Analyze power log and prepare for estimation.
  * When a job have finished, This function will be called with the job id.
  * This API is for analysing a finished job.
+ * NOTE: Called with job write lock, while the job still has its nodes
  */
 int power_analyzer_p_analyze_finished_job(struct job_record *job_ptr)
 {
+	power_model_obs_t obs;
+	job_power_acc_t *acc;
+	time_t now = time(NULL), run_time = 0;
+
+	slurm_mutex_lock(&acc_mutex);
+	acc = _acc_find(job_ptr->job_id);
+	if (!acc || !acc->sample_cnt) {
+		/* ended before any sample, nothing learned */
+		slurm_mutex_unlock(&acc_mutex);
+		return SLURM_SUCCESS;
+	}
+
+	memset(&obs, 0, sizeof(power_model_obs_t));
+	obs.user_id = job_ptr->user_id;
+	obs.name = job_ptr->name;
+	obs.node_cnt = job_ptr->node_cnt;
+	obs.node_watts = acc->sum_watts / acc->sample_cnt;
+	obs.peak_watts = acc->peak_watts;
+	obs.dram_watts = acc->sum_dram / acc->sample_cnt;
+	if (acc->freq_cnt)
+		obs.freq = acc->sum_freq / acc->freq_cnt;
+	if (acc->miss_cnt)
+		obs.miss_ratio = acc->sum_miss / acc->miss_cnt;
+	/* the pass after this one drops the accumulator */
+	acc->sample_cnt = 0;
+	slurm_mutex_unlock(&acc_mutex);
+
+	if (job_ptr->start_time) {
+		run_time = (job_ptr->end_time ? job_ptr->end_time : now) -
+			   job_ptr->start_time - job_ptr->tot_sus_time;
+	}
+	obs.run_secs = MAX(run_time, 0);
+
+	power_model_add(&obs, now);
+	debug2("power_analyzer: job %u %.1f W/node (peak %.1f) on %u nodes",
+	       job_ptr->job_id, obs.node_watts, obs.peak_watts, obs.node_cnt);
+
 	return SLURM_SUCCESS;
 }
 
@@ -263,12 +548,6 @@ int power_analyzer_p_analyze_finished_job(struct job_record *job_ptr)
  */
 int power_analyzer_p_analyze_interval(void)
 {
-	while (1){
-		sleep(slurmctld_conf.power_allocatorinterval);
-		debug3(" ************************");
-		debug3(" Start of power_analyzer");
-		do_analysis_power_log();
-	}	
+	_analyze_pass(time(NULL), _interval());
 	return SLURM_SUCCESS;
 }
-
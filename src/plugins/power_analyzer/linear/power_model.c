@@ -0,0 +1,451 @@
+/*****************************************************************************\
+ *  power_model.c - per job power and performance profiles
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "slurm/slurm.h"
+#include "slurm/slurm_errno.h"
+
+#include "src/common/log.h"
+#include "src/common/macros.h"
+#include "src/common/pack.h"
+#include "src/common/slurm_protocol_api.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+#include "src/slurmctld/state_save.h"
+
+#include "power_model.h"
+
+#define MODEL_MAX_PROFILES	32768	/* oldest eighth dropped beyond */
+#define MODEL_STATE_FILE	"power_analyzer_state"
+
+/*
+ * Profiles are kept in a dense array indexed by an open addressing hash
+ * table of twice the array capacity, so lookups stay a few probes.
+ */
+static pthread_mutex_t model_mutex = PTHREAD_MUTEX_INITIALIZER;
+static power_model_profile_t *profiles = NULL;
+static int profile_cnt = 0;
+static int profile_size = 0;
+static int32_t *slots = NULL;		/* index in profiles, -1 if empty */
+static uint32_t slot_mask = 0;
+static bool model_dirty = false;
+
+extern uint32_t power_model_name_hash(const char *name)
+{
+	uint32_t hash = 2166136261U;	/* FNV-1a */
+
+	if (!name)
+		return 0;
+	for ( ; *name; name++) {
+		hash ^= (uint8_t) *name;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static uint32_t _key_hash(uint32_t user_id, uint32_t name_hash,
+			  uint32_t node_cnt)
+{
+	uint32_t hash = name_hash;
+
+	hash ^= user_id + 0x9e3779b9U + (hash << 6) + (hash >> 2);
+	hash ^= node_cnt + 0x9e3779b9U + (hash << 6) + (hash >> 2);
+	return hash;
+}
+
+/* Call with model_mutex held */
+static void _index_rebuild(int size)
+{
+	uint32_t slot_cnt = 64, slot;
+	power_model_profile_t *p;
+	int i;
+
+	while (slot_cnt < (uint32_t) size * 2)
+		slot_cnt <<= 1;
+	xfree(slots);
+	slots = xmalloc(sizeof(int32_t) * slot_cnt);
+	memset(slots, 0xff, sizeof(int32_t) * slot_cnt);
+	slot_mask = slot_cnt - 1;
+
+	for (i = 0; i < profile_cnt; i++) {
+		p = &profiles[i];
+		slot = _key_hash(p->user_id, p->name_hash, p->node_cnt) &
+		       slot_mask;
+		while (slots[slot] >= 0)
+			slot = (slot + 1) & slot_mask;
+		slots[slot] = i;
+	}
+}
+
+/* Call with model_mutex held */
+static power_model_profile_t *_find(uint32_t user_id, uint32_t name_hash,
+				    uint32_t node_cnt)
+{
+	power_model_profile_t *p;
+	uint32_t slot;
+
+	if (!slots)
+		return NULL;
+	slot = _key_hash(user_id, name_hash, node_cnt) & slot_mask;
+	while (slots[slot] >= 0) {
+		p = &profiles[slots[slot]];
+		if ((p->user_id == user_id) && (p->name_hash == name_hash) &&
+		    (p->node_cnt == node_cnt))
+			return p;
+		slot = (slot + 1) & slot_mask;
+	}
+	return NULL;
+}
+
+static int _newest_first(const void *a, const void *b)
+{
+	const power_model_profile_t *pa = a, *pb = b;
+
+	if (pa->update_time > pb->update_time)
+		return -1;
+	if (pa->update_time < pb->update_time)
+		return 1;
+	return 0;
+}
+
+/* Call with model_mutex held */
+static power_model_profile_t *_insert(uint32_t user_id, uint32_t name_hash,
+				      uint32_t node_cnt)
+{
+	power_model_profile_t *p;
+	uint32_t slot;
+
+	if (profile_cnt >= MODEL_MAX_PROFILES) {
+		qsort(profiles, profile_cnt, sizeof(power_model_profile_t),
+		      _newest_first);
+		profile_cnt -= profile_cnt / 8;
+		_index_rebuild(profile_size);
+	}
+	if (profile_cnt >= profile_size) {
+		profile_size = MAX(profile_size * 2, 64);
+		profile_size = MIN(profile_size, MODEL_MAX_PROFILES);
+		xrealloc(profiles,
+			 sizeof(power_model_profile_t) * profile_size);
+		_index_rebuild(profile_size);
+	}
+
+	p = &profiles[profile_cnt];
+	memset(p, 0, sizeof(power_model_profile_t));
+	p->user_id = user_id;
+	p->name_hash = name_hash;
+	p->node_cnt = node_cnt;
+
+	slot = _key_hash(user_id, name_hash, node_cnt) & slot_mask;
+	while (slots[slot] >= 0)
+		slot = (slot + 1) & slot_mask;
+	slots[slot] = profile_cnt++;
+
+	return p;
+}
+
+static void _fold(power_model_profile_t *p, power_model_obs_t *obs,
+		  time_t now)
+{
+	float alpha;
+
+	if (p->job_cnt < POWER_MODEL_WINDOW)
+		p->job_cnt++;
+	alpha = 1.0 / p->job_cnt;
+
+	p->node_watts += alpha * (obs->node_watts - p->node_watts);
+	p->peak_watts += alpha * (obs->peak_watts - p->peak_watts);
+	p->dram_watts += alpha * (obs->dram_watts - p->dram_watts);
+	p->miss_ratio += alpha * (obs->miss_ratio - p->miss_ratio);
+	p->run_secs += alpha * (obs->run_secs - p->run_secs);
+	if (obs->freq > 0.0) {
+		if (p->freq > 0.0)
+			p->freq += alpha * (obs->freq - p->freq);
+		else
+			p->freq = obs->freq;
+	}
+	p->update_time = now;
+}
+
+extern void power_model_add(power_model_obs_t *obs, time_t now)
+{
+	power_model_profile_t *p;
+	uint32_t name_hash = power_model_name_hash(obs->name);
+
+	slurm_mutex_lock(&model_mutex);
+	if (!(p = _find(obs->user_id, name_hash, obs->node_cnt)))
+		p = _insert(obs->user_id, name_hash, obs->node_cnt);
+	_fold(p, obs, now);
+	if (obs->node_cnt) {
+		if (!(p = _find(obs->user_id, name_hash, 0)))
+			p = _insert(obs->user_id, name_hash, 0);
+		_fold(p, obs, now);
+	}
+	model_dirty = true;
+	slurm_mutex_unlock(&model_mutex);
+}
+
+extern int power_model_find(uint32_t user_id, const char *name,
+			    uint32_t node_cnt, power_model_profile_t *profile)
+{
+	power_model_profile_t *p;
+	uint32_t name_hash = power_model_name_hash(name);
+	int rc = SLURM_ERROR;
+
+	slurm_mutex_lock(&model_mutex);
+	if ((p = _find(user_id, name_hash, node_cnt)) ||
+	    (p = _find(user_id, name_hash, 0))) {
+		*profile = *p;
+		rc = SLURM_SUCCESS;
+	}
+	slurm_mutex_unlock(&model_mutex);
+
+	return rc;
+}
+
+/* Fixed point in the state file: centiwatts, ppm of misses */
+static void _pack_profile(power_model_profile_t *p, Buf buffer)
+{
+	pack32(p->user_id, buffer);
+	pack32(p->name_hash, buffer);
+	pack32(p->node_cnt, buffer);
+	pack32(p->job_cnt, buffer);
+	pack_time(p->update_time, buffer);
+	pack32((uint32_t) (p->node_watts * 100.0 + 0.5), buffer);
+	pack32((uint32_t) (p->peak_watts * 100.0 + 0.5), buffer);
+	pack32((uint32_t) (p->dram_watts * 100.0 + 0.5), buffer);
+	pack32((uint32_t) (p->freq + 0.5), buffer);
+	pack32((uint32_t) (p->miss_ratio * 1000000.0 + 0.5), buffer);
+	pack32((uint32_t) (p->run_secs + 0.5), buffer);
+}
+
+static int _unpack_profile(power_model_profile_t *p, Buf buffer)
+{
+	uint32_t val[6];
+	int i;
+
+	safe_unpack32(&p->user_id, buffer);
+	safe_unpack32(&p->name_hash, buffer);
+	safe_unpack32(&p->node_cnt, buffer);
+	safe_unpack32(&p->job_cnt, buffer);
+	safe_unpack_time(&p->update_time, buffer);
+	for (i = 0; i < 6; i++)
+		safe_unpack32(&val[i], buffer);
+	p->node_watts = val[0] / 100.0;
+	p->peak_watts = val[1] / 100.0;
+	p->dram_watts = val[2] / 100.0;
+	p->freq = val[3];
+	p->miss_ratio = val[4] / 1000000.0;
+	p->run_secs = val[5];
+	p->job_cnt = MIN(p->job_cnt, POWER_MODEL_WINDOW);
+	return SLURM_SUCCESS;
+
+unpack_error:
+	return SLURM_ERROR;
+}
+
+extern int power_model_save(void)
+{
+	char *dir_path, *old_file, *new_file, *reg_file;
+	Buf buffer;
+	int error_code = SLURM_SUCCESS;
+	int i, log_fd;
+
+	slurm_mutex_lock(&model_mutex);
+	if (!model_dirty) {
+		slurm_mutex_unlock(&model_mutex);
+		return SLURM_SUCCESS;
+	}
+	buffer = init_buf(BUF_SIZE + profile_cnt * 48);
+	pack16(SLURM_PROTOCOL_VERSION, buffer);
+	pack_time(time(NULL), buffer);
+	pack32(profile_cnt, buffer);
+	for (i = 0; i < profile_cnt; i++)
+		_pack_profile(&profiles[i], buffer);
+	model_dirty = false;
+	slurm_mutex_unlock(&model_mutex);
+
+	dir_path = slurm_get_state_save_location();
+	old_file = xstrdup_printf("%s/%s.old", dir_path, MODEL_STATE_FILE);
+	reg_file = xstrdup_printf("%s/%s", dir_path, MODEL_STATE_FILE);
+	new_file = xstrdup_printf("%s/%s.new", dir_path, MODEL_STATE_FILE);
+
+	log_fd = creat(new_file, 0600);
+	if (log_fd < 0) {
+		error("Can't save state, create file %s error %m",
+		      new_file);
+		error_code = errno;
+	} else {
+		int pos = 0, nwrite = get_buf_offset(buffer), amount, rc;
+		char *data = (char *)get_buf_data(buffer);
+		while (nwrite > 0) {
+			amount = write(log_fd, &data[pos], nwrite);
+			if ((amount < 0) && (errno != EINTR)) {
+				error("Error writing file %s, %m", new_file);
+				error_code = errno;
+				break;
+			}
+			nwrite -= amount;
+			pos    += amount;
+		}
+
+		rc = fsync_and_close(log_fd, "power_analyzer");
+		if (rc && !error_code)
+			error_code = rc;
+	}
+	if (error_code) {
+		(void) unlink(new_file);
+		/* try again next time */
+		slurm_mutex_lock(&model_mutex);
+		model_dirty = true;
+		slurm_mutex_unlock(&model_mutex);
+	} else {			/* file shuffle */
+		(void) unlink(old_file);
+		if (link(reg_file, old_file))
+			debug4("unable to create link for %s -> %s: %m",
+			       reg_file, old_file);
+		(void) unlink(reg_file);
+		if (link(new_file, reg_file))
+			debug4("unable to create link for %s -> %s: %m",
+			       new_file, reg_file);
+		(void) unlink(new_file);
+	}
+	xfree(dir_path);
+	xfree(old_file);
+	xfree(reg_file);
+	xfree(new_file);
+	free_buf(buffer);
+
+	return error_code;
+}
+
+extern int power_model_restore(void)
+{
+	char *dir_path, *state_file, *data;
+	uint32_t data_allocated, data_size = 0, cnt = 0;
+	uint16_t protocol_version = (uint16_t) NO_VAL;
+	power_model_profile_t *loaded = NULL;
+	time_t buf_time;
+	Buf buffer;
+	int i, state_fd, data_read;
+
+	dir_path = slurm_get_state_save_location();
+	state_file = xstrdup_printf("%s/%s", dir_path, MODEL_STATE_FILE);
+	xfree(dir_path);
+
+	state_fd = open(state_file, O_RDONLY);
+	if (state_fd < 0) {
+		info("No power analyzer state file (%s) to recover",
+		     state_file);
+		xfree(state_file);
+		return SLURM_SUCCESS;
+	}
+	data_allocated = BUF_SIZE;
+	data = xmalloc(data_allocated);
+	while (1) {
+		data_read = read(state_fd, &data[data_size], BUF_SIZE);
+		if (data_read < 0) {
+			if (errno == EINTR)
+				continue;
+			error("Read error on %s: %m", state_file);
+			break;
+		} else if (data_read == 0)	/* eof */
+			break;
+		data_size      += data_read;
+		data_allocated += data_read;
+		xrealloc(data, data_allocated);
+	}
+	close(state_fd);
+	xfree(state_file);
+
+	buffer = create_buf(data, data_size);
+	safe_unpack16(&protocol_version, buffer);
+	if ((protocol_version == (uint16_t) NO_VAL) ||
+	    (protocol_version < SLURM_MIN_PROTOCOL_VERSION)) {
+		error("Can not recover power analyzer state, "
+		      "incompatible version %hu", protocol_version);
+		free_buf(buffer);
+		return EFAULT;
+	}
+	safe_unpack_time(&buf_time, buffer);
+	safe_unpack32(&cnt, buffer);
+	if (cnt > MODEL_MAX_PROFILES)
+		goto unpack_error;
+	loaded = xmalloc(sizeof(power_model_profile_t) * MAX(cnt, 1));
+	for (i = 0; i < cnt; i++) {
+		if (_unpack_profile(&loaded[i], buffer) != SLURM_SUCCESS)
+			goto unpack_error;
+	}
+	free_buf(buffer);
+
+	slurm_mutex_lock(&model_mutex);
+	xfree(profiles);
+	profiles = loaded;
+	profile_cnt = cnt;
+	profile_size = MAX(cnt, 1);
+	_index_rebuild(profile_size);
+	model_dirty = false;
+	slurm_mutex_unlock(&model_mutex);
+	info("power analyzer: recovered %u job profiles", cnt);
+
+	return SLURM_SUCCESS;
+
+unpack_error:
+	error("Incomplete power analyzer state file");
+	xfree(loaded);
+	free_buf(buffer);
+	return SLURM_ERROR;
+}
+
+extern void power_model_fini(void)
+{
+	slurm_mutex_lock(&model_mutex);
+	xfree(profiles);
+	xfree(slots);
+	profile_cnt = 0;
+	profile_size = 0;
+	slot_mask = 0;
+	model_dirty = false;
+	slurm_mutex_unlock(&model_mutex);
+}
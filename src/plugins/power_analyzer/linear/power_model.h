@@ -0,0 +1,110 @@
+/*****************************************************************************\
+ *  power_model.h - per job power and performance profiles
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _POWER_MODEL_H
+#define _POWER_MODEL_H
+
+#include <inttypes.h>
+#include <time.h>
+
+/*
+ * A profile summarizes the completed jobs of one user with one job name
+ * on one node count. Each job updates two profiles: the one of its node
+ * count and the one for every node count (node_cnt 0), which answers for
+ * node counts not seen yet. Values are running means over the first
+ * POWER_MODEL_WINDOW jobs and exponential means after that, so profiles
+ * follow applications which change.
+ */
+#define POWER_MODEL_WINDOW	8
+
+typedef struct power_model_profile {
+	uint32_t user_id;
+	uint32_t name_hash;	/* power_model_name_hash() of the job name */
+	uint32_t node_cnt;	/* 0 for every node count */
+	uint32_t job_cnt;	/* jobs folded in, saturates */
+	time_t update_time;	/* last job folded in */
+	float node_watts;	/* mean node watts, packages plus DRAM */
+	float peak_watts;	/* highest sampled mean node watts */
+	float dram_watts;	/* mean DRAM watts per node */
+	float freq;		/* mean CPU frequency, 0 if unknown */
+	float miss_ratio;	/* L3 misses per cache reference */
+	float run_secs;		/* run time */
+} power_model_profile_t;
+
+/* One completed job, see power_model_add() */
+typedef struct power_model_obs {
+	uint32_t user_id;
+	char *name;
+	uint32_t node_cnt;
+	uint32_t run_secs;
+	double node_watts;
+	double peak_watts;
+	double dram_watts;
+	double freq;
+	double miss_ratio;
+} power_model_obs_t;
+
+/* power_model_name_hash - hash of a job name, NULL for no name */
+extern uint32_t power_model_name_hash(const char *name);
+
+/* power_model_add - fold a completed job into its profiles */
+extern void power_model_add(power_model_obs_t *obs, time_t now);
+
+/*
+ * power_model_find - look up the profile of a job
+ * IN user_id, name, node_cnt - the job
+ * OUT profile - copy of the profile of that node count, else of the one
+ *	for every node count
+ * RET SLURM_SUCCESS or SLURM_ERROR if the model knows no such job
+ */
+extern int power_model_find(uint32_t user_id, const char *name,
+			    uint32_t node_cnt, power_model_profile_t *profile);
+
+/*
+ * power_model_save - write the profiles to the state save directory if
+ *	they changed since the last save
+ * RET SLURM_SUCCESS or an errno
+ */
+extern int power_model_save(void);
+
+/* power_model_restore - load the profiles saved by power_model_save() */
+extern int power_model_restore(void);
+
+/* power_model_fini - free the profiles */
+extern void power_model_fini(void);
+
+#endif /* !_POWER_MODEL_H */
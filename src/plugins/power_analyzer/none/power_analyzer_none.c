@@ -104,15 +104,15 @@ int power_analyzer_p_reconfig( void )
  *            currently sopported Intel RAPL
  * IN frequency - maximum number of frequency to a cpu
  * OUT job_power - estimated power consumption by under constraints
- * RET zero on success, EINVAL otherwise
+ * RET SLURM_ERROR, this plugin makes no estimates
  */
 int power_analyzer_p_estimate_job_power(struct job_record *job_ptr, bitstr_t *bitmap, 
 			uint32_t min_nodes, uint32_t max_nodes, uint32_t req_nodes,
 			uint32_t constraint_mode,
 			uint32_t cpu_cap, uint32_t dram_cap, uint32_t frequency, 
-			uint32_t job_power)
+			uint32_t *job_power)
 {
-	return SLURM_SUCCESS;
+	return SLURM_ERROR;
 }
 
 /**
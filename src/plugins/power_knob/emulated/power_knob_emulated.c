@@ -0,0 +1,436 @@
+/*****************************************************************************\
+ *  power_knob_emulated.c - emulated power knob for testing without RAPL
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+/*   power_knob_emulated
+ * Model the package and DRAM power of each socket from the node load, the
+ * frequency and the package cap, so that power management can be exercised
+ * on nodes without RAPL, including the many virtual nodes of a
+ * --enable-multiple-slurmd build.
+ *
+ * The model has no thread of its own: it is advanced to the current time
+ * whenever it is read or a cap is set. A node with job steps runs at
+ * emulated_load (100% by default), an idle node at 5%. Under a cap the
+ * frequency drops until the package power, which grows as the cube of the
+ * frequency, fits the cap or the minimum frequency is reached. Power moves
+ * toward its target with a first order lag and is reported with uniform
+ * noise.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "src/common/slurm_xlator.h"
+#include "src/common/list.h"
+#include "src/common/power_knob.h"
+#include "src/common/slurm_protocol_api.h"
+#include "src/common/stepd_api.h"
+#include "src/common/xstring.h"
+#include "src/slurmd/slurmd/slurmd.h"
+
+/* These are defined here so when we link with something other than
+ * the slurmd we will have these symbols defined.  They will get
+ * overwritten when linking with the slurmd.
+ */
+#if defined (__APPLE__)
+slurmd_conf_t *conf __attribute__((weak_import));
+#else
+slurmd_conf_t *conf;
+#endif
+
+/*
+ * These variables are required by the generic plugin interface.  If they
+ * are not found in the plugin, the plugin loader will ignore it.
+ *
+ * plugin_name - a string giving a human-readable description of the
+ * plugin.  There is no maximum length, but the symbol must refer to
+ * a valid string.
+ *
+ * plugin_type - a string suggesting the type of the plugin or its
+ * applicability to a particular form of data or method of data handling.
+ * If the low-level plugin API is used, the contents of this string are
+ * unimportant and may be anything.  SLURM uses the higher-level plugin
+ * interface which requires this string to be of the form
+ *
+ *	<application>/<method>
+ *
+ * where <application> is a description of the intended application of
+ * the plugin (e.g., "jobacct" for SLURM job completion logging) and <method>
+ * is a description of how this plugin satisfies that application.  SLURM will
+ * only load job completion logging plugins if the plugin_type string has a
+ * prefix of "jobacct/".
+ *
+ * plugin_version - an unsigned 32-bit integer containing the Slurm version
+ * (major.minor.micro combined into a single number).
+ */
+const char plugin_name[] = "PowerKnob emulated plugin";
+const char plugin_type[] = "power_knob/emulated";
+const uint32_t plugin_version = SLURM_VERSION_NUMBER;
+
+/* The cap request carries one package cap per socket for two sockets */
+#define EMU_MAX_SOCKETS		2
+#define EMU_IDLE_LOAD		0.05
+#define EMU_LOAD_CHECK_SEC	1	/* rescan job steps at most this often */
+#define EMU_CACHE_REF_RATE	1.0e9	/* references per second at full load */
+
+typedef struct emu_socket {
+	double pkg_watts;		/* actual, lagging the target */
+	double dram_watts;
+	uint32_t pkg_cap;		/* 0 if uncapped */
+	uint32_t dram_cap;		/* 0 if uncapped */
+	uint32_t freq_khz;
+	uint64_t cache_ref;		/* counts of the last interval */
+	uint64_t l1_miss;
+	uint64_t l2_miss;
+	uint64_t l3_miss;
+} emu_socket_t;
+
+/* Model parameters, PowerParameters emulated_<name>= */
+static uint16_t emu_sockets	= 2;
+static uint32_t emu_tdp		= 120;	/* package watts, full load */
+static uint32_t emu_idle	= 35;	/* package watts, no load */
+static uint32_t emu_dram	= 20;	/* dram watts, full load */
+static uint32_t emu_freq	= 2600000;	/* kHz */
+static uint32_t emu_min_freq	= 1200000;	/* kHz */
+static uint32_t emu_lag_msec	= 300;	/* time constant of the response */
+static uint32_t emu_noise	= 2;	/* percent */
+static uint32_t emu_load	= 100;	/* percent while steps run */
+static uint32_t emu_l3_miss	= 5;	/* percent of the cache references */
+
+static pthread_mutex_t emu_lock = PTHREAD_MUTEX_INITIALIZER;
+static emu_socket_t emu_socket[EMU_MAX_SOCKETS];
+static struct timespec emu_last;	/* CLOCK_MONOTONIC */
+static unsigned int emu_seed;
+static double emu_node_load = EMU_IDLE_LOAD;
+static time_t emu_load_time = 0;
+static bool emu_ready = false;
+
+static void _read_param(char *power_params, char *key, uint32_t min_val,
+			uint32_t max_val, uint32_t *value)
+{
+	char *tmp, *end;
+	long val;
+
+	if (!power_params || !(tmp = strstr(power_params, key)))
+		return;
+	val = strtol(tmp + strlen(key), &end, 10);
+	if ((end == tmp + strlen(key)) || (val < min_val) || (val > max_val))
+		error("power_knob/emulated: invalid PowerParameters %s%s",
+		      key, tmp + strlen(key));
+	else
+		*value = (uint32_t) val;
+}
+
+static void _read_power_params(void)
+{
+	char *power_params = slurm_get_power_parameters();
+	uint32_t sockets = emu_sockets;
+
+	_read_param(power_params, "emulated_sockets=", 1, EMU_MAX_SOCKETS,
+		    &sockets);
+	emu_sockets = sockets;
+	_read_param(power_params, "emulated_tdp=", 1, 10000, &emu_tdp);
+	_read_param(power_params, "emulated_idle=", 0, 10000, &emu_idle);
+	_read_param(power_params, "emulated_dram=", 0, 10000, &emu_dram);
+	_read_param(power_params, "emulated_freq=", 1000, 10000000,
+		    &emu_freq);
+	_read_param(power_params, "emulated_min_freq=", 1000, 10000000,
+		    &emu_min_freq);
+	_read_param(power_params, "emulated_lag_msec=", 0, 600000,
+		    &emu_lag_msec);
+	_read_param(power_params, "emulated_noise=", 0, 100, &emu_noise);
+	_read_param(power_params, "emulated_load=", 0, 100, &emu_load);
+	_read_param(power_params, "emulated_l3_miss=", 0, 100, &emu_l3_miss);
+	xfree(power_params);
+
+	if (emu_idle >= emu_tdp) {
+		error("power_knob/emulated: emulated_idle must be below "
+		      "emulated_tdp");
+		emu_idle = emu_tdp / 4;
+	}
+	if (emu_min_freq > emu_freq)
+		emu_min_freq = emu_freq;
+}
+
+/* Busy while this slurmd runs job steps, the scan of the spool directory
+ * is repeated at most every EMU_LOAD_CHECK_SEC */
+static double _node_load(void)
+{
+	time_t now = time(NULL);
+	List steps;
+
+	if (now < emu_load_time + EMU_LOAD_CHECK_SEC)
+		return emu_node_load;
+	emu_load_time = now;
+
+	if (!conf || !conf->spooldir)
+		return emu_node_load;
+	steps = stepd_available(conf->spooldir, conf->node_name);
+	if (steps && list_count(steps))
+		emu_node_load = MAX((double) emu_load / 100.0, EMU_IDLE_LOAD);
+	else
+		emu_node_load = EMU_IDLE_LOAD;
+	FREE_NULL_LIST(steps);
+
+	return emu_node_load;
+}
+
+/* Advance the model to now.
+ * NOTE: Call with emu_lock held */
+static void _advance(void)
+{
+	struct timespec now;
+	double dt, alpha, load, dyn, f, f_min, target, dram_idle, dram_target;
+	double refs;
+	emu_socket_t *sock;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	dt = (double) (now.tv_sec - emu_last.tv_sec) +
+	     (double) (now.tv_nsec - emu_last.tv_nsec) / 1.0e9;
+	if (dt <= 0.0)
+		return;
+	emu_last = now;
+	if (emu_lag_msec)
+		alpha = 1.0 - exp(-dt * 1000.0 / (double) emu_lag_msec);
+	else
+		alpha = 1.0;
+
+	/* The node load is shared evenly by the sockets */
+	load = _node_load();
+	f_min = (double) emu_min_freq / (double) emu_freq;
+	dram_idle = (double) emu_dram / 4.0;
+	for (i = 0; i < emu_sockets; i++) {
+		sock = &emu_socket[i];
+		dyn = (double) (emu_tdp - emu_idle) * load;
+		f = 1.0;
+		if (sock->pkg_cap && (emu_idle + dyn > sock->pkg_cap)) {
+			if ((sock->pkg_cap > emu_idle) && (dyn > 0.0))
+				f = cbrt((sock->pkg_cap - emu_idle) / dyn);
+			else
+				f = 0.0;
+			f = MAX(f, f_min);
+		}
+		target = emu_idle + dyn * f * f * f;
+		sock->pkg_watts += (target - sock->pkg_watts) * alpha;
+		sock->freq_khz = (uint32_t) (f * emu_freq);
+
+		dram_target = dram_idle +
+			      ((double) emu_dram - dram_idle) * load *
+			      (0.5 + 0.5 * f);
+		if (sock->dram_cap && (dram_target > sock->dram_cap))
+			dram_target = sock->dram_cap;
+		sock->dram_watts += (dram_target - sock->dram_watts) * alpha;
+
+		refs = EMU_CACHE_REF_RATE * load * f * dt;
+		sock->cache_ref = (uint64_t) refs;
+		sock->l1_miss = (uint64_t) (refs * 0.30);
+		sock->l2_miss = (uint64_t) (refs * 0.15);
+		sock->l3_miss = (uint64_t) (refs * emu_l3_miss / 100.0);
+	}
+}
+
+static uint32_t _noisy(double watts)
+{
+	double noise;
+
+	if (emu_noise) {
+		noise = ((double) rand_r(&emu_seed) / (double) RAND_MAX) *
+			2.0 - 1.0;
+		watts *= 1.0 + noise * (double) emu_noise / 100.0;
+	}
+	return (watts > 0.0) ? (uint32_t) (watts + 0.5) : 0;
+}
+
+/* Seed the noise from the node name so virtual nodes differ but runs are
+ * repeatable */
+static unsigned int _name_seed(char *name)
+{
+	unsigned int seed = 2166136261U;
+
+	while (name && *name)
+		seed = (seed ^ (unsigned char) *name++) * 16777619U;
+	return seed;
+}
+
+/*
+ * init() is called when the plugin is loaded, before any other functions
+ * are called.  Put global initialization here.
+ */
+extern int init(void)
+{
+	debug("%s loaded", plugin_name);
+	return SLURM_SUCCESS;
+}
+
+extern int fini(void)
+{
+	return SLURM_SUCCESS;
+}
+
+extern int power_knob_p_get_data(enum power_knob_type data_type, void *data)
+{
+	power_current_data_t *power = (power_current_data_t *) data;
+	uint16_t *socket_cnt = (uint16_t *) data;
+	time_t now;
+	int i, rc = SLURM_SUCCESS;
+
+	switch (data_type) {
+	case POWER_KNOB_DATA_NODE_POWER:
+		now = time(NULL);
+		slurm_mutex_lock(&emu_lock);
+		if (emu_ready)
+			_advance();
+		for (i = 0; emu_ready && (i < emu_sockets); i++) {
+			memset(&power[i], 0, sizeof(power_current_data_t));
+			power[i].cpu_current_watts =
+				_noisy(emu_socket[i].pkg_watts);
+			power[i].dram_current_watts =
+				_noisy(emu_socket[i].dram_watts);
+			power[i].cpu_current_frequency =
+				emu_socket[i].freq_khz;
+			power[i].cpu_current_cap_watts =
+				emu_socket[i].pkg_cap ?
+				emu_socket[i].pkg_cap : emu_tdp;
+			power[i].dram_current_cap_watts =
+				emu_socket[i].dram_cap ?
+				emu_socket[i].dram_cap : emu_dram;
+			power[i].poll_time = now;
+		}
+		slurm_mutex_unlock(&emu_lock);
+		break;
+	case POWER_KNOB_DATA_SOCKET_CNT:
+		*socket_cnt = emu_ready ? emu_sockets : 0;
+		break;
+	default:
+		error("power_knob_p_get_data: unknown enum %d", data_type);
+		rc = SLURM_ERROR;
+		break;
+	}
+	return rc;
+}
+
+extern int power_knob_p_get_cache_data(enum cache_type data_type,
+				       void *cache_data)
+{
+	cache_ref_t *cache = (cache_ref_t *) cache_data;
+	uint16_t *cache_socket_cnt = (uint16_t *) cache_data;
+	int i, rc = SLURM_SUCCESS;
+
+	switch (data_type) {
+	case CACHE_POWER_KNOB_DATA_NODE_POWER:
+		slurm_mutex_lock(&emu_lock);
+		for (i = 0; emu_ready && (i < emu_sockets); i++) {
+			memset(&cache[i], 0, sizeof(cache_ref_t));
+			cache[i].all_cache_ref = emu_socket[i].cache_ref;
+			cache[i].l1_miss = emu_socket[i].l1_miss;
+			cache[i].l2_miss = emu_socket[i].l2_miss;
+			cache[i].l3_miss = emu_socket[i].l3_miss;
+		}
+		slurm_mutex_unlock(&emu_lock);
+		break;
+	case CACHE_POWER_KNOB_DATA_SOCKET_CNT:
+		*cache_socket_cnt = emu_ready ? emu_sockets : 0;
+		break;
+	default:
+		error("power_knob_p_get_cache_data: unknown enum %d",
+		      data_type);
+		rc = SLURM_ERROR;
+		break;
+	}
+	return rc;
+}
+
+/* A cap at or above the TDP, such as the 0x7fff release value, removes
+ * the cap. DRAM caps are the same against emulated_dram, 0 leaves them */
+extern int power_knob_p_set_data(power_knob_cap_req_msg_t *cap_msg)
+{
+	uint32_t caps[EMU_MAX_SOCKETS], dram_caps[EMU_MAX_SOCKETS];
+	int i;
+
+	caps[0] = cap_msg->cap_info;
+	caps[1] = cap_msg->cap_info2;
+	dram_caps[0] = cap_msg->dram_cap_info;
+	dram_caps[1] = cap_msg->dram_cap_info2;
+
+	slurm_mutex_lock(&emu_lock);
+	if (emu_ready)
+		_advance();	/* the old cap applied until now */
+	for (i = 0; i < emu_sockets; i++) {
+		emu_socket[i].pkg_cap = (caps[i] < emu_tdp) ? caps[i] : 0;
+		if (dram_caps[i] == 0)
+			continue;
+		emu_socket[i].dram_cap =
+			(dram_caps[i] < emu_dram) ? dram_caps[i] : 0;
+	}
+	slurm_mutex_unlock(&emu_lock);
+
+	debug3("power_knob/emulated: package caps %u %u, dram caps %u %u",
+	       caps[0], caps[1], dram_caps[0], dram_caps[1]);
+	return SLURM_SUCCESS;
+}
+
+extern int power_knob_p_refresh(void)
+{
+	return SLURM_SUCCESS;
+}
+
+extern void power_knob_p_conf_set(void)
+{
+	int i;
+
+	slurm_mutex_lock(&emu_lock);
+	_read_power_params();
+	emu_seed = _name_seed(conf ? conf->node_name : NULL);
+	memset(emu_socket, 0, sizeof(emu_socket));
+	for (i = 0; i < emu_sockets; i++) {
+		emu_socket[i].pkg_watts = emu_idle +
+			(emu_tdp - emu_idle) * EMU_IDLE_LOAD;
+		emu_socket[i].dram_watts = (double) emu_dram / 4.0;
+		emu_socket[i].freq_khz = emu_freq;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &emu_last);
+	emu_load_time = 0;
+	emu_ready = true;
+	slurm_mutex_unlock(&emu_lock);
+
+	debug("power_knob/emulated: %u sockets, %u-%u W package, %u W dram, "
+	      "%u msec lag, %u%% noise", emu_sockets, emu_idle, emu_tdp,
+	      emu_dram, emu_lag_msec, emu_noise);
+}
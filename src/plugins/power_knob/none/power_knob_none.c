@@ -117,3 +117,8 @@ extern void power_knob_p_conf_set(void)
 	return SLURM_SUCCESS;	
 }
 
+extern int power_knob_p_refresh(void)
+{
+	return SLURM_SUCCESS;
+}
+
@@ -45,7 +45,10 @@
 #include "src/common/slurm_protocol_api.h"
 #include "src/common/slurm_protocol_defs.h"
 #include "src/common/power_knob.h"
+#include "src/common/power_knob_perf.h"
 #include "src/common/fd.h"
+#include "src/common/timers.h"
+#include "src/common/xstring.h"
 #include "src/slurmd/common/proctrack.h"
 
 #include <stdlib.h>
@@ -102,8 +105,22 @@
 #define DEFAULT_INTERVAL	 1000	// interval in milisecond 1000 = 1.00sec
 #define MAX_PKGS MAX_SOCKET_NUMBER
 
-pthread_mutex_t interval_monitor_mutex = PTHREAD_MUTEX_INITIALIZER;
-bool interval_monitor_enabled = false;
+/* sampler pacing, PowerParameters=sample_fast=<msec>,sample_idle=<msec>,
+ * sample_settle=<msec> */
+#define DEFAULT_SAMPLE_FAST	100	/* msec, while a change is settling */
+#define DEFAULT_SAMPLE_IDLE	DEFAULT_INTERVAL
+#define DEFAULT_SAMPLE_SETTLE	2000	/* msec of fast sampling per event */
+
+static uint32_t sample_fast_msec = DEFAULT_SAMPLE_FAST;
+static uint32_t sample_idle_msec = DEFAULT_SAMPLE_IDLE;
+static uint32_t sample_settle_msec = DEFAULT_SAMPLE_SETTLE;
+
+static pthread_t sample_thread = 0;
+static pthread_mutex_t sample_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sample_cond;	/* waits on CLOCK_MONOTONIC */
+static bool sample_stop = false;
+static bool sample_wake = false;
+static struct timespec fast_until;	/* CLOCK_MONOTONIC */
 
 struct	node_power_info {
 	char	nname[NNAME_LENGTH];
@@ -135,8 +152,6 @@ static double power_measuring_pkg[MAX_PKGS];	/* pkg power measuring */
 static double power_measuring_pp0[MAX_PKGS];	/* pp0 power measuring */
 static double power_measuring_dram[MAX_PKGS];	/* dram power measuring */
 
-static int interval_sec;	/* interval in sec */
-static int interval_usec;	/* interval in usec */
 static float _msec_;		/* interval of interrupt handler (milli second) */
 static char _curr_time[32];	/* current time  */
 
@@ -151,9 +166,42 @@ static double pmc_epoch[MAX_PKGS][4];	/* average pmc each epoch (or each time in
 
 static char msr_socket_file_name[MAX_PKGS][32];	/* msr file name for rapl setting /dev/cpu/?/msr */
 static char msr_core_file_name[MAXCORES][32];	/* msr file name for performance monitoring counter /dev/cpu/?/msr */
+static int msr_socket_fd[MAX_PKGS] = {[0 ... MAX_PKGS-1] = -1};	/* kept open for the daemon's lifetime */
+static int msr_core_fd[MAXCORES] = {[0 ... MAXCORES-1] = -1};
+
+static int core_cpu_id[MAXCORES];	/* cpu number of each msr_core_file_name */
+
+static char my_host_name[64];	/* resolved once in _hardware() */
+
+/* PMC backend, chosen by PowerParameters=pmc_backend=msr|perf */
+#define PMC_BACKEND_MSR		0	/* program IA32_PERFEVTSELx directly */
+#define PMC_BACKEND_PERF	1	/* perf_event_open counter groups */
+static int pmc_backend = PMC_BACKEND_MSR;
+static pmc_perf_group_t *pmc_group[MAXCORES];	/* one group per core */
+
+#ifdef __linux__
+/* same events as the PMC1-PMC4 programmed by _init_pmc() */
+static const pmc_perf_event_t pmc_perf_events[4] = {
+	{ PERF_TYPE_RAW, 0x4F2E },	/* LONGEST_LAT_CACHE.REFERENCE */
+	{ PERF_TYPE_RAW, 0x412E },	/* LONGEST_LAT_CACHE.MISS */
+	{ PERF_TYPE_RAW, 0x3024 },	/* L2_RQSTS.ALL_CODE_RD */
+	{ PERF_TYPE_RAW, 0x8024 },	/* L2_RQSTS.PF_MISS */
+};
+#endif
+
+/* sampling cost, reported every SAMPLE_STATS_PERIOD samples */
+#define SAMPLE_STATS_PERIOD	60
+static uint32_t sample_cnt;		/* samples in this period */
+static uint64_t sample_usec_total;	/* time spent sampling */
+static uint32_t sample_usec_max;
+static uint32_t msr_read_cnt;		/* MSR reads in this period */
 
 static uint32_t _start_en_val_[MAX_PKGS][3] = { {0} };	/* starting and previous value of msr (energy) */
 static uint64_t _energy_val_[MAX_PKGS][3]   = { {0} };	/* store difference value of msr (energy) */
+/* energy registers, in the order of the _start_en_val_ and _energy_val_ columns */
+static const uint32_t energy_regs[3] = {
+	MSR_PKG_ENERGY_STATUS, MSR_PP0_ENERGY_STATUS,
+	MSR_DRAM_ENERGY_STATUS };
 static uint64_t _start_pmc_val_[MAXCORES][4] = { {0} };	/* starting and previous value of msr (performance counter) */
 static uint64_t _pmc_val_[MAXCORES][4]      = { {0} };	/* store difference value of msr (performance counter) */
 
@@ -209,43 +257,56 @@ char *_currtime ()
 	return _curr_time;
 }
 
-/* _rdmsr(file_name, reg, *data) : read from file_name, to *data from offset = reg
+/* _msr_open(file_name) : open an msr device once, read-write if allowed
+ * so the same descriptor serves power limits and PMC setup
+ */
+static int _msr_open (char *msr_file_name)
+{
+	int fd;
+
+	if ((fd = open (msr_file_name, O_RDWR)) < 0)
+		fd = open (msr_file_name, O_RDONLY);
+	if (fd < 0)
+		error("power_knob/rapl: open(%s): %m", msr_file_name);
+	else
+		fd_set_close_on_exec(fd);
+	return fd;
+}
+
+/* _rdmsr(fd, reg, *data) : read to *data from offset = reg of an open msr
+ *  device. The msr driver reads one register per call, so a pass over
+ *  several registers is one pread() each on the persistent descriptor.
  *  char *call_function just uses for debug
  */
-static void _rdmsr (char *call_function, char *msr_file_name, uint32_t reg,
+static void _rdmsr (char *call_function, int fd, uint32_t reg,
 		uint64_t * data)
 {
-	int fd;
-	if ((fd = open (msr_file_name, O_RDONLY)) < 0){
-		exit (1);
-	}
+	msr_read_cnt++;
 	/* pread, pwrite - read from or write to a file descriptor at a given offset */
 	/* pread(int fd, void *buf, size_t count, off_t offset); */
-	if (pread (fd, data, sizeof (*data), reg) != sizeof (*data)){
-		exit (1);
+	if ((fd < 0) || (pread (fd, data, sizeof (*data), reg) != sizeof (*data))){
+		debug("power_knob/rapl: %s: can't read msr 0x%x: %m",
+		      call_function, reg);
+		*data = 0;
 	}
-	close (fd);
 }
 
-/* _read_energy_val(int cpu_socket, uint32_t reg) : read filename[socket] from offset = reg 
- * read energy value from MSR__@@@_ENERGY_STATUS , and return it 
+/* _rdmsr_batch(fd, regs, cnt, data) : read cnt registers of one cpu in
+ *  one pass
  */
-static uint32_t _read_energy_val (int cpu_socket, uint32_t reg)
+static void _rdmsr_batch (char *call_function, int fd, const uint32_t *regs,
+		int cnt, uint64_t *data)
 {
-	uint32_t *p;
-	uint64_t data;
-	_rdmsr ("_read_energy_val", msr_socket_file_name[cpu_socket], reg, &data);
-	p = (uint32_t *) (&data);
-	return p[0];
+	int i;
+
+	for (i = 0; i < cnt; i++)
+		_rdmsr (call_function, fd, regs[i], &data[i]);
 }
 
-/* _update_energy_val(uint32_t reg, int cpu_socket, int num): update value on [cpu_socket][num], msr offset = reg 
+/* _update_energy_val(int cpu_socket, int num, energy): update value on [cpu_socket][num], read from energy_regs[num]
  */
-static void _update_energy_val (uint32_t reg, int cpu_socket, int num)
+static void _update_energy_val (int cpu_socket, int num, uint32_t energy)
 {
-	/* read energy value */
-	uint32_t energy;
-	energy = _read_energy_val (cpu_socket, reg);
 	double val = 0;
 	if (energy < _start_en_val_[cpu_socket][num]){				// overflow
 		val = (double) (((~_start_en_val_[cpu_socket][num] + 1) +
@@ -260,14 +321,14 @@ static void _update_energy_val (uint32_t reg, int cpu_socket, int num)
 	}
 
 	/* update the power of this time interval */
-	switch (reg){
-		case MSR_PKG_ENERGY_STATUS:
+	switch (num){
+		case 0:
 			pkg_epoch[cpu_socket] = val;
 			break;
-		case MSR_PP0_ENERGY_STATUS:
+		case 1:
 			pp0_epoch[cpu_socket] = val;
 			break;
-		case MSR_DRAM_ENERGY_STATUS:
+		case 2:
 			dram_epoch[cpu_socket] = val;
 			break;
 	}
@@ -288,7 +349,7 @@ static void _set_pkg_power_limut (int cpu_socket, int pwLimit, int clamp)
 	debug2("Clamp is %d", clamp);
 	// read the MSR_PKG_POWER_LIMIT Register, , Intel 64 and IA-32 Architectures Software Developer's Manual, pp Vol. 3B 14-21
 	uint64_t pw_limit_reg = 0;
-	_rdmsr ("_set_pkg_power_limit", msr_socket_file_name[cpu_socket],
+	_rdmsr ("_set_pkg_power_limit", msr_socket_fd[cpu_socket],
 			MSR_PKG_POWER_LIMIT, &pw_limit_reg);
 
 	// 64 bit = 16 f letters =	0xffffffffffffffff
@@ -329,15 +390,13 @@ static void _set_pkg_power_limut (int cpu_socket, int pwLimit, int clamp)
 	uint64_t pw_limit_reg_new = pw_limit_reg_upper | (raw_pkg_pw_limit_1_new);
 
 	// write the new value to register
-	int fd = open (msr_socket_file_name[cpu_socket], O_WRONLY);
 	int bwrite =
-		pwrite (fd, &pw_limit_reg_new, sizeof (pw_limit_reg_new),
-				MSR_PKG_POWER_LIMIT);
+		pwrite (msr_socket_fd[cpu_socket], &pw_limit_reg_new,
+				sizeof (pw_limit_reg_new), MSR_PKG_POWER_LIMIT);
 	if (bwrite != sizeof (pw_limit_reg_new)){
-		exit (1);
+		error("power_knob/rapl: can't set power limit of socket %d: %m",
+		      cpu_socket);
 	}
-
-	close (fd);
 	return;
 }
 
@@ -347,20 +406,50 @@ double _get_dram_power_limit (int cpu_socket)
 {
 	// read the MSR_DRAM_POWER_LIMIT Register, , Intel 64 and IA-32 Architectures Software Developer's Manual, pp 14-38 Vol. 3B
 	uint64_t pw_limit_reg = 0;
-	_rdmsr ("_get_dram_power_limit", msr_socket_file_name[cpu_socket],
+	_rdmsr ("_get_dram_power_limit", msr_socket_fd[cpu_socket],
 			MSR_DRAM_POWER_LIMIT, &pw_limit_reg);
 
 	double dram_power_limit = power_units[cpu_socket] * (int) (pw_limit_reg & 0x7fff);	// bit 0~14	 
 	return dram_power_limit;
 }
 
+/* set RAPL dram power limit, NO_VAL disables it. The time window set by
+ * the BIOS is kept.
+ */
+static void _set_dram_power_limit (int cpu_socket, uint32_t pwLimit)
+{
+	// read the MSR_DRAM_POWER_LIMIT Register, , Intel 64 and IA-32 Architectures Software Developer's Manual, pp 14-38 Vol. 3B
+	uint64_t pw_limit_reg = 0, raw_limit;
+	int bwrite;
+
+	_rdmsr ("_set_dram_power_limit", msr_socket_fd[cpu_socket],
+			MSR_DRAM_POWER_LIMIT, &pw_limit_reg);
+
+	if (pwLimit == NO_VAL) {
+		pw_limit_reg &= ~((uint64_t) 0x8000);	// bit 15 = 0
+	} else {
+		raw_limit = (uint64_t) (pwLimit / power_units[cpu_socket]);
+		if (raw_limit > 0x7fff)
+			raw_limit = 0x7fff;
+		pw_limit_reg &= 0xffffffffffff8000;	// clear bit 14~0
+		pw_limit_reg |= 0x8000 | raw_limit;	// enable, new limit
+	}
+
+	bwrite = pwrite (msr_socket_fd[cpu_socket], &pw_limit_reg,
+			 sizeof (pw_limit_reg), MSR_DRAM_POWER_LIMIT);
+	if (bwrite != sizeof (pw_limit_reg)){
+		error("power_knob/rapl: can't set dram power limit of "
+		      "socket %d: %m", cpu_socket);
+	}
+}
+
 /* get pp0 power limit info
  */
 double _get_pp0_power_limit (int cpu_socket)
 {
 	// read the MSR_PP0_POWER_LIMIT Register, , Intel 64 and IA-32 Architectures Software Developer's Manual, pp 14-36 Vol. 3B
 	uint64_t pw_limit_reg = 0;
-	_rdmsr ("_get_pp0_power_limit", msr_socket_file_name[cpu_socket],
+	_rdmsr ("_get_pp0_power_limit", msr_socket_fd[cpu_socket],
 			MSR_PP0_POWER_LIMIT, &pw_limit_reg);
 
 	double pp0_power_limit = power_units[cpu_socket] * (int) (pw_limit_reg & 0x7fff);	// bit 0~14	 
@@ -372,7 +461,7 @@ double _get_pp0_power_limit (int cpu_socket)
 double _get_pkg_power_limit (int cpu_socket)
 {
 	uint64_t pw_limit_reg = 0;
-	_rdmsr ("_get_pkg_power_limit", msr_socket_file_name[cpu_socket],
+	_rdmsr ("_get_pkg_power_limit", msr_socket_fd[cpu_socket],
 			MSR_PKG_POWER_LIMIT, &pw_limit_reg);
 
 	int raw_pkg_pw_limit_1 = (int) (pw_limit_reg & 0x7fff);
@@ -388,8 +477,8 @@ double _get_pkg_power_limit (int cpu_socket)
 static void _wrmsr (int cpu_core, uint32_t reg, uint64_t data, char *strEv, char *strMa,
 		char *strEventName)
 {
-	int fd;
-	if ((fd = open (msr_core_file_name[cpu_core], O_WRONLY)) < 0){
+	int fd = msr_core_fd[cpu_core];
+	if (fd < 0){
 		printf("ERROR in (fd=open(msr_file_name = '%s'): Event= '%s', Mask = '%s', EventName = '%s'\n",
 				msr_core_file_name[cpu_core], strEv, strMa, strEventName);
 		exit (1);
@@ -402,7 +491,6 @@ static void _wrmsr (int cpu_core, uint32_t reg, uint64_t data, char *strEv, char
 		printf ("  data          = 0x%04x\n", (uint32_t) data);
 		exit (1);
 	}
-	close (fd);
 }
 
 /* read from msr_file_name, *data from offset = reg 
@@ -429,15 +517,8 @@ static void _wrpmc (uint32_t evnum, uint32_t umnum, uint32_t reg, char *strEv, c
 /* update pmc values
  * used for get performance monitoring counter
  */
-static void _update_pmc_val (int core_id, int pcm_reg)
+static void _update_pmc_val (int core_id, int pcm_reg, uint64_t pmc)
 {
-	uint32_t reg;
-	uint64_t pmc;
-
-	reg = 0xC1 + pcm_reg;		// offset
-
-	/* _rdmsr(file_name, reg, *data) : read from file_name, to *data from offset = reg */
-	_rdmsr ("pdate_pmc_val", msr_core_file_name[core_id], reg, &pmc);
 	// the period is in ms, so result in sec = *1000/_msec_
 	if (pmc < _start_pmc_val_[core_id][pcm_reg]){				// overflow
 		_pmc_val_[core_id][pcm_reg] = (uint64_t) (((~_start_pmc_val_[core_id][pcm_reg] + 1) +
@@ -475,6 +556,27 @@ int _get_host_name(char *buf, int n)
 	return 0;
 }
 
+/* account the cost of one sample and report it once per period */
+static void _sample_stats (uint32_t sample_usec)
+{
+	sample_cnt++;
+	sample_usec_total += sample_usec;
+	if (sample_usec > sample_usec_max)
+		sample_usec_max = sample_usec;
+	if (sample_cnt < SAMPLE_STATS_PERIOD)
+		return;
+
+	debug2("power_knob/rapl: %u samples, avg %"PRIu64" usec max %u usec, "
+	       "%u msr reads/sample, %d sockets %d cpus, %s pmc", sample_cnt,
+	       sample_usec_total / sample_cnt, sample_usec_max,
+	       msr_read_cnt / sample_cnt, nb_pkg, num_all_cores,
+	       (pmc_backend == PMC_BACKEND_PERF) ? "perf" : "msr");
+	sample_cnt = 0;
+	sample_usec_total = 0;
+	sample_usec_max = 0;
+	msr_read_cnt = 0;
+}
+
 /* get power usage and pmc values on each time interval
  * used for get performance monitoring counter
  */
@@ -482,38 +584,48 @@ static void _get_power_at_time_interval ()
 {
     debug3("CAO: power_knob_rapl.c: _get_power_at_time_interval()");
 	int i, k, l;
-	//struct timeval tv;
-	struct itimerval timer;
 	time_t current_time;
 	struct node_power_info node;
 
-	static struct timeval prev_tv;
-	struct timeval now_tv;
-	gettimeofday(&now_tv,NULL);
+	/* the sampler period varies, so rate everything over the time
+	 * actually elapsed since the previous sample */
+	static struct timespec prev_ts;
+	struct timespec now_ts;
+	clock_gettime(CLOCK_MONOTONIC, &now_ts);
 	float _sample_msec;
-	_sample_msec = (float)((1000000 * (now_tv.tv_sec - prev_tv.tv_sec)) + (now_tv.tv_usec - prev_tv.tv_usec)) / (1000);
-	//fprintf (stderr, " #####################################\nSAMPLE  %lf\n",_sample_msec);
-	prev_tv.tv_sec = now_tv.tv_sec;
-	prev_tv.tv_usec = now_tv.tv_usec;
+	_sample_msec = (float)(now_ts.tv_sec - prev_ts.tv_sec) * 1000 +
+		       (float)(now_ts.tv_nsec - prev_ts.tv_nsec) / 1000000;
+	prev_ts = now_ts;
 
 	_msec_ = _sample_msec;
 
-	char my_host_name[64];
-	_get_host_name(&my_host_name, sizeof(my_host_name));
+	static const uint32_t limit_regs[3] = {
+		MSR_PKG_POWER_LIMIT, MSR_PP0_POWER_LIMIT,
+		MSR_DRAM_POWER_LIMIT };
+	static const uint32_t pmc_regs[4] = { 0xC1, 0xC2, 0xC3, 0xC4 };
+	uint64_t socket_regs[6], core_regs[4];
+	struct timespec start_ts, end_ts;
+	uint32_t sample_usec;
 
-	timer.it_value.tv_sec = interval_sec;
-	timer.it_value.tv_usec = interval_usec;
-	timer.it_interval.tv_sec = interval_sec;
-	timer.it_interval.tv_usec = interval_usec;
-	if (setitimer (ITIMER_REAL, &timer, NULL) < 0){
-		perror ("setitimer");
-	}
+	clock_gettime(CLOCK_MONOTONIC, &start_ts);
+	memset(&node, 0, sizeof(struct node_power_info));
 
-	/* update the power of each cpu socket now */
+	/* update the power of each cpu socket now, reading its energy and
+	 * limit registers in one pass */
 	for (i = 0; i < nb_pkg; i++){
-		_update_energy_val (MSR_PKG_ENERGY_STATUS, i, 0);	// PKG
-		_update_energy_val (MSR_PP0_ENERGY_STATUS, i, 1);	// PP0
-		_update_energy_val (MSR_DRAM_ENERGY_STATUS, i, 2);// DRAM
+		_rdmsr_batch ("_get_power_at_time_interval", msr_socket_fd[i],
+			      energy_regs, 3, socket_regs);
+		_rdmsr_batch ("_get_power_at_time_interval", msr_socket_fd[i],
+			      limit_regs, 3, &socket_regs[3]);
+		_update_energy_val (i, 0, (uint32_t) socket_regs[0]);	// PKG
+		_update_energy_val (i, 1, (uint32_t) socket_regs[1]);	// PP0
+		_update_energy_val (i, 2, (uint32_t) socket_regs[2]);	// DRAM
+		node.pkg_limit[i] = power_units[i] *
+				    (int) (socket_regs[3] & 0x7fff);
+		node.pp0_limit[i] = power_units[i] *
+				    (int) (socket_regs[4] & 0x7fff);
+		node.dram_limit[i] = power_units[i] *
+				     (int) (socket_regs[5] & 0x7fff);
 	}
 
 	//printf("%.2f %.2f %.2f \n", pkg_epoch[0], pp0_epoch[0], dram_epoch[0]);
@@ -526,10 +638,18 @@ static void _get_power_at_time_interval ()
 		}
 	}
 
-	/* get 4 pmc values of all cores */
+	/* get 4 pmc values of all cores, one pass per core */
 	for (l = 0; l < num_all_cores; l++){
+		if (pmc_backend == PMC_BACKEND_PERF){
+			if (pmc_perf_group_read (pmc_group[l], core_regs))
+				memcpy (core_regs, _start_pmc_val_[l],
+					sizeof (core_regs));
+		}else{
+			_rdmsr_batch ("_get_power_at_time_interval",
+				      msr_core_fd[l], pmc_regs, 4, core_regs);
+		}
 		for (k = 0; k < 4; k++){
-			_update_pmc_val (l, k);
+			_update_pmc_val (l, k, core_regs[k]);
 		}
 	}
 
@@ -555,17 +675,11 @@ static void _get_power_at_time_interval ()
 	//fprintf(stderr, "%s ",my_host_name);
 	debug3( "host:%s ",my_host_name);
 
-	memset(&node, 0, sizeof(struct node_power_info));
-	
 	if(local_power==NULL){
 		return;
 	}
 	
 	for (i = 0; i < nb_pkg; i++){
-		// power limit now
-		node.pkg_limit[i] = _get_pkg_power_limit (i);
-		node.pp0_limit[i] = _get_pp0_power_limit (i);
-		node.dram_limit[i] = _get_dram_power_limit (i);
 		// power usage now	 
 		node.pkg_watts[i] = pkg_epoch[i];
 		node.pp0_watts[i] = pp0_epoch[i];
@@ -592,25 +706,15 @@ static void _get_power_at_time_interval ()
 
 	local_power[0].cpu_current_frequency = (uint32_t)_get_avr_cpufreq();	
 
+	clock_gettime(CLOCK_MONOTONIC, &end_ts);
+	sample_usec = (end_ts.tv_sec - start_ts.tv_sec) * 1000000 +
+		      (end_ts.tv_nsec - start_ts.tv_nsec) / 1000;
+	_sample_stats(sample_usec);
+
 	debug3("%ld %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f ", current_time,
 			node.pkg_limit[0], node.pkg_watts[0], node.pp0_limit[0], node.pp0_watts[0], node.dram_limit[0], node.dram_watts[0], 
 			node.pkg_limit[1], node.pkg_watts[1], node.pp0_limit[1], node.pp0_watts[1], node.dram_limit[1], node.dram_watts[1]);
 
-	////sprintf(file_name,"%s%s.log",RAPL_DATA_ROOT,my_host_name);
-	//sprintf(file_name,"/home/.slurm/log/%s.log",my_host_name);
-	////fprintf(stderr, " file name %s ",file_name);
-
-	//fp = fopen(file_name, "a");
-
-	//fprintf(fp,"%ld %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f ", current_time,
-	//		node.pkg_limit[0], node.pkg_watts[0], node.pp0_limit[0], node.pp0_watts[0], node.dram_limit[0], node.dram_watts[0], 
-	//		node.pkg_limit[1], node.pkg_watts[1], node.pp0_limit[1], node.pp0_watts[1], node.dram_limit[1], node.dram_watts[1]);
-	//fprintf(fp,"%6.2f %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f %s\n", 
-	//		node.pmc[0][0], node.pmc[0][1], node.pmc[0][2], node.pmc[0][3], 
-	//		node.pmc[1][0], node.pmc[1][1], node.pmc[1][2], node.pmc[1][3]);
-	//
-	//fclose(fp);
-
 	return;
 }
 
@@ -774,6 +878,7 @@ static void _hardware(void)
 			sscanf(buf, "processor\t: %d", &cpu);
 			//printf("proc %d\n",cpu);
 			sprintf (msr_core_file_name[num_all_cores], "/dev/cpu/%d/msr", cpu);
+			core_cpu_id[num_all_cores] = cpu;
 			num_all_cores++;
 			continue;
 		}
@@ -796,6 +901,16 @@ static void _hardware(void)
 	}
 	fclose(fd);
 
+	/* keep one descriptor per msr device for the daemon's lifetime */
+	for (i = 0; i < nb_pkg; i++)
+		msr_socket_fd[i] = _msr_open (msr_socket_file_name[i]);
+	for (i = 0; i < num_all_cores; i++)
+		msr_core_fd[i] = _msr_open (msr_core_file_name[i]);
+
+	if (gethostname(my_host_name, sizeof(my_host_name)) < 0)
+		my_host_name[0] = '\0';
+	my_host_name[sizeof(my_host_name) - 1] = '\0';
+
 	/* number of cores that enable cpufreq */
 	num_dvfs_cores = 0;
 	for (i = 0; i < num_all_cores; i++){
@@ -818,9 +933,10 @@ int _init_rapl()
 		//Calculate the units used
 		uint64_t pw_unit_reg = 0;
 		uint64_t pw_info_reg = 0;
-		_rdmsr ("main", msr_socket_file_name[i], MSR_RAPL_POWER_UNIT,
+		uint64_t start_regs[3];
+		_rdmsr ("main", msr_socket_fd[i], MSR_RAPL_POWER_UNIT,
 				&pw_unit_reg);
-		_rdmsr ("main", msr_socket_file_name[i], MSR_PKG_POWER_INFO,
+		_rdmsr ("main", msr_socket_fd[i], MSR_PKG_POWER_INFO,
 				&pw_info_reg);
 
 		power_units[i] = pow (0.5, (double) (pw_unit_reg & 0xf));
@@ -829,9 +945,11 @@ int _init_rapl()
 		thermal_design_power[i] =
 			power_units[i] * (double) (pw_info_reg & 0x7fff);
 
-		_start_en_val_[i][0] = _read_energy_val (i, MSR_PKG_ENERGY_STATUS);	// PKG
-		_start_en_val_[i][1] = _read_energy_val (i, MSR_PP0_ENERGY_STATUS);	// PP0
-		_start_en_val_[i][2] = _read_energy_val (i, MSR_DRAM_ENERGY_STATUS);	// DRAM	 
+		_rdmsr_batch ("main", msr_socket_fd[i], energy_regs, 3,
+			      start_regs);
+		_start_en_val_[i][0] = (uint32_t) start_regs[0];	// PKG
+		_start_en_val_[i][1] = (uint32_t) start_regs[1];	// PP0
+		_start_en_val_[i][2] = (uint32_t) start_regs[2];	// DRAM
 
 #ifdef CODE_DEBUG
 		fprintf (stderr, "	Power Units = %.3fW\n", power_units[i]);
@@ -868,10 +986,92 @@ int _init_rapl()
 	return 0;
 }
 
+/* parse a "<key><msec>" PowerParameters option, keep *msec if absent */
+static void _read_msec_param(char *power_params, char *key, uint32_t *msec)
+{
+	char *tmp, *end;
+	long val;
+
+	if (!power_params || !(tmp = strstr(power_params, key)))
+		return;
+	val = strtol(tmp + strlen(key), &end, 10);
+	if ((end == tmp + strlen(key)) || (val < 10) || (val > 3600000))
+		error("power_knob/rapl: invalid PowerParameters %s%s",
+		      key, tmp + strlen(key));
+	else
+		*msec = (uint32_t) val;
+}
+
+/* read pmc_backend and the sampler periods from PowerParameters */
+static void _read_power_params(void)
+{
+	char *power_params = slurm_get_power_parameters();
+	char *tmp;
+
+	pmc_backend = PMC_BACKEND_MSR;
+	if (power_params && (tmp = strstr(power_params, "pmc_backend="))) {
+		tmp += strlen("pmc_backend=");
+		if (!strncasecmp(tmp, "perf", 4))
+			pmc_backend = PMC_BACKEND_PERF;
+		else if (strncasecmp(tmp, "msr", 3))
+			error("power_knob/rapl: invalid PowerParameters "
+			      "pmc_backend, using msr");
+	}
+
+	sample_fast_msec = DEFAULT_SAMPLE_FAST;
+	sample_idle_msec = DEFAULT_SAMPLE_IDLE;
+	sample_settle_msec = DEFAULT_SAMPLE_SETTLE;
+	_read_msec_param(power_params, "sample_fast=", &sample_fast_msec);
+	_read_msec_param(power_params, "sample_idle=", &sample_idle_msec);
+	_read_msec_param(power_params, "sample_settle=", &sample_settle_msec);
+	if (sample_fast_msec > sample_idle_msec)
+		sample_fast_msec = sample_idle_msec;
+	xfree(power_params);
+}
+
+static void _fini_pmc_perf(void)
+{
+	int i;
+
+	for (i = 0; i < MAXCORES; i++){
+		pmc_perf_group_close (pmc_group[i]);
+		pmc_group[i] = NULL;
+	}
+}
+
+/* open a counter group on every core, all or nothing */
+static int _init_pmc_perf(void)
+{
+#ifdef __linux__
+	int i;
+
+	for (i = 0; i < num_all_cores; i++){
+		pmc_group[i] = pmc_perf_group_open (-1, core_cpu_id[i],
+						    pmc_perf_events, 4);
+		if (!pmc_group[i] ||
+		    pmc_perf_group_read (pmc_group[i], _start_pmc_val_[i])){
+			info("power_knob/rapl: perf pmc backend unusable on "
+			     "cpu %d (%m), using msr", core_cpu_id[i]);
+			_fini_pmc_perf();
+			return SLURM_ERROR;
+		}
+	}
+	return SLURM_SUCCESS;
+#else
+	return SLURM_ERROR;
+#endif
+}
+
 int _init_pmc()
 {
 	int i,k;
 
+	_read_power_params();
+	if ((pmc_backend == PMC_BACKEND_PERF) &&
+	    (_init_pmc_perf() == SLURM_SUCCESS))
+		return 0;
+	pmc_backend = PMC_BACKEND_MSR;
+
 	_wrpmc (0x2E, 0x4F, 0x186, "0x2E", "0x4F", "PMC1");	// 2EH 4FH LONGEST_LAT_CACHE.REFERENCE This event counts requests originating from the core that reference a cache line in the last level cache.
 	_wrpmc (0x2E, 0x41, 0x187, "0x2E", "0x41", "PMC2");	// 2EH 41H LONGEST_LAT_CACHE.MISS This event counts each cache miss condition for references to the last level cache.
 	_wrpmc (0x24, 0x30, 0x188, "0x24", "0x30", "PMC3");	// 24H 30H L2_RQSTS.ALL_CODE_RD Counts all L2 code requests.
@@ -880,38 +1080,124 @@ int _init_pmc()
 	/* get pmc started values */
 	for (i = 0; i < num_all_cores; i++){
 		for (k = 0; k < 4; k++){
-			_update_pmc_val (i, k);
+			_rdmsr ("_init_pmc", msr_core_fd[i], 0xC1 + k,
+				&_start_pmc_val_[i][k]);
 		}
 	}
 	return 0;
 }
 
-static void *_get_power_loop(void *arg){
-	while(1){
+/* sample now and keep the fast rate for the next sample_settle_msec */
+static void _sample_refresh(void)
+{
+	struct timespec until;
+
+	clock_gettime(CLOCK_MONOTONIC, &until);
+	slurm_ts_add_msec(&until, sample_settle_msec);
+
+	slurm_mutex_lock(&sample_lock);
+	if (slurm_ts_before(&fast_until, &until))
+		fast_until = until;
+	sample_wake = true;
+	if (sample_thread)
+		pthread_cond_signal(&sample_cond);
+	slurm_mutex_unlock(&sample_lock);
+}
+
+/*
+ * Sample at sample_fast_msec until fast_until passes, then at
+ * sample_idle_msec. Deadlines advance from the previous deadline rather
+ * than from the end of the sample, so the period does not drift by the
+ * sampling cost. _sample_refresh() samples at once and restarts the
+ * period from there.
+ */
+static void *_get_power_loop(void *arg)
+{
+	struct timespec next, now;
+	uint32_t period;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	slurm_mutex_lock(&sample_lock);
+	while (!sample_stop) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (slurm_ts_before(&now, &fast_until))
+			period = sample_fast_msec;
+		else
+			period = sample_idle_msec;
+		slurm_ts_add_msec(&next, period);
+		if (!slurm_ts_before(&now, &next)) {
+			/* overran a whole period, resynchronize */
+			next = now;
+			slurm_ts_add_msec(&next, period);
+		}
+
+		while (!sample_stop && !sample_wake) {
+			if (pthread_cond_timedwait(&sample_cond, &sample_lock,
+						   &next) == ETIMEDOUT)
+				break;
+		}
+		if (sample_stop)
+			break;
+		if (sample_wake)
+			clock_gettime(CLOCK_MONOTONIC, &next);
+		sample_wake = false;
+
+		slurm_mutex_unlock(&sample_lock);
 		_get_power_at_time_interval();
-		sleep(1);
+		slurm_mutex_lock(&sample_lock);
 	}
+	slurm_mutex_unlock(&sample_lock);
+
+	return NULL;
 }
 
 int _set_interval()
 {
 	pthread_attr_t thread_attr;
-	pthread_t thread_id;
+	pthread_condattr_t cond_attr;
 
-	slurm_mutex_lock(&interval_monitor_mutex);
-	if(interval_monitor_enabled){
-		slurm_mutex_unlock(&interval_monitor_mutex);
+	slurm_mutex_lock(&sample_lock);
+	if (sample_thread){
+		slurm_mutex_unlock(&sample_lock);
 		return SLURM_SUCCESS;
 	}
 
-	interval_monitor_enabled = true;
-	slurm_mutex_unlock(&interval_monitor_mutex);
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&sample_cond, &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+	sample_stop = false;
 
-	while(pthread_create(&thread_id, NULL, _get_power_loop, NULL)){
+	slurm_attr_init(&thread_attr);
+	/* since we do a join on this later we don't make it detached */
+	while (pthread_create(&sample_thread, &thread_attr, _get_power_loop,
+			      NULL)){
 		error(" pthread_create");
 		sleep(1);
 	}
+	slurm_attr_destroy(&thread_attr);
+	slurm_mutex_unlock(&sample_lock);
+
+	debug("power_knob/rapl: sampling every %u msec, %u msec for %u msec "
+	      "after a change", sample_idle_msec, sample_fast_msec,
+	      sample_settle_msec);
+	return SLURM_SUCCESS;
+}
+
+static void _stop_interval(void)
+{
+	slurm_mutex_lock(&sample_lock);
+	if (!sample_thread){
+		slurm_mutex_unlock(&sample_lock);
+		return;
+	}
+	sample_stop = true;
+	pthread_cond_signal(&sample_cond);
+	slurm_mutex_unlock(&sample_lock);
 
+	pthread_join(sample_thread, NULL);
+	sample_thread = 0;
+	pthread_cond_destroy(&sample_cond);
 }
 
 /*
@@ -928,6 +1214,20 @@ extern int init(void)
 
 extern int fini(void)
 {
+	int i;
+
+	_stop_interval();
+	for (i = 0; i < MAX_PKGS; i++){
+		if (msr_socket_fd[i] >= 0)
+			close(msr_socket_fd[i]);
+		msr_socket_fd[i] = -1;
+	}
+	for (i = 0; i < MAXCORES; i++){
+		if (msr_core_fd[i] >= 0)
+			close(msr_core_fd[i]);
+		msr_core_fd[i] = -1;
+	}
+	_fini_pmc_perf();
 	power_knob_current_destroy(local_power);
 	power_knob_cache_destroy(local_cache);
 	local_power = NULL;
@@ -1000,7 +1300,20 @@ extern int power_knob_p_set_data(power_knob_cap_req_msg_t *cap_msg)
 	//_set_pkg_power_limut (int cpu_socket, double pwLimit, int clamp)			
 	_set_pkg_power_limut (0, cap_msg->cap_info, 1);
 	_set_pkg_power_limut (1, cap_msg->cap_info2, 1);
-	
+	if (cap_msg->dram_cap_info)
+		_set_dram_power_limit (0, cap_msg->dram_cap_info);
+	if (cap_msg->dram_cap_info2 && (nb_pkg > 1))
+		_set_dram_power_limit (1, cap_msg->dram_cap_info2);
+
+	/* watch the new cap settle */
+	_sample_refresh();
+
+	return SLURM_SUCCESS;
+}
+
+extern int power_knob_p_refresh(void)
+{
+	_sample_refresh();
 	return SLURM_SUCCESS;
 }
 
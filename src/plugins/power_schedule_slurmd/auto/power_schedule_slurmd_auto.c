@@ -37,6 +37,7 @@
 
 #include <pthread.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "slurm/slurm_errno.h"
@@ -45,6 +46,12 @@
 #include "src/common/log.h"
 #include "src/common/slurm_priority.h"
 #include "src/common/macros.h"
+#include "src/common/slurm_protocol_api.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+#include "src/slurmctld/locks.h"
+#include "src/slurmctld/power_budget.h"
+#include "src/slurmctld/power_collect.h"
 #include "src/slurmctld/slurmctld.h"
 
 
@@ -57,10 +64,24 @@ static int plugin_errno = SLURM_SUCCESS;
 
 static pthread_t powerschedule_slurmd_thread = 0;
 static pthread_mutex_t thread_flag_mutex = PTHREAD_MUTEX_INITIALIZER;
+static power_pace_t schedule_pace;
 
 static void *_get_schedule_slurmd_auto_loop(void);
 
 static void stop_get_schedule_slurmd_auto_loop(void);
+static void _load_config(void);
+
+/* PowerParameters, see _load_config() */
+static uint32_t node_watts = 0;		/* default node budget, 0 for none */
+static uint32_t period_msec = 0;	/* slurmd control period */
+
+/* Aggregate of the controller state replies of one round */
+typedef struct {
+	uint32_t node_cnt;
+	uint64_t avg_watts;
+	uint32_t exceeded_cnt;
+	uint32_t exceeded_nodes;
+} schedule_state_t;
 
 
 int power_schedule_slurmd_p_send_to_slurmd_autocap_request();
@@ -72,6 +93,7 @@ int init( void )
 
 	verbose( "power schedule: Power schedule_slurmd plugin AUTO  loaded" );
 	debug ("Hello from plugin SCHEDULE init");
+	_load_config();
 
 	slurm_mutex_lock( &thread_flag_mutex );
 	if ( powerschedule_slurmd_thread ) {
@@ -79,6 +101,7 @@ int init( void )
 		slurm_mutex_unlock( &thread_flag_mutex );
 		return SLURM_ERROR;
 	}
+	power_pace_init(&schedule_pace);
 	slurm_attr_init( &attr );
 	
 	/* since we do a join on this later we don't make it detached */
@@ -100,6 +123,7 @@ void fini( void )
 		verbose( "Power schedule auto plugin shutting down" );
 		stop_get_schedule_slurmd_auto_loop();
 		pthread_join( powerschedule_slurmd_thread, NULL);
+		power_pace_destroy(&schedule_pace);
 		 powerschedule_slurmd_thread = 0;
 	}
 	slurm_pthread_mutex_unlock( &thread_flag_mutex );
@@ -108,119 +132,134 @@ void fini( void )
 }
 
 static void *_get_schedule_slurmd_auto_loop(void){
-	int i;
-	while(1){
+	do {
 		power_schedule_slurmd_p_send_to_slurmd_autocap_request();
-		sleep(10);
-		//sleep (slurmctld_conf.power_allocatorinterval);
-	}
+	} while (power_pace_wait(&schedule_pace, 10000));
+	return NULL;
 }
 
 
 /* Terminate power thread */
 static void stop_get_schedule_slurmd_auto_loop(void)
 {
-	slurm_mutex_lock(&thread_flag_mutex );
-//	stop_power = true;
-//	slurm_cond_signal(&term_cond);
-	slurm_mutex_unlock(&thread_flag_mutex );
+	power_pace_stop(&schedule_pace);
 }
 
 
 
 int power_schedule_slurmd_p_reconfig( void )
 {
-	//backfill_reconfig();
+	_load_config();
 	return SLURM_SUCCESS;
 }
 
+static void _load_config(void)
+{
+	char *power_params, *tmp_ptr;
+	long val;
+
+	power_params = slurm_get_power_parameters();
+	if (!power_params)
+		power_params = xmalloc(1);	/* Set defaults below */
+
+	node_watts = 0;
+	/*                                   12345678901234567890 */
+	if ((tmp_ptr = strstr(power_params, "slurmd_node_watts="))) {
+		val = strtol(tmp_ptr + 18, NULL, 10);
+		if (val < 0)
+			error("PowerParameters: slurmd_node_watts=%ld invalid",
+			      val);
+		else
+			node_watts = val;
+	}
+	period_msec = 0;
+	if ((tmp_ptr = strstr(power_params, "slurmd_period_msec="))) {
+		val = strtol(tmp_ptr + 19, NULL, 10);
+		if (val < 0)
+			error("PowerParameters: slurmd_period_msec=%ld invalid",
+			      val);
+		else
+			period_msec = val;
+	}
+	xfree(power_params);
+}
+
+static void _state_reply(int node_inx, uint16_t msg_type, void *msg_data,
+			 void *arg)
+{
+	power_schedule_slurmd_resp_msg_t *resp = msg_data;
+	schedule_state_t *state = arg;
+
+	if ((msg_type != RESPONSE_POWER_SCHEDULE_SLURMD) || !resp)
+		return;
+	state->node_cnt++;
+	state->avg_watts += resp->avg_watts;
+	if (resp->exceeded_cnt) {
+		state->exceeded_cnt += resp->exceeded_cnt;
+		state->exceeded_nodes++;
+		debug("power_schedule_slurmd: %s exceeded its %u W budget "
+		      "%u time(s), peak %u W",
+		      node_record_table_ptr[node_inx].name, resp->node_watts,
+		      resp->exceeded_cnt, resp->peak_watts);
+	}
+}
+
+/*
+ * Hand every node its budget: its share of the power layout domains it
+ * sits in, else slurmd_node_watts. All budgets go in one request down the
+ * forwarding tree. slurmd only acts on a changed budget, so resending it
+ * every round costs nothing and doubles as the state poll; it also reaches
+ * slurmd daemons which restarted since the last round.
+ */
 int power_schedule_slurmd_p_send_to_slurmd_autocap_request()
 {
-	int rc;
-	int i;
-	slurm_msg_t req_msg;
-	slurm_msg_t resp_msg;
-	char *host;
-	char *this_addr;
-	struct node_record *node_ptr;
-	
-	power_schedule_slurmd_req_msg_t req;
-	
-	uint32_t cluster_flags = slurmdb_setup_cluster_flags();
+	/* Locks: Read job, read node */
+	slurmctld_lock_t read_lock = {
+		NO_LOCK, READ_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
+	schedule_state_t state;
+	bitstr_t *node_bitmap, *fail_bitmap = NULL;
+	uint32_t *budgets, node_cnt;
+	char *fail_nodes;
+	int i, fail_cnt;
 
-	slurm_msg_t_init(&req_msg);
-	slurm_msg_t_init(&resp_msg);
-	
-	
-	for(i=0, node_ptr = node_record_table_ptr;
-		i<node_record_count; i++, node_ptr++){
-		
-		debug3(" PMON node name : %s",node_ptr->name);
-		host = node_ptr->name;
-	if (host)
-		slurm_conf_get_addr(host, &req_msg.address);
-	else if (cluster_flags & CLUSTER_FLAG_MULTSD) {
-		if ((this_addr = getenv("SLURMD_NODENAME"))) {
-			slurm_conf_get_addr(this_addr, &req_msg.address);
-		} else {
-			this_addr = "localhost";
-			slurm_set_addr(&req_msg.address,
-				       (uint16_t)slurm_get_slurmd_port(),
-				       this_addr);
-		}
+	lock_slurmctld(read_lock);
+	node_cnt = node_record_count;
+	budgets = xmalloc(sizeof(uint32_t) * MAX(node_cnt, 1));
+	power_budget_refresh();
+	power_budget_node_caps(budgets);
+	unlock_slurmctld(read_lock);
+
+	for (i = 0; i < node_cnt; i++) {
+		if (!budgets[i])
+			budgets[i] = node_watts;
 	}
-	else {
-		char this_host[256];
-		/*
-		 *  Set request message address to slurmd on localhost
-		 */
-		gethostname_short(this_host, sizeof(this_host));
-		this_addr = slurm_conf_get_nodeaddr(this_host);
-		if (this_addr == NULL)
-			this_addr = xstrdup("localhost");
-		slurm_set_addr(&req_msg.address,
-			       (uint16_t)slurm_get_slurmd_port(),
-			       this_addr);
-		xfree(this_addr);
+	/* sized like the budgets, so a reconfigure in between is caught */
+	node_bitmap = bit_alloc(node_cnt);
+	bit_set_all(node_bitmap);
+
+	memset(&state, 0, sizeof(state));
+	fail_cnt = power_collect_set_budgets(node_bitmap, budgets, period_msec,
+					     0, _state_reply, &state,
+					     &fail_bitmap);
+	if (fail_cnt) {
+		fail_nodes = bitmap2node_name(fail_bitmap);
+		error("power_schedule_slurmd_p_send_to_slurmd_autocap_request: "
+		      "no reply from %s", fail_nodes);
+		xfree(fail_nodes);
 	}
+	FREE_NULL_BITMAP(fail_bitmap);
+	FREE_NULL_BITMAP(node_bitmap);
+	xfree(budgets);
 
-	req_msg.msg_type = REQUEST_POWER_SCHEDULE_SLURMD;
-	req_msg.data     = &req;
-    
-    debug3("LINH: REQUEST_POWER_SCHEDULE_SLURMD: do slurm_send_recv_node_msg. *host = '%s'", host);
-	rc = slurm_send_recv_node_msg(&req_msg, &resp_msg, 0);
-	
-	// Return signal does nothing, so it is chosen randomly as RESPONSE_POWER_KNOB_GET_INFO:
-	
-	if (rc != 0 || !resp_msg.auth_cred) {
-		error("slurm_get_node_energy: %m");
-		if (resp_msg.auth_cred)
-			g_slurm_auth_destroy(resp_msg.auth_cred);
-		return SLURM_ERROR;
+	if (state.exceeded_nodes) {
+		info("power_schedule_slurmd: %u of %u nodes exceeded their "
+		     "budget (%u episodes)", state.exceeded_nodes,
+		     state.node_cnt, state.exceeded_cnt);
 	}
-	if (resp_msg.auth_cred)
-		g_slurm_auth_destroy(resp_msg.auth_cred);
-	switch (resp_msg.msg_type) {
-	case RESPONSE_POWER_KNOB_GET_INFO:
-//		socket_cnt = ((power_knob_get_info_node_resp_msg_t *) 
-//			resp_msg.data)->socket_cnt;
-//		set_info = ((power_knob_get_info_node_resp_msg_t *) 
-//			resp_msg.data)->power_info;
-//		((power_knob_get_info_node_resp_msg_t *) resp_msg.data)->power_info = NULL;
-//		slurm_free_power_knob_get_info_node_resp_msg(resp_msg.data);
-		break;
-	case RESPONSE_SLURM_RC:
-	        rc = ((return_code_msg_t *) resp_msg.data)->return_code;
-		slurm_free_return_code_msg(resp_msg.data);
-		if (rc)
-			slurm_seterrno_ret(rc);
-		break;
-	default:
-		slurm_seterrno_ret(SLURM_UNEXPECTED_MSG_ERROR);
-		break;
+	if (state.node_cnt) {
+		debug2("power_schedule_slurmd: %u nodes, %"PRIu64" W in total",
+		       state.node_cnt, state.avg_watts);
 	}
-	
-	//Finish of the RESPONSE
-		}
-	return SLURM_SUCCESS;
+
+	return fail_cnt ? SLURM_ERROR : SLURM_SUCCESS;
 }
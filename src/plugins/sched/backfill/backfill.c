@@ -90,6 +90,7 @@
 #include "src/slurmctld/licenses.h"
 #include "src/slurmctld/locks.h"
 #include "src/slurmctld/node_scheduler.h"
+#include "src/slurmctld/power_budget.h"
 #include "src/slurmctld/preempt.h"
 #include "src/slurmctld/reservation.h"
 #include "src/slurmctld/slurmctld.h"
@@ -110,6 +111,9 @@ typedef struct node_space_map {
 	time_t begin_time;
 	time_t end_time;
 	bitstr_t *avail_bitmap;
+	uint64_t power_watts;	/* watts committed over this interval */
+	uint64_t *domain_watts;	/* watts committed below each power domain
+				 * over this interval, NULL if none */
 	int next;	/* next record, by time, zero termination */
 } node_space_map_t;
 
@@ -132,6 +136,9 @@ static int bf_job_part_count_reserve = 0;
 static int bf_max_job_array_resv = BF_MAX_JOB_ARRAY_RESV;
 static int bf_min_age_reserve = 0;
 static uint32_t bf_min_prio_reserve = 0;
+static bool bf_power = false;		/* plan job starts against power */
+static uint32_t bf_power_budget = 0;	/* PowerBudget watts, zero if none */
+static int bf_domain_cnt = 0;		/* power domains with limits */
 static int max_backfill_job_cnt = 100;
 static int max_backfill_job_per_part = 0;
 static int max_backfill_job_per_user = 0;
@@ -144,22 +151,34 @@ static int yield_sleep   = YIELD_SLEEP;
 
 /*********************** local functions *********************/
 static void _add_reservation(uint32_t start_time, uint32_t end_reserve,
-			     bitstr_t *res_bitmap,
+			     bitstr_t *res_bitmap, uint64_t watts,
+			     uint64_t *domain_watts,
 			     node_space_map_t *node_space,
 			     int *node_space_recs);
+static int  _add_running_power(struct job_record *job_ptr,
+			       node_space_map_t *node_space,
+			       int *node_space_recs);
 static int  _attempt_backfill(void);
 static int  _clear_job_start_times(void *x, void *arg);
 static void _do_diag_stats(struct timeval *tv1, struct timeval *tv2);
 static bool _job_part_valid(struct job_record *job_ptr,
 			    struct part_record *part_ptr);
+static uint64_t _job_power(struct job_record *job_ptr, bitstr_t *bitmap,
+			   uint64_t *job_domain);
 static void _load_config(void);
 static bool _many_pending_rpcs(void);
 static bool _more_work(time_t last_backfill_time);
 static uint32_t _my_sleep(int usec);
+static bool _power_fits_alone(struct job_record *job_ptr, uint64_t job_watts,
+			      uint64_t *job_domain);
 static int  _num_feature_count(struct job_record *job_ptr, bool *has_xor);
 static void _reset_job_time_limit(struct job_record *job_ptr, time_t now,
 				  node_space_map_t *node_space);
 static int  _start_job(struct job_record *job_ptr, bitstr_t *avail_bitmap);
+static time_t _test_power_overlap(struct job_record *job_ptr,
+				  node_space_map_t *node_space,
+				  uint64_t job_watts, uint64_t *job_domain,
+				  time_t start_time, time_t end_time);
 static bool _test_resv_overlap(node_space_map_t *node_space,
 			       bitstr_t *use_bitmap, uint32_t start_time,
 			       uint32_t end_reserve);
@@ -210,8 +229,14 @@ static void _dump_node_space_table(node_space_map_t *node_space_ptr)
 		slurm_make_time_str(&node_space_ptr[i].end_time,
 				    end_buf, sizeof(end_buf));
 		node_list = bitmap2node_name(node_space_ptr[i].avail_bitmap);
-		info("Begin:%s End:%s Nodes:%s",
-		     begin_buf, end_buf, node_list);
+		if (bf_power) {
+			info("Begin:%s End:%s Nodes:%s Watts:%"PRIu64,
+			     begin_buf, end_buf, node_list,
+			     node_space_ptr[i].power_watts);
+		} else {
+			info("Begin:%s End:%s Nodes:%s",
+			     begin_buf, end_buf, node_list);
+		}
 		xfree(node_list);
 		if ((i = node_space_ptr[i].next) == 0)
 			break;
@@ -641,6 +666,22 @@ static void _load_config(void)
 		}
 	}
 
+	/* bf_power plans job starts against PowerBudget and the power
+	 * domain limits over time */
+	bf_power = false;
+	bf_power_budget = 0;
+	tmp_ptr = sched_params;
+	while (tmp_ptr && (tmp_ptr = strstr(tmp_ptr, "bf_power"))) {
+		tmp_ptr += 8;
+		if ((tmp_ptr[0] != '\0') && (tmp_ptr[0] != ','))
+			continue;	/* some longer option name */
+		bf_power = true;
+		if ((slurmctld_conf.z_32 != NO_VAL) &&
+		    (slurmctld_conf.z_32 != 0))
+			bf_power_budget = slurmctld_conf.z_32;
+		break;
+	}
+
 	/* bf_continue makes backfill continue where it was if interrupted */
 	if (sched_params && (strstr(sched_params, "bf_continue"))) {
 		backfill_continue = true;
@@ -889,7 +930,7 @@ static int _attempt_backfill(void)
 	List job_queue;
 	job_queue_rec_t *job_queue_rec;
 	slurmdb_qos_rec_t *qos_ptr = NULL, *qos_part_ptr = NULL;;
-	int bb, i, j, node_space_recs, mcs_select = 0;
+	int bb, i, j, node_space_recs, power_space_recs = 0, mcs_select = 0;
 	struct job_record *job_ptr;
 	struct part_record *part_ptr, **bf_part_ptr = NULL;
 	uint32_t end_time, end_reserve, deadline_time_limit, boot_time;
@@ -921,6 +962,8 @@ static int _attempt_backfill(void)
 	uint8_t save_share_res, save_whole_node;
 	int test_fini;
 	uint32_t qos_flags = 0;
+	uint64_t job_watts, *job_domain = NULL;
+	time_t power_start;
 	time_t qos_blocked_until = 0, qos_part_blocked_until = 0;
 	/* QOS Read lock */
 	assoc_mgr_lock_t qos_read_lock =
@@ -984,14 +1027,44 @@ static int _attempt_backfill(void)
 	slurmctld_diag_stats.bf_when_last_cycle = now;
 	slurmctld_diag_stats.bf_active = 1;
 
+	/* Running jobs and jobs started here each add up to two records of
+	 * power use to the table */
+	if (bf_power) {
+		i = list_count(job_list) * 2;
+		bf_domain_cnt = power_budget_domain_cnt();
+		if (bf_domain_cnt) {
+			job_domain = xmalloc(sizeof(uint64_t) *
+					     bf_domain_cnt);
+		}
+	} else {
+		i = 0;
+		bf_domain_cnt = 0;
+	}
 	node_space = xmalloc(sizeof(node_space_map_t) *
-			     (max_backfill_job_cnt * 2 + 1));
+			     (max_backfill_job_cnt * 2 + i + 1));
 	node_space[0].begin_time = sched_start;
 	window_end = sched_start + backfill_window;
 	node_space[0].end_time = window_end;
 	node_space[0].avail_bitmap = bit_copy(avail_node_bitmap);
+	if (bf_domain_cnt) {
+		node_space[0].domain_watts = xmalloc(sizeof(uint64_t) *
+						     bf_domain_cnt);
+	}
 	node_space[0].next = 0;
 	node_space_recs = 1;
+	if (bf_power) {
+		/* Records used by running jobs do not count against the
+		 * bf_max_job_test table size limit */
+		ListIterator job_iterator = list_iterator_create(job_list);
+		while ((job_ptr = (struct job_record *)
+				  list_next(job_iterator))) {
+			if (IS_JOB_RUNNING(job_ptr)) {
+				power_space_recs += _add_running_power(
+					job_ptr, node_space, &node_space_recs);
+			}
+		}
+		list_iterator_destroy(job_iterator);
+	}
 	if (debug_flags & DEBUG_FLAG_BACKFILL_MAP)
 		_dump_node_space_table(node_space);
 
@@ -1647,6 +1720,41 @@ next_task:
 			job_ptr->start_time = start_res;
 			last_job_update = now;
 		}
+		if (bf_power &&
+		    (job_watts = _job_power(job_ptr, avail_bitmap,
+					    job_domain))) {
+			/* Only plan a start that fits the power budget over
+			 * the job's whole run, otherwise retry once the
+			 * blocking interval has ended */
+			start_time = MAX(job_ptr->start_time, now);
+			end_reserve = start_time + boot_time +
+				      (time_limit * 60);
+			power_start = _test_power_overlap(job_ptr, node_space,
+							  job_watts, job_domain,
+							  start_time,
+							  end_reserve);
+			if (power_start) {
+				if (debug_flags & DEBUG_FLAG_BACKFILL) {
+					info("backfill: job %u needs %"PRIu64
+					     " watts, power budget delays "
+					     "start to %ld", job_ptr->job_id,
+					     job_watts, power_start);
+				}
+				job_ptr->start_time = 0;
+				if (_power_fits_alone(job_ptr, job_watts,
+						      job_domain) &&
+				    (power_start < window_end)) {
+					later_start = power_start;
+					goto TRY_LATER;
+				}
+				_set_job_time_limit(job_ptr, orig_time_limit);
+				if (orig_start_time != 0) {
+					/* Can start in different partition */
+					job_ptr->start_time = orig_start_time;
+				}
+				continue;
+			}
+		}
 		if ((job_ptr->start_time <= now) &&
 		    (bit_overlap(avail_bitmap, cg_node_bitmap) > 0)) {
 			/* Need to wait for in-progress completion/epilog */
@@ -1808,6 +1916,11 @@ next_task:
 				/* Started this job, move to next one */
 				reject_array_job_id = 0;
 				reject_array_part   = NULL;
+				if (bf_power) {
+					power_space_recs += _add_running_power(
+						job_ptr, node_space,
+						&node_space_recs);
+				}
 
 				/* Update the database if job time limit
 				 * changed and move to next job */
@@ -1878,7 +1991,8 @@ next_task:
 			continue;
 		}
 
-		if (node_space_recs >= max_backfill_job_cnt) {
+		if ((node_space_recs - power_space_recs) >=
+		    max_backfill_job_cnt) {
 			if (debug_flags & DEBUG_FLAG_BACKFILL) {
 				info("backfill: table size limit of %u reached",
 				     max_backfill_job_cnt);
@@ -1980,9 +2094,15 @@ next_task:
 		reject_array_part   = NULL;
 		xfree(job_ptr->sched_nodes);
 		job_ptr->sched_nodes = bitmap2node_name(avail_bitmap);
+		job_watts = 0;
+		if (bf_power) {
+			job_watts = _job_power(job_ptr, avail_bitmap,
+					       job_domain);
+		}
 		bit_not(avail_bitmap);
-		_add_reservation(start_time, end_reserve,
-				 avail_bitmap, node_space, &node_space_recs);
+		_add_reservation(start_time, end_reserve, avail_bitmap,
+				 job_watts, job_watts ? job_domain : NULL,
+				 node_space, &node_space_recs);
 		if (debug_flags & DEBUG_FLAG_BACKFILL_MAP)
 			_dump_node_space_table(node_space);
 		if ((orig_start_time != 0) &&
@@ -2014,10 +2134,12 @@ next_task:
 
 	for (i=0; ; ) {
 		FREE_NULL_BITMAP(node_space[i].avail_bitmap);
+		xfree(node_space[i].domain_watts);
 		if ((i = node_space[i].next) == 0)
 			break;
 	}
 	xfree(node_space);
+	xfree(job_domain);
 	FREE_NULL_LIST(job_queue);
 	gettimeofday(&bf_time2, NULL);
 	_do_diag_stats(&bf_time1, &bf_time2);
@@ -2177,14 +2299,36 @@ static bool _more_work (time_t last_backfill_time)
 	return rc;
 }
 
-/* Create a reservation for a job in the future */
+/* Copy the per-domain watts of a node space record */
+static uint64_t *_copy_domain_watts(uint64_t *domain_watts)
+{
+	uint64_t *copy;
+
+	if (!domain_watts)
+		return NULL;
+	copy = xmalloc(sizeof(uint64_t) * bf_domain_cnt);
+	memcpy(copy, domain_watts, sizeof(uint64_t) * bf_domain_cnt);
+	return copy;
+}
+
+static bool _equal_domain_watts(uint64_t *watts1, uint64_t *watts2)
+{
+	if (!watts1 || !watts2)
+		return (watts1 == watts2);
+	return !memcmp(watts1, watts2, sizeof(uint64_t) * bf_domain_cnt);
+}
+
+/* Create a reservation for a job in the future.
+ * A NULL res_bitmap reserves only watts, leaving node availability as is.
+ * domain_watts is the charge of the job below each power domain, or NULL */
 static void _add_reservation(uint32_t start_time, uint32_t end_reserve,
-			     bitstr_t *res_bitmap,
+			     bitstr_t *res_bitmap, uint64_t watts,
+			     uint64_t *domain_watts,
 			     node_space_map_t *node_space,
 			     int *node_space_recs)
 {
 	bool placed = false;
-	int i, j;
+	int i, j, d;
 
 #if 0	
 	info("add job start:%u end:%u", start_time, end_reserve);
@@ -2207,6 +2351,9 @@ static void _add_reservation(uint32_t start_time, uint32_t end_reserve,
 			node_space[j].end_time = start_time;
 			node_space[i].avail_bitmap =
 				bit_copy(node_space[j].avail_bitmap);
+			node_space[i].power_watts = node_space[j].power_watts;
+			node_space[i].domain_watts =
+				_copy_domain_watts(node_space[j].domain_watts);
 			node_space[i].next = node_space[j].next;
 			node_space[j].next = i;
 			(*node_space_recs)++;
@@ -2228,6 +2375,11 @@ static void _add_reservation(uint32_t start_time, uint32_t end_reserve,
 					node_space[i].avail_bitmap =
 						bit_copy(node_space[j].
 							 avail_bitmap);
+					node_space[i].power_watts =
+						node_space[j].power_watts;
+					node_space[i].domain_watts =
+						_copy_domain_watts(node_space[j].
+								   domain_watts);
 					node_space[i].next = node_space[j].next;
 					node_space[j].next = i;
 					(*node_space_recs)++;
@@ -2245,19 +2397,31 @@ static void _add_reservation(uint32_t start_time, uint32_t end_reserve,
 
 	for (j = 0; ; ) {
 		if ((node_space[j].begin_time >= start_time) &&
-		    (node_space[j].end_time <= end_reserve))
-			bit_and(node_space[j].avail_bitmap, res_bitmap);
+		    (node_space[j].end_time <= end_reserve)) {
+			if (res_bitmap)
+				bit_and(node_space[j].avail_bitmap, res_bitmap);
+			node_space[j].power_watts += watts;
+			if (domain_watts && node_space[j].domain_watts) {
+				for (d = 0; d < bf_domain_cnt; d++) {
+					node_space[j].domain_watts[d] +=
+						domain_watts[d];
+				}
+			}
+		}
 		if ((node_space[j].begin_time >= end_reserve) ||
 		    ((j = node_space[j].next) == 0))
 			break;
 	}
 
-	/* Drop records with identical bitmaps (up to one record).
+	/* Drop records with identical bitmaps and watts (up to one record).
 	 * This can significantly improve performance of the backfill tests. */
 	for (i = 0; ; ) {
 		if ((j = node_space[i].next) == 0)
 			break;
-		if (!bit_equal(node_space[i].avail_bitmap,
+		if ((node_space[i].power_watts != node_space[j].power_watts) ||
+		    !_equal_domain_watts(node_space[i].domain_watts,
+					 node_space[j].domain_watts) ||
+		    !bit_equal(node_space[i].avail_bitmap,
 			       node_space[j].avail_bitmap)) {
 			i = j;
 			continue;
@@ -2265,10 +2429,112 @@ static void _add_reservation(uint32_t start_time, uint32_t end_reserve,
 		node_space[i].end_time = node_space[j].end_time;
 		node_space[i].next = node_space[j].next;
 		FREE_NULL_BITMAP(node_space[j].avail_bitmap);
+		xfree(node_space[j].domain_watts);
 		break;
 	}
 }
 
+/*
+ * Charge the watts drawn by a running job to the scheduling table until the
+ *	job's expected end time. Adds at most two records.
+ * RET number of records added
+ */
+static int _add_running_power(struct job_record *job_ptr,
+			      node_space_map_t *node_space,
+			      int *node_space_recs)
+{
+	uint32_t start_time, end_time;
+	uint64_t watts, *domain_watts = NULL;
+	int orig_recs = *node_space_recs;
+
+	if (!job_ptr->node_bitmap ||
+	    (job_ptr->end_time <= node_space[0].begin_time))
+		return 0;
+	if (bf_domain_cnt)
+		domain_watts = xmalloc(sizeof(uint64_t) * bf_domain_cnt);
+	watts = _job_power(job_ptr, job_ptr->node_bitmap, domain_watts);
+	if (watts == 0) {
+		xfree(domain_watts);
+		return 0;
+	}
+
+	/* Round outward so the watts stay charged for the whole run */
+	start_time = (job_ptr->start_time / backfill_resolution) *
+		     backfill_resolution;
+	end_time = ((job_ptr->end_time + backfill_resolution - 1) /
+		    backfill_resolution) * backfill_resolution;
+	_add_reservation(start_time, end_time, NULL, watts, domain_watts,
+			 node_space, node_space_recs);
+	xfree(domain_watts);
+
+	return *node_space_recs - orig_recs;
+}
+
+/*
+ * Watts a job commits on a set of nodes, charged as power_budget_job_test()
+ *	does at launch time
+ * OUT job_domain - if not NULL, set to the job's charge below each power
+ *	domain
+ * RET total watts, zero if the job is not charged
+ */
+static uint64_t _job_power(struct job_record *job_ptr, bitstr_t *bitmap,
+			   uint64_t *job_domain)
+{
+	if (job_domain)
+		memset(job_domain, 0, sizeof(uint64_t) * bf_domain_cnt);
+	return power_budget_job_charge(job_ptr, bitmap, job_domain,
+				       bf_domain_cnt);
+}
+
+/* Determine if a job's watts fit the power limits with no other job */
+static bool _power_fits_alone(struct job_record *job_ptr, uint64_t job_watts,
+			      uint64_t *job_domain)
+{
+	if (bf_power_budget && (job_watts > bf_power_budget))
+		return false;
+	if (job_domain &&
+	    (power_budget_charge_test(job_ptr, NULL, job_domain,
+				      bf_domain_cnt, false) != SLURM_SUCCESS))
+		return false;
+	return true;
+}
+
+/*
+ * Determine if a job drawing job_watts from start_time to end_time would
+ *	exceed PowerBudget or the limit of a power domain at any time, given
+ *	the watts already committed to running jobs and to jobs the backfill
+ *	scheduler has planned. The first record also counts the watts
+ *	measured now, as the launch-time test of power_budget_job_test() does.
+ * RET zero if the job fits, otherwise the end of the last interval in which
+ *	a limit would be exceeded
+ */
+static time_t _test_power_overlap(struct job_record *job_ptr,
+				  node_space_map_t *node_space,
+				  uint64_t job_watts, uint64_t *job_domain,
+				  time_t start_time, time_t end_time)
+{
+	time_t power_start = 0;
+	int j;
+
+	for (j = 0; ; ) {
+		if ((node_space[j].end_time   > start_time) &&
+		    (node_space[j].begin_time < end_time) &&
+		    ((bf_power_budget &&
+		      ((node_space[j].power_watts + job_watts) >
+		       bf_power_budget)) ||
+		     (job_domain &&
+		      (power_budget_charge_test(job_ptr,
+						node_space[j].domain_watts,
+						job_domain, bf_domain_cnt,
+						(j == 0)) != SLURM_SUCCESS))))
+			power_start = node_space[j].end_time;
+		if ((node_space[j].begin_time >= end_time) ||
+		    ((j = node_space[j].next) == 0))
+			break;
+	}
+	return power_start;
+}
+
 /*
  * Determine if the resource specification for a new job overlaps with a
  *	reservation that the backfill scheduler has made for a job to be
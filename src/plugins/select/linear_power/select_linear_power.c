@@ -74,6 +74,7 @@
 #include "src/common/xmalloc.h"
 
 #include "src/slurmctld/slurmctld.h"
+#include "src/slurmctld/power_analyzer_plugin.h"
 #include "src/slurmctld/preempt.h"
 #include "src/slurmctld/proc_req.h"
 #include "src/plugins/select/linear_power/select_linear_power.h"
@@ -127,7 +128,8 @@ struct select_nodeinfo {
 static int  _add_job_to_nodes(struct cr_record *cr_ptr,
 			      struct job_record *job_ptr, char *pre_err,
 			      int suspended);
-static void _add_run_job(struct cr_record *cr_ptr, uint32_t job_id);
+static void _add_run_job(struct cr_record *cr_ptr, uint32_t job_id,
+			 int32_t watts);
 static void _add_tot_job(struct cr_record *cr_ptr, uint32_t job_id);
 static void _build_select_struct(struct job_record *job_ptr, bitstr_t *bitmap);
 static int  _cr_job_list_sort(void *x, void *y);
@@ -235,16 +237,62 @@ static uint32_t total_node_num;
 static uint32_t idle_node_cpu_power;
 static uint32_t idle_node_mem_power;
 
-/* Add job id to record of jobs running on this node */
-static void _add_run_job(struct cr_record *cr_ptr, uint32_t job_id)
+/*
+ * Gross watts of a job on use_package sockets, two to a node: what the
+ * power analyzer predicts for it if it has seen the job before, else the
+ * job's package and DRAM request for every socket.
+ */
+static int64_t _job_package_watts(struct job_record *job_ptr,
+				  int32_t use_package)
+{
+	uint32_t node_cnt = use_package / 2, watts = 0;
+
+	if (node_cnt &&
+	    (power_analyzer_g_estimate_job_power(job_ptr, NULL, node_cnt,
+						 node_cnt, node_cnt, 0, 0, 0,
+						 0, &watts) == SLURM_SUCCESS))
+		return watts;
+	return use_package * (int64_t) (job_ptr->power_pkg_watts +
+					job_ptr->power_dram_watts);
+}
+
+/*
+ * Net watts a job adds to the cluster power when it runs: its package
+ * watts, less the idle power of the nodes it takes out of the idle pool.
+ * Jobs with neither a prediction nor a power request are not charged.
+ */
+static int32_t _job_power_charge(struct job_record *job_ptr)
+{
+	int32_t use_package, idle_node_power;
+	int64_t watts;
+
+	if (core_num_sock == 0)
+		return 0;
+	use_package = job_ptr->cpu_cnt / core_num_sock;
+	watts = _job_package_watts(job_ptr, use_package);
+	if (!watts)
+		return 0;
+	idle_node_power = idle_node_cpu_power + idle_node_mem_power;
+
+	return (int32_t) watts - (use_package / 2) * idle_node_power;
+}
+
+/* Add job id to record of jobs running on this node, charging it watts
+ * in the committed power ledger */
+static void _add_run_job(struct cr_record *cr_ptr, uint32_t job_id,
+			 int32_t watts)
 {
 	int i;
 
+	cr_ptr->run_watts += watts;
 	if (cr_ptr->run_job_ids == NULL) {	/* create new array */
 		cr_ptr->run_job_len = RUN_JOB_INCR;
 		cr_ptr->run_job_ids = xmalloc(sizeof(uint32_t) *
 					      cr_ptr->run_job_len);
+		cr_ptr->run_job_watts = xmalloc(sizeof(int32_t) *
+						cr_ptr->run_job_len);
 		cr_ptr->run_job_ids[0] = job_id;
+		cr_ptr->run_job_watts[0] = watts;
 		return;
 	}
 
@@ -253,13 +301,16 @@ static void _add_run_job(struct cr_record *cr_ptr, uint32_t job_id)
 			continue;
 		/* fill in hole */
 		cr_ptr->run_job_ids[i] = job_id;
+		cr_ptr->run_job_watts[i] = watts;
 		return;
 	}
 
 	/* expand array and add to end */
 	cr_ptr->run_job_len += RUN_JOB_INCR;
 	xrealloc(cr_ptr->run_job_ids, sizeof(uint32_t) * cr_ptr->run_job_len);
+	xrealloc(cr_ptr->run_job_watts, sizeof(int32_t) * cr_ptr->run_job_len);
 	cr_ptr->run_job_ids[i] = job_id;
+	cr_ptr->run_job_watts[i] = watts;
 }
 
 /* Add job id to record of jobs running or suspended on this node */
@@ -301,8 +352,11 @@ static bool _ck_run_job(struct cr_record *cr_ptr, uint32_t job_id,
 	for (i=0; i<cr_ptr->run_job_len; i++) {
 		if (cr_ptr->run_job_ids[i] != job_id)
 			continue;
-		if (clear_it)
+		if (clear_it) {
 			cr_ptr->run_job_ids[i] = 0;
+			cr_ptr->run_watts -= cr_ptr->run_job_watts[i];
+			cr_ptr->run_job_watts[i] = 0;
+		}
 		rc = true;
 	}
 	return rc;
@@ -546,187 +600,40 @@ static void _build_select_struct(struct job_record *job_ptr, bitstr_t *bitmap)
 	}
 }
 
-#define MAXITEM 20
-static int ssplit( char *str, const char *delim, char *outlist[] ) {
-    char    *tk;
-    int     cnt = 0;
-    tk = strtok( str, delim );
-    while( tk != NULL && cnt < MAXITEM ) {
-        outlist[cnt++] = tk;
-        tk = strtok( NULL, delim );
-    }
-    return cnt;
-}
-static uint32_t pparse_rapl_package(char *comment){
-    char    *shoppinglst[MAXITEM];
-    char    *data[MAXITEM];
-    int     i, cnt;
-    int   n;
-    char *buff;
-    int power = 0;
-
-    if(comment == NULL){
-      return 0;
-    }
-
-    buff = xmalloc(sizeof(char) * strlen(comment));
-    if(buff==NULL){
-      return 0;
-    }
-
-    strncpy(buff, comment,strlen(comment));
-
-    cnt = ssplit( buff, ", :" , shoppinglst );
-    if(cnt<0){
-      xfree(buff);
-      return 0;  
-    }
-
-    for(i=0;i<cnt;i++){
-        n = ssplit(shoppinglst[i], "=", data);
-        if(n == 2){
-          if(strcmp("PACKAGE", data[0])==0){
-            power = atoi(data[1]);
-          }
-        }
-    }
-
-
-
-    xfree(buff);
-    if(power < 0 || power > 5000){
-      return 0;
-    }
-    
-    return power;
-}
-
-static uint32_t pparse_rapl_dram(char *comment){
-    char    *shoppinglst[MAXITEM];
-    char    *data[MAXITEM];
-    int     i, cnt;
-    int n;
-    char *buff;
-    int power = 0;
-
-    if(comment == NULL){
-      return 0;
-    }
-
-    buff = xmalloc(sizeof(char) * strlen(comment));
-    if(buff==NULL){
-      return 0;
-    }
-
-    strncpy(buff, comment,strlen(comment));
-
-    cnt = ssplit( buff, ", :" , shoppinglst );
-    if(cnt<0){
-      xfree(buff);
-      return 0;  
-    }
-
-    for(i=0;i<cnt;i++){
-        n = ssplit(shoppinglst[i], "=", data);
-        if(n == 2){
-          if(strcmp("DRAM", data[0])==0){
-            power = atoi(data[1]);
-          }
-        }
-    }
-
-    xfree(buff);
-    if(power < 0 || power > 5000){
-      return 0;
-    }
-    
-    return power;
-}
+/*
+ * Test if the job fits in the cluster power budget next to the jobs
+ * already running. The running jobs' watts come from the ledger kept by
+ * _add_run_job() and _rem_run_job(), so this does not depend on the
+ * number of running jobs.
+ */
 static int _job_power_test(struct cr_record *cr_ptr,
 			     struct job_record *job_ptr)
 {
-
-	int i, i_first, i_last;
-	int count = 0, total_jobs, total_run_jobs;
-	struct part_cr_record *part_cr_ptr;
-	struct node_record *node_ptr;
-	uint32_t job_memory_cpu = 0, job_memory_node = 0;
-	uint32_t alloc_mem = 0, job_mem = 0, avail_mem = 0;
-	uint32_t cpu_cnt, gres_cpus, gres_cores;
-	int core_start_bit, core_end_bit, cpus_per_core;
-	List gres_list;
-	bool use_total_gres = true;
-  
-	int rc = EINVAL;
-	int use_package;
-	int tmp_use_package;
-	uint32_t tmp_total_power = 0;
-	struct job_record *tmp_job;
-	int core_num_per_socket = core_num_sock;
-	int idle_node_power = idle_node_cpu_power + idle_node_mem_power;
-	int tot_idle_node_power;
+	int64_t total_power;
+	int32_t idle_node_power = idle_node_cpu_power + idle_node_mem_power;
+	int32_t use_package = 0;
 
 	xassert(cr_ptr);
 	xassert(cr_ptr->nodes);
- 
-	use_package = job_ptr->cpu_cnt/core_num_per_socket;
-	tot_idle_node_power = total_node_num * idle_node_power;
-
-	debug3("############################################");
-	debug3(" run job len  %u",cr_ptr->run_job_len);
-	debug3(" tot job len  %u",cr_ptr->tot_job_len);
-	debug3("--------------------------------------------");
-	debug3(" this job id %u", job_ptr->job_id);
-	debug3("   cpu_cnt %u", job_ptr->cpu_cnt);
-	debug3("   use package %u", job_ptr->cpu_cnt/core_num_per_socket);
-	debug3("   use node    %u", (job_ptr->cpu_cnt/core_num_per_socket)/2);
-	debug3("   package %u",pparse_rapl_package(job_ptr->comment));
-	debug3("   dram %u",pparse_rapl_dram(job_ptr->comment));
-	debug3("   job total w %u", (job_ptr->cpu_cnt/core_num_per_socket) * 
-                     (pparse_rapl_package(job_ptr->comment) + pparse_rapl_dram(job_ptr->comment)));
-	debug3("   --------------------");
-
-	for(i = 0; i<cr_ptr->run_job_len; i++){
-		tmp_job = find_job_record(cr_ptr->run_job_ids[i]);
-		if(tmp_job){
-			debug3(" preb job id %u", tmp_job->job_id);
-			if(tmp_job->comment){
-				debug3(" comment: %s", tmp_job->comment);
-				debug3("     package %u", pparse_rapl_package(tmp_job->comment));
-				debug3("     use cpu_cnt %u", tmp_job->cpu_cnt);
-				debug3("     use package %u", tmp_job->cpu_cnt/core_num_per_socket);
-				debug3("     use node    %u",  (tmp_job->cpu_cnt/core_num_per_socket)/2 );
-				debug3("     dram    %u", pparse_rapl_dram(tmp_job->comment));
-				debug3("     job_total w %u",  tmp_job->cpu_cnt/core_num_per_socket 
-                                               * (pparse_rapl_package(tmp_job->comment) + pparse_rapl_dram(tmp_job->comment)));
-				tmp_total_power += (tmp_job->cpu_cnt/core_num_per_socket)*pparse_rapl_package(tmp_job->comment);
-				tot_idle_node_power = tot_idle_node_power - ( idle_node_power * ( (tmp_job->cpu_cnt/core_num_per_socket)/2 ));
-				tmp_total_power += (tmp_job->cpu_cnt/core_num_per_socket)*pparse_rapl_dram(tmp_job->comment);
-				debug3("     idle node power %u",tot_idle_node_power);
-			}
-		}
-	}
 
-	debug3(" rev total power %u", tmp_total_power);
-	debug3(" idle node power %u", tot_idle_node_power);
-	if(job_ptr->comment){
-		tmp_total_power += (job_ptr->cpu_cnt/core_num_per_socket) * 
-                                   (pparse_rapl_package(job_ptr->comment) + pparse_rapl_dram(job_ptr->comment));
-	}
- 
-	tmp_total_power = tmp_total_power + tot_idle_node_power - ( (job_ptr->cpu_cnt/core_num_per_socket)/2 * idle_node_power);
-	debug3(" all total power %u", tmp_total_power);
-	if(power_budget > tmp_total_power){
-		debug3(" power const OK");
-		rc =  SLURM_SUCCESS;
-	}else{
-		debug3(" power const NG");
-	}
+	if (core_num_sock)
+		use_package = job_ptr->cpu_cnt / core_num_sock;
 
-	debug3("--------------------------------------------");
-	debug3("");
-	
-	return rc;
+	/* every node idle, plus what the running jobs add */
+	total_power = (int64_t) total_node_num * idle_node_power +
+		      cr_ptr->run_watts;
+	total_power += _job_package_watts(job_ptr, use_package);
+	total_power -= (use_package / 2) * idle_node_power;
+
+	debug3("_job_power_test: job %u package %u dram %u sockets %d, "
+	       "running %"PRId64" W, total %"PRId64" W of %u W",
+	       job_ptr->job_id, job_ptr->power_pkg_watts,
+	       job_ptr->power_dram_watts, use_package, cr_ptr->run_watts,
+	       total_power, power_budget);
+
+	if (power_budget > total_power)
+		return SLURM_SUCCESS;
+	return EINVAL;
 }
 /*
  * Set the bits in 'jobmap' that correspond to bits in the 'bitmap'
@@ -2951,7 +2858,8 @@ static int _add_job_to_nodes(struct cr_record *cr_ptr,
 
 	exclusive = (job_ptr->details->share_res == 0);
 	if (alloc_all)
-		_add_run_job(cr_ptr, job_ptr->job_id);
+		_add_run_job(cr_ptr, job_ptr->job_id,
+			     _job_power_charge(job_ptr));
 	_add_tot_job(cr_ptr, job_ptr->job_id);
 
 	i_first = bit_ffs(job_resrcs_ptr->node_bitmap);
@@ -3037,6 +2945,7 @@ static void _free_cr(struct cr_record *cr_ptr)
 	}
 	xfree(cr_ptr->nodes);
 	xfree(cr_ptr->run_job_ids);
+	xfree(cr_ptr->run_job_watts);
 	xfree(cr_ptr->tot_job_ids);
 	xfree(cr_ptr);
 }
@@ -3102,6 +3011,10 @@ static struct cr_record *_dup_cr(struct cr_record *cr_ptr)
 	i = sizeof(uint32_t) * cr_ptr->run_job_len;
 	new_cr_ptr->run_job_ids = xmalloc(i);
 	memcpy(new_cr_ptr->run_job_ids, cr_ptr->run_job_ids, i);
+	i = sizeof(int32_t) * cr_ptr->run_job_len;
+	new_cr_ptr->run_job_watts = xmalloc(i);
+	memcpy(new_cr_ptr->run_job_watts, cr_ptr->run_job_watts, i);
+	new_cr_ptr->run_watts = cr_ptr->run_watts;
 	new_cr_ptr->tot_job_len = cr_ptr->tot_job_len;
 	i = sizeof(uint32_t) * cr_ptr->tot_job_len;
 	new_cr_ptr->tot_job_ids = xmalloc(i);
@@ -3193,7 +3106,8 @@ static void _init_node_cr(void)
 		}
 		if (IS_JOB_RUNNING(job_ptr) ||
 		    (IS_JOB_SUSPENDED(job_ptr) && (job_ptr->priority != 0)))
-			_add_run_job(cr_ptr, job_ptr->job_id);
+			_add_run_job(cr_ptr, job_ptr->job_id,
+				     _job_power_charge(job_ptr));
 		_add_tot_job(cr_ptr, job_ptr->job_id);
 
 		job_memory_cpu  = 0;
@@ -99,7 +99,10 @@ struct node_cr_record {
 struct cr_record {
 	struct node_cr_record *nodes;	/* ptr to array of node records */
 	uint32_t *run_job_ids;		/* job IDs for running jobs */
+	int32_t *run_job_watts;		/* power charged for each entry of
+					 * run_job_ids, see _job_power_charge */
 	uint16_t run_job_len;		/* length of run_job_ids array */
+	int64_t run_watts;		/* sum of run_job_watts */
 	uint32_t *tot_job_ids;		/* job IDs for allocated jobs 
 					 * (RUNNING & SUSPENDED)*/
 	uint16_t tot_job_len;		/* length of tot_job_ids array */
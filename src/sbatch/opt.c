@@ -189,6 +189,9 @@ enum wrappers {
 #define LONG_OPT_DEADLINE        0x166
 #define LONG_OPT_BURST_BUFFER_FILE 0x167
 #define LONG_OPT_DELAY_BOOT      0x168
+#define LONG_OPT_POWER_PKG       0x169
+#define LONG_OPT_POWER_DRAM      0x16a
+#define LONG_OPT_POWER_FREQ      0x16b
 
 /*---- global variables, defined in opt.h ----*/
 opt_t opt;
@@ -340,6 +343,9 @@ static void _opt_default(void)
 	opt.time_min = NO_VAL;
 	opt.partition = NULL;
 	opt.power_flags = 0;
+	opt.power_pkg_watts = NO_VAL;
+	opt.power_dram_watts = NO_VAL;
+	opt.power_freq = NO_VAL;
 
 	opt.job_name = NULL;
 	opt.jobid    = NO_VAL;
@@ -851,6 +857,9 @@ static struct option long_options[] = {
 	{"open-mode",     required_argument, 0, LONG_OPT_OPEN_MODE},
 	{"parsable",      optional_argument, 0, LONG_OPT_PARSABLE},
 	{"power",         required_argument, 0, LONG_OPT_POWER},
+	{"power-dram",    required_argument, 0, LONG_OPT_POWER_DRAM},
+	{"power-freq",    required_argument, 0, LONG_OPT_POWER_FREQ},
+	{"power-pkg",     required_argument, 0, LONG_OPT_POWER_PKG},
 	{"propagate",     optional_argument, 0, LONG_OPT_PROPAGATE},
 	{"profile",       required_argument, 0, LONG_OPT_PROFILE},
 	{"priority",      required_argument, 0, LONG_OPT_PRIORITY},
@@ -1950,6 +1959,17 @@ static void _set_options(int argc, char **argv)
 		case LONG_OPT_POWER:
 			opt.power_flags = power_flags_id(optarg);
 			break;
+		case LONG_OPT_POWER_PKG:
+			opt.power_pkg_watts = parse_int("power-pkg", optarg,
+							false);
+			break;
+		case LONG_OPT_POWER_DRAM:
+			opt.power_dram_watts = parse_int("power-dram", optarg,
+							 false);
+			break;
+		case LONG_OPT_POWER_FREQ:
+			opt.power_freq = parse_int("power-freq", optarg, false);
+			break;
 		case LONG_OPT_THREAD_SPEC:
 			opt.core_spec = parse_int("thread_spec",
 						  optarg, false) |
@@ -3308,6 +3328,12 @@ static void _opt_list(void)
 	info("burst_buffer_file : `%s'", opt.burst_buffer_file);
 	info("remote command    : `%s'", str);
 	info("power             : %s", power_flags_str(opt.power_flags));
+	if (opt.power_pkg_watts != NO_VAL)
+		info("power_pkg_watts   : %u", opt.power_pkg_watts);
+	if (opt.power_dram_watts != NO_VAL)
+		info("power_dram_watts  : %u", opt.power_dram_watts);
+	if (opt.power_freq != NO_VAL)
+		info("power_freq        : %u", opt.power_freq);
 	info("wait              : %s", opt.wait ? "no" : "yes");
 	if (opt.mcs_label)
 		info("mcs-label         : %s",opt.mcs_label);
@@ -3404,6 +3430,9 @@ static void _help(void)
 "      --parsable              outputs only the jobid and cluster name (if present),\n"
 "                              separated by semicolon, only on successful submission.\n"
 "      --power=flags           power management options\n"
+"      --power-pkg=watts       package watts per socket for the power budget\n"
+"      --power-dram=watts      DRAM watts per socket for the power budget\n"
+"      --power-freq=khz        target CPU frequency for the power allocator\n"
 "      --priority=value        set the priority of the job to value\n"
 "      --profile=value         enable acct_gather_profile for detailed data\n"
 "                              value is all or none or any combination of\n"
@@ -189,6 +189,9 @@ typedef struct sbatch_options {
 	bool test_only;		/* --test-only			*/
 	char *burst_buffer_file;/* --bbf			*/
 	uint8_t power_flags;	/* Power management options	*/
+	uint32_t power_pkg_watts; /* --power-pkg, package watts/socket */
+	uint32_t power_dram_watts; /* --power-dram, DRAM watts/socket	*/
+	uint32_t power_freq;	/* --power-freq, target kHz	*/
 	char *mcs_label;	/* mcs label if mcs plugin in use */
 	time_t deadline;	/* ---deadline                  */
 	uint32_t delay_boot;	/* --delay-boot			*/
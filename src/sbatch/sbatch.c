@@ -656,6 +656,9 @@ static int _fill_job_desc_from_opts(job_desc_msg_t *desc)
 
 	if (opt.power_flags)
 		desc->power_flags = opt.power_flags;
+	desc->power_pkg_watts = opt.power_pkg_watts;
+	desc->power_dram_watts = opt.power_dram_watts;
+	desc->power_freq = opt.power_freq;
 	if (opt.job_flags)
 		desc->bitflags = opt.job_flags;
 	if (opt.mcs_label)
@@ -1034,6 +1034,32 @@ extern int scontrol_update_job(int argc, char **argv)
 			}
 			update_cnt++;
 		}
+		else if (strncasecmp(tag, "PowerPkgWatts",
+				     MAX(taglen, 6)) == 0) {
+			if (parse_uint32(val, &job_msg.power_pkg_watts)) {
+				error ("Invalid PowerPkgWatts value: %s", val);
+				exit_code = 1;
+				return 0;
+			}
+			update_cnt++;
+		}
+		else if (strncasecmp(tag, "PowerDramWatts",
+				     MAX(taglen, 6)) == 0) {
+			if (parse_uint32(val, &job_msg.power_dram_watts)) {
+				error ("Invalid PowerDramWatts value: %s", val);
+				exit_code = 1;
+				return 0;
+			}
+			update_cnt++;
+		}
+		else if (strncasecmp(tag, "PowerFreq", MAX(taglen, 6)) == 0) {
+			if (parse_uint32(val, &job_msg.power_freq)) {
+				error ("Invalid PowerFreq value: %s", val);
+				exit_code = 1;
+				return 0;
+			}
+			update_cnt++;
+		}
 		else if (strncasecmp(tag, "Partition", MAX(taglen, 2)) == 0) {
 			job_msg.partition = val;
 			update_cnt++;
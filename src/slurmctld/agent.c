@@ -971,12 +971,13 @@ static void *_thread_per_group_rpc(void *args)
 			unlock_slurmctld(node_write_lock);
 		}
 
-		/* SPECIAL CASE: Record node's CPU load */
+		/* SPECIAL CASE: Record node's power, published to the
+		 * telemetry rings so only the name lookup needs a lock */
 		if (ret_data_info->type == RESPONSE_POWER_KNOB_GET_INFO) {
-			lock_slurmctld(node_write_lock);
+			lock_slurmctld(node_read_lock);
 			update_node_record_power_knob_current_data(
 				ret_data_info->data);
-			unlock_slurmctld(node_write_lock);
+			unlock_slurmctld(node_read_lock);
 		}
 		
 		/* SPECIAL CASE: Requeue/hold non-startable batch job,
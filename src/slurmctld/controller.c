@@ -116,6 +116,10 @@
 #include "src/slurmctld/trigger_mgr.h"
 #include "src/slurmctld/power_analyzer_plugin.h"
 #include "src/slurmctld/power_allocator_plugin.h"
+#include "src/slurmctld/power_monitor.h"
+#include "src/slurmctld/power_shed.h"
+#include "src/slurmctld/power_budget.h"
+#include "src/slurmctld/power_telemetry.h"
 #include "src/slurmctld/power_schedule_slurmd_plugin.h"
 
 
@@ -580,6 +584,7 @@ int main(int argc, char **argv)
 		 * create attached thread for node power monitor
   		 */
 		start_power_monitor(&slurmctld_config.thread_id_power_monitor);		
+		start_power_shed();
 		printf("Power monitor \n");
 		/*
 		 * create attached thread to process RPCs
@@ -754,6 +759,8 @@ int main(int argc, char **argv)
 
 	/* purge remaining data structures */
 	license_free();
+	power_budget_fini();
+	power_telemetry_fini();
 	slurm_cred_ctx_destroy(slurmctld_config.cred_ctx);
 	slurm_crypto_fini();	/* must be after ctx_destroy */
 	slurm_conf_destroy();
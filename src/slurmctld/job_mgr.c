@@ -92,6 +92,7 @@
 #include "src/slurmctld/licenses.h"
 #include "src/slurmctld/locks.h"
 #include "src/slurmctld/node_scheduler.h"
+#include "src/slurmctld/power_energy.h"
 #include "src/slurmctld/preempt.h"
 #include "src/slurmctld/proc_req.h"
 #include "src/slurmctld/reservation.h"
@@ -108,6 +109,8 @@
 #define SLURM_CREATE_JOB_FLAG_NO_ALLOCATE_0 0
 #define TOP_PRIORITY 0xffff0000	/* large, but leave headroom for higher */
 #define ONE_YEAR	(365 * 24 * 60 * 60)
+#define MAX_JOB_POWER_WATTS	5000	/* per socket, package or DRAM */
+#define MAX_JOB_POWER_FREQ	10000000	/* kHz */
 
 #define JOB_HASH_INX(_job_id)	(_job_id % hash_table_size)
 #define JOB_ARRAY_HASH_INX(_job_id, _task_id) \
@@ -1189,6 +1192,9 @@ static int _dump_job_state(void *x, void *arg)
 	pack16(dump_job_ptr->alloc_resp_port, buffer);
 	pack16(dump_job_ptr->other_port, buffer);
 	pack8(dump_job_ptr->power_flags, buffer);
+	pack32(dump_job_ptr->power_pkg_watts, buffer);
+	pack32(dump_job_ptr->power_dram_watts, buffer);
+	pack32(dump_job_ptr->power_freq, buffer);
 	pack16(dump_job_ptr->start_protocol_ver, buffer);
 	packdouble(dump_job_ptr->billable_tres, buffer);
 
@@ -1281,6 +1287,7 @@ static int _load_job_state(Buf buffer, uint16_t protocol_version)
 	time_t resize_time = 0, now = time(NULL);
 	uint8_t reboot = 0, power_flags = 0;
 	uint8_t uint8_tmp = 0;
+	uint32_t power_pkg_watts = 0, power_dram_watts = 0, power_freq = 0;
 	uint32_t array_task_id = NO_VAL;
 	uint32_t array_flags = 0, max_run_tasks = 0, tot_run_tasks = 0;
 	uint32_t min_exit_code = 0, max_exit_code = 0, tot_comp_tasks = 0;
@@ -1417,6 +1424,11 @@ static int _load_job_state(Buf buffer, uint16_t protocol_version)
 		safe_unpack16(&alloc_resp_port, buffer);
 		safe_unpack16(&other_port, buffer);
 		safe_unpack8(&power_flags, buffer);
+		if (protocol_version >= SLURM_17_02_POWER_PROTOCOL_VERSION) {
+			safe_unpack32(&power_pkg_watts, buffer);
+			safe_unpack32(&power_dram_watts, buffer);
+			safe_unpack32(&power_freq, buffer);
+		}
 		safe_unpack16(&start_protocol_ver, buffer);
 		safe_unpackdouble(&billable_tres, buffer);
 
@@ -2038,6 +2050,9 @@ static int _load_job_state(Buf buffer, uint16_t protocol_version)
 	}
 	job_ptr->other_port   = other_port;
 	job_ptr->power_flags  = power_flags;
+	job_ptr->power_pkg_watts  = power_pkg_watts;
+	job_ptr->power_dram_watts = power_dram_watts;
+	job_ptr->power_freq   = power_freq;
 	xfree(job_ptr->partition);
 	job_ptr->partition    = partition;
 	partition             = NULL;	/* reused, nothing left to free */
@@ -3694,8 +3709,14 @@ void dump_job_desc(job_desc_msg_t * job_specs)
 	       job_specs->work_dir,
 	       job_specs->alloc_node, job_specs->alloc_sid);
 
-	debug3("   power_flags=%s",
-	       power_flags_str(job_specs->power_flags));
+	debug3("   power_flags=%s power_pkg_watts=%ld power_dram_watts=%ld "
+	       "power_freq=%ld", power_flags_str(job_specs->power_flags),
+	       (job_specs->power_pkg_watts != NO_VAL) ?
+	       (long) job_specs->power_pkg_watts : -1L,
+	       (job_specs->power_dram_watts != NO_VAL) ?
+	       (long) job_specs->power_dram_watts : -1L,
+	       (job_specs->power_freq != NO_VAL) ?
+	       (long) job_specs->power_freq : -1L);
 
 	debug3("   resp_host=%s alloc_resp_port=%u other_port=%u",
 	       job_specs->resp_host,
@@ -3902,6 +3923,9 @@ extern struct job_record *job_array_split(struct job_record *job_ptr)
 	job_ptr_pend->burst_buffer_state = xstrdup(job_ptr->burst_buffer_state);
 	job_ptr_pend->clusters = xstrdup(job_ptr->clusters);
 	job_ptr_pend->comment = xstrdup(job_ptr->comment);
+	job_ptr_pend->power_pkg_watts = job_ptr->power_pkg_watts;
+	job_ptr_pend->power_dram_watts = job_ptr->power_dram_watts;
+	job_ptr_pend->power_freq = job_ptr->power_freq;
 
 	job_ptr_pend->front_end_ptr = NULL;
 	/* struct job_details *details;		*** NOTE: Copied below */
@@ -7303,6 +7327,12 @@ _copy_job_desc_to_job_record(job_desc_msg_t * job_desc,
 	job_ptr->alloc_resp_port = job_desc->alloc_resp_port;
 	job_ptr->other_port = job_desc->other_port;
 	job_ptr->power_flags = job_desc->power_flags;
+	if (job_desc->power_pkg_watts != NO_VAL)
+		job_ptr->power_pkg_watts = job_desc->power_pkg_watts;
+	if (job_desc->power_dram_watts != NO_VAL)
+		job_ptr->power_dram_watts = job_desc->power_dram_watts;
+	if (job_desc->power_freq != NO_VAL)
+		job_ptr->power_freq = job_desc->power_freq;
 	job_ptr->time_last_active = time(NULL);
 	job_ptr->cr_enabled = 0;
 	job_ptr->derived_ec = 0;
@@ -8175,6 +8205,24 @@ static void _job_timed_out(struct job_record *job_ptr)
 	return;
 }
 
+/* Validate the power request of a job, NO_VAL fields are not set */
+static int _valid_job_power(job_desc_msg_t *job_desc_msg)
+{
+	if (((job_desc_msg->power_pkg_watts != NO_VAL) &&
+	     (job_desc_msg->power_pkg_watts > MAX_JOB_POWER_WATTS)) ||
+	    ((job_desc_msg->power_dram_watts != NO_VAL) &&
+	     (job_desc_msg->power_dram_watts > MAX_JOB_POWER_WATTS)) ||
+	    ((job_desc_msg->power_freq != NO_VAL) &&
+	     (job_desc_msg->power_freq > MAX_JOB_POWER_FREQ))) {
+		info("Job power request out of range: package %u W, "
+		     "dram %u W, freq %u kHz", job_desc_msg->power_pkg_watts,
+		     job_desc_msg->power_dram_watts,
+		     job_desc_msg->power_freq);
+		return ESLURM_INVALID_POWER;
+	}
+	return SLURM_SUCCESS;
+}
+
 /* _validate_job_desc - validate that a job descriptor for job submit or
  *	allocate has valid data, set values to defaults as required
  * IN/OUT job_desc_msg - pointer to job descriptor, modified as needed
@@ -8185,6 +8233,8 @@ static int _validate_job_desc(job_desc_msg_t * job_desc_msg, int allocate,
 			      uid_t submit_uid, struct part_record *part_ptr,
 			      List part_list)
 {
+	int rc;
+
 	if ((job_desc_msg->min_cpus  == NO_VAL) &&
 	    (job_desc_msg->min_nodes == NO_VAL) &&
 	    (job_desc_msg->req_nodes == NULL)) {
@@ -8217,6 +8267,9 @@ static int _validate_job_desc(job_desc_msg_t * job_desc_msg, int allocate,
 	if (job_desc_msg->kill_on_node_fail == (uint16_t) NO_VAL)
 		job_desc_msg->kill_on_node_fail = 1;
 
+	if ((rc = _valid_job_power(job_desc_msg)) != SLURM_SUCCESS)
+		return rc;
+
 	if (job_desc_msg->job_id != NO_VAL) {
 		struct job_record *dup_job_ptr;
 		if ((submit_uid != 0) &&
@@ -8801,6 +8854,11 @@ void pack_job(struct job_record *dump_job_ptr, uint16_t show_flags, Buf buffer,
 		} else
 			pack16(dump_job_ptr->state_reason, buffer);
 		pack8(dump_job_ptr->power_flags,   buffer);
+		if (protocol_version >= SLURM_17_02_POWER_PROTOCOL_VERSION) {
+			pack32(dump_job_ptr->power_pkg_watts,  buffer);
+			pack32(dump_job_ptr->power_dram_watts, buffer);
+			pack32(dump_job_ptr->power_freq,   buffer);
+		}
 		pack8(dump_job_ptr->reboot,        buffer);
 		pack16(dump_job_ptr->restart_cnt,  buffer);
 		pack16(show_flags,  buffer);
@@ -11270,6 +11328,28 @@ static int _update_job(struct job_record *job_ptr, job_desc_msg_t * job_specs,
 		     job_specs->delay_boot, job_ptr->job_id);
 	}
 
+	if ((job_specs->power_pkg_watts != NO_VAL) ||
+	    (job_specs->power_dram_watts != NO_VAL) ||
+	    (job_specs->power_freq != NO_VAL)) {
+		/* select/linear_power charged a running job at its start */
+		if (!IS_JOB_PENDING(job_ptr)) {
+			error_code = ESLURM_JOB_NOT_PENDING;
+			goto fini;
+		}
+		if ((error_code = _valid_job_power(job_specs)))
+			goto fini;
+		if (job_specs->power_pkg_watts != NO_VAL)
+			job_ptr->power_pkg_watts = job_specs->power_pkg_watts;
+		if (job_specs->power_dram_watts != NO_VAL)
+			job_ptr->power_dram_watts = job_specs->power_dram_watts;
+		if (job_specs->power_freq != NO_VAL)
+			job_ptr->power_freq = job_specs->power_freq;
+		info("sched: update_job: setting power request to package "
+		     "%u W dram %u W freq %u kHz for job_id %u",
+		     job_ptr->power_pkg_watts, job_ptr->power_dram_watts,
+		     job_ptr->power_freq, job_ptr->job_id);
+	}
+
 	/* this needs to be after partition and QOS checks */
 	if (job_specs->reservation
 	    && !xstrcmp(job_specs->reservation, job_ptr->resv_name)) {
@@ -13687,6 +13767,7 @@ extern void job_completion_logger(struct job_record *job_ptr, bool requeue)
 	if (!with_slurmdbd && !job_ptr->db_index)
 		jobacct_storage_g_job_start(acct_db_conn, job_ptr);
 
+	power_energy_job_fini(job_ptr);
 	jobacct_storage_g_job_complete(acct_db_conn, job_ptr);
 }
 
@@ -15690,6 +15771,9 @@ extern job_desc_msg_t *copy_job_record_to_job_desc(struct job_record *job_ptr)
 	job_desc->open_mode         = details->open_mode;
 	job_desc->other_port        = job_ptr->other_port;
 	job_desc->power_flags       = job_ptr->power_flags;
+	job_desc->power_pkg_watts   = job_ptr->power_pkg_watts;
+	job_desc->power_dram_watts  = job_ptr->power_dram_watts;
+	job_desc->power_freq        = job_ptr->power_freq;
 	job_desc->overcommit        = details->overcommit;
 	job_desc->partition         = xstrdup(job_ptr->partition);
 	job_desc->plane_size        = details->plane_size;
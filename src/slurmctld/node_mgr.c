@@ -45,6 +45,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -60,6 +61,7 @@
 #include "src/common/pack.h"
 #include "src/common/parse_time.h"
 #include "src/common/power.h"
+#include "src/common/power_delta.h"
 #include "src/common/power_knob.h"
 #include "src/common/node_features.h"
 #include "src/common/node_select.h"
@@ -74,6 +76,8 @@
 #include "src/slurmctld/front_end.h"
 #include "src/slurmctld/locks.h"
 #include "src/slurmctld/ping_nodes.h"
+#include "src/slurmctld/power_shed.h"
+#include "src/slurmctld/power_telemetry.h"
 #include "src/slurmctld/proc_req.h"
 #include "src/slurmctld/read_config.h"
 #include "src/slurmctld/reservation.h"
@@ -90,6 +94,20 @@
 /* No need to change we always pack SLURM_PROTOCOL_VERSION */
 #define NODE_STATE_VERSION        "PROTOCOL_VERSION"
 
+/* Responses of pack_node_power() kept for other requesters, see there */
+#define NODE_POWER_DUMP_CNT	4
+
+typedef struct node_power_dump {
+	time_t built;			/* second the dump was packed, 0 if
+					 * the slot is unused */
+	time_t node_update;		/* last_node_update when packed */
+	time_t watts_since;		/* request keys */
+	time_t cache_since;
+	uint16_t protocol_version;
+	char *dump;
+	int dump_size;
+} node_power_dump_t;
+
 /* Global variables */
 bitstr_t *avail_node_bitmap = NULL;	/* bitmap of available nodes */
 bitstr_t *booting_node_bitmap = NULL;	/* bitmap of booting nodes */
@@ -99,6 +117,9 @@ bitstr_t *power_node_bitmap = NULL;	/* bitmap of powered down nodes */
 bitstr_t *share_node_bitmap = NULL;  	/* bitmap of sharable nodes */
 bitstr_t *up_node_bitmap    = NULL;  	/* bitmap of non-down nodes */
 
+static node_power_dump_t node_power_dump[NODE_POWER_DUMP_CNT];
+static pthread_mutex_t node_power_dump_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 static void 	_dump_node_state (struct node_record *dump_node_ptr,
 				  Buf buffer);
 static front_end_record_t * _front_end_reg(
@@ -108,6 +129,8 @@ static void 	_make_node_down(struct node_record *node_ptr,
 				time_t event_time);
 static bool	_node_is_hidden(struct node_record *node_ptr, uid_t uid);
 static int	_open_node_state_file(char **state_file);
+static void	_pack_node_power_info(struct node_record *node_ptr,
+				      Buf buffer, uint16_t protocol_version);
 static void 	_pack_node(struct node_record *dump_node_ptr, Buf buffer,
 			   uint16_t protocol_version, uint16_t show_flags);
 static void	_sync_bitmaps(struct node_record *node_ptr, int job_count);
@@ -879,6 +902,126 @@ extern void pack_all_node (char **buffer_ptr, int *buffer_size,
 	buffer_ptr[0] = xfer_buf_data (buffer);
 }
 
+/* Pack the power records of nodes with readings at or after the given
+ * times, see pack_node_power() */
+static void _pack_node_power(time_t watts_since, time_t cache_since,
+			     time_t now, Buf buffer)
+{
+	power_telemetry_sample_t *samples;
+	node_power_info_t *nodes;
+	struct node_record *node_ptr = node_record_table_ptr;
+	uint32_t cnt = 0;
+	int inx;
+
+	samples = xmalloc(sizeof(power_telemetry_sample_t) *
+			  (node_record_count + 1));
+	nodes = xmalloc(sizeof(node_power_info_t) * (node_record_count + 1));
+	for (inx = 0; inx < node_record_count; inx++, node_ptr++) {
+		power_telemetry_sample_t *sample = &samples[cnt];
+		node_power_info_t *node = &nodes[cnt];
+
+		if ((node_ptr->name == NULL) || (node_ptr->name[0] == '\0') ||
+		    IS_NODE_FUTURE(node_ptr) || _is_cloud_hidden(node_ptr))
+			continue;
+		if (power_telemetry_latest(inx, sample) != SLURM_SUCCESS)
+			continue;
+		if (sample->power_time && (sample->power_time >= watts_since)) {
+			node->watts_update_time = sample->power_time;
+			node->socket_cnt = sample->socket_cnt;
+			node->power = sample->power;
+		}
+		if (sample->cache_time && (sample->cache_time >= cache_since)) {
+			node->cache_update_time = sample->cache_time;
+			node->cache_socket_cnt = sample->cache_socket_cnt;
+			node->cache = sample->cache;
+		}
+		if (!node->watts_update_time && !node->cache_update_time)
+			continue;
+		node->name = node_ptr->name;
+		cnt++;
+	}
+
+	pack_time(now, buffer);
+	pack_time(now, buffer);
+	power_delta_pack_nodes(nodes, cnt, buffer);
+	xfree(nodes);
+	xfree(samples);
+}
+
+/*
+ * pack_node_power - dump the power readings of nodes which changed since
+ *	the given times, in machine independent form (for network transmission)
+ * OUT buffer_ptr - pointer to the stored data
+ * OUT buffer_size - set to size of the buffer in bytes
+ * IN watts_since - include power readings taken at or after this time,
+ *	0 for all
+ * IN cache_since - likewise for PMC cache counts
+ * IN protocol_version - slurm protocol version of client
+ * global: node_record_table_ptr - pointer to global node table
+ * NOTE: the caller must xfree the buffer at *buffer_ptr
+ * NOTE: change slurm_load_node_power() in api/node_info.c when data format
+ *	changes
+ * NOTE: READ lock_slurmctld node before entry
+ *
+ * The response carries the time it was packed, which the client passes back
+ * as the times of its next request. Readings are included when taken at or
+ * after those times, so one landing in the same second as a dump is sent
+ * again rather than missed. That also lets every client asking with the same
+ * times within one second share a single dump: it is packed once, under
+ * node_power_dump_mutex, and copied out to the others.
+ */
+extern void pack_node_power(char **buffer_ptr, int *buffer_size,
+			    time_t watts_since, time_t cache_since,
+			    uint16_t protocol_version)
+{
+	node_power_dump_t *dump = NULL;
+	time_t now = time(NULL);
+	bool hit = false;
+	Buf buffer;
+	int i;
+
+	buffer_ptr[0] = NULL;
+	*buffer_size = 0;
+
+	if (protocol_version < SLURM_MIN_PROTOCOL_VERSION) {
+		error("%s: protocol_version %hu not supported",
+		      __func__, protocol_version);
+		return;
+	}
+
+	slurm_mutex_lock(&node_power_dump_mutex);
+	for (i = 0; i < NODE_POWER_DUMP_CNT; i++) {
+		if ((node_power_dump[i].built == now) &&
+		    (node_power_dump[i].node_update == last_node_update) &&
+		    (node_power_dump[i].watts_since == watts_since) &&
+		    (node_power_dump[i].cache_since == cache_since) &&
+		    (node_power_dump[i].protocol_version == protocol_version)) {
+			dump = &node_power_dump[i];
+			hit = true;
+			break;
+		}
+		/* Replace the oldest slot on a miss */
+		if (!dump || (node_power_dump[i].built < dump->built))
+			dump = &node_power_dump[i];
+	}
+	if (!hit) {
+		buffer = init_buf(BUF_SIZE);
+		_pack_node_power(watts_since, cache_since, now, buffer);
+		xfree(dump->dump);
+		dump->built = now;
+		dump->node_update = last_node_update;
+		dump->watts_since = watts_since;
+		dump->cache_since = cache_since;
+		dump->protocol_version = protocol_version;
+		dump->dump_size = get_buf_offset(buffer);
+		dump->dump = xfer_buf_data(buffer);
+	}
+	buffer_ptr[0] = xmalloc(dump->dump_size);
+	memcpy(buffer_ptr[0], dump->dump, dump->dump_size);
+	*buffer_size = dump->dump_size;
+	slurm_mutex_unlock(&node_power_dump_mutex);
+}
+
 /*
  * pack_one_node - dump all configuration and node information for one node
  *	in machine independent form (for network transmission)
@@ -961,6 +1104,44 @@ extern void pack_one_node (char **buffer_ptr, int *buffer_size,
 	buffer_ptr[0] = xfer_buf_data (buffer);
 }
 
+/*
+ * Pack a node's power knob data using its newest telemetry sample, which
+ * is read without any lock. Caps and limits come from the node record.
+ */
+static void _pack_node_power_info(struct node_record *node_ptr, Buf buffer,
+				  uint16_t protocol_version)
+{
+	power_capping_data_t power_cap[POWER_TELEMETRY_MAX_SOCKET];
+	power_telemetry_sample_t sample;
+	power_data_t power_info;
+	int cap_cnt = 0;
+
+	memset(&power_info, 0, sizeof(power_data_t));
+	if (node_ptr->power_info)
+		memcpy(&power_info, node_ptr->power_info, sizeof(power_data_t));
+
+	if (power_telemetry_latest(node_ptr - node_record_table_ptr, &sample)
+	    == SLURM_SUCCESS) {
+		memset(power_cap, 0, sizeof(power_cap));
+		power_info.socket_cnt = MAX(sample.socket_cnt,
+					    sample.cache_socket_cnt);
+		if (power_info.power_cap) {
+			cap_cnt = xsize(power_info.power_cap) /
+				  sizeof(power_capping_data_t);
+			cap_cnt = MIN(cap_cnt, power_info.socket_cnt);
+			memcpy(power_cap, power_info.power_cap,
+			       sizeof(power_capping_data_t) * cap_cnt);
+		}
+		power_info.power_cap = power_cap;
+		power_info.current_power = sample.power;
+		power_info.cache_reference = sample.cache;
+		power_info.watts_update_time = sample.power_time;
+		power_info.cache_update_time = sample.cache_time;
+	}
+
+	power_knob_data_pack(&power_info, buffer, protocol_version);
+}
+
 /*
  * _pack_node - dump all configuration information about a specific node in
  *	machine independent form (for network transmission)
@@ -1055,8 +1236,8 @@ static void _pack_node (struct node_record *dump_node_ptr, Buf buffer,
 				      protocol_version);
 		power_mgmt_data_pack(dump_node_ptr->power, buffer,
 				     protocol_version);
-		power_knob_data_pack(dump_node_ptr->power_info, buffer,
-				     protocol_version);
+		_pack_node_power_info(dump_node_ptr, buffer,
+				      protocol_version);
 					 
 		packstr(dump_node_ptr->tres_fmt_str,buffer);
 	} else if (protocol_version >= SLURM_16_05_PROTOCOL_VERSION) {
@@ -2313,12 +2494,54 @@ extern int update_node_record_power_knob_current_data(
 	power_knob_get_info_node_resp_msg_t *msg)
 {
 	struct node_record *node_ptr;
+	power_telemetry_sample_t sample;
 
 	node_ptr = find_node_record(msg->node_name);
 	if (node_ptr == NULL)
 		return ENOENT;
 
-	memcpy(node_ptr->power_info->current_power, msg->power_info, sizeof(power_current_data_t) * msg->socket_cnt);
+	memset(&sample, 0, sizeof(power_telemetry_sample_t));
+	sample.power_time = time(NULL);
+	sample.socket_cnt = MIN(msg->socket_cnt, POWER_TELEMETRY_MAX_SOCKET);
+	memcpy(sample.power, msg->power_info,
+	       sizeof(power_current_data_t) * sample.socket_cnt);
+	power_telemetry_publish(node_ptr - node_record_table_ptr, &sample);
+
+	return SLURM_SUCCESS;
+}
+
+extern int update_node_record_power_sample(power_knob_sample_resp_msg_t *msg)
+{
+	struct node_record *node_ptr;
+	power_telemetry_sample_t sample;
+	int node_inx;
+
+	node_ptr = find_node_record(msg->node_name);
+	if (node_ptr == NULL)
+		return ENOENT;
+	node_inx = node_ptr - node_record_table_ptr;
+
+	/* A node without PMCs still sent a fresh, empty, cache reading */
+	memset(&sample, 0, sizeof(power_telemetry_sample_t));
+	sample.seq = msg->seq;
+	sample.sample_usec = msg->sample_usec;
+	sample.power_time = time(NULL);
+	sample.cache_time = sample.power_time;
+	if (msg->power_info) {
+		sample.socket_cnt = MIN(msg->socket_cnt,
+					POWER_TELEMETRY_MAX_SOCKET);
+		memcpy(sample.power, msg->power_info,
+		       sizeof(power_current_data_t) * sample.socket_cnt);
+	}
+	if (msg->perf_info) {
+		sample.cache_socket_cnt = MIN(msg->cache_socket_cnt,
+					      POWER_TELEMETRY_MAX_SOCKET);
+		memcpy(sample.cache, msg->perf_info,
+		       sizeof(cache_ref_t) * sample.cache_socket_cnt);
+	}
+	power_telemetry_publish(node_inx, &sample);
+	power_shed_node_watts(node_inx, node_record_count,
+			      power_telemetry_sample_watts(&sample));
 
 	return SLURM_SUCCESS;
 }
@@ -3955,6 +4178,8 @@ extern int send_nodes_to_accounting(time_t event_time)
 /* node_fini - free all memory associated with node records */
 extern void node_fini (void)
 {
+	int i;
+
 	FREE_NULL_LIST(active_feature_list);
 	FREE_NULL_LIST(avail_feature_list);
 	FREE_NULL_BITMAP(avail_node_bitmap);
@@ -3964,6 +4189,10 @@ extern void node_fini (void)
 	FREE_NULL_BITMAP(power_node_bitmap);
 	FREE_NULL_BITMAP(share_node_bitmap);
 	FREE_NULL_BITMAP(up_node_bitmap);
+	for (i = 0; i < NODE_POWER_DUMP_CNT; i++) {
+		xfree(node_power_dump[i].dump);
+		node_power_dump[i].built = 0;
+	}
 	node_fini2();
 }
 
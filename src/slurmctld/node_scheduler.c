@@ -77,6 +77,8 @@
 #include "src/slurmctld/job_scheduler.h"
 #include "src/slurmctld/licenses.h"
 #include "src/slurmctld/node_scheduler.h"
+#include "src/slurmctld/power_analyzer_plugin.h"
+#include "src/slurmctld/power_budget.h"
 #include "src/slurmctld/powercapping.h"
 #include "src/slurmctld/preempt.h"
 #include "src/slurmctld/proc_req.h"
@@ -485,6 +487,8 @@ extern void deallocate_nodes(struct job_record *job_ptr, bool timeout,
 	}
 
 	acct_policy_job_fini(job_ptr);
+	power_analyzer_g_analyze_finished_job(job_ptr);
+	power_budget_job_fini(job_ptr);
 	if (select_g_job_fini(job_ptr) != SLURM_SUCCESS)
 		error("select_g_job_fini(%u): %m", job_ptr->job_id);
 	(void) epilog_slurmctld(job_ptr);
@@ -1481,6 +1485,17 @@ _get_req_features(struct node_set *node_set_ptr, int node_set_size,
 		       slurm_strerror(error_code));
 	}
 
+	/*
+	 * The selected nodes must also fit below the LimitWatts of every
+	 * rack or PDU enclosing them in the power layout.
+	 */
+	if ((error_code == SLURM_SUCCESS) && *select_bitmap &&
+	    (power_budget_job_test(job_ptr, *select_bitmap) !=
+	     SLURM_SUCCESS)) {
+		FREE_NULL_BITMAP(*select_bitmap);
+		error_code = ESLURM_POWER_NOT_AVAIL;
+	}
+
 	FREE_NULL_LIST(preemptee_candidates);
 
 	/* restore job's initial required node bitmap */
@@ -2661,6 +2676,7 @@ extern int select_nodes(struct job_record *job_ptr, bool test_only,
 	/* job_set_alloc_tres has to be done before acct_policy_job_begin */
 	job_set_alloc_tres(job_ptr, false);
 	acct_policy_job_begin(job_ptr);
+	power_budget_job_begin(job_ptr);
 
 	job_claim_resv(job_ptr);
 
@@ -56,7 +56,7 @@ typedef struct power_analyzer_ops {
 	int (*estimate_job_power)
 			(struct job_record *, bitstr_t *, 
 			uint32_t, uint32_t, uint32_t, uint32_t,
-			uint32_t, uint32_t, uint32_t, uint32_t);
+			uint32_t, uint32_t, uint32_t, uint32_t *);
 	int (*estimate_job_time)
 			(struct job_record *, bitstr_t *, 
 			uint32_t , uint32_t , uint32_t ,uint32_t , 
@@ -189,13 +189,13 @@ int power_analyzer_g_reconfig(void)
  *            currently sopported Intel RAPL
  * IN frequency - maximum number of frequency to a cpu
  * OUT job_power - estimated power consumption by under constraints
- * RET zero on success, EINVAL otherwise
+ * RET zero on success, SLURM_ERROR if no estimate is available
  */
 int power_analyzer_g_estimate_job_power(struct job_record *job_ptr, bitstr_t *bitmap, 
 			uint32_t min_nodes, uint32_t max_nodes, uint32_t req_nodes,
 			uint32_t constraint_mode,
 			uint32_t cpu_cap, uint32_t dram_cap, uint32_t frequency, 
-			uint32_t job_power)
+			uint32_t *job_power)
 {
 	if ( power_analyzer_init() < 0 )
 		return SLURM_ERROR;
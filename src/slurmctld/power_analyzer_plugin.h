@@ -41,6 +41,12 @@
 #include "slurm/slurm.h"
 #include "src/slurmctld/slurmctld.h"
 
+/* constraint_mode flags of the estimate functions */
+#define PA_FLAG_CPU_CAP		0x0001	/* cpu_cap applies */
+#define PA_FLAG_DRAM_CAP	0x0002	/* dram_cap applies */
+#define PA_FLAG_FREQ		0x0004	/* frequency applies */
+#define PA_FLAG_JOB		0x0008	/* job_limit applies */
+
 /**
  * Initialize the external power analyzer adapter.
  * Returns a SLURM errno.
@@ -76,13 +82,13 @@ int power_analyzer_g_reconfig(void);
  *            currently sopported Intel RAPL
  * IN frequency - maximum number of frequency to a cpu
  * OUT job_power - estimated power consumption by under constraints
- * RET zero on success, EINVAL otherwise
+ * RET zero on success, SLURM_ERROR if no estimate is available
  */
 int power_analyzer_g_estimate_job_power(struct job_record *job_ptr, bitstr_t *bitmap, 
 			uint32_t min_nodes, uint32_t max_nodes, uint32_t req_nodes,
 			uint32_t constraint_mode,
 			uint32_t cpu_cap, uint32_t dram_cap, uint32_t frequency, 
-			uint32_t job_power);
+			uint32_t *job_power);
 
 /**
  * Estimate a job execution time under specified constraints
@@ -0,0 +1,548 @@
+/*****************************************************************************\
+ *  power_budget.c - Hierarchical power budget driven by the power layout
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "slurm/slurm_errno.h"
+
+#include "src/common/layouts_mgr.h"
+#include "src/common/log.h"
+#include "src/common/macros.h"
+#include "src/common/node_conf.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+#include "src/slurmctld/power_analyzer_plugin.h"
+#include "src/slurmctld/power_budget.h"
+#include "src/slurmctld/power_telemetry.h"
+#include "src/slurmctld/slurmctld.h"
+
+#define L_NAME		"power"
+#define L_LIMIT		"LimitWatts"
+#define L_NODE_MAX	"MaxWatts"
+#define REFRESH_PERIOD	10	/* seconds between on the fly refreshes */
+
+typedef struct budget_domain {
+	char *name;			/* layout entity name */
+	int parent;			/* parent domain, -1 for a root. Always
+					 * lower than the domain's own index */
+	uint32_t limit;			/* LimitWatts, 0 if none */
+	uint64_t committed;		/* watts of the subtree's running jobs */
+	uint64_t measured;		/* measured watts of the subtree */
+	uint64_t charge;		/* scratch space of the tests */
+	uint64_t demand;		/* scratch space of the cap split */
+	double scale;			/* scratch space of the cap split */
+	bool capped;			/* scratch space of the cap split */
+} budget_domain_t;
+
+static pthread_mutex_t budget_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool budget_built = false;
+static budget_domain_t *domains = NULL;
+static int domain_cnt = 0;
+static int *node_domain = NULL;		/* deepest domain of each node, or
+					 * -1, indexed like
+					 * node_record_table_ptr */
+static int node_cnt = 0;
+static int max_watts_handle = -1;
+static bool any_limit = false;
+static time_t refresh_time = 0;
+
+static void _free_domains(void)
+{
+	int i;
+
+	for (i = 0; i < domain_cnt; i++)
+		xfree(domains[i].name);
+	xfree(domains);
+	xfree(node_domain);
+	domain_cnt = 0;
+	node_cnt = 0;
+	any_limit = false;
+	refresh_time = 0;
+}
+
+/*
+ * Flatten the power layout into the domain array. Entities which are
+ * nodes map the node to their nearest enclosing domain, entities below
+ * the nodes (e.g. cores) are skipped. Call with budget_mutex held.
+ */
+static void _build_domains(void)
+{
+	layouts_tree_entry_t *entries = NULL;
+	struct node_record *node_ptr;
+	int *entry_domain, *entry_node;
+	int entry_cnt = 0, i, p;
+
+	_free_domains();
+	budget_built = true;
+	node_cnt = node_record_count;
+	node_domain = xmalloc(sizeof(int) * MAX(node_cnt, 1));
+	for (i = 0; i < node_cnt; i++)
+		node_domain[i] = -1;
+
+	if ((layouts_tree_flatten(L_NAME, &entries, &entry_cnt) !=
+	     SLURM_SUCCESS) || (entry_cnt == 0))
+		return;
+	max_watts_handle = layouts_key_handle(L_NAME, L_NODE_MAX);
+
+	entry_domain = xmalloc(sizeof(int) * entry_cnt);
+	entry_node = xmalloc(sizeof(int) * entry_cnt);
+	domains = xmalloc(sizeof(budget_domain_t) * entry_cnt);
+	for (i = 0; i < entry_cnt; i++) {
+		entry_domain[i] = -1;
+		entry_node[i] = -1;
+		p = entries[i].parent;
+		if ((p >= 0) && (entry_domain[p] < 0))
+			continue;	/* below a node, e.g. a core */
+		node_ptr = find_node_record2(entries[i].name);
+		if (node_ptr) {
+			entry_node[i] = node_ptr - node_record_table_ptr;
+			if (p >= 0)
+				node_domain[entry_node[i]] = entry_domain[p];
+			continue;
+		}
+		entry_domain[i] = domain_cnt;
+		domains[domain_cnt].name = xstrdup(entries[i].name);
+		domains[domain_cnt].parent = (p >= 0) ? entry_domain[p] : -1;
+		domain_cnt++;
+	}
+	xfree(entry_domain);
+	xfree(entry_node);
+	layouts_tree_entries_free(entries, entry_cnt);
+
+	debug("%s: %d power domains above %d nodes", __func__, domain_cnt,
+	      node_cnt);
+}
+
+/* Add watts to a domain and all its ancestors */
+static void _commit_watts(int d, int64_t watts)
+{
+	for ( ; d >= 0; d = domains[d].parent) {
+		if ((watts < 0) && (domains[d].committed < -watts))
+			domains[d].committed = 0;
+		else
+			domains[d].committed += watts;
+	}
+}
+
+static void _commit_job(struct job_record *job_ptr, int sign)
+{
+	int i, i_first, i_last;
+
+	if (!job_ptr->node_bitmap)
+		return;
+	i_first = bit_ffs(job_ptr->node_bitmap);
+	if (i_first < 0)
+		return;
+	i_last = MIN(bit_fls(job_ptr->node_bitmap), node_cnt - 1);
+	for (i = i_first; i <= i_last; i++) {
+		if (!bit_test(job_ptr->node_bitmap, i) ||
+		    (node_domain[i] < 0))
+			continue;
+		_commit_watts(node_domain[i], sign *
+			      (int64_t) power_budget_job_node_watts(job_ptr, i));
+	}
+}
+
+/* Call with budget_mutex held and the domain tree built */
+static void _refresh(time_t now)
+{
+	power_telemetry_sample_t sample;
+	struct job_record *job_ptr;
+	ListIterator job_iterator;
+	uint32_t limit, watts;
+	int d, i;
+
+	refresh_time = now;
+	any_limit = false;
+	for (d = 0; d < domain_cnt; d++) {
+		limit = 0;
+		if (layouts_entity_get_kv(L_NAME, domains[d].name, L_LIMIT,
+					  &limit, L_T_UINT32) != SLURM_SUCCESS)
+			limit = 0;
+		domains[d].limit = limit;
+		domains[d].committed = 0;
+		domains[d].measured = 0;
+		if (limit)
+			any_limit = true;
+	}
+	if (!any_limit)
+		return;
+
+	for (i = 0; i < node_cnt; i++) {
+		if ((node_domain[i] < 0) ||
+		    (power_telemetry_latest(i, &sample) != SLURM_SUCCESS))
+			continue;
+		watts = power_telemetry_sample_watts(&sample);
+		for (d = node_domain[i]; d >= 0; d = domains[d].parent)
+			domains[d].measured += watts;
+	}
+
+	job_iterator = list_iterator_create(job_list);
+	while ((job_ptr = (struct job_record *) list_next(job_iterator))) {
+		if (IS_JOB_RUNNING(job_ptr) || IS_JOB_SUSPENDED(job_ptr))
+			_commit_job(job_ptr, 1);
+	}
+	list_iterator_destroy(job_iterator);
+}
+
+/*
+ * Build or refresh the domain tree as needed, call with budget_mutex held.
+ * RET true if the committed watts were recounted from the job list
+ */
+static bool _budget_sync(bool force)
+{
+	time_t now = time(NULL);
+
+	if (!budget_built || (node_cnt != node_record_count)) {
+		_build_domains();
+		force = true;
+	}
+	if (domain_cnt &&
+	    (force || (difftime(now, refresh_time) >= REFRESH_PERIOD))) {
+		_refresh(now);
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Watts per node the power analyzer predicts for a job on node_cnt nodes,
+ * 0 if it has no prediction
+ */
+static uint32_t _job_estimate(struct job_record *job_ptr, uint32_t node_cnt)
+{
+	uint32_t watts = 0;
+
+	node_cnt = MAX(node_cnt, 1);
+	if (power_analyzer_g_estimate_job_power(job_ptr, NULL, node_cnt,
+						node_cnt, node_cnt, 0, 0, 0, 0,
+						&watts) != SLURM_SUCCESS)
+		return 0;
+	return (watts + node_cnt - 1) / node_cnt;
+}
+
+static uint32_t _job_node_watts(struct job_record *job_ptr, int node_inx,
+				uint32_t est_watts)
+{
+	struct node_record *node_ptr = node_record_table_ptr + node_inx;
+	uint32_t watts = 0;
+	uint16_t sockets;
+
+	if (est_watts)
+		return est_watts;
+	if (job_ptr->power_pkg_watts || job_ptr->power_dram_watts) {
+		if (slurmctld_conf.fast_schedule)
+			sockets = node_ptr->config_ptr->sockets;
+		else
+			sockets = node_ptr->sockets;
+		return (job_ptr->power_pkg_watts + job_ptr->power_dram_watts) *
+		       MAX(sockets, 1);
+	}
+	if ((max_watts_handle < 0) ||
+	    (layouts_key_get(max_watts_handle, node_inx, &watts) !=
+	     SLURM_SUCCESS))
+		return 0;
+	return watts;
+}
+
+extern uint32_t power_budget_job_node_watts(struct job_record *job_ptr,
+					    int node_inx)
+{
+	return _job_node_watts(job_ptr, node_inx, job_ptr->power_est_watts);
+}
+
+/*
+ * Charge the watts of a job on each node of bitmap to the node's deepest
+ * domain, then fold the charges up: parents always come before their
+ * children in the array. Call with budget_mutex held and the domain tree
+ * built, the charges are left in domains[].charge.
+ * RET watts of all the nodes, inside a domain or not
+ */
+static uint64_t _charge_job(struct job_record *job_ptr, bitstr_t *bitmap,
+			    int i_first, uint32_t est_watts)
+{
+	uint64_t total = 0;
+	uint32_t watts;
+	int d, i, i_last;
+
+	i_last = MIN(bit_fls(bitmap), node_cnt - 1);
+	for (i = i_first; i <= i_last; i++) {
+		if (!bit_test(bitmap, i))
+			continue;
+		watts = _job_node_watts(job_ptr, i, est_watts);
+		total += watts;
+		if (node_domain[i] >= 0)
+			domains[node_domain[i]].charge += watts;
+	}
+	for (d = domain_cnt - 1; d > 0; d--) {
+		if (domains[d].charge && (domains[d].parent >= 0))
+			domains[domains[d].parent].charge += domains[d].charge;
+	}
+	return total;
+}
+
+/*
+ * Test the charges left by _charge_job() against the domain limits and
+ * clear them. used is the watts already in use in each domain.
+ */
+static int _charge_test(struct job_record *job_ptr, uint64_t *used)
+{
+	int d, rc = SLURM_SUCCESS;
+
+	for (d = 0; d < domain_cnt; d++) {
+		if (!domains[d].charge)
+			continue;
+		if (domains[d].limit && (rc == SLURM_SUCCESS) &&
+		    (used[d] + domains[d].charge > domains[d].limit)) {
+			debug2("%s: job %u needs %"PRIu64" W in %s, %"PRIu64
+			       " W of %u W in use", __func__, job_ptr->job_id,
+			       domains[d].charge, domains[d].name, used[d],
+			       domains[d].limit);
+			rc = ESLURM_POWER_NOT_AVAIL;
+		}
+		domains[d].charge = 0;
+	}
+	return rc;
+}
+
+extern int power_budget_domain_cnt(void)
+{
+	int cnt;
+
+	slurm_mutex_lock(&budget_mutex);
+	_budget_sync(false);
+	cnt = any_limit ? domain_cnt : 0;
+	slurm_mutex_unlock(&budget_mutex);
+
+	return cnt;
+}
+
+extern uint64_t power_budget_job_charge(struct job_record *job_ptr,
+					bitstr_t *bitmap, uint64_t *charge,
+					int charge_cnt)
+{
+	uint64_t watts;
+	uint32_t est_watts;
+	int d, i_first;
+
+	if (!bitmap || ((i_first = bit_ffs(bitmap)) < 0))
+		return 0;
+
+	slurm_mutex_lock(&budget_mutex);
+	_budget_sync(false);
+	if (IS_JOB_PENDING(job_ptr))
+		est_watts = _job_estimate(job_ptr, bit_set_count(bitmap));
+	else
+		est_watts = job_ptr->power_est_watts;
+	watts = _charge_job(job_ptr, bitmap, i_first, est_watts);
+	for (d = 0; d < domain_cnt; d++) {
+		if (charge && (charge_cnt == domain_cnt))
+			charge[d] += domains[d].charge;
+		domains[d].charge = 0;
+	}
+	slurm_mutex_unlock(&budget_mutex);
+
+	return watts;
+}
+
+extern int power_budget_charge_test(struct job_record *job_ptr,
+				    uint64_t *planned, uint64_t *charge,
+				    int charge_cnt, bool now)
+{
+	uint64_t *used;
+	int d, rc = SLURM_SUCCESS;
+
+	slurm_mutex_lock(&budget_mutex);
+	if (!any_limit || (charge_cnt != domain_cnt)) {
+		/* the domain tree changed, the caller replans */
+		slurm_mutex_unlock(&budget_mutex);
+		return SLURM_SUCCESS;
+	}
+	used = xmalloc(sizeof(uint64_t) * domain_cnt);
+	for (d = 0; d < domain_cnt; d++) {
+		if (planned)
+			used[d] = planned[d];
+		if (now)
+			used[d] = MAX(used[d], domains[d].measured);
+		domains[d].charge = charge[d];
+	}
+	rc = _charge_test(job_ptr, used);
+	xfree(used);
+	slurm_mutex_unlock(&budget_mutex);
+
+	return rc;
+}
+
+extern int power_budget_job_test(struct job_record *job_ptr,
+				 bitstr_t *bitmap)
+{
+	uint64_t *used;
+	int d, i_first, rc;
+
+	slurm_mutex_lock(&budget_mutex);
+	_budget_sync(false);
+	if (!any_limit || !bitmap || ((i_first = bit_ffs(bitmap)) < 0)) {
+		slurm_mutex_unlock(&budget_mutex);
+		return SLURM_SUCCESS;
+	}
+	_charge_job(job_ptr, bitmap, i_first,
+		    _job_estimate(job_ptr, bit_set_count(bitmap)));
+	used = xmalloc(sizeof(uint64_t) * domain_cnt);
+	for (d = 0; d < domain_cnt; d++)
+		used[d] = MAX(domains[d].committed, domains[d].measured);
+	rc = _charge_test(job_ptr, used);
+	xfree(used);
+	slurm_mutex_unlock(&budget_mutex);
+
+	return rc;
+}
+
+extern void power_budget_job_begin(struct job_record *job_ptr)
+{
+	bool recounted;
+
+	/* the prediction the job is charged until it ends */
+	job_ptr->power_est_watts = _job_estimate(job_ptr, job_ptr->node_cnt);
+
+	slurm_mutex_lock(&budget_mutex);
+	recounted = _budget_sync(false);
+	/* a recount already included the job if it is running */
+	if (any_limit && !(recounted && IS_JOB_RUNNING(job_ptr)))
+		_commit_job(job_ptr, 1);
+	slurm_mutex_unlock(&budget_mutex);
+}
+
+extern void power_budget_job_fini(struct job_record *job_ptr)
+{
+	slurm_mutex_lock(&budget_mutex);
+	if (budget_built && any_limit && (node_cnt == node_record_count))
+		_commit_job(job_ptr, -1);
+	slurm_mutex_unlock(&budget_mutex);
+}
+
+extern void power_budget_refresh(void)
+{
+	slurm_mutex_lock(&budget_mutex);
+	_budget_sync(true);
+	slurm_mutex_unlock(&budget_mutex);
+}
+
+extern int power_budget_node_caps(uint32_t *caps)
+{
+	power_telemetry_sample_t sample;
+	uint32_t *demand;
+	double budget;
+	int d, i, cap_cnt = 0;
+
+	memset(caps, 0, sizeof(uint32_t) * node_record_count);
+
+	slurm_mutex_lock(&budget_mutex);
+	_budget_sync(false);
+	if (!any_limit) {
+		slurm_mutex_unlock(&budget_mutex);
+		return 0;
+	}
+
+	/* demand of each node, summed up the tree */
+	demand = xmalloc(sizeof(uint32_t) * MAX(node_cnt, 1));
+	for (d = 0; d < domain_cnt; d++)
+		domains[d].demand = 0;
+	for (i = 0; i < node_cnt; i++) {
+		if (node_domain[i] < 0)
+			continue;
+		if ((max_watts_handle < 0) ||
+		    (layouts_key_get(max_watts_handle, i, &demand[i]) !=
+		     SLURM_SUCCESS) || !demand[i]) {
+			if (power_telemetry_latest(i, &sample) == SLURM_SUCCESS)
+				demand[i] = power_telemetry_sample_watts(
+					&sample);
+		}
+		domains[node_domain[i]].demand += demand[i];
+	}
+	for (d = domain_cnt - 1; d > 0; d--) {
+		if (domains[d].parent >= 0)
+			domains[domains[d].parent].demand += domains[d].demand;
+	}
+
+	/* top down: a domain gets the smaller of its limit and its share of
+	 * its parent's budget, then scales its children to fit */
+	for (d = 0; d < domain_cnt; d++) {
+		int p = domains[d].parent;
+
+		budget = domains[d].demand;
+		domains[d].capped = false;
+		if (p >= 0) {
+			budget *= domains[p].scale;
+			domains[d].capped = domains[p].capped;
+		}
+		if (domains[d].limit) {
+			budget = MIN(budget, (double) domains[d].limit);
+			domains[d].capped = true;
+		}
+		if (domains[d].demand)
+			domains[d].scale = budget / domains[d].demand;
+		else
+			domains[d].scale = 1.0;
+	}
+
+	for (i = 0; i < node_cnt; i++) {
+		d = node_domain[i];
+		if ((d < 0) || !domains[d].capped || !demand[i])
+			continue;
+		caps[i] = (uint32_t) (demand[i] * domains[d].scale);
+		cap_cnt++;
+	}
+	xfree(demand);
+	slurm_mutex_unlock(&budget_mutex);
+
+	return cap_cnt;
+}
+
+extern void power_budget_reset(void)
+{
+	slurm_mutex_lock(&budget_mutex);
+	_free_domains();
+	budget_built = false;
+	slurm_mutex_unlock(&budget_mutex);
+}
+
+extern void power_budget_fini(void)
+{
+	power_budget_reset();
+}
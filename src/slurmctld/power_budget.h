@@ -0,0 +1,172 @@
+/*****************************************************************************\
+ *  power_budget.h - Hierarchical power budget driven by the power layout
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _POWER_BUDGET_H
+#define _POWER_BUDGET_H
+
+#include <stdint.h>
+
+#include "src/common/bitstring.h"
+#include "src/slurmctld/slurmctld.h"
+
+/*
+ * The power budget is a tree of domains built from the entities of the
+ * "power" layout which enclose nodes: the Center, and any Rack or PDU
+ * between the Center and the nodes. A domain with a LimitWatts value may
+ * not have more than that many watts committed to the jobs running below
+ * it, nor measured on the nodes below it.
+ *
+ * Each domain keeps the committed watts of its whole subtree, so testing
+ * a job charges the job's watts to the deepest domain of each of its nodes,
+ * folds the charges up the tree once and then compares every touched
+ * domain with its limit.
+ *
+ * Domains without a LimitWatts value are not limited. Without a power
+ * layout, or without any limit, every job fits.
+ */
+
+/*
+ * power_budget_job_node_watts - watts a job commits on one of its nodes:
+ *	what the power analyzer predicted for it, else its package plus DRAM
+ *	request times the node's sockets, else the node's MaxWatts in the
+ *	power layout
+ * IN job_ptr - the job
+ * IN node_inx - index of the node in node_record_table_ptr
+ * NOTE: Call with node read lock
+ */
+extern uint32_t power_budget_job_node_watts(struct job_record *job_ptr,
+					    int node_inx);
+
+/*
+ * power_budget_domain_cnt - number of power domains, the size of the
+ *	charge vectors of the functions below
+ * RET domain count, 0 if no domain has a LimitWatts
+ * NOTE: Call with job read and node read locks
+ */
+extern int power_budget_domain_cnt(void);
+
+/*
+ * power_budget_job_charge - watts a job commits on a set of nodes, charged
+ *	per node as power_budget_job_test() does for a pending job and as
+ *	power_budget_job_begin() did for a started one
+ * IN job_ptr - the job
+ * IN bitmap - the job's nodes, or those it may be given
+ * IN/OUT charge - if not NULL, the watts committed below each domain are
+ *	added to it
+ * IN charge_cnt - entries of charge, from power_budget_domain_cnt(). charge
+ *	is left alone if the domain tree changed size since.
+ * RET total watts, 0 if the job is not charged
+ * NOTE: Call with job read and node read locks
+ */
+extern uint64_t power_budget_job_charge(struct job_record *job_ptr,
+					bitstr_t *bitmap, uint64_t *charge,
+					int charge_cnt);
+
+/*
+ * power_budget_charge_test - test if the charge of a job fits in the limit
+ *	of every domain, next to the watts planned for other jobs. This lets
+ *	a planner apply the test of power_budget_job_test() to future times.
+ * IN job_ptr - the job, for logging
+ * IN planned - watts committed below each domain over the time tested,
+ *	NULL for none
+ * IN charge - from power_budget_job_charge()
+ * IN charge_cnt - entries of planned and charge
+ * IN now - the time tested starts now: the watts measured below each
+ *	domain count too, as in power_budget_job_test()
+ * RET SLURM_SUCCESS or ESLURM_POWER_NOT_AVAIL
+ * NOTE: Call with job read and node read locks
+ */
+extern int power_budget_charge_test(struct job_record *job_ptr,
+				    uint64_t *planned, uint64_t *charge,
+				    int charge_cnt, bool now);
+
+/*
+ * power_budget_job_test - test if a job fits in the budget of every
+ *	domain above a set of nodes, next to the jobs already running
+ * IN job_ptr - the job
+ * IN bitmap - the nodes selected for the job
+ * RET SLURM_SUCCESS or ESLURM_POWER_NOT_AVAIL
+ * NOTE: Call with job read and node read locks
+ */
+extern int power_budget_job_test(struct job_record *job_ptr,
+				 bitstr_t *bitmap);
+
+/*
+ * power_budget_job_begin - commit the watts of a job to its domains,
+ *	recording the power analyzer's prediction in job_ptr->power_est_watts
+ * NOTE: Call with job write and node read locks
+ */
+extern void power_budget_job_begin(struct job_record *job_ptr);
+
+/*
+ * power_budget_job_fini - release the watts of a job from its domains
+ * NOTE: Call with job read and node read locks, before the job's
+ *	node_bitmap is cleared
+ */
+extern void power_budget_job_fini(struct job_record *job_ptr);
+
+/*
+ * power_budget_refresh - reload the domain limits from the power layout,
+ *	the measured watts from the telemetry store, and recount the watts
+ *	committed to the running jobs. This is also done on the fly by
+ *	power_budget_job_test() when the last refresh is old enough.
+ * NOTE: Call with job read and node read locks
+ */
+extern void power_budget_refresh(void);
+
+/*
+ * power_budget_node_caps - split the limit of each domain between its
+ *	child domains and nodes in proportion to their demand (MaxWatts, or
+ *	the measured watts of nodes without one), top down, so that no
+ *	domain's nodes are capped above its limit
+ * OUT caps - node_record_count entries, in watts. Nodes below no limited
+ *	domain get 0, meaning no cap.
+ * RET number of nodes given a cap
+ * NOTE: Call with node read lock
+ */
+extern int power_budget_node_caps(uint32_t *caps);
+
+/*
+ * power_budget_reset - drop the domain tree, e.g. when the node table is
+ *	rebuilt. It is built again from the power layout on next use.
+ */
+extern void power_budget_reset(void);
+
+/* power_budget_fini - free the domain tree at shutdown */
+extern void power_budget_fini(void);
+
+#endif /* !_POWER_BUDGET_H */
@@ -0,0 +1,703 @@
+/*****************************************************************************\
+ *  power_collect.c - parallel power/PMC sample collection for slurmctld
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/common/bitstring.h"
+#include "src/common/forward.h"
+#include "src/common/hostlist.h"
+#include "src/common/log.h"
+#include "src/common/node_conf.h"
+#include "src/common/power_knob.h"
+#include "src/common/slurm_protocol_api.h"
+#include "src/common/timers.h"
+#include "src/common/xmalloc.h"
+#include "src/slurmctld/locks.h"
+#include "src/slurmctld/power_collect.h"
+#include "src/slurmctld/power_shed.h"
+#include "src/slurmctld/power_telemetry.h"
+#include "src/slurmctld/slurmctld.h"
+
+#define PUSH_STALE_PERIODS	3	/* pushed samples older than this many
+					 * push periods are queried again */
+
+static pthread_mutex_t sweep_seq_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t sweep_seq = 0;
+static time_t push_config_update = 0;	/* protected by sweep_seq_mutex */
+static uint32_t push_msec = 0;
+
+/* PowerParameters=telemetry_push_msec, 0 if the nodes do not push.
+ * NOTE: sweep_seq_mutex must be held */
+static uint32_t _push_msec(void)
+{
+	char *power_params, *tmp_ptr;
+
+	if (push_config_update == slurmctld_conf.last_update)
+		return push_msec;
+	push_config_update = slurmctld_conf.last_update;
+	push_msec = 0;
+	power_params = slurm_get_power_parameters();
+	if (!power_params)
+		return push_msec;
+	/*                                   12345678901234567890 */
+	if ((tmp_ptr = strstr(power_params, "telemetry_push_msec=")))
+		push_msec = MAX(atoi(tmp_ptr + 20), 0);
+	xfree(power_params);
+	return push_msec;
+}
+
+/* Build the hostlist of the nodes in node_bitmap.
+ * NOTE: READ lock_slurmctld node before entry */
+static hostlist_t _bitmap2hostlist(bitstr_t *node_bitmap)
+{
+	struct node_record *node_ptr;
+	hostlist_t hl = hostlist_create(NULL);
+	int i;
+
+	for (i = 0, node_ptr = node_record_table_ptr;
+	     i < node_record_count; i++, node_ptr++) {
+		if (node_bitmap && !bit_test(node_bitmap, i))
+			continue;
+		hostlist_push_host(hl, node_ptr->name);
+	}
+	return hl;
+}
+
+/* Map a responding node name to its node table index, -1 if unknown.
+ * NOTE: READ lock_slurmctld node before entry */
+static int _node_name2inx(char *node_name, uint32_t node_cnt)
+{
+	struct node_record *node_ptr;
+	int inx;
+
+	if (!node_name || !(node_ptr = find_node_record(node_name)))
+		return -1;
+	inx = node_ptr - node_record_table_ptr;
+	if ((inx < 0) || (inx >= node_cnt))
+		return -1;
+	return inx;
+}
+
+/* Send one request down the forwarding tree to every node in hl.
+ * RET list of ret_data_info_t, NULL on failure */
+static List _tree_send(hostlist_t hl, uint16_t msg_type, void *data,
+		       int timeout)
+{
+	slurm_msg_t msg;
+
+	if (hostlist_count(hl) == 0)
+		return NULL;
+
+	slurm_msg_t_init(&msg);
+	msg.msg_type = msg_type;
+	msg.data     = data;
+
+	return start_msg_tree(hl, &msg, timeout);
+}
+
+/* Record the reply of one node to a sweep */
+static void _sweep_record(power_sweep_t *sweep, int inx, uint16_t flags,
+			  ret_data_info_t *ret_data_info)
+{
+	power_node_sample_t *sample = &sweep->samples[inx];
+	power_knob_sample_resp_msg_t *sample_msg;
+	int rc;
+
+	if (ret_data_info->type != RESPONSE_POWER_KNOB_SAMPLE) {
+		rc = slurm_get_return_code(ret_data_info->type,
+					   ret_data_info->data);
+		if (rc == SLURM_SUCCESS)
+			rc = SLURM_UNEXPECTED_MSG_ERROR;
+		sample->rc = rc;
+		bit_set(sweep->fail_bitmap, inx);
+		return;
+	}
+
+	sample_msg = ret_data_info->data;
+	if (sample_msg->req_seq != sweep->seq) {
+		debug("power_collect_sweep: stale sample from %s (seq %u != %u)",
+		      ret_data_info->node_name, sample_msg->req_seq,
+		      sweep->seq);
+	}
+	sample->seq = sample_msg->seq;
+	sample->sample_usec = sample_msg->sample_usec;
+	if (flags & POWER_COLLECT_POWER) {
+		sample->socket_cnt = sample_msg->socket_cnt;
+		sample->power = sample_msg->power_info;
+		sample_msg->power_info = NULL;
+	}
+	if (flags & POWER_COLLECT_CACHE) {
+		sample->cache_socket_cnt = sample_msg->cache_socket_cnt;
+		sample->cache = sample_msg->perf_info;
+		sample_msg->perf_info = NULL;
+	}
+}
+
+/* Serve the nodes of query_bitmap which pushed a sample within stale_sec
+ * from the telemetry store and take them out of query_bitmap */
+static void _sweep_pushed(power_sweep_t *sweep, bitstr_t *query_bitmap,
+			  uint16_t flags, uint32_t stale_sec)
+{
+	power_telemetry_sample_t telemetry;
+	power_node_sample_t *sample;
+	time_t now = time(NULL);
+	int i;
+
+	for (i = 0; i < sweep->node_cnt; i++) {
+		if (!bit_test(query_bitmap, i) ||
+		    (power_telemetry_latest(i, &telemetry) != SLURM_SUCCESS))
+			continue;
+		if ((flags & POWER_COLLECT_POWER) &&
+		    (!telemetry.power_time ||
+		     (now - telemetry.power_time > stale_sec)))
+			continue;
+		if ((flags & POWER_COLLECT_CACHE) &&
+		    (!telemetry.cache_time ||
+		     (now - telemetry.cache_time > stale_sec)))
+			continue;
+
+		sample = &sweep->samples[i];
+		sample->pushed = true;
+		sample->seq = telemetry.seq;
+		sample->sample_usec = telemetry.sample_usec;
+		if (flags & POWER_COLLECT_POWER) {
+			sample->socket_cnt = telemetry.socket_cnt;
+			sample->power =
+				power_knob_current_alloc(telemetry.socket_cnt);
+			memcpy(sample->power, telemetry.power,
+			       sizeof(power_current_data_t) *
+			       telemetry.socket_cnt);
+		}
+		if (flags & POWER_COLLECT_CACHE) {
+			sample->cache_socket_cnt = telemetry.cache_socket_cnt;
+			sample->cache = power_knob_cache_alloc(
+					telemetry.cache_socket_cnt);
+			memcpy(sample->cache, telemetry.cache,
+			       sizeof(cache_ref_t) *
+			       telemetry.cache_socket_cnt);
+		}
+		bit_clear(query_bitmap, i);
+	}
+}
+
+/* Send the sample request of a sweep and merge the replies into it */
+static void _sweep_send(power_sweep_t *sweep, hostlist_t hl,
+			uint16_t flags, int timeout)
+{
+	/* Locks: Read node */
+	slurmctld_lock_t node_read_lock = {
+		NO_LOCK, NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
+	power_knob_sample_req_msg_t req;
+	ret_data_info_t *ret_data_info;
+	bitstr_t *resp_bitmap;
+	ListIterator itr;
+	List ret_list;
+	int inx;
+
+	memset(&req, 0, sizeof(req));
+	req.seq = sweep->seq;
+	ret_list = _tree_send(hl, REQUEST_POWER_KNOB_SAMPLE, &req, timeout);
+	resp_bitmap = bit_alloc(sweep->node_cnt);
+
+	lock_slurmctld(node_read_lock);
+	if (ret_list) {
+		itr = list_iterator_create(ret_list);
+		while ((ret_data_info = list_next(itr))) {
+			inx = _node_name2inx(ret_data_info->node_name,
+					     sweep->node_cnt);
+			if ((inx < 0) || !bit_test(sweep->node_bitmap, inx))
+				continue;
+			bit_set(resp_bitmap, inx);
+			_sweep_record(sweep, inx, flags, ret_data_info);
+		}
+		list_iterator_destroy(itr);
+	}
+	unlock_slurmctld(node_read_lock);
+	FREE_NULL_LIST(ret_list);
+
+	/* Nodes which never answered timed out somewhere in the tree */
+	bit_not(resp_bitmap);
+	bit_and(resp_bitmap, sweep->node_bitmap);
+	for (inx = bit_ffs(resp_bitmap);
+	     (inx >= 0) && (inx < sweep->node_cnt); inx++) {
+		if (!bit_test(resp_bitmap, inx))
+			continue;
+		sweep->samples[inx].rc = SLURM_PROTOCOL_SOCKET_IMPL_TIMEOUT;
+		bit_set(sweep->fail_bitmap, inx);
+	}
+	FREE_NULL_BITMAP(resp_bitmap);
+}
+
+extern power_sweep_t *power_collect_sweep(bitstr_t *node_bitmap,
+					  uint16_t flags, int timeout)
+{
+	/* Locks: Read node */
+	slurmctld_lock_t node_read_lock = {
+		NO_LOCK, NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
+	power_sweep_t *sweep;
+	bitstr_t *query_bitmap;
+	hostlist_t hl;
+	uint32_t push_period;
+	int pushed_cnt = 0;
+	DEF_TIMERS;
+
+	START_TIMER;
+	sweep = xmalloc(sizeof(power_sweep_t));
+	sweep->sweep_time = time(NULL);
+	slurm_mutex_lock(&sweep_seq_mutex);
+	sweep->seq = ++sweep_seq;
+	push_period = _push_msec();
+	slurm_mutex_unlock(&sweep_seq_mutex);
+
+	lock_slurmctld(node_read_lock);
+	sweep->node_cnt = node_record_count;
+	sweep->samples = xmalloc(sizeof(power_node_sample_t) *
+				 MAX(sweep->node_cnt, 1));
+	sweep->fail_bitmap = bit_alloc(sweep->node_cnt);
+	if (node_bitmap) {
+		sweep->node_bitmap = bit_copy(node_bitmap);
+	} else {
+		sweep->node_bitmap = bit_alloc(sweep->node_cnt);
+		bit_set_all(sweep->node_bitmap);
+	}
+	query_bitmap = bit_copy(sweep->node_bitmap);
+	if (push_period && (flags & (POWER_COLLECT_POWER |
+				     POWER_COLLECT_CACHE))) {
+		_sweep_pushed(sweep, query_bitmap, flags,
+			      (push_period * PUSH_STALE_PERIODS + 999) / 1000);
+		pushed_cnt = bit_set_count(sweep->node_bitmap) -
+			     bit_set_count(query_bitmap);
+	}
+	hl = _bitmap2hostlist(query_bitmap);
+	unlock_slurmctld(node_read_lock);
+	FREE_NULL_BITMAP(query_bitmap);
+
+	if (flags & (POWER_COLLECT_POWER | POWER_COLLECT_CACHE))
+		_sweep_send(sweep, hl, flags, timeout);
+	hostlist_destroy(hl);
+
+	END_TIMER;
+	sweep->sweep_usec = DELTA_TIMER;
+	debug2("power_collect_sweep: %d nodes, %d pushed, %d failed, %s",
+	       bit_set_count(sweep->node_bitmap), pushed_cnt,
+	       bit_set_count(sweep->fail_bitmap), TIME_STR);
+
+	return sweep;
+}
+
+extern int power_collect_send(bitstr_t *node_bitmap, uint16_t msg_type,
+			      void *data, int timeout, bitstr_t **fail_bitmap)
+{
+	return power_collect_query(node_bitmap, msg_type, data, timeout,
+				   NULL, NULL, fail_bitmap);
+}
+
+/* Copy node_bitmap, or every node if NULL.
+ * NOTE: READ lock_slurmctld node before entry */
+static bitstr_t *_query_bitmap(bitstr_t *node_bitmap)
+{
+	bitstr_t *query_bitmap;
+
+	if (node_bitmap)
+		return bit_copy(node_bitmap);
+	query_bitmap = bit_alloc(node_record_count);
+	bit_set_all(query_bitmap);
+	return query_bitmap;
+}
+
+/* Send one request to the nodes of hl and sort out their replies, the
+ * common part of power_collect_query(), power_collect_set_caps() and
+ * power_collect_set_budgets() */
+static int _collect_replies(hostlist_t hl, bitstr_t *query_bitmap,
+			    uint32_t node_cnt, uint16_t msg_type, void *data,
+			    int timeout, power_collect_reply_f reply,
+			    void *arg, bitstr_t **fail_bitmap)
+{
+	/* Locks: Read node */
+	slurmctld_lock_t node_read_lock = {
+		NO_LOCK, NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
+	ret_data_info_t *ret_data_info;
+	bitstr_t *ok_bitmap;
+	ListIterator itr;
+	List ret_list;
+	int inx, fail_cnt;
+
+	ret_list = _tree_send(hl, msg_type, data, timeout);
+
+	ok_bitmap = bit_alloc(node_cnt);
+	lock_slurmctld(node_read_lock);
+	if (ret_list) {
+		itr = list_iterator_create(ret_list);
+		while ((ret_data_info = list_next(itr))) {
+			if ((ret_data_info->type == RESPONSE_FORWARD_FAILED) ||
+			    ((ret_data_info->type == RESPONSE_SLURM_RC) &&
+			     slurm_get_return_code(ret_data_info->type,
+						   ret_data_info->data)))
+				continue;
+			inx = _node_name2inx(ret_data_info->node_name,
+					     node_cnt);
+			if (inx < 0)
+				continue;
+			bit_set(ok_bitmap, inx);
+			if (reply)
+				(*reply)(inx, ret_data_info->type,
+					 ret_data_info->data, arg);
+		}
+		list_iterator_destroy(itr);
+	}
+	unlock_slurmctld(node_read_lock);
+	FREE_NULL_LIST(ret_list);
+
+	bit_not(ok_bitmap);
+	bit_and(ok_bitmap, query_bitmap);
+	fail_cnt = bit_set_count(ok_bitmap);
+	if (fail_bitmap)
+		*fail_bitmap = ok_bitmap;
+	else
+		FREE_NULL_BITMAP(ok_bitmap);
+
+	return fail_cnt;
+}
+
+extern int power_collect_query(bitstr_t *node_bitmap, uint16_t msg_type,
+			       void *data, int timeout,
+			       power_collect_reply_f reply, void *arg,
+			       bitstr_t **fail_bitmap)
+{
+	/* Locks: Read node */
+	slurmctld_lock_t node_read_lock = {
+		NO_LOCK, NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
+	bitstr_t *query_bitmap;
+	hostlist_t hl;
+	uint32_t node_cnt;
+	int fail_cnt;
+
+	lock_slurmctld(node_read_lock);
+	node_cnt = node_record_count;
+	query_bitmap = _query_bitmap(node_bitmap);
+	hl = _bitmap2hostlist(query_bitmap);
+	unlock_slurmctld(node_read_lock);
+
+	fail_cnt = _collect_replies(hl, query_bitmap, node_cnt, msg_type,
+				    data, timeout, reply, arg, fail_bitmap);
+	hostlist_destroy(hl);
+	FREE_NULL_BITMAP(query_bitmap);
+
+	return fail_cnt;
+}
+
+/* Gather the values of the nodes of query_bitmap in table order. This is
+ * the order in which _bitmap2hostlist() pushes them, so each slurmd finds
+ * its own value at its position in the node list of the request. */
+static uint32_t *_node_values(bitstr_t *query_bitmap, uint32_t node_cnt,
+			      uint32_t *values)
+{
+	uint32_t *node_values;
+	int i, j;
+
+	node_values = xmalloc(sizeof(uint32_t) *
+			      (bit_set_count(query_bitmap) + 1));
+	for (i = 0, j = 0; i < node_cnt; i++) {
+		if (bit_test(query_bitmap, i))
+			node_values[j++] = values[i];
+	}
+	return node_values;
+}
+
+/* RET true if all cnt values are the same */
+static bool _uniform_values(uint32_t *values, uint32_t cnt)
+{
+	int i;
+
+	for (i = 1; i < cnt; i++) {
+		if (values[i] != values[0])
+			return false;
+	}
+	return true;
+}
+
+extern int power_collect_set_caps(bitstr_t *node_bitmap, uint32_t *cap,
+				  uint32_t *cap2, int timeout,
+				  bitstr_t **fail_bitmap)
+{
+	/* Locks: Read node */
+	slurmctld_lock_t node_read_lock = {
+		NO_LOCK, NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
+	power_cap_nodes_req_msg_t req;
+	bitstr_t *query_bitmap;
+	hostlist_t hl;
+	uint32_t node_cnt;
+	int fail_cnt;
+
+	if (!cap2)
+		cap2 = cap;
+
+	lock_slurmctld(node_read_lock);
+	node_cnt = node_record_count;
+	if (node_bitmap && (bit_size(node_bitmap) != node_cnt)) {
+		/* the caps were built against an older node table */
+		unlock_slurmctld(node_read_lock);
+		fail_cnt = bit_set_count(node_bitmap);
+		if (fail_bitmap)
+			*fail_bitmap = bit_copy(node_bitmap);
+		return fail_cnt;
+	}
+	query_bitmap = _query_bitmap(node_bitmap);
+	hl = _bitmap2hostlist(query_bitmap);
+	unlock_slurmctld(node_read_lock);
+
+	memset(&req, 0, sizeof(power_cap_nodes_req_msg_t));
+	req.node_list = hostlist_ranged_string_xmalloc(hl);
+	req.cap_info  = _node_values(query_bitmap, node_cnt, cap);
+	req.cap_info2 = _node_values(query_bitmap, node_cnt, cap2);
+	req.cap_cnt = bit_set_count(query_bitmap);
+	/* send a single pair when every node gets the same caps */
+	if (_uniform_values(req.cap_info, req.cap_cnt) &&
+	    _uniform_values(req.cap_info2, req.cap_cnt))
+		req.cap_cnt = 1;
+
+	fail_cnt = _collect_replies(hl, query_bitmap, node_cnt,
+				    REQUEST_POWER_CAP_SET_NODES, &req,
+				    timeout, NULL, NULL, fail_bitmap);
+	hostlist_destroy(hl);
+	FREE_NULL_BITMAP(query_bitmap);
+	xfree(req.node_list);
+	xfree(req.cap_info);
+	xfree(req.cap_info2);
+
+	return fail_cnt;
+}
+
+extern int power_collect_set_budgets(bitstr_t *node_bitmap,
+				     uint32_t *node_watts,
+				     uint32_t period_msec, int timeout,
+				     power_collect_reply_f reply, void *arg,
+				     bitstr_t **fail_bitmap)
+{
+	/* Locks: Read node */
+	slurmctld_lock_t node_read_lock = {
+		NO_LOCK, NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
+	power_schedule_slurmd_req_msg_t req;
+	bitstr_t *query_bitmap;
+	hostlist_t hl;
+	uint32_t node_cnt;
+	int fail_cnt;
+
+	lock_slurmctld(node_read_lock);
+	node_cnt = node_record_count;
+	if (node_bitmap && (bit_size(node_bitmap) != node_cnt)) {
+		/* the budgets were built against an older node table */
+		unlock_slurmctld(node_read_lock);
+		fail_cnt = bit_set_count(node_bitmap);
+		if (fail_bitmap)
+			*fail_bitmap = bit_copy(node_bitmap);
+		return fail_cnt;
+	}
+	query_bitmap = _query_bitmap(node_bitmap);
+	hl = _bitmap2hostlist(query_bitmap);
+	unlock_slurmctld(node_read_lock);
+
+	memset(&req, 0, sizeof(power_schedule_slurmd_req_msg_t));
+	req.node_list = hostlist_ranged_string_xmalloc(hl);
+	req.node_watts = _node_values(query_bitmap, node_cnt, node_watts);
+	req.watts_cnt = bit_set_count(query_bitmap);
+	if (_uniform_values(req.node_watts, req.watts_cnt))
+		req.watts_cnt = 1;
+	req.period_msec = period_msec;
+
+	fail_cnt = _collect_replies(hl, query_bitmap, node_cnt,
+				    REQUEST_POWER_SCHEDULE_SLURMD, &req,
+				    timeout, reply, arg, fail_bitmap);
+	hostlist_destroy(hl);
+	FREE_NULL_BITMAP(query_bitmap);
+	xfree(req.node_list);
+	xfree(req.node_watts);
+
+	return fail_cnt;
+}
+
+extern void power_collect_store(power_sweep_t *sweep)
+{
+	/* Locks: Read node */
+	slurmctld_lock_t node_read_lock = {
+		NO_LOCK, NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
+	power_telemetry_sample_t telemetry;
+	power_node_sample_t *sample;
+	int i;
+
+	if (!sweep)
+		return;
+
+	/* Node indexes of a sweep begun before a reconfigure are stale.
+	 * The node read lock keeps the node table from being rebuilt until
+	 * the samples are published. */
+	lock_slurmctld(node_read_lock);
+	if (sweep->node_cnt != node_record_count) {
+		unlock_slurmctld(node_read_lock);
+		return;
+	}
+
+	power_shed_store(sweep);
+	for (i = 0; i < sweep->node_cnt; i++) {
+		sample = &sweep->samples[i];
+		/* pushed samples were published when they arrived */
+		if (sample->pushed || (!sample->power && !sample->cache))
+			continue;
+		memset(&telemetry, 0, sizeof(power_telemetry_sample_t));
+		telemetry.seq = sample->seq;
+		telemetry.sample_usec = sample->sample_usec;
+		if (sample->power) {
+			telemetry.power_time = sweep->sweep_time;
+			telemetry.socket_cnt = MIN(sample->socket_cnt,
+						   POWER_TELEMETRY_MAX_SOCKET);
+			memcpy(telemetry.power, sample->power,
+			       sizeof(power_current_data_t) *
+			       telemetry.socket_cnt);
+		}
+		if (sample->cache) {
+			telemetry.cache_time = sweep->sweep_time;
+			telemetry.cache_socket_cnt =
+				MIN(sample->cache_socket_cnt,
+				    POWER_TELEMETRY_MAX_SOCKET);
+			memcpy(telemetry.cache, sample->cache,
+			       sizeof(cache_ref_t) *
+			       telemetry.cache_socket_cnt);
+		}
+		power_telemetry_publish(i, &telemetry);
+	}
+	unlock_slurmctld(node_read_lock);
+}
+
+extern uint32_t power_sweep_node_watts(power_sweep_t *sweep, int node_inx)
+{
+	power_node_sample_t *sample;
+	uint32_t watts = 0;
+	int i;
+
+	if (!sweep || (node_inx < 0) || (node_inx >= sweep->node_cnt))
+		return 0;
+	sample = &sweep->samples[node_inx];
+	if (!sample->power)
+		return 0;
+	for (i = 0; i < sample->socket_cnt; i++) {
+		watts += sample->power[i].cpu_current_watts +
+			 sample->power[i].dram_current_watts;
+	}
+	return watts;
+}
+
+extern void power_sweep_free(power_sweep_t *sweep)
+{
+	int i;
+
+	if (!sweep)
+		return;
+	for (i = 0; i < sweep->node_cnt; i++) {
+		xfree(sweep->samples[i].power);
+		xfree(sweep->samples[i].cache);
+	}
+	xfree(sweep->samples);
+	FREE_NULL_BITMAP(sweep->node_bitmap);
+	FREE_NULL_BITMAP(sweep->fail_bitmap);
+	xfree(sweep);
+}
+
+extern void power_pace_init(power_pace_t *pace)
+{
+	pthread_condattr_t cond_attr;
+
+	memset(pace, 0, sizeof(power_pace_t));
+	slurm_mutex_init(&pace->lock);
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&pace->cond, &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+	clock_gettime(CLOCK_MONOTONIC, &pace->next);
+}
+
+extern void power_pace_destroy(power_pace_t *pace)
+{
+	pthread_cond_destroy(&pace->cond);
+	slurm_mutex_destroy(&pace->lock);
+}
+
+extern bool power_pace_wait(power_pace_t *pace, uint32_t period_msec)
+{
+	struct timespec now;
+	bool running;
+
+	slurm_mutex_lock(&pace->lock);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	slurm_ts_add_msec(&pace->next, period_msec);
+	if (!slurm_ts_before(&now, &pace->next)) {
+		/* overran a whole period, resynchronize */
+		pace->next = now;
+		slurm_ts_add_msec(&pace->next, period_msec);
+	}
+	while (!pace->stop && !pace->wake) {
+		if (pthread_cond_timedwait(&pace->cond, &pace->lock,
+					   &pace->next) == ETIMEDOUT)
+			break;
+	}
+	if (pace->wake) {
+		clock_gettime(CLOCK_MONOTONIC, &pace->next);
+		pace->wake = false;
+	}
+	running = !pace->stop;
+	slurm_mutex_unlock(&pace->lock);
+
+	return running;
+}
+
+extern void power_pace_wake(power_pace_t *pace)
+{
+	slurm_mutex_lock(&pace->lock);
+	pace->wake = true;
+	pthread_cond_signal(&pace->cond);
+	slurm_mutex_unlock(&pace->lock);
+}
+
+extern void power_pace_stop(power_pace_t *pace)
+{
+	slurm_mutex_lock(&pace->lock);
+	pace->stop = true;
+	pthread_cond_signal(&pace->cond);
+	slurm_mutex_unlock(&pace->lock);
+}
@@ -0,0 +1,223 @@
+/*****************************************************************************\
+ *  power_collect.h - parallel power/PMC sample collection for slurmctld
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _POWER_COLLECT_H
+#define _POWER_COLLECT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "slurm/slurm.h"
+#include "src/common/bitstring.h"
+
+/* Sample types requested by power_collect_sweep() */
+#define POWER_COLLECT_POWER	0x0001	/* per-socket power_current_data_t */
+#define POWER_COLLECT_CACHE	0x0002	/* per-socket cache_ref_t (PMCs) */
+
+typedef struct power_node_sample {
+	int rc;				/* SLURM_SUCCESS or the reason the
+					 * node could not be sampled */
+	uint16_t socket_cnt;		/* entries in power */
+	power_current_data_t *power;	/* per-socket power, NULL if none */
+	uint16_t cache_socket_cnt;	/* entries in cache */
+	cache_ref_t *cache;		/* per-socket PMC counts, NULL if none */
+	uint32_t seq;			/* slurmd's sample sequence number */
+	uint64_t sample_usec;		/* slurmd's CLOCK_MONOTONIC time of
+					 * the sample, in microseconds */
+	bool pushed;			/* copied from a sample the node
+					 * pushed, not queried */
+} power_node_sample_t;
+
+typedef struct power_sweep {
+	uint32_t node_cnt;		/* size of samples (node_record_count) */
+	bitstr_t *node_bitmap;		/* nodes which were queried */
+	bitstr_t *fail_bitmap;		/* queried nodes which failed to
+					 * answer or timed out */
+	uint32_t seq;			/* sweep sequence number, echoed by
+					 * each node in its reply */
+	time_t sweep_time;		/* when the sweep was started */
+	uint32_t sweep_usec;		/* wall clock time of the sweep */
+	power_node_sample_t *samples;	/* dense, indexed like
+					 * node_record_table_ptr */
+} power_sweep_t;
+
+/*
+ * power_collect_sweep - gather power and/or PMC samples from a set of nodes
+ *	in one parallel pass through the TreeWidth message forwarding tree,
+ *	so the sweep time scales with the tree depth, not the node count.
+ *	Each node answers one REQUEST_POWER_KNOB_SAMPLE with both its power
+ *	and PMC readings, so a sweep costs one round trip per node.
+ *	With PowerParameters=telemetry_push_msec, nodes whose pushed samples
+ *	are recent are served from the telemetry store and not queried.
+ * IN node_bitmap - nodes to query, NULL for every node
+ * IN flags - POWER_COLLECT_POWER and/or POWER_COLLECT_CACHE
+ * IN timeout - per-message timeout in milliseconds, 0 for MessageTimeout
+ * RET sweep results, free with power_sweep_free()
+ * NOTE: Do not hold any slurmctld locks when calling this function.
+ */
+extern power_sweep_t *power_collect_sweep(bitstr_t *node_bitmap,
+					  uint16_t flags, int timeout);
+
+/*
+ * power_collect_send - send one request to a set of nodes through the
+ *	message forwarding tree and wait for every node to answer
+ * IN node_bitmap - nodes to send to, NULL for every node
+ * IN msg_type - request message type
+ * IN data - request message body
+ * IN timeout - per-message timeout in milliseconds, 0 for MessageTimeout
+ * OUT fail_bitmap - if not NULL, set to the nodes which failed, free with
+ *	FREE_NULL_BITMAP()
+ * RET count of nodes which failed or timed out
+ * NOTE: Do not hold any slurmctld locks when calling this function.
+ */
+extern int power_collect_send(bitstr_t *node_bitmap, uint16_t msg_type,
+			      void *data, int timeout, bitstr_t **fail_bitmap);
+
+/* Called by power_collect_query() for each reply, with node read lock */
+typedef void (*power_collect_reply_f)(int node_inx, uint16_t msg_type,
+				      void *msg_data, void *arg);
+
+/*
+ * power_collect_query - same as power_collect_send(), also handing every
+ *	successful reply to a callback
+ * IN reply - called for each node which answered, may be NULL
+ * IN arg - passed through to reply
+ */
+extern int power_collect_query(bitstr_t *node_bitmap, uint16_t msg_type,
+			       void *data, int timeout,
+			       power_collect_reply_f reply, void *arg,
+			       bitstr_t **fail_bitmap);
+
+/*
+ * power_collect_set_caps - set the package caps of a set of nodes with a
+ *	single REQUEST_POWER_CAP_SET_NODES sent down the forwarding tree.
+ *	The request carries the node list and either one cap pair for every
+ *	node or one pair per node; each slurmd applies its own entry and
+ *	its return code comes back up the tree.
+ * IN node_bitmap - nodes to cap, NULL for every node
+ * IN cap - package caps of socket 0 in watts, indexed like
+ *	node_record_table_ptr
+ * IN cap2 - package caps of socket 1, NULL to use cap for both sockets
+ * IN timeout - per-message timeout in milliseconds, 0 for MessageTimeout
+ * OUT fail_bitmap - if not NULL, set to the nodes which failed or refused
+ *	their caps, free with FREE_NULL_BITMAP()
+ * RET count of nodes which failed, timed out or refused their caps
+ * NOTE: Do not hold any slurmctld locks when calling this function.
+ */
+extern int power_collect_set_caps(bitstr_t *node_bitmap, uint32_t *cap,
+				  uint32_t *cap2, int timeout,
+				  bitstr_t **fail_bitmap);
+
+/*
+ * power_collect_set_budgets - hand a set of nodes their power budgets with a
+ *	single REQUEST_POWER_SCHEDULE_SLURMD sent down the forwarding tree,
+ *	laid out like the request of power_collect_set_caps()
+ * IN node_bitmap - nodes to send to, NULL for every node
+ * IN node_watts - node budgets in watts, indexed like node_record_table_ptr,
+ *	0 to release a node
+ * IN period_msec - slurmd control period, 0 for its default
+ * IN timeout - per-message timeout in milliseconds, 0 for MessageTimeout
+ * IN reply - called for each node which answered, may be NULL
+ * IN arg - passed through to reply
+ * OUT fail_bitmap - if not NULL, set to the nodes which failed or refused
+ *	their budgets, free with FREE_NULL_BITMAP()
+ * RET count of nodes which failed, timed out or refused their budgets
+ * NOTE: Do not hold any slurmctld locks when calling this function.
+ */
+extern int power_collect_set_budgets(bitstr_t *node_bitmap,
+				     uint32_t *node_watts,
+				     uint32_t period_msec, int timeout,
+				     power_collect_reply_f reply, void *arg,
+				     bitstr_t **fail_bitmap);
+
+/*
+ * power_collect_store - publish the samples of a sweep to the per-node
+ *	telemetry rings (see power_telemetry.h)
+ * IN sweep - results from power_collect_sweep()
+ * NOTE: Do not hold any slurmctld locks, a node read lock is taken
+ */
+extern void power_collect_store(power_sweep_t *sweep);
+
+/*
+ * power_sweep_node_watts - sum the package and DRAM watts of one node
+ * IN sweep - results from power_collect_sweep()
+ * IN node_inx - index of the node in node_record_table_ptr
+ * RET watts, zero if the node was not sampled
+ */
+extern uint32_t power_sweep_node_watts(power_sweep_t *sweep, int node_inx);
+
+/* power_sweep_free - free the results of power_collect_sweep() */
+extern void power_sweep_free(power_sweep_t *sweep);
+
+/*
+ * Pacing of the periodic power threads. Deadlines are kept on
+ * CLOCK_MONOTONIC and advance from the previous deadline, so a loop body
+ * that takes a while does not push the period back, and a clock step
+ * does not stall or rush the loop.
+ */
+typedef struct power_pace {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;		/* waits on CLOCK_MONOTONIC */
+	struct timespec next;		/* next deadline */
+	bool stop;			/* set by power_pace_stop() */
+	bool wake;			/* set by power_pace_wake() */
+} power_pace_t;
+
+/* power_pace_init - prepare a pace, the first period starts now */
+extern void power_pace_init(power_pace_t *pace);
+
+/* power_pace_destroy - release a pace, its thread must have exited */
+extern void power_pace_destroy(power_pace_t *pace);
+
+/*
+ * power_pace_wait - sleep until the next deadline, one period_msec after
+ *	the previous one, or until power_pace_wake() / power_pace_stop()
+ * IN pace - the thread's pace
+ * IN period_msec - the period to use for this deadline
+ * RET false once power_pace_stop() was called, true otherwise
+ */
+extern bool power_pace_wait(power_pace_t *pace, uint32_t period_msec);
+
+/* power_pace_wake - end the current wait now and start a new period */
+extern void power_pace_wake(power_pace_t *pace);
+
+/* power_pace_stop - make power_pace_wait() return false from now on */
+extern void power_pace_stop(power_pace_t *pace);
+
+#endif /* !_POWER_COLLECT_H */
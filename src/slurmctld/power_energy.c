@@ -0,0 +1,300 @@
+/*****************************************************************************\
+ *  power_energy.c - Per-job energy attribution from power_knob telemetry
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "src/common/assoc_mgr.h"
+#include "src/common/bitstring.h"
+#include "src/common/job_resources.h"
+#include "src/common/log.h"
+#include "src/common/macros.h"
+#include "src/common/slurm_accounting_storage.h"
+#include "src/common/xmalloc.h"
+#include "src/slurmctld/locks.h"
+#include "src/slurmctld/power_energy.h"
+#include "src/slurmctld/power_telemetry.h"
+#include "src/slurmctld/slurmctld.h"
+
+/* Samples further apart are not integrated, the node was unreachable */
+#define ENERGY_MAX_GAP_SEC	300
+
+/* Newest sample of a node integrated so far */
+typedef struct energy_node {
+	time_t power_time;		/* 0 if none yet */
+	uint64_t sample_usec;
+	uint16_t socket_cnt;
+	uint32_t watts[POWER_TELEMETRY_MAX_SOCKET];	/* package plus DRAM */
+} energy_node_t;
+
+/* Cores a job holds on one socket of a node */
+typedef struct energy_share {
+	struct job_record *job_ptr;
+	int node_inx;
+	int socket;
+	double cores;
+} energy_share_t;
+
+static pthread_mutex_t energy_mutex = PTHREAD_MUTEX_INITIALIZER;
+static energy_node_t *energy_nodes = NULL;
+static struct node_record *energy_table = NULL;
+static int energy_node_cnt = 0;
+
+static bool _sample_newer(energy_node_t *last,
+			  power_telemetry_sample_t *sample)
+{
+	if (!sample->power_time)
+		return false;
+	if (sample->power_time != last->power_time)
+		return (sample->power_time > last->power_time);
+	return (sample->sample_usec > last->sample_usec);
+}
+
+/* Seconds between two samples, from slurmd's clock when it is usable */
+static double _sample_secs(energy_node_t *last,
+			   power_telemetry_sample_t *sample)
+{
+	if (last->sample_usec && (sample->sample_usec > last->sample_usec))
+		return (sample->sample_usec - last->sample_usec) / 1000000.0;
+	return difftime(sample->power_time, last->power_time);
+}
+
+/*
+ * Integrate the samples of a node newer than the last one integrated
+ * IN/OUT last - newest sample integrated so far
+ * OUT joules - per-socket energy since then
+ * RET number of sockets in the newest sample
+ */
+static int _integrate_node(int node_inx, energy_node_t *last, double *joules)
+{
+	power_telemetry_sample_t hist[POWER_TELEMETRY_DEPTH], *sample;
+	uint32_t watts;
+	double secs;
+	int i, s, hist_cnt;
+
+	hist_cnt = power_telemetry_history(node_inx, hist,
+					   POWER_TELEMETRY_DEPTH);
+	/* oldest first */
+	for (i = hist_cnt - 1; i >= 0; i--) {
+		sample = &hist[i];
+		if (!_sample_newer(last, sample))
+			continue;
+		secs = last->power_time ? _sample_secs(last, sample) : 0.0;
+		for (s = 0; s < sample->socket_cnt; s++) {
+			watts = sample->power[s].cpu_current_watts +
+				sample->power[s].dram_current_watts;
+			if ((secs > 0.0) && (secs <= ENERGY_MAX_GAP_SEC)) {
+				/* trapezoid between the two samples */
+				if (s < last->socket_cnt)
+					joules[s] += (last->watts[s] + watts) *
+						     secs / 2.0;
+				else
+					joules[s] += watts * secs;
+			}
+			last->watts[s] = watts;
+		}
+		last->power_time = sample->power_time;
+		last->sample_usec = sample->sample_usec;
+		last->socket_cnt = sample->socket_cnt;
+	}
+
+	return last->socket_cnt;
+}
+
+/*
+ * Record the cores a job holds on each socket of its nodes. When the job's
+ * layout of a node does not match the sockets the node reports, its cores
+ * are spread evenly over those sockets.
+ */
+static void _job_shares(struct job_record *job_ptr, double *socket_cores,
+			energy_share_t **shares, int *share_cnt,
+			int *share_size)
+{
+	job_resources_t *job_resrcs = job_ptr->job_resrcs;
+	uint32_t cnt[POWER_TELEMETRY_MAX_SOCKET];
+	uint16_t sockets, cores;
+	int i, i_first, i_last, j = 0, s, offset, node_sockets, total;
+	energy_share_t *share;
+
+	i_first = bit_ffs(job_ptr->node_bitmap);
+	if (i_first < 0)
+		return;
+	i_last = bit_fls(job_ptr->node_bitmap);
+	for (i = i_first; i <= i_last; i++) {
+		if (!bit_test(job_ptr->node_bitmap, i))
+			continue;
+		if ((i >= energy_node_cnt) ||
+		    (get_job_resources_cnt(job_resrcs, j, &sockets, &cores) !=
+		     SLURM_SUCCESS) ||
+		    ((offset = get_job_resources_offset(job_resrcs, j, 0, 0))
+		     < 0)) {
+			j++;
+			continue;
+		}
+		j++;
+		node_sockets = energy_nodes[i].socket_cnt;
+		if (!node_sockets)
+			continue;
+		memset(cnt, 0, sizeof(cnt));
+		total = bit_set_count_range(job_resrcs->core_bitmap, offset,
+					    offset + (sockets * cores));
+		if (!total)
+			continue;
+		if (sockets == node_sockets) {
+			for (s = 0; s < sockets; s++) {
+				cnt[s] = bit_set_count_range(
+						job_resrcs->core_bitmap,
+						offset + (s * cores),
+						offset + ((s + 1) * cores));
+			}
+		}
+		for (s = 0; s < node_sockets; s++) {
+			if (*share_cnt >= *share_size) {
+				*share_size = MAX(*share_size * 2, 64);
+				xrealloc(*shares, sizeof(energy_share_t) *
+					 *share_size);
+			}
+			share = &(*shares)[*share_cnt];
+			share->job_ptr = job_ptr;
+			share->node_inx = i;
+			share->socket = s;
+			if (sockets == node_sockets)
+				share->cores = cnt[s];
+			else
+				share->cores = (double) total / node_sockets;
+			if (share->cores == 0.0)
+				continue;
+			socket_cores[i * POWER_TELEMETRY_MAX_SOCKET + s] +=
+				share->cores;
+			(*share_cnt)++;
+		}
+	}
+}
+
+extern void power_energy_update(void)
+{
+	/* Locks: Read job, read node */
+	slurmctld_lock_t job_read_lock = {
+		NO_LOCK, READ_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
+	struct job_record *job_ptr;
+	ListIterator job_iterator;
+	energy_share_t *shares = NULL, *share;
+	double *joules, *socket_cores;
+	int i, inx, share_cnt = 0, share_size = 0;
+
+	slurm_mutex_lock(&energy_mutex);
+	lock_slurmctld(job_read_lock);
+	if ((energy_table != node_record_table_ptr) ||
+	    (energy_node_cnt != node_record_count)) {
+		/* Indexes changed, start over */
+		xfree(energy_nodes);
+		energy_table = node_record_table_ptr;
+		energy_node_cnt = node_record_count;
+		energy_nodes = xmalloc(sizeof(energy_node_t) *
+				       (energy_node_cnt + 1));
+	}
+
+	joules = xmalloc(sizeof(double) * POWER_TELEMETRY_MAX_SOCKET *
+			 (energy_node_cnt + 1));
+	socket_cores = xmalloc(sizeof(double) * POWER_TELEMETRY_MAX_SOCKET *
+			       (energy_node_cnt + 1));
+	for (i = 0; i < energy_node_cnt; i++) {
+		_integrate_node(i, &energy_nodes[i],
+				&joules[i * POWER_TELEMETRY_MAX_SOCKET]);
+	}
+
+	job_iterator = list_iterator_create(job_list);
+	while ((job_ptr = (struct job_record *) list_next(job_iterator))) {
+		if (!IS_JOB_RUNNING(job_ptr) || !job_ptr->node_bitmap ||
+		    !job_ptr->job_resrcs ||
+		    !job_ptr->job_resrcs->core_bitmap)
+			continue;
+		_job_shares(job_ptr, socket_cores, &shares, &share_cnt,
+			    &share_size);
+	}
+	list_iterator_destroy(job_iterator);
+
+	/* power_energy is only written here, with energy_mutex held, and
+	 * read by power_energy_job_fini() with the job write lock held */
+	for (i = 0, share = shares; i < share_cnt; i++, share++) {
+		inx = share->node_inx * POWER_TELEMETRY_MAX_SOCKET +
+		      share->socket;
+		share->job_ptr->power_energy += joules[inx] * share->cores /
+						socket_cores[inx];
+	}
+	unlock_slurmctld(job_read_lock);
+	slurm_mutex_unlock(&energy_mutex);
+
+	xfree(shares);
+	xfree(joules);
+	xfree(socket_cores);
+}
+
+extern void power_energy_job_fini(struct job_record *job_ptr)
+{
+	uint64_t *tres_cnt;
+
+	if ((job_ptr->power_energy < 1.0) || !job_ptr->tres_alloc_cnt) {
+		job_ptr->power_energy = 0.0;
+		return;
+	}
+
+	/* acct_policy still releases what tres_alloc_cnt holds, so only the
+	 * strings sent to accounting carry the energy */
+	tres_cnt = xmalloc(sizeof(uint64_t) * slurmctld_tres_cnt);
+	memcpy(tres_cnt, job_ptr->tres_alloc_cnt,
+	       sizeof(uint64_t) * slurmctld_tres_cnt);
+	tres_cnt[TRES_ARRAY_ENEGRY] = (uint64_t) job_ptr->power_energy;
+	debug("%s: job %u used %"PRIu64" joules", __func__, job_ptr->job_id,
+	      tres_cnt[TRES_ARRAY_ENEGRY]);
+	job_ptr->power_energy = 0.0;
+
+	xfree(job_ptr->tres_alloc_str);
+	job_ptr->tres_alloc_str = assoc_mgr_make_tres_str_from_array(
+		tres_cnt, TRES_STR_FLAG_SIMPLE, false);
+	xfree(job_ptr->tres_fmt_alloc_str);
+	job_ptr->tres_fmt_alloc_str = assoc_mgr_make_tres_str_from_array(
+		tres_cnt, TRES_STR_CONVERT_UNITS, false);
+	xfree(tres_cnt);
+
+	/* The completion record carries no TRES. Update the start record if
+	 * it is already stored, otherwise it goes out with the energy. */
+	if (job_ptr->db_index && (job_ptr->db_index != NO_VAL64))
+		jobacct_storage_g_job_start(acct_db_conn, job_ptr);
+}
@@ -0,0 +1,66 @@
+/*****************************************************************************\
+ *  power_energy.h - Per-job energy attribution from power_knob telemetry
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _POWER_ENERGY_H
+#define _POWER_ENERGY_H
+
+#include "src/slurmctld/slurmctld.h"
+
+/*
+ * Each power monitor pass integrates the package and DRAM watts of every
+ * socket over the telemetry samples received since the previous pass, and
+ * splits the energy of a socket across the running jobs holding cores on
+ * it, in proportion to those cores. The joules of a job accumulate in
+ * job_ptr->power_energy and go to accounting as its energy TRES when it
+ * ends. Energy of sockets no job holds is not attributed.
+ */
+
+/*
+ * power_energy_update - attribute the energy of new telemetry samples
+ * NOTE: Do not hold any slurmctld locks when calling this function.
+ */
+extern void power_energy_update(void);
+
+/*
+ * power_energy_job_fini - record the energy attributed to a job which
+ *	ended as its energy TRES and send it to accounting
+ * IN job_ptr - the job, its accounting record not yet completed
+ * NOTE: WRITE lock_slurmctld job before entry
+ */
+extern void power_energy_job_fini(struct job_record *job_ptr);
+
+#endif /* !_POWER_ENERGY_H */
@@ -35,12 +35,13 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
 \*****************************************************************************/
 
-#ifndef __POWERMONITOR_H
-#define __POWERMONITOR_H
-
 #define MAX_NODES = 1024*1024
 #define MAX_SOCKET = 16
 
+/* Longest time a sample waits in memory before it is written out */
+#define POWER_MONITOR_FLUSH_SECS 60
+
+#include <errno.h>
 #include <stdio.h>
 #include <signal.h>
 #include <stdlib.h>
@@ -54,305 +55,176 @@
 
 #include "src/common/bitstring.h"
 #include "src/common/macros.h"
+#include "src/common/power_tsdb.h"
 #include "src/common/xstring.h"
 #include "src/slurmctld/locks.h"
 #include "slurm/slurm.h"
+#include "src/common/xmalloc.h"
+#include "src/slurmctld/power_collect.h"
+#include "src/slurmctld/power_energy.h"
+#include "src/slurmctld/power_monitor.h"
 #include "src/slurmctld/slurmctld.h"
 
 
 pthread_mutex_t power_monitor_mutex = PTHREAD_MUTEX_INITIALIZER;
 bool power_monitor_enabled = false;
 
-static void _do_power_monitor_work(FILE *fp);
+static void _do_power_monitor_work(power_tsdb_writer_t *writer);
 static int _init_power_monitor_config(void);
 static void *_init_power_monitor(void *arg);
 
-static void slurm_get_power_consumption(double **power_consumption_value, char *node_name[], int number_of_node);
-static void slurm_get_power_cap(double **power_cap_value, char *node_name[], int number_of_node);
-static void slurm_set_power_cap2(int *power_cap_value[], char *node_name[], int number_of_node)
+/* Record the job running on each node, 0 for idle nodes */
+static uint32_t *_node_jobs(int node_cnt)
 {
-	debug(" LINH: SET POWER CAP");
-
-	power_current_data_t *powers;
-	power_capping_data_t *powers_cap;
-	powers_cap = (power_capping_data_t*)malloc(sizeof(power_capping_data_t));
-
-	uint16_t  socket_cnt;
-	int i,j,k;
-	struct node_record *node_ptr;
-
-
-    /* Locks: Read nodes */
-    slurmctld_lock_t node_read_lock = {
-        NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
-    /* Locks: Write nodes */
-    slurmctld_lock_t node_write_lock = {
-        NO_LOCK, WRITE_LOCK, NO_LOCK, NO_LOCK };	
-					
-	debug(" LINH: node_record_count: %d", node_record_count);		
-	
-	for(i=0, node_ptr = node_record_table_ptr;
-	    i<node_record_count; i++, node_ptr++){
-		debug3(" PMON node name : %s",node_ptr->name);
-		if (slurm_get_node_power(node_ptr->name, &socket_cnt, &powers)) {
-			debug("_get_node_power_task: can't get info from slurmd(NODE : %s)", node_ptr->name);
-		}else{		
-			//Check  whether node is called
-			debug3(" Get socket_cnt : %d",socket_cnt);
-			 for (j=0; j < number_of_node; j++) {
-				debug(" LINH: ___Set power cap node PTR %s", node_ptr->name);
-				debug(" LINH:  Set power cap node_name %s", node_name[j]);
-				if (strcmp(node_name[j], node_ptr->name) == 0){
-					 
-					debug("Inside compare set power)");
-				    debug("Before assign set power");
-					
-					//powers_cap[0].cpu_cap_watts = (uint32_t)power_cap_value[j][0];
-					//powers_cap[1].cpu_cap_watts = (uint32_t)power_cap_value[j][1];
-					
-					//debug("Before assign of set power");			
-					debug(" LINH: Before Set power cap node PTR %s", node_ptr->name);	
-						
-					if (slurm_set_node_power4(node_ptr->name, power_cap_value[0], power_cap_value[1] )) 
-					
-					debug("_get_node_power_task: can't get info from slurmd(NODE : %s)", node_ptr->name);							
-					debug("After assign of set power");
-				}
-			}
-			
-			debug("Socket is %d", socket_cnt);
-						
-			lock_slurmctld(node_write_lock);	
-			//memcpy(node_ptr->power_info->power_cap, powers_cap, sizeof(power_capping_data_t) * socket_cnt);			
-			unlock_slurmctld(node_write_lock);
-
-			xfree(powers);
-			free(powers_cap);
-			powers = NULL;	
-			powers_cap = NULL;
+	/* Locks: Read job, read node */
+	slurmctld_lock_t job_read_lock = {
+		NO_LOCK, READ_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
+	struct job_record *job_ptr;
+	ListIterator job_iterator;
+	uint32_t *node_jobs;
+	int i, i_first, i_last;
+
+	node_jobs = xmalloc(sizeof(uint32_t) * (node_cnt ? node_cnt : 1));
+	lock_slurmctld(job_read_lock);
+	job_iterator = list_iterator_create(job_list);
+	while ((job_ptr = (struct job_record *) list_next(job_iterator))) {
+		if (!IS_JOB_RUNNING(job_ptr) || !job_ptr->node_bitmap)
+			continue;
+		i_first = bit_ffs(job_ptr->node_bitmap);
+		if (i_first < 0)
+			continue;
+		i_last = MIN(bit_fls(job_ptr->node_bitmap), node_cnt - 1);
+		for (i = i_first; i <= i_last; i++) {
+			if (bit_test(job_ptr->node_bitmap, i) && !node_jobs[i])
+				node_jobs[i] = job_ptr->job_id;
 		}
 	}
-}
+	list_iterator_destroy(job_iterator);
+	unlock_slurmctld(job_read_lock);
 
+	return node_jobs;
+}
 
-static void slurm_get_power_cap(double **power_cap_value, char *node_name[], int number_of_node)
+/* Name the node indexes of the telemetry store after a reconfiguration */
+static void _set_tsdb_nodes(power_tsdb_writer_t *writer)
 {
-	debug(" LINH: START POWER CAP");
-
-	power_current_data_t *powers;
-	uint16_t  socket_cnt;
-	int i,j,k;
-	struct node_record *node_ptr;
-
-    /* Locks: Read nodes */
-    slurmctld_lock_t node_read_lock = {
-        NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
-    /* Locks: Write nodes */
-    slurmctld_lock_t node_write_lock = {
-        NO_LOCK, WRITE_LOCK, NO_LOCK, NO_LOCK };	
-				
-				
-	for(i=0, node_ptr = node_record_table_ptr;
-	    i<node_record_count; i++, node_ptr++){
-		debug3(" PMON node name : %s",node_ptr->name);
-		if (slurm_get_node_power(node_ptr->name, &socket_cnt, &powers)) {
-			debug("_get_node_power_task: can't get info from slurmd(NODE : %s)", node_ptr->name);
-		}else{
-			//Check  whether node is called
-			 for (j=0; j < number_of_node; j++) {
-				 debug(" LINH: node PTR %s", node_ptr->name);
-				 debug(" LINH:  node_name %s", node_name[j]);
-				 if (strcmp(node_name[j], node_ptr->name) == 0){
-					 debug("Inside compare)");
-					for(k=0;k<socket_cnt;k++){
-						
-						debug("Before assign");
-						power_cap_value[j][k] =  (double)(powers[k].cpu_current_cap_watts +  powers[k].dram_current_cap_watts);
-						
-						debug("power_cap_value [j][k] is %f", power_cap_value[j][k]);
-						debug("After assign");
-					} 
-				 }
-			}
-			
-			lock_slurmctld(node_write_lock);		
-			unlock_slurmctld(node_write_lock);
-			xfree(powers);
-			powers = NULL;				
-		}				
+	/* Locks: Read node */
+	slurmctld_lock_t node_read_lock = {
+		NO_LOCK, NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
+	static struct node_record *last_table = NULL;
+	static int last_cnt = -1;
+	char **names;
+	int i;
+
+	lock_slurmctld(node_read_lock);
+	if ((last_table == node_record_table_ptr) &&
+	    (last_cnt == node_record_count)) {
+		unlock_slurmctld(node_read_lock);
+		return;
 	}
+	last_table = node_record_table_ptr;
+	last_cnt = node_record_count;
+	names = xmalloc(sizeof(char *) * (node_record_count + 1));
+	for (i = 0; i < node_record_count; i++)
+		names[i] = node_record_table_ptr[i].name;
+	power_tsdb_set_nodes(writer, names, node_record_count);
+	unlock_slurmctld(node_read_lock);
+	xfree(names);
 }
 
-
-static void slurm_get_power_consumption(double **power_consumption_value, char *node_name[], int number_of_node)
+static void _do_power_monitor_work(power_tsdb_writer_t *writer)
 {
-	debug(" LINH: START POWER CONSUMPTION");
-	
-	power_current_data_t *powers;
-	uint16_t  socket_cnt;
-	int i,j,k;
-	struct node_record *node_ptr;
-
-    /* Locks: Read nodes */
-    slurmctld_lock_t node_read_lock = {
-        NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
-    /* Locks: Write nodes */
-    slurmctld_lock_t node_write_lock = {
-        NO_LOCK, WRITE_LOCK, NO_LOCK, NO_LOCK };	
-				
-	for(i=0, node_ptr = node_record_table_ptr;
-	    i<node_record_count; i++, node_ptr++){
-		debug3(" PMON node name : %s",node_ptr->name);
-		if (slurm_get_node_power(node_ptr->name, &socket_cnt, &powers)) {
-			debug("_get_node_power_task: can't get info from slurmd(NODE : %s)", node_ptr->name);
-		}else{
-			//Check  whether node is called
-			 for (j=0; j < number_of_node; j++) {
-				 debug(" LINH: node name %s", node_ptr->name);
-				 debug(" LINH: NODE_PTR name %s", node_name[j]);
-				 if (strcmp(node_name[j], node_ptr->name) == 0){
-					 debug("Inside compare)");
-					for(k=0;k<socket_cnt;k++){
-						debug("Before assign");
-			//Wrong:	power_consumption_value[j][k] =  (double)(node_ptr->power_info->current_power+k)->dram_current_watts + (node_ptr->power_info->current_power+k)->cpu_current_watts;
-						power_consumption_value[j][k] =  (double)(powers[k].cpu_current_watts +  powers[k].dram_current_watts);
-						
-						debug("power_consumption_value [j][k] is %f", power_consumption_value[j][k]);
-						debug("After assign");
-					} 
-				 }
-			 }
-			
-			lock_slurmctld(node_write_lock);		
-			//memcpy if need
-			unlock_slurmctld(node_write_lock);
-
-			xfree(powers);
-			powers = NULL;			
-		}
+	power_sweep_t *sweep;
+	power_node_sample_t *sample;
+	power_tsdb_row_t *rows = NULL;
+	uint32_t *node_jobs;
+	int i, j, row_cnt = 0, row_size = 0;
+
+	debug3("_do_power_monitor_work");
+
+	/* One parallel sweep through the forwarding tree, no locks held */
+	sweep = power_collect_sweep(NULL,
+				    POWER_COLLECT_POWER | POWER_COLLECT_CACHE,
+				    0);
+	if (bit_set_count(sweep->fail_bitmap)) {
+		char *fail_nodes = bitmap2node_name(sweep->fail_bitmap);
+		debug("_do_power_monitor_work: can't get info from slurmd "
+		      "(NODES : %s)", fail_nodes);
+		xfree(fail_nodes);
 	}
-}
 
-static uint32_t sum_nodes_power()
-{
-	debug(" LINH: START POWER CONSUMPTION");
-	power_current_data_t *powers;
-	uint16_t  socket_cnt;
-	int i,j,k;
-	uint32_t sum;
-	sum = 0;
-	struct node_record *node_ptr;
-	
-    /* Locks: Read nodes */
-    slurmctld_lock_t node_read_lock = {
-        NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
-    /* Locks: Write nodes */
-    slurmctld_lock_t node_write_lock = {
-        NO_LOCK, WRITE_LOCK, NO_LOCK, NO_LOCK };	
-						
-	for(i=0, node_ptr = node_record_table_ptr;
-	    i<node_record_count; i++, node_ptr++){
-		debug3(" PMON node name : %s",node_ptr->name);
-		if (slurm_get_node_power(node_ptr->name, &socket_cnt, &powers)) {
-			debug("_get_node_power_task: can't get info from slurmd(NODE : %s)", node_ptr->name);
-		}else{
-			debug(" LINH: node name %s", node_ptr->name);
-			for(k=0;k<socket_cnt;k++){
-				
-				debug("Before assign");		
-				sum = sum + powers[k].cpu_current_watts + powers[k].dram_current_watts;
-								
-				debug3("    PMON:cpu :%4d", powers[k].cpu_current_watts);
-				debug3("    PMON:dram:%4d", powers[k].dram_current_watts);
-				debug3("    PMON PREV cpu  : %4d", (node_ptr->power_info->current_power+k)->cpu_current_watts);
-				debug3("    PMON PREV dram : %4d", (node_ptr->power_info->current_power+k)->dram_current_watts);
+	if (writer) {
+		_set_tsdb_nodes(writer);
+		node_jobs = _node_jobs(sweep->node_cnt);
+	} else
+		node_jobs = NULL;
+
+	for (i = 0; i < sweep->node_cnt; i++) {
+		sample = &sweep->samples[i];
+		for (j = 0; sample->power && (j < sample->socket_cnt); j++) {
+			debug3(" PMON: node[%d] socket[%d] cpu:%4d dram:%4d "
+			       "cpu cap:%4d dram cap:%4d", i, j,
+			       sample->power[j].cpu_current_watts,
+			       sample->power[j].dram_current_watts,
+			       sample->power[j].cpu_current_cap_watts,
+			       sample->power[j].dram_current_cap_watts);
+			if (!writer)
+				continue;
+			if (row_cnt >= row_size) {
+				row_size = MAX(row_size * 2, 64);
+				xrealloc(rows, sizeof(power_tsdb_row_t) *
+					 row_size);
+			}
+			rows[row_cnt].time = sweep->sweep_time;
+			rows[row_cnt].node_inx = i;
+			rows[row_cnt].socket = j;
+			rows[row_cnt].job_id = node_jobs[i];
+			rows[row_cnt].pkg_watts =
+				sample->power[j].cpu_current_watts;
+			rows[row_cnt].dram_watts =
+				sample->power[j].dram_current_watts;
+			rows[row_cnt].pkg_cap_watts =
+				sample->power[j].cpu_current_cap_watts;
+			rows[row_cnt].dram_cap_watts =
+				sample->power[j].dram_current_cap_watts;
+			/* knobs may report one frequency for the node */
+			rows[row_cnt].freq =
+				sample->power[j].cpu_current_frequency ?
+				sample->power[j].cpu_current_frequency :
+				sample->power[0].cpu_current_frequency;
+			if (sample->cache && (j < sample->cache_socket_cnt)) {
+				rows[row_cnt].cache_ref =
+					sample->cache[j].all_cache_ref;
+				rows[row_cnt].l3_miss =
+					sample->cache[j].l3_miss;
+			} else {
+				rows[row_cnt].cache_ref = 0;
+				rows[row_cnt].l3_miss = 0;
 			}
-			
-			node_ptr->power_info->socket_cnt = socket_cnt;
-			
-			lock_slurmctld(node_write_lock);
-			memcpy(node_ptr->power_info->current_power, powers, sizeof(power_current_data_t) * socket_cnt);	//if need		
-			unlock_slurmctld(node_write_lock);
-
-			xfree(powers);
-			powers = NULL;			
+			rows[row_cnt].node_name = NULL;
+			row_cnt++;
+		}
+		for (j = 0; sample->cache && (j < sample->cache_socket_cnt);
+		     j++) {
+			debug3(" PMON: node[%d] socket[%d] cache ref:%"PRIu64
+			       " l1:%"PRIu64" l2:%"PRIu64" l3:%"PRIu64, i, j,
+			       sample->cache[j].all_cache_ref,
+			       sample->cache[j].l1_miss,
+			       sample->cache[j].l2_miss,
+			       sample->cache[j].l3_miss);
 		}
 	}
-	return sum;
-}
 
-static void _do_power_monitor_work(FILE *fp)
-{
-    debug3("LINH: _do_power_monitor_work");
-
-	char filename[255];
-	struct tm *timenow;
-	power_current_data_t *powers;
-	cache_ref_t *caches; // cao
-	int i,j;
-	uint16_t socket_cnt;
-	uint16_t  cache_socket_cnt;
-	struct node_record *node_ptr;
-
-    /* Locks: Read nodes */
-    slurmctld_lock_t node_read_lock = {
-        NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
-    /* Locks: Write nodes */
-    slurmctld_lock_t node_write_lock = {
-        NO_LOCK, WRITE_LOCK, NO_LOCK, NO_LOCK };
-	 	 
-	for(i=0, node_ptr = node_record_table_ptr;
-	    i<node_record_count; i++, node_ptr++){
-		debug3(" PMON node name : %s",node_ptr->name);
-		if (slurm_get_node_power(node_ptr->name, &socket_cnt, &powers)) {
-			debug("_get_node_power_task: can't get info from slurmd(NODE : %s)", node_ptr->name);
-		}else{
-			debug3(" PMON! socket_cnt %d",socket_cnt);
-			debug3(" avr freq : %d",powers[0].cpu_current_frequency);
-			for(j=0;j<socket_cnt;j++){
-				debug3(" PMON: socket[%d]",j);
-				debug3("    PMON:cpu :%4d", powers[j].cpu_current_watts);
-				debug3("    PMON:dram:%4d", powers[j].dram_current_watts);
-				debug3("    PMON PREV cpu  : %4d", (node_ptr->power_info->current_power+j)->cpu_current_watts);
-				debug3("    PMON PREV dram : %4d", (node_ptr->power_info->current_power+j)->dram_current_watts);
-				debug3("Power cap data is");
-				debug3("    CPU cap: %4d", powers[j].cpu_current_cap_watts);
-				debug3("    DRAM cap: %4d", powers[j].dram_current_cap_watts);
-			    
-				fprintf(fp, "node = %d, socket = %d, current_watt = %d, current_watt_limit = %d,  dram= %d, dramlimit =  %d "  , i,j,powers[j].cpu_current_watts,powers[j].cpu_current_cap_watts,powers[j].dram_current_watts,powers[j].dram_current_cap_watts);
-			}
-			node_ptr->power_info->socket_cnt = socket_cnt;
+	/* Only copies the rows, the store's own thread does the I/O */
+	power_tsdb_append(writer, rows, row_cnt);
+	xfree(rows);
+	xfree(node_jobs);
 
-			lock_slurmctld(node_write_lock);
-			memcpy(node_ptr->power_info->current_power, powers, sizeof(power_current_data_t) * socket_cnt);
-			unlock_slurmctld(node_write_lock);
+	/* Publish the sweep to the per-node telemetry rings */
+	power_collect_store(sweep);
+	power_sweep_free(sweep);
 
-			xfree(powers);
-			powers = NULL;
-		}
-		if (slurm_get_cache(node_ptr->name, &cache_socket_cnt, &caches)) {
-				debug("_get_cache: can't get info from slurmd(NODE : %s)", node_ptr->name);
-		}else{
-			debug3(" Get caches! socket_cnt %d",cache_socket_cnt);
-			for(j=0;j<cache_socket_cnt;j++){
-				debug3(" PMON: socket[%d]",j);
-				debug3(" Cache 1 :%4d", caches[j].all_cache_ref);
-				debug3(" Cache 2 :%4d", caches[j].l1_miss);
-				debug3(" Cache 3 :%4d", caches[j].l2_miss);
-				debug3(" Cache 4 :%4d", caches[j].l3_miss);
-			}
-			node_ptr->power_info->socket_cnt = cache_socket_cnt; //line 1400 slurm.h
-			
-			lock_slurmctld(node_write_lock);
-			memcpy(node_ptr->power_info->cache_reference, caches, sizeof(cache_ref_t) * cache_socket_cnt);
-			unlock_slurmctld(node_write_lock);	
-			
-			xfree(caches);
-			caches = NULL;
-				
-		}
-	}
-	fprintf(fp,"\n");
+	power_energy_update();
 }
 
 static int _init_power_monitor_config(void){
@@ -360,162 +232,30 @@ static int _init_power_monitor_config(void){
 }
 
 static void *_init_power_monitor(void *arg){
-	FILE *fp;
-	char filename[255];
-	struct tm *timenow;
-	int i = 0;
-	int j,k,l;
-	char *node_name[1024];	
-	int number_of_node;
-	int SOCKET_Number;
-	number_of_node = 2;
-	SOCKET_Number =2;
-	int *cap_values[2];
-	int sum;
-//************************* TEST Power Information on the nodes   ***********************//	
-	node_info_msg_t *slres;
-	int node_num,i1;
-	time_t update_time;
-	
-	int node_total_power = 0;
-	int system_total_power = 0;
-	power_current_data_t *p_val;
-	
-	node_info_t *node_info;
-	power_data_t *p_info;
-	
-	slurm_load_node(update_time, &slres, 1);
-	
-	node_num = slres->record_count;
-	
-	for(i1=0; i1<node_num; i1++){
-		debug("node name [%d] : %s\n",i1 ,slres->node_array[i1].name);
-	}
-	
-	printf("b\n");
-	node_num = slres->record_count;
-	for(i1=0, p_info = (slres->node_array[i1].power_info); i1<node_num; i1++){
-		printf("node name [%d] : %s\n",i1 ,slres->node_array[i1].name);
-		printf("  socket_num %d\n", slres->node_array[i1].sockets);
-		printf("  socket_num %d\n", slres->node_array[i1].power_info->socket_cnt);
-
-		printf("  cpu w  %d\n", slres->node_array[i1].power_info->current_power[0].cpu_current_watts);
-		printf("  dram w %d\n", slres->node_array[i1].power_info->current_power[0].dram_current_watts);
-		printf("  cpu0  f %d\n", slres->node_array[i1].power_info->current_power[0].cpu_current_frequency);
-		printf("  cpu1  f %d\n", slres->node_array[i1].power_info->current_power[1].cpu_current_frequency);
-	}
-	
-	slurm_free_node_info_msg(slres);
-
-//************************* Finish test  ***********************//	
-	
-	//for power_get_consumption:
-	double **power_consumption_value = malloc(sizeof *power_consumption_value * number_of_node);
-	if (power_consumption_value) {
-		for (j = 0; j < number_of_node; j++){
-			power_consumption_value[j] = malloc(sizeof *power_consumption_value[j] * SOCKET_Number);
-			}
-	}
-	//For power_get_cap:
-	double **power_cap_value = malloc(sizeof *power_cap_value * number_of_node);
-	if (power_cap_value) {
-		for (j = 0; j < number_of_node; j++){
-			power_cap_value[j] = malloc(sizeof *power_cap_value[j] * SOCKET_Number);
-			}
-	}
-		
+	power_tsdb_writer_t *writer = NULL;
+	uint64_t max_bytes;
+	char *path;
+
 	debug2 ("Currently, Power budget is %d", slurmctld_conf.z_32);
 	_init_power_monitor_config();
-	if (slurmctld_config.shutdown_time == 0){
-
-		node_name[0] = "pompp00";
-//		node_name[1] = "pompp01";
-		debug(" SET _POWER__CAP");
-		cap_values[0] = 50;
-		cap_values[1] = 55;
-		//Check:		slurm_set_power_cap2(cap_values, node_name, number_of_node);		
-	
+
+	/* The telemetry store is only kept if PowerParameters names it */
+	if ((path = power_tsdb_conf_path(&max_bytes))) {
+		writer = power_tsdb_writer_open(path, 0,
+						POWER_MONITOR_FLUSH_SECS,
+						max_bytes);
+		if (writer)
+			verbose("power monitor: writing telemetry to %s", path);
+		xfree(path);
 	}
-	 
+
 	while(slurmctld_config.shutdown_time == 0){
 		sleep(slurmctld_conf.power_monitorinterval);
-
-		node_name[0] = "pompp00";
-		node_name[1] = "pompp03";
-		cap_values[0] = 50;
-		cap_values[1] = 55;
-		
-		debug("POWER_CONSUMPTION");
-		debug("Node before function call %s",node_name[0]);
-	//Check get_power_consumption():	slurm_get_power_consumption(power_consumption_value, node_name, number_of_node);
-	//Check get_power_cap:	slurm_get_power_cap(power_cap_value, node_name, number_of_node);		
-	//Check set_power_cap:		
-		slurm_set_power_cap2(cap_values, node_name, number_of_node);		
-		
-	//Check sum function()		sum = sum_nodes_power();
-
-	//Check sum function()		debug ("Current power usage is %d",sum);
-	//Check sum function()		debug ("Currently, SUM is %d",sum_nodes_power());
-	//Check sum function()		debug ("Current power usage is %d",sum);
-	//Check sum function()		debug ("Currently, SUM is %d",sum_nodes_power());
-	//Check sum function()		debug ("Power Budget is %d",slurmctld_conf.z_32);
-	
-		for (j = 0; j<number_of_node; j++){
-			for (k = 0; k <SOCKET_Number; k++){
-				//Check power_get function: debug2("power_consumption_value: node[%d] socket[%d] is %f", j,k,power_consumption_value[j][k]);
-			}
-		}
-		
-		for (j = 0; j<number_of_node; j++){
-			for (k = 0; k <SOCKET_Number; k++){
-				//Check power_get function: debug2("power_cap_value: node[%d] socket[%d] is %f", j,k,power_cap_value[j][k]);
-			}
-		}
-		if (i == 0) {
-			debug3(" New time stamp");
-			i = i +1;	
-			time_t now = time(NULL);
-			timenow = localtime(&now);		
-			strftime(filename, sizeof(filename), "/var/log/slurm/power_monitor/%Y-%m-%d_%H:%M:%S.txt", timenow);
-			fp = fopen(filename,"w");
-			debug2(" !!!!File name %s",filename);
-			if (fp == NULL){
-				printf("I couldn't open results.dat for writing i == 0 .\n");
-				exit(0);
-			}	
-			//Check power_monitor function:	
-			_do_power_monitor_work(fp);
-			fclose(fp);	
-		}
-		
-		else if (i == 4){
-			i = 0;		
-			fp = fopen(filename,"a");
-			if (fp == NULL){
-				printf("I couldn't open results.dat for writing i == 4.\n");
-				exit(0);
-			}			
-			//Check power_monitor function:	
-			_do_power_monitor_work(fp);
-			fclose(fp);	
-		}
-		else {
-			i = i +1;
-			fp = fopen(filename,"a");
-			if (fp == NULL){
-				printf("I couldn't open results.dat for writing i = i+1.\n");
-				exit(0);
-			}	
-			//Check power_monitor function:	
-			_do_power_monitor_work(fp);
-			fclose(fp);
-		}
+		_do_power_monitor_work(writer);
 	}
-	free(power_consumption_value);
-	free(power_cap_value);
-	
-	return ;
+	power_tsdb_writer_close(writer);
 
+	return NULL;
 }
 
 extern void start_power_monitor(pthread_t *thread_id)
@@ -539,176 +279,352 @@ extern void start_power_monitor(pthread_t *thread_id)
 	slurm_attr_destroy(&thread_attr);
 }
 
-/**
- * get_remote_nodes_power - update nodes power consumption
- * 	check current power consumption 
- * 	and update node_info->power_perf
- * IN node_bitmap - pointer to list of update nodes
- * IN/OUT node_record_table_ptr - pointer to node_info list
- * OUT total_power - total power consumption specified by the node_bitmap
- * IN synq_mode - SYNC_MODE_BLOCK     : wait until updating
- * 		  SYNC_MODE_NON_BLOCK 
- * 		     : no-wait. when finished updating, calls callback function.
- * IN callback - pointer to callback function (for non_blocking mode)
- * RET zero on success, EINVAL otherwise
+enum power_monitor_req_type {
+	POWER_MONITOR_GET_POWER,
+	POWER_MONITOR_GET_FREQ,
+	POWER_MONITOR_SET_POWER,
+	POWER_MONITOR_FREE_POWER
+};
+
+typedef struct power_monitor_req {
+	uint16_t type;			/* enum power_monitor_req_type */
+	bitstr_t *node_bitmap;		/* private copy, NULL for all nodes */
+	power_monitor_callback_t callback;
+	void *arg;
+} power_monitor_req_t;
+
+static pthread_mutex_t pending_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int pending_cnt = 0;
+
+/* Sample the nodes of a request and publish the results */
+static void _get_remote(power_monitor_req_t *req,
+			power_monitor_result_t *result)
+{
+	int i;
+
+	result->sweep = power_collect_sweep(req->node_bitmap,
+					    POWER_COLLECT_POWER, 0);
+	power_collect_store(result->sweep);
+
+	result->node_bitmap = bit_copy(result->sweep->node_bitmap);
+	result->fail_bitmap = bit_copy(result->sweep->fail_bitmap);
+	for (i = 0; i < result->sweep->node_cnt; i++) {
+		result->total_power +=
+			power_sweep_node_watts(result->sweep, i);
+	}
+}
+
+/*
+ * Fill the package caps each node of a request should get.
+ * NOTE: READ lock_slurmctld node before entry
  */
-extern uint32_t get_remote_nodes_power(
-		bitstr_t *node_bitmap,
-		struct node_record *node_record_table_ptr, 
-		uint32_t total_power, 
-		uint32_t synq_mode, 
-		void *callback)
+static void _build_caps(power_monitor_req_t *req,
+			power_monitor_result_t *result,
+			bitstr_t *send_bitmap, uint32_t *cap, uint32_t *cap2)
 {
-	//int i;
-	//int rc =  SLURM_ERROR;
+	struct node_record *node_ptr;
+	power_data_t *power_info;
+	int i;
+
+	for (i = 0, node_ptr = node_record_table_ptr; i < node_record_count;
+	     i++, node_ptr++) {
+		if (!bit_test(result->node_bitmap, i))
+			continue;
+		power_info = node_ptr->power_info;
+		if (!power_info) {
+			bit_set(result->fail_bitmap, i);
+			continue;
+		}
+		if (req->type == POWER_MONITOR_FREE_POWER) {
+			cap[i] = cap2[i] = power_info->cpu_max_watts;
+		} else if (power_info->power_cap && power_info->socket_cnt) {
+			cap[i] = power_info->power_cap[0].cpu_cap_watts;
+			if (power_info->socket_cnt > 1) {
+				cap2[i] =
+					power_info->power_cap[1].cpu_cap_watts;
+			} else {
+				cap2[i] = cap[i];
+			}
+		}
+		if ((cap[i] == 0) || (cap2[i] == 0)) {
+			debug("%s: no package cap known for node %s",
+			      __func__, node_ptr->name);
+			bit_set(result->fail_bitmap, i);
+			continue;
+		}
+		bit_set(send_bitmap, i);
+	}
+}
+
+/* Push the package caps of the nodes of a request, one message for all */
+static void _set_remote(power_monitor_req_t *req,
+			power_monitor_result_t *result)
+{
+	/* Locks: Read node */
+	slurmctld_lock_t node_read_lock = {
+		NO_LOCK, NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
+	bitstr_t *send_bitmap, *fail_bitmap = NULL;
+	uint32_t *cap, *cap2;
+
+	lock_slurmctld(node_read_lock);
+	if (req->node_bitmap) {
+		result->node_bitmap = bit_copy(req->node_bitmap);
+	} else {
+		result->node_bitmap = bit_alloc(node_record_count);
+		bit_set_all(result->node_bitmap);
+	}
+	result->fail_bitmap = bit_alloc(bit_size(result->node_bitmap));
+	send_bitmap = bit_alloc(bit_size(result->node_bitmap));
+	cap  = xmalloc(sizeof(uint32_t) * (node_record_count + 1));
+	cap2 = xmalloc(sizeof(uint32_t) * (node_record_count + 1));
+	_build_caps(req, result, send_bitmap, cap, cap2);
+	unlock_slurmctld(node_read_lock);
+
+	if (bit_ffs(send_bitmap) >= 0) {
+		power_collect_set_caps(send_bitmap, cap, cap2, 0,
+				       &fail_bitmap);
+		if (fail_bitmap)
+			bit_or(result->fail_bitmap, fail_bitmap);
+		FREE_NULL_BITMAP(fail_bitmap);
+	}
+	FREE_NULL_BITMAP(send_bitmap);
+	xfree(cap);
+	xfree(cap2);
+}
+
+static void _run_request(power_monitor_req_t *req,
+			 power_monitor_result_t *result)
+{
+	memset(result, 0, sizeof(power_monitor_result_t));
+	if ((req->type == POWER_MONITOR_GET_POWER) ||
+	    (req->type == POWER_MONITOR_GET_FREQ))
+		_get_remote(req, result);
+	else
+		_set_remote(req, result);
+
+	if (bit_set_count(result->fail_bitmap))
+		result->rc = SLURM_ERROR;
+	else
+		result->rc = SLURM_SUCCESS;
+}
+
+static void _result_free_members(power_monitor_result_t *result)
+{
+	FREE_NULL_BITMAP(result->node_bitmap);
+	FREE_NULL_BITMAP(result->fail_bitmap);
+	power_sweep_free(result->sweep);
+	result->sweep = NULL;
+}
+
+static void _req_free(power_monitor_req_t *req)
+{
+	if (req) {
+		FREE_NULL_BITMAP(req->node_bitmap);
+		xfree(req);
+	}
+}
+
+/* Worker thread of one SYNC_MODE_NON_BLOCK request */
+static void *_req_thread(void *arg)
+{
+	power_monitor_req_t *req = (power_monitor_req_t *) arg;
+	power_monitor_result_t result;
+
+	_run_request(req, &result);
+
+	/* Done with the nodes, so the callback may queue a new request */
+	slurm_mutex_lock(&pending_mutex);
+	pending_cnt--;
+	slurm_mutex_unlock(&pending_mutex);
+
+	if (req->callback)
+		(req->callback)(&result, req->arg);
+	_result_free_members(&result);
+	_req_free(req);
+
+	return NULL;
+}
+
 /*
-	if(synq_mode == SYNC_MODE_BLOCK){
-		
-<<<<<<< HEAD
-	}else if(synq_mode == SYNC_MODE_NON_BLOCK){
-		
-	}else{
+ * Run a request in the caller's thread or hand it to a detached worker.
+ * Takes ownership of node_bitmap.
+ */
+static int _submit_request(uint16_t type, bitstr_t *node_bitmap,
+			   uint32_t *total_power, uint32_t sync_mode,
+			   power_monitor_callback_t callback, void *arg)
+{
+	pthread_attr_t thread_attr;
+	pthread_t thread_id;
+	power_monitor_req_t *req;
+	power_monitor_result_t result;
+	int rc;
+
+	if ((sync_mode != SYNC_MODE_BLOCK) &&
+	    (sync_mode != SYNC_MODE_NON_BLOCK)) {
+		FREE_NULL_BITMAP(node_bitmap);
+		return EINVAL;
 	}
-//	for(i=0; i<node_record_count; i++){
-//		if(bit_test(node_bitmap, i) == 1){
-//			node_record_table_ptr[i].power_perf.xxi = get_power();
-//		}
+
+	req = xmalloc(sizeof(power_monitor_req_t));
+	req->type = type;
+	req->node_bitmap = node_bitmap;
+	req->callback = callback;
+	req->arg = arg;
+
+	if (sync_mode == SYNC_MODE_BLOCK) {
+		_run_request(req, &result);
+		if (total_power)
+			*total_power = result.total_power;
+		rc = result.rc;
+		_result_free_members(&result);
+		_req_free(req);
+		return rc;
 	}
 
-	_make_task_data();
-	_send_get_current();
+	slurm_mutex_lock(&pending_mutex);
+	if (pending_cnt >= POWER_MONITOR_MAX_PENDING) {
+		slurm_mutex_unlock(&pending_mutex);
+		debug("%s: %d requests pending, try again later",
+		      __func__, pending_cnt);
+		_req_free(req);
+		return EAGAIN;
+	}
+	pending_cnt++;
+	slurm_mutex_unlock(&pending_mutex);
 
-	if(synq_mode == SYNC_MODE_BLOCK){	
-	}else if(synq_mode == SYNC_MODE_NON_BLOCK){
+	slurm_attr_init(&thread_attr);
+	if (pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED))
+		error("pthread_attr_setdetachstate error %m");
+	rc = pthread_create(&thread_id, &thread_attr, _req_thread, req);
+	slurm_attr_destroy(&thread_attr);
+	if (rc) {
+		error("%s: pthread_create error %m", __func__);
+		_req_free(req);
+		slurm_mutex_lock(&pending_mutex);
+		pending_cnt--;
+		slurm_mutex_unlock(&pending_mutex);
+		return EAGAIN;
 	}
 
-*/
 	return SLURM_SUCCESS;
 }
 
+/* Copy a caller's bitmap so it may change once we return */
+static bitstr_t *_copy_bitmap(bitstr_t *node_bitmap)
+{
+	if (node_bitmap)
+		return bit_copy(node_bitmap);
+	return NULL;
+}
 
+extern int get_remote_nodes_power(bitstr_t *node_bitmap,
+				  uint32_t *total_power,
+				  uint32_t sync_mode,
+				  power_monitor_callback_t callback,
+				  void *arg)
+{
+	return _submit_request(POWER_MONITOR_GET_POWER,
+			       _copy_bitmap(node_bitmap), total_power,
+			       sync_mode, callback, arg);
+}
 
-/**
- * get_remote_job_power - update nodes power consumption
- * 	check current power consumption 
- * 	update node_info->power_perf
- * IN job_ptr - pointer to job_record
- * IN/OUT node_record_table_ptr - pointer to node_info list
- * OUT total_power - total power consumption specified by the job_record
- * IN synq_mode - SYNC_MODE_BLOCK     : wait until updating
- * 		  SYNC_MODE_NON_BLOCK 
- * 		     : no-wait. when finished updating, calls callback function.
- * IN callback - pointer to callback function (for non_blocking mode)
- * RET zero on success, EINVAL otherwise
- */
-extern uint32_t get_remote_job_power(
-		struct job_record job_ptr,
-		struct node_record *node_record_table_ptr,
-		uint32_t total_power,
-		uint32_t synq_mode, 
-		void *callback);
-
-/**
- * get_remote_nodes_frequency - update nodes frequency
- * 	check current frequency
- * 	update node_info->power_perf
- * IN node_bitmap - pointer to list of update nodes
- * IN/OUT node_record_table_ptr - pointer to node_info list
- * OUT total_power - total power consumption specified by the node_bitmap
- * IN synq_mode - SYNC_MODE_BLOCK     : wait until updating
- * 		  SYNC_MODE_NON_BLOCK 
- * 		     : no-wait. when finished updating, calls callback function.
- * IN callback - pointer to callback function (for non_blocking mode)
- * RET zero on success, EINVAL otherwise
- */
-extern uint32_t get_remote_nodes_frequency(
-		bitstr_t *node_bitmap,
-		struct node_record *node_record_table_ptr, 
-		uint32_t synq_mode, 
-		void *callback);
-
-/**
- * get_remote_job_frequency - update nodes frequency
- * 	check current frequency
- * 	update node_info->power_perf
- * IN job_ptr - pointer to job_record
- * IN/OUT node_record_table_ptr - pointer to node_info list
- * OUT total_power - total power consumption specified by the job_record
- * IN synq_mode - SYNC_MODE_BLOCK     : wait until updating
- * 		  SYNC_MODE_NON_BLOCK 
- * 		     : no-wait. when finished updating, calls callback function.
- * IN callback - pointer to callback function (for non_blocking mode)
- * RET zero on success, EINVAL otherwise
- */
-extern uint32_t get_remote_job_frequency(
-		struct job_record *job_ptr,  
-		struct node_record *node_record_table_ptr, 
-		uint32_t synq_mode,
-		void *callback);
-
-/**
- * set_remote_nodes_power - update nodes power cap
- * 	set power capping and update node_info->power_perf
- * IN node_bitmap - pointer to list of cap nodes
- * IN node_record_table_ptr - pointer to node_info list (containing power capping)
- * IN synq_mode - SYNC_MODE_BLOCK     : wait until updating
- * 		  SYNC_MODE_NON_BLOCK 
- * 		     : no-wait. when finished updating, calls callback function.
- * IN callback - pointer to callback function (for non_blocking mode)
- * RET zero on success, EINVAL otherwise
- */
-extern uint32_t set_remote_nodes_power(
-		bitstr_t *node_bitmap,
-		struct node_record *node_record_table_ptr,
-		uint32_t synq_mode,
-		void *callback);
-
-/**
- * set_remote_nodes_freqency - update nodes frequency cap
- * 	set frequency capping and update node_info->power_perf
- * IN node_bitmap - pointer to list of cap nodes
- * IN node_record_table_ptr - pointer to node_info list (containing frequency capping)
- * IN synq_mode - SYNC_MODE_BLOCK     : wait until updating
- * 		  SYNC_MODE_NON_BLOCK 
- * 		     : no-wait. when finished updating, calls callback function.
- * IN callback - pointer to callback function (for non_blocking mode)
- * RET zero on success, EINVAL otherwise
- */
-extern uint32_t set_remote_nodes_freqency(
-		bitstr_t *node_bitmap,
-		struct node_record *node_record_table_ptr,
-		uint32_t synq_mode, 
-		void *callback);
-
-/**
- * set_free_remote_nodes_power - remove power cap
- * 	remove power capping and update node_info->power_perf
- * IN node_bitmap - pointer to list of nodes
- * IN synq_mode - SYNC_MODE_BLOCK     : wait until updating
- * 		  SYNC_MODE_NON_BLOCK 
- * 		     : no-wait. when finished updating, calls callback function.
- * IN callback - pointer to callback function (for non_blocking mode)
- * RET zero on success, EINVAL otherwise
- */
-extern uint32_t set_free_remote_nodes_power(
-		bitstr_t *node_bitmap,
-		uint32_t synq_mode,
-		void *callback);
-
-/**
- * set_free_remote_nodes_freqency - remove frequency cap
- * 	remove frequency capping and update node_info->power_perf
- * IN node_bitmap - pointer to list of nodes
- * IN synq_mode - SYNC_MODE_BLOCK     : wait until updating
- * 		  SYNC_MODE_NON_BLOCK 
- * 		     : no-wait. when finished updating, calls callback function.
- * IN callback - pointer to callback function (for non_blocking mode)
- * RET zero on success, EINVAL otherwise
+/*
+ * Copy the node_bitmap of a job, so the request does not depend on the job
+ * record once the job lock is released.
+ * NOTE: Do not hold any slurmctld locks when calling this function.
  */
-extern uint32_t set_free_remote_nodes_freqency(
-		bitstr_t *node_bitmap,
-		struct node_record *node_record_table_ptr,
-		uint32_t synq_mode, 
-		void *callback);
+static int _copy_job_bitmap(uint32_t job_id, bitstr_t **node_bitmap)
+{
+	/* Locks: Read job */
+	slurmctld_lock_t job_read_lock = {
+		NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK, NO_LOCK };
+	struct job_record *job_ptr;
+	int rc = SLURM_SUCCESS;
+
+	lock_slurmctld(job_read_lock);
+	job_ptr = find_job_record(job_id);
+	if (!job_ptr)
+		rc = ESLURM_INVALID_JOB_ID;
+	else if (!job_ptr->node_bitmap)
+		rc = EINVAL;
+	else
+		*node_bitmap = bit_copy(job_ptr->node_bitmap);
+	unlock_slurmctld(job_read_lock);
+
+	return rc;
+}
+
+extern int get_remote_job_power(uint32_t job_id,
+				uint32_t *total_power,
+				uint32_t sync_mode,
+				power_monitor_callback_t callback,
+				void *arg)
+{
+	bitstr_t *node_bitmap = NULL;
+	int rc;
+
+	if ((rc = _copy_job_bitmap(job_id, &node_bitmap)))
+		return rc;
+	return _submit_request(POWER_MONITOR_GET_POWER, node_bitmap,
+			       total_power, sync_mode, callback, arg);
+}
+
+extern int get_remote_nodes_frequency(bitstr_t *node_bitmap,
+				      uint32_t sync_mode,
+				      power_monitor_callback_t callback,
+				      void *arg)
+{
+	return _submit_request(POWER_MONITOR_GET_FREQ,
+			       _copy_bitmap(node_bitmap), NULL,
+			       sync_mode, callback, arg);
+}
+
+extern int get_remote_job_frequency(uint32_t job_id,
+				    uint32_t sync_mode,
+				    power_monitor_callback_t callback,
+				    void *arg)
+{
+	bitstr_t *node_bitmap = NULL;
+	int rc;
+
+	if ((rc = _copy_job_bitmap(job_id, &node_bitmap)))
+		return rc;
+	return _submit_request(POWER_MONITOR_GET_FREQ, node_bitmap, NULL,
+			       sync_mode, callback, arg);
+}
+
+extern int set_remote_nodes_power(bitstr_t *node_bitmap,
+				  uint32_t sync_mode,
+				  power_monitor_callback_t callback,
+				  void *arg)
+{
+	return _submit_request(POWER_MONITOR_SET_POWER,
+			       _copy_bitmap(node_bitmap), NULL,
+			       sync_mode, callback, arg);
+}
 
-#endif /* !__POWERMONITOR_H */
+extern int set_remote_nodes_freqency(bitstr_t *node_bitmap,
+				     uint32_t sync_mode,
+				     power_monitor_callback_t callback,
+				     void *arg)
+{
+	return ESLURM_NOT_SUPPORTED;
+}
+
+extern int set_free_remote_nodes_power(bitstr_t *node_bitmap,
+				       uint32_t sync_mode,
+				       power_monitor_callback_t callback,
+				       void *arg)
+{
+	return _submit_request(POWER_MONITOR_FREE_POWER,
+			       _copy_bitmap(node_bitmap), NULL,
+			       sync_mode, callback, arg);
+}
+
+extern int set_free_remote_nodes_freqency(bitstr_t *node_bitmap,
+					  uint32_t sync_mode,
+					  power_monitor_callback_t callback,
+					  void *arg)
+{
+	return ESLURM_NOT_SUPPORTED;
+}
@@ -39,149 +39,166 @@
 #define __POWERMONITOR_H
 
 #include "slurm/slurm.h"
+#include "src/common/bitstring.h"
+#include "src/slurmctld/power_collect.h"
 #include "src/slurmctld/slurmctld.h"
 
+/* sync_mode values for the remote power APIs below */
+#define SYNC_MODE_BLOCK		0	/* wait for every node, no callback */
+#define SYNC_MODE_NON_BLOCK	1	/* return at once, then call the
+					 * callback from a worker thread */
+
+/* Most non-blocking requests allowed in flight at once */
+#define POWER_MONITOR_MAX_PENDING	16
+
+typedef struct power_monitor_result {
+	int rc;				/* SLURM_SUCCESS if every node
+					 * answered */
+	bitstr_t *node_bitmap;		/* nodes the request was sent to */
+	bitstr_t *fail_bitmap;		/* nodes which failed or timed out */
+	uint32_t total_power;		/* get_*_power: watts of the nodes
+					 * which answered */
+	power_sweep_t *sweep;		/* get_*: per-node samples, NULL for
+					 * set_* requests */
+} power_monitor_result_t;
+
+/*
+ * Completion callback of a SYNC_MODE_NON_BLOCK request. It is called once,
+ * from a worker thread, after every node has answered or timed out. No
+ * slurmctld locks are held. The result is freed when the callback returns.
+ */
+typedef void (*power_monitor_callback_t) (power_monitor_result_t *result,
+					  void *arg);
+
+/* start_power_monitor - create the periodic power monitor thread */
+extern void start_power_monitor(pthread_t *thread_id);
+
 /**
  * get_remote_nodes_power - update nodes power consumption
  * 	check current power consumption 
- * 	and update node_info->power_perf
- * IN node_bitmap - pointer to list of update nodes
- * IN/OUT node_record_table_ptr - pointer to node_info list
+ * 	and publish it to the telemetry store (see power_telemetry.h)
+ * IN node_bitmap - nodes to update, NULL for every node
  * OUT total_power - total power consumption specified by the node_bitmap
- * IN synq_mode - SYNC_MODE_BLOCK     : wait until updating
+ *		     (SYNC_MODE_BLOCK only, may be NULL)
+ * IN sync_mode - SYNC_MODE_BLOCK     : wait until updating
  * 		  SYNC_MODE_NON_BLOCK 
  * 		     : no-wait. when finished updating, calls callback function.
- * IN callback - pointer to callback function (for non_blocking mode)
- * RET zero on success, EINVAL otherwise
+ * IN callback - completion function (for non_blocking mode)
+ * IN arg - passed to callback
+ * RET zero on success, EINVAL or EAGAIN otherwise
+ * NOTE: SYNC_MODE_BLOCK must be called without slurmctld locks
  */
-extern uint32_t get_remote_nodes_power(
-		bitstr_t *node_bitmap,
-		node_record *node_record_table_ptr, 
-		uint32_t total_power, 
-		uint32_t synq_mode, 
-		void *callback);
+extern int get_remote_nodes_power(bitstr_t *node_bitmap,
+				  uint32_t *total_power,
+				  uint32_t sync_mode,
+				  power_monitor_callback_t callback,
+				  void *arg);
 
 /**
- * get_remote_job_power - update nodes power consumption
+ * get_remote_job_power - update power consumption of a job's nodes
  * 	check current power consumption 
- * 	update node_info->power_perf
- * IN job_ptr - pointer to job_record
- * IN/OUT node_record_table_ptr - pointer to node_info list
- * OUT total_power - total power consumption specified by the job_record
- * IN synq_mode - SYNC_MODE_BLOCK     : wait until updating
- * 		  SYNC_MODE_NON_BLOCK 
- * 		     : no-wait. when finished updating, calls callback function.
- * IN callback - pointer to callback function (for non_blocking mode)
- * RET zero on success, EINVAL otherwise
+ * 	and publish it to the telemetry store (see power_telemetry.h)
+ * IN job_id - id of a job with allocated nodes
+ * OUT total_power - total power consumption of the job's nodes
+ *		     (SYNC_MODE_BLOCK only, may be NULL)
+ * IN sync_mode - SYNC_MODE_BLOCK or SYNC_MODE_NON_BLOCK
+ * IN callback - completion function (for non_blocking mode)
+ * IN arg - passed to callback
+ * RET zero on success, ESLURM_INVALID_JOB_ID, EINVAL or EAGAIN otherwise
+ * NOTE: Must be called without slurmctld locks in both modes, the job's
+ *	 node_bitmap is copied under a job read lock
  */
-extern uint32_t get_remote_job_power(
-		struct job_record job_ptr,
-		node_record *node_record_table_ptr,
-		uint32_t total_power,
-		uint32_t synq_mode, 
-		void *callback);
+extern int get_remote_job_power(uint32_t job_id,
+				uint32_t *total_power,
+				uint32_t sync_mode,
+				power_monitor_callback_t callback,
+				void *arg);
 
 /**
  * get_remote_nodes_frequency - update nodes frequency
  * 	check current frequency
- * 	update node_info->power_perf
- * IN node_bitmap - pointer to list of update nodes
- * IN/OUT node_record_table_ptr - pointer to node_info list
- * OUT total_power - total power consumption specified by the node_bitmap
- * IN synq_mode - SYNC_MODE_BLOCK     : wait until updating
- * 		  SYNC_MODE_NON_BLOCK 
- * 		     : no-wait. when finished updating, calls callback function.
- * IN callback - pointer to callback function (for non_blocking mode)
- * RET zero on success, EINVAL otherwise
+ * 	and publish it to the telemetry store (see power_telemetry.h)
+ * IN node_bitmap - nodes to update, NULL for every node
+ * IN sync_mode - SYNC_MODE_BLOCK or SYNC_MODE_NON_BLOCK
+ * IN callback - completion function (for non_blocking mode)
+ * IN arg - passed to callback
+ * RET zero on success, EINVAL or EAGAIN otherwise
  */
-extern uint32_t get_remote_nodes_frequency(
-		bitstr_t *node_bitmap,
-		node_record *node_record_table_ptr, 
-		uint32_t synq_mode, 
-		void *callback);
+extern int get_remote_nodes_frequency(bitstr_t *node_bitmap,
+				      uint32_t sync_mode,
+				      power_monitor_callback_t callback,
+				      void *arg);
 
 /**
- * get_remote_job_frequency - update nodes frequency
+ * get_remote_job_frequency - update frequency of a job's nodes
  * 	check current frequency
- * 	update node_info->power_perf
- * IN job_ptr - pointer to job_record
- * IN/OUT node_record_table_ptr - pointer to node_info list
- * OUT total_power - total power consumption specified by the job_record
- * IN synq_mode - SYNC_MODE_BLOCK     : wait until updating
- * 		  SYNC_MODE_NON_BLOCK 
- * 		     : no-wait. when finished updating, calls callback function.
- * IN callback - pointer to callback function (for non_blocking mode)
- * RET zero on success, EINVAL otherwise
+ * 	and publish it to the telemetry store (see power_telemetry.h)
+ * IN job_id - id of a job with allocated nodes
+ * IN sync_mode - SYNC_MODE_BLOCK or SYNC_MODE_NON_BLOCK
+ * IN callback - completion function (for non_blocking mode)
+ * IN arg - passed to callback
+ * RET zero on success, ESLURM_INVALID_JOB_ID, EINVAL or EAGAIN otherwise
+ * NOTE: Must be called without slurmctld locks in both modes, the job's
+ *	 node_bitmap is copied under a job read lock
  */
-extern uint32_t get_remote_job_frequency(
-		struct job_record *job_ptr,  
-		node_record *node_record_table_ptr, 
-		uint32_t synq_mode,
-		void *callback);
+extern int get_remote_job_frequency(uint32_t job_id,
+				    uint32_t sync_mode,
+				    power_monitor_callback_t callback,
+				    void *arg);
 
 /**
- * set_remote_nodes_power - update nodes power cap
- * 	set power capping and update node_info->power_perf
- * IN node_bitmap - pointer to list of cap nodes
- * IN node_record_table_ptr - pointer to node_info list (containing power capping)
- * IN synq_mode - SYNC_MODE_BLOCK     : wait until updating
- * 		  SYNC_MODE_NON_BLOCK 
- * 		     : no-wait. when finished updating, calls callback function.
- * IN callback - pointer to callback function (for non_blocking mode)
- * RET zero on success, EINVAL otherwise
+ * set_remote_nodes_power - push nodes power cap
+ * 	send each node the package caps held in its
+ *	node_info->power_info->power_cap
+ * IN node_bitmap - nodes to cap, NULL for every node
+ * IN sync_mode - SYNC_MODE_BLOCK or SYNC_MODE_NON_BLOCK
+ * IN callback - completion function (for non_blocking mode)
+ * IN arg - passed to callback
+ * RET zero on success, EINVAL or EAGAIN otherwise
  */
-extern uint32_t set_remote_nodes_power(
-		bitstr_t *node_bitmap,
-		node_record *node_record_table_ptr,
-		uint32_t synq_mode,
-		void *callback);
+extern int set_remote_nodes_power(bitstr_t *node_bitmap,
+				  uint32_t sync_mode,
+				  power_monitor_callback_t callback,
+				  void *arg);
 
 /**
  * set_remote_nodes_freqency - update nodes frequency cap
- * 	set frequency capping and update node_info->power_perf
- * IN node_bitmap - pointer to list of cap nodes
- * IN node_record_table_ptr - pointer to node_info list (containing frequency capping)
- * IN synq_mode - SYNC_MODE_BLOCK     : wait until updating
- * 		  SYNC_MODE_NON_BLOCK 
- * 		     : no-wait. when finished updating, calls callback function.
- * IN callback - pointer to callback function (for non_blocking mode)
- * RET zero on success, EINVAL otherwise
+ * IN node_bitmap - nodes to cap, NULL for every node
+ * IN sync_mode - SYNC_MODE_BLOCK or SYNC_MODE_NON_BLOCK
+ * IN callback - completion function (for non_blocking mode)
+ * IN arg - passed to callback
+ * RET ESLURM_NOT_SUPPORTED, no power knob accepts frequency caps yet
  */
-extern uint32_t set_remote_nodes_freqency(
-		bitstr_t *node_bitmap,
-		node_record *node_record_table_ptr,
-		uint32_t synq_mode, 
-		void *callback);
+extern int set_remote_nodes_freqency(bitstr_t *node_bitmap,
+				     uint32_t sync_mode,
+				     power_monitor_callback_t callback,
+				     void *arg);
 
 /**
  * set_free_remote_nodes_power - remove power cap
- * 	remove power capping and update node_info->power_perf
- * IN node_bitmap - pointer to list of nodes
- * IN synq_mode - SYNC_MODE_BLOCK     : wait until updating
- * 		  SYNC_MODE_NON_BLOCK 
- * 		     : no-wait. when finished updating, calls callback function.
- * IN callback - pointer to callback function (for non_blocking mode)
- * RET zero on success, EINVAL otherwise
+ * 	raise the package caps of the nodes back to cpu_max_watts
+ * IN node_bitmap - nodes to uncap, NULL for every node
+ * IN sync_mode - SYNC_MODE_BLOCK or SYNC_MODE_NON_BLOCK
+ * IN callback - completion function (for non_blocking mode)
+ * IN arg - passed to callback
+ * RET zero on success, EINVAL or EAGAIN otherwise
  */
-extern uint32_t set_free_remote_nodes_power(
-		bitstr_t *node_bitmap
-		uint32_t synq_mode,
-		void *callback);
+extern int set_free_remote_nodes_power(bitstr_t *node_bitmap,
+				       uint32_t sync_mode,
+				       power_monitor_callback_t callback,
+				       void *arg);
 
 /**
  * set_free_remote_nodes_freqency - remove frequency cap
- * 	remove frequency capping and update node_info->power_perf
- * IN node_bitmap - pointer to list of nodes
- * IN synq_mode - SYNC_MODE_BLOCK     : wait until updating
- * 		  SYNC_MODE_NON_BLOCK 
- * 		     : no-wait. when finished updating, calls callback function.
- * IN callback - pointer to callback function (for non_blocking mode)
- * RET zero on success, EINVAL otherwise
+ * IN node_bitmap - nodes to uncap, NULL for every node
+ * IN sync_mode - SYNC_MODE_BLOCK or SYNC_MODE_NON_BLOCK
+ * IN callback - completion function (for non_blocking mode)
+ * IN arg - passed to callback
+ * RET ESLURM_NOT_SUPPORTED, no power knob accepts frequency caps yet
  */
-extern uint32_t set_free_remote_nodes_freqency(
-		bitstr_t *node_bitmap,
-		node_record *node_record_table_ptr,
-		uint32_t synq_mode, 
-		void *callback);
+extern int set_free_remote_nodes_freqency(bitstr_t *node_bitmap,
+					  uint32_t sync_mode,
+					  power_monitor_callback_t callback,
+					  void *arg);
 
 #endif /* !__POWERMONITOR_H */
@@ -0,0 +1,617 @@
+/*****************************************************************************\
+ *  power_shed.c - emergency power shedding on budget overruns
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "src/common/bitstring.h"
+#include "src/common/log.h"
+#include "src/common/macros.h"
+#include "src/common/node_conf.h"
+#include "src/common/slurm_protocol_api.h"
+#include "src/common/timers.h"
+#include "src/common/xmalloc.h"
+#include "src/slurmctld/locks.h"
+#include "src/slurmctld/power_allocator_plugin.h"
+#include "src/slurmctld/power_shed.h"
+#include "src/slurmctld/slurmctld.h"
+
+#define SHED_PLAN_MSEC		5000	/* plan rebuild period */
+#define SHED_HOLD_MSEC		2000	/* no second shed within this time
+					 * unless the total keeps rising */
+#define SHED_RISE_PCT		5	/* rise which overrides the hold */
+#define SHED_RESUME_PCT		90	/* of PowerAlert, to resume a job */
+#define SHED_MAX_USEC		1000000	/* warn if a shed takes longer */
+#define DEFAULT_SHED_MIN_WATTS	30	/* lowest package cap we shed to */
+
+enum shed_mode {
+	SHED_MODE_NONE,
+	SHED_MODE_UNIFORM,
+	SHED_MODE_PRIORITY,
+	SHED_MODE_SUSPEND
+};
+
+/* One running job of the plan, lowest priority first */
+typedef struct shed_job {
+	uint32_t job_id;
+	uint32_t priority;
+	time_t start_time;
+	bitstr_t *node_bitmap;
+} shed_job_t;
+
+static pthread_mutex_t shed_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t shed_cond;
+static bool shed_started = false;
+static uint16_t shed_mode = SHED_MODE_NONE;
+static uint32_t shed_min_watts = DEFAULT_SHED_MIN_WATTS;
+static uint32_t shed_alert_watts = 0;	/* PowerAlert */
+
+/* Protected by shed_mutex */
+static uint32_t *node_watts = NULL;	/* last known power of each node */
+static uint32_t node_cnt = 0;
+static uint64_t total_watts = 0;	/* sum of node_watts */
+static bool shed_pending = false;
+static uint32_t shed_gen = 0;
+
+/* Owned by the shed thread */
+static uint16_t *node_sockets = NULL;
+static shed_job_t *plan_jobs = NULL;
+static int plan_job_cnt = 0;
+static uint32_t plan_node_cnt = 0;
+static uint32_t *suspended = NULL;	/* jobs we suspended, in order */
+static int suspended_cnt = 0;
+
+static uint32_t _ts_msec_since(struct timespec *then)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t) ((now.tv_sec - then->tv_sec) * 1000 +
+			   (now.tv_nsec - then->tv_nsec) / 1000000);
+}
+
+/* Parse PowerParameters configuration */
+static void _load_config(void)
+{
+	char *power_params, *tmp_ptr;
+	long val;
+
+	power_params = slurm_get_power_parameters();
+	if (!power_params)
+		power_params = xmalloc(1);	/* Set defaults below */
+
+	shed_mode = SHED_MODE_NONE;
+	/*                                   1234567890 */
+	if ((tmp_ptr = strstr(power_params, "shed_mode="))) {
+		tmp_ptr += 10;
+		if (!strncasecmp(tmp_ptr, "uniform", 7))
+			shed_mode = SHED_MODE_UNIFORM;
+		else if (!strncasecmp(tmp_ptr, "priority", 8))
+			shed_mode = SHED_MODE_PRIORITY;
+		else if (!strncasecmp(tmp_ptr, "suspend", 7))
+			shed_mode = SHED_MODE_SUSPEND;
+		else if (strncasecmp(tmp_ptr, "none", 4))
+			error("PowerParameters: shed_mode invalid");
+	}
+	shed_min_watts = DEFAULT_SHED_MIN_WATTS;
+	/*                                   123456789012345 */
+	if ((tmp_ptr = strstr(power_params, "shed_min_watts="))) {
+		val = strtol(tmp_ptr + 15, NULL, 10);
+		if (val < 1)
+			error("PowerParameters: shed_min_watts=%ld invalid",
+			      val);
+		else
+			shed_min_watts = val;
+	}
+	xfree(power_params);
+
+	shed_alert_watts = slurmctld_conf.power_alert;
+	if ((shed_alert_watts == NO_VAL) || (shed_alert_watts == 0)) {
+		if (shed_mode != SHED_MODE_NONE)
+			error("power_shed: shed_mode needs PowerAlert");
+		shed_mode = SHED_MODE_NONE;
+	}
+}
+
+/* Start over with an empty running total when the node table changed.
+ * NOTE: shed_mutex must be held */
+static void _resize_nodes(uint32_t cnt)
+{
+	if (cnt == node_cnt)
+		return;
+	xfree(node_watts);
+	node_watts = xmalloc(sizeof(uint32_t) * (cnt + 1));
+	node_cnt = cnt;
+	total_watts = 0;
+}
+
+/* Record a node's power in the running total.
+ * NOTE: shed_mutex must be held */
+static void _set_node_watts(int inx, uint32_t watts)
+{
+	total_watts -= node_watts[inx];
+	total_watts += watts;
+	node_watts[inx] = watts;
+}
+
+/* Wake the shed thread if the total is over PowerAlert.
+ * NOTE: shed_mutex must be held */
+static void _check_total(void)
+{
+	if ((total_watts > shed_alert_watts) && !shed_pending) {
+		shed_pending = true;
+		pthread_cond_signal(&shed_cond);
+	}
+}
+
+extern void power_shed_node_event(char *node_name, uint32_t watts)
+{
+	/* Locks: Read node */
+	slurmctld_lock_t node_read_lock = {
+		NO_LOCK, NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
+	struct node_record *node_ptr;
+	int inx = -1;
+	uint32_t cnt;
+
+	if (!shed_started)
+		return;
+
+	lock_slurmctld(node_read_lock);
+	if ((node_ptr = find_node_record(node_name)))
+		inx = node_ptr - node_record_table_ptr;
+	cnt = node_record_count;
+	unlock_slurmctld(node_read_lock);
+	if (inx < 0)
+		return;
+
+	power_shed_node_watts(inx, cnt, watts);
+}
+
+extern void power_shed_node_watts(int node_inx, uint32_t node_cnt,
+				  uint32_t watts)
+{
+	if (!shed_started || (node_inx < 0) || (node_inx >= node_cnt))
+		return;
+
+	slurm_mutex_lock(&shed_mutex);
+	_resize_nodes(node_cnt);
+	_set_node_watts(node_inx, watts);
+	_check_total();
+	slurm_mutex_unlock(&shed_mutex);
+}
+
+extern void power_shed_store(power_sweep_t *sweep)
+{
+	int i;
+
+	if (!shed_started || !sweep)
+		return;
+
+	slurm_mutex_lock(&shed_mutex);
+	_resize_nodes(sweep->node_cnt);
+	for (i = 0; i < sweep->node_cnt; i++) {
+		if (sweep->samples[i].power)
+			_set_node_watts(i, power_sweep_node_watts(sweep, i));
+	}
+	_check_total();
+	slurm_mutex_unlock(&shed_mutex);
+}
+
+extern uint32_t power_shed_generation(void)
+{
+	uint32_t gen;
+
+	slurm_mutex_lock(&shed_mutex);
+	gen = shed_gen;
+	slurm_mutex_unlock(&shed_mutex);
+
+	return gen;
+}
+
+static int _shed_job_cmp(const void *x, const void *y)
+{
+	const shed_job_t *j1 = x, *j2 = y;
+
+	if (j1->priority != j2->priority)
+		return (j1->priority < j2->priority) ? -1 : 1;
+	/* the youngest job loses the least work */
+	if (j1->start_time != j2->start_time)
+		return (j1->start_time > j2->start_time) ? -1 : 1;
+	return 0;
+}
+
+static void _free_plan(void)
+{
+	int i;
+
+	for (i = 0; i < plan_job_cnt; i++)
+		FREE_NULL_BITMAP(plan_jobs[i].node_bitmap);
+	xfree(plan_jobs);
+	plan_job_cnt = 0;
+}
+
+/* Rebuild the socket counts and the job order the shed relies on */
+static void _build_plan(void)
+{
+	/* Locks: Read job, read node */
+	slurmctld_lock_t job_read_lock = {
+		NO_LOCK, READ_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
+	struct node_record *node_ptr;
+	struct job_record *job_ptr;
+	ListIterator job_iterator;
+	int i;
+
+	_free_plan();
+	lock_slurmctld(job_read_lock);
+	if (plan_node_cnt != node_record_count) {
+		xfree(node_sockets);
+		plan_node_cnt = node_record_count;
+		node_sockets = xmalloc(sizeof(uint16_t) * (plan_node_cnt + 1));
+	}
+	for (i = 0, node_ptr = node_record_table_ptr; i < node_record_count;
+	     i++, node_ptr++) {
+		if (slurmctld_conf.fast_schedule)
+			node_sockets[i] = node_ptr->config_ptr->sockets;
+		else
+			node_sockets[i] = node_ptr->sockets;
+		node_sockets[i] = MAX(node_sockets[i], 1);
+	}
+
+	if (shed_mode != SHED_MODE_UNIFORM) {
+		plan_jobs = xmalloc(sizeof(shed_job_t) *
+				    (list_count(job_list) + 1));
+		job_iterator = list_iterator_create(job_list);
+		while ((job_ptr = (struct job_record *)
+				  list_next(job_iterator))) {
+			if (!IS_JOB_RUNNING(job_ptr) || !job_ptr->node_bitmap ||
+			    (bit_size(job_ptr->node_bitmap) != plan_node_cnt))
+				continue;
+			plan_jobs[plan_job_cnt].job_id = job_ptr->job_id;
+			plan_jobs[plan_job_cnt].priority = job_ptr->priority;
+			plan_jobs[plan_job_cnt].start_time =
+				job_ptr->start_time;
+			plan_jobs[plan_job_cnt].node_bitmap =
+				bit_copy(job_ptr->node_bitmap);
+			plan_job_cnt++;
+		}
+		list_iterator_destroy(job_iterator);
+	}
+	unlock_slurmctld(job_read_lock);
+
+	qsort(plan_jobs, plan_job_cnt, sizeof(shed_job_t), _shed_job_cmp);
+}
+
+/* Saving from dropping a node to the minimum caps */
+static uint32_t _node_saving(uint32_t *watts, int inx)
+{
+	uint32_t floor_watts = shed_min_watts * node_sockets[inx];
+
+	return (watts[inx] > floor_watts) ? (watts[inx] - floor_watts) : 0;
+}
+
+/* Scale every node down to fit, RET watts expected to be saved */
+static uint32_t _plan_uniform(uint32_t *watts, uint64_t total,
+			      bitstr_t *cut_bitmap, uint32_t *caps)
+{
+	double ratio = (double) shed_alert_watts / (double) total;
+	uint32_t cap, saved = 0;
+	int i;
+
+	for (i = 0; i < plan_node_cnt; i++) {
+		if (!watts[i])
+			continue;
+		cap = (uint32_t) (watts[i] * ratio) / node_sockets[i];
+		cap = MAX(cap, shed_min_watts);
+		if (cap * node_sockets[i] >= watts[i])
+			continue;
+		caps[i] = cap;
+		saved += watts[i] - cap * node_sockets[i];
+		bit_set(cut_bitmap, i);
+	}
+	return saved;
+}
+
+/* Drop whole jobs, lowest priority first, to the minimum caps until the
+ * excess is covered. RET watts expected to be saved */
+static uint32_t _plan_priority(uint32_t *watts, uint32_t excess,
+			       bitstr_t *cut_bitmap, uint32_t *caps)
+{
+	uint32_t saved = 0;
+	int i, j, first, last;
+
+	for (j = 0; (j < plan_job_cnt) && (saved < excess); j++) {
+		first = bit_ffs(plan_jobs[j].node_bitmap);
+		last = bit_fls(plan_jobs[j].node_bitmap);
+		for (i = first; (first >= 0) && (i <= last); i++) {
+			if (!bit_test(plan_jobs[j].node_bitmap, i) ||
+			    bit_test(cut_bitmap, i))
+				continue;
+			saved += _node_saving(watts, i);
+			caps[i] = shed_min_watts;
+			bit_set(cut_bitmap, i);
+		}
+	}
+	return saved;
+}
+
+/* Pick jobs, lowest priority first, whose nodes cover the excess.
+ * RET watts expected to be saved */
+static uint32_t _plan_suspend(uint32_t *watts, uint32_t excess,
+			      bitstr_t *cut_bitmap, uint32_t *job_ids,
+			      int *job_cnt)
+{
+	uint32_t saved = 0, job_saved;
+	int i, j, first, last;
+
+	*job_cnt = 0;
+	for (j = 0; (j < plan_job_cnt) && (saved < excess); j++) {
+		first = bit_ffs(plan_jobs[j].node_bitmap);
+		last = bit_fls(plan_jobs[j].node_bitmap);
+		job_saved = 0;
+		for (i = first; (first >= 0) && (i <= last); i++) {
+			if (!bit_test(plan_jobs[j].node_bitmap, i) ||
+			    bit_test(cut_bitmap, i))
+				continue;
+			job_saved += _node_saving(watts, i);
+			bit_set(cut_bitmap, i);
+		}
+		if (!job_saved)
+			continue;
+		job_ids[(*job_cnt)++] = plan_jobs[j].job_id;
+		saved += job_saved;
+	}
+	return saved;
+}
+
+static void _suspend_jobs(uint32_t *job_ids, int job_cnt)
+{
+	/* Locks: Write job, write node */
+	slurmctld_lock_t job_write_lock = {
+		NO_LOCK, WRITE_LOCK, WRITE_LOCK, NO_LOCK, READ_LOCK };
+	suspend_msg_t msg;
+	int i, rc;
+
+	memset(&msg, 0, sizeof(suspend_msg_t));
+	msg.op = SUSPEND_JOB;
+	lock_slurmctld(job_write_lock);
+	for (i = 0; i < job_cnt; i++) {
+		msg.job_id = job_ids[i];
+		rc = job_suspend(&msg, 0, -1, false, (uint16_t) NO_VAL);
+		if (rc == SLURM_SUCCESS) {
+			info("power_shed: suspended job %u", job_ids[i]);
+			xrealloc(suspended,
+				 sizeof(uint32_t) * (suspended_cnt + 1));
+			suspended[suspended_cnt++] = job_ids[i];
+		} else {
+			info("power_shed: suspending job %u: %s",
+			     job_ids[i], slurm_strerror(rc));
+		}
+	}
+	unlock_slurmctld(job_write_lock);
+}
+
+/* Resume the last job we suspended */
+static void _resume_job(void)
+{
+	/* Locks: Write job, write node */
+	slurmctld_lock_t job_write_lock = {
+		NO_LOCK, WRITE_LOCK, WRITE_LOCK, NO_LOCK, READ_LOCK };
+	suspend_msg_t msg;
+	int rc;
+
+	memset(&msg, 0, sizeof(suspend_msg_t));
+	msg.op = RESUME_JOB;
+	msg.job_id = suspended[--suspended_cnt];
+	lock_slurmctld(job_write_lock);
+	rc = job_suspend(&msg, 0, -1, false, (uint16_t) NO_VAL);
+	unlock_slurmctld(job_write_lock);
+	if (rc == SLURM_SUCCESS)
+		info("power_shed: resumed job %u", msg.job_id);
+	else
+		debug("power_shed: resuming job %u: %s", msg.job_id,
+		      slurm_strerror(rc));
+}
+
+/* Decide and apply one shed, RET the total expected afterwards */
+static uint64_t _shed(uint32_t *watts, uint64_t total)
+{
+	static char *mode_str[] = { "none", "uniform", "priority", "suspend" };
+	bitstr_t *cut_bitmap;
+	uint32_t *caps = NULL, *job_ids = NULL, excess, saved;
+	int i, cut_cnt, job_cnt = 0, fail_cnt = 0;
+	DEF_TIMERS;
+
+	START_TIMER;
+	excess = (uint32_t) (total - shed_alert_watts);
+	cut_bitmap = bit_alloc(plan_node_cnt);
+	if (shed_mode == SHED_MODE_UNIFORM) {
+		caps = xmalloc(sizeof(uint32_t) * (plan_node_cnt + 1));
+		saved = _plan_uniform(watts, total, cut_bitmap, caps);
+	} else if (shed_mode == SHED_MODE_PRIORITY) {
+		caps = xmalloc(sizeof(uint32_t) * (plan_node_cnt + 1));
+		saved = _plan_priority(watts, excess, cut_bitmap, caps);
+	} else {
+		job_ids = xmalloc(sizeof(uint32_t) * (plan_job_cnt + 1));
+		saved = _plan_suspend(watts, excess, cut_bitmap, job_ids,
+				      &job_cnt);
+	}
+
+	cut_cnt = bit_set_count(cut_bitmap);
+	if (caps && cut_cnt)
+		fail_cnt = power_collect_set_caps(cut_bitmap, caps, NULL, 0,
+						  NULL);
+	else if (job_cnt)
+		_suspend_jobs(job_ids, job_cnt);
+	END_TIMER;
+
+	if (DELTA_TIMER > SHED_MAX_USEC) {
+		error("power_shed: %s shed took %ld usec", mode_str[shed_mode],
+		      DELTA_TIMER);
+	}
+	info("power_shed: %"PRIu64" W over PowerAlert %u W, %s shed of "
+	     "%u W on %d nodes (%d failed) in %ld usec", total,
+	     shed_alert_watts, mode_str[shed_mode], saved, cut_cnt,
+	     fail_cnt, DELTA_TIMER);
+
+	/* expect the cut nodes at their new level until measured again */
+	for (i = 0; i < plan_node_cnt; i++) {
+		if (!bit_test(cut_bitmap, i))
+			continue;
+		if (caps)
+			watts[i] = MIN(watts[i], caps[i] * node_sockets[i]);
+		else
+			watts[i] = MIN(watts[i],
+				       shed_min_watts * node_sockets[i]);
+	}
+	FREE_NULL_BITMAP(cut_bitmap);
+	xfree(caps);
+	xfree(job_ids);
+
+	return (saved < total) ? (total - saved) : 0;
+}
+
+static void *_shed_loop(void *arg)
+{
+	struct timespec plan_time, last_shed, until;
+	uint32_t *watts = NULL, cnt;
+	uint64_t total, shed_total = 0;
+	bool shed_now, have_shed = false;
+	int i;
+
+	_build_plan();
+	clock_gettime(CLOCK_MONOTONIC, &plan_time);
+	slurm_mutex_lock(&shed_mutex);
+	while (slurmctld_config.shutdown_time == 0) {
+		if (!shed_pending) {
+			until = plan_time;
+			slurm_ts_add_msec(&until, SHED_PLAN_MSEC);
+			if (pthread_cond_timedwait(&shed_cond, &shed_mutex,
+						   &until) == ETIMEDOUT) {
+				total = total_watts;
+				slurm_mutex_unlock(&shed_mutex);
+				_build_plan();
+				clock_gettime(CLOCK_MONOTONIC, &plan_time);
+				if (suspended_cnt && (!have_shed ||
+				    (_ts_msec_since(&last_shed) >=
+				     SHED_PLAN_MSEC)) &&
+				    (total * 100 < (uint64_t) shed_alert_watts *
+						   SHED_RESUME_PCT))
+					_resume_job();
+				slurm_mutex_lock(&shed_mutex);
+			}
+			continue;
+		}
+		shed_pending = false;
+		total = total_watts;
+		shed_now = (total > shed_alert_watts) &&
+			   (node_cnt == plan_node_cnt);
+		if (shed_now && have_shed &&
+		    (_ts_msec_since(&last_shed) < SHED_HOLD_MSEC) &&
+		    (total * 100 < shed_total * (100 + SHED_RISE_PCT)))
+			shed_now = false;	/* last shed still settling */
+		if (!shed_now)
+			continue;
+
+		/* work on a copy, the totals keep moving meanwhile */
+		cnt = node_cnt;
+		xrealloc(watts, sizeof(uint32_t) * (cnt + 1));
+		memcpy(watts, node_watts, sizeof(uint32_t) * cnt);
+		slurm_mutex_unlock(&shed_mutex);
+
+		total = _shed(watts, total);
+
+		slurm_mutex_lock(&shed_mutex);
+		if (node_cnt == cnt) {
+			for (i = 0; i < cnt; i++) {
+				if (watts[i] < node_watts[i])
+					_set_node_watts(i, watts[i]);
+			}
+		}
+		shed_gen++;
+		shed_total = total_watts;
+		have_shed = true;
+		clock_gettime(CLOCK_MONOTONIC, &last_shed);
+		slurm_mutex_unlock(&shed_mutex);
+
+		/* the allocator owns the caps again from its next pass */
+		power_allocator_g_alert((uint32_t) total);
+		slurm_mutex_lock(&shed_mutex);
+	}
+	slurm_mutex_unlock(&shed_mutex);
+	xfree(watts);
+
+	return NULL;
+}
+
+extern void start_power_shed(void)
+{
+	pthread_attr_t thread_attr;
+	pthread_condattr_t cond_attr;
+	pthread_t thread_id;
+
+	slurm_mutex_lock(&shed_mutex);
+	if (shed_started) {
+		slurm_mutex_unlock(&shed_mutex);
+		return;
+	}
+	_load_config();
+	if (shed_mode == SHED_MODE_NONE) {
+		slurm_mutex_unlock(&shed_mutex);
+		return;
+	}
+
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&shed_cond, &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+
+	slurm_attr_init(&thread_attr);
+	if (pthread_create(&thread_id, &thread_attr, _shed_loop, NULL)) {
+		error("power_shed: pthread_create %m");
+		pthread_cond_destroy(&shed_cond);
+	} else {
+		shed_started = true;
+		verbose("power_shed: shedding over PowerAlert %u W",
+			shed_alert_watts);
+	}
+	slurm_attr_destroy(&thread_attr);
+	slurm_mutex_unlock(&shed_mutex);
+}
@@ -0,0 +1,98 @@
+/*****************************************************************************\
+ *  power_shed.h - emergency power shedding on budget overruns
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _POWER_SHED_H
+#define _POWER_SHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "src/slurmctld/power_collect.h"
+
+/*
+ * The shedding path keeps a running total of the cluster power, fed by
+ * every sweep (power_collect_store) and by the watermark events slurmd
+ * pushes as soon as a node crosses PowerParameters=shed_node_watts. When
+ * the total goes over PowerAlert, a dedicated thread applies the shed
+ * plan it keeps ready (PowerParameters=shed_mode):
+ *	uniform  - scale the package caps of every node down to fit,
+ *	priority - drop the nodes of the lowest priority jobs to the
+ *		   minimum cap until the excess is covered,
+ *	suspend  - suspend the lowest priority jobs until the excess is
+ *		   covered, resuming them once the power is back down.
+ * The plan is rebuilt in the background, so the alert path takes no
+ * slurmctld locks except to suspend jobs, and the caps go out in one
+ * tree-forwarded message (power_collect_set_caps).
+ */
+
+/* start_power_shed - start the shedding thread if shed_mode is set */
+extern void start_power_shed(void);
+
+/*
+ * power_shed_node_event - record a watermark event from a node
+ * IN node_name - the node which sent it
+ * IN watts - node power (packages plus DRAM) when it was sent
+ * NOTE: Do not hold any slurmctld locks when calling this function.
+ */
+extern void power_shed_node_event(char *node_name, uint32_t watts);
+
+/*
+ * power_shed_node_watts - same as power_shed_node_event() for a node
+ *	already looked up, e.g. while ingesting a pushed sample
+ * IN node_inx - index of the node in node_record_table_ptr
+ * IN node_cnt - node_record_count the index belongs to
+ * IN watts - node power (packages plus DRAM)
+ * NOTE: No slurmctld locks are needed
+ */
+extern void power_shed_node_watts(int node_inx, uint32_t node_cnt,
+				  uint32_t watts);
+
+/*
+ * power_shed_store - update the running total from a sweep
+ * IN sweep - results from power_collect_sweep()
+ * NOTE: No slurmctld locks are needed
+ */
+extern void power_shed_store(power_sweep_t *sweep);
+
+/*
+ * power_shed_generation - count of sheds applied so far. Allocators which
+ *	only push the caps that changed should forget what they pushed when
+ *	it moves, since a shed overwrote the caps behind their back.
+ */
+extern uint32_t power_shed_generation(void);
+
+#endif /* !_POWER_SHED_H */
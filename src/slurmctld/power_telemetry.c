@@ -0,0 +1,267 @@
+/*****************************************************************************\
+ *  power_telemetry.c - Lock-free per-node power telemetry rings
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "src/common/log.h"
+#include "src/common/macros.h"
+#include "src/common/xmalloc.h"
+#include "src/slurmctld/power_telemetry.h"
+#include "src/slurmctld/slurmctld.h"
+
+typedef struct telemetry_slot {
+	uint32_t seq;			/* odd while a publisher writes */
+	uint32_t idx;			/* ring position held, see ring head */
+	power_telemetry_sample_t sample;
+} telemetry_slot_t;
+
+typedef struct telemetry_ring {
+	uint32_t head;			/* samples ever published */
+	telemetry_slot_t slot[POWER_TELEMETRY_DEPTH];
+} telemetry_ring_t;
+
+typedef struct telemetry_store {
+	uint32_t ring_cnt;
+	telemetry_ring_t *rings;
+	struct telemetry_store *retired;	/* replaced stores, see below */
+} telemetry_store_t;
+
+/* Serializes publishers and store replacement, never taken by readers */
+static pthread_mutex_t publish_mutex = PTHREAD_MUTEX_INITIALIZER;
+static telemetry_store_t *store = NULL;
+/* Readers inside power_telemetry_history(). Replaced stores are kept on
+ * the retired list until a publisher sees this drop to zero: any reader
+ * that starts later can only load the current store. */
+static uint32_t reader_cnt = 0;
+
+static telemetry_store_t *_store_get(void)
+{
+	__atomic_add_fetch(&reader_cnt, 1, __ATOMIC_SEQ_CST);
+	return __atomic_load_n(&store, __ATOMIC_SEQ_CST);
+}
+
+static void _store_put(void)
+{
+	__atomic_sub_fetch(&reader_cnt, 1, __ATOMIC_RELEASE);
+}
+
+static void _store_free(telemetry_store_t *old_store)
+{
+	telemetry_store_t *next;
+
+	while (old_store) {
+		next = old_store->retired;
+		xfree(old_store->rings);
+		xfree(old_store);
+		old_store = next;
+	}
+}
+
+/* Free the retired stores if no reader can still hold one of them.
+ * NOTE: Lock publish_mutex before entry */
+static void _store_reclaim(void)
+{
+	if (!store || !store->retired)
+		return;
+	if (__atomic_load_n(&reader_cnt, __ATOMIC_SEQ_CST))
+		return;		/* retry on the next publish */
+	_store_free(store->retired);
+	store->retired = NULL;
+}
+
+/* Replace the store with one holding ring_cnt rings, keeping the samples
+ * of the old one if keep is set.
+ * NOTE: Lock publish_mutex before entry */
+static telemetry_store_t *_store_replace(uint32_t ring_cnt, bool keep)
+{
+	telemetry_store_t *old_store = store, *new_store;
+
+	new_store = xmalloc(sizeof(telemetry_store_t));
+	new_store->ring_cnt = ring_cnt;
+	if (ring_cnt)
+		new_store->rings = xmalloc(sizeof(telemetry_ring_t) * ring_cnt);
+	if (old_store && keep) {
+		memcpy(new_store->rings, old_store->rings,
+		       sizeof(telemetry_ring_t) *
+		       MIN(old_store->ring_cnt, ring_cnt));
+	}
+	new_store->retired = old_store;
+	__atomic_store_n(&store, new_store, __ATOMIC_SEQ_CST);
+
+	return new_store;
+}
+
+/* Copy one slot if it still holds ring position idx.
+ * RET true on a consistent copy */
+static bool _slot_read(telemetry_slot_t *slot, uint32_t idx,
+		       power_telemetry_sample_t *sample)
+{
+	uint32_t seq1, seq2;
+
+	while (1) {
+		seq1 = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if (seq1 & 1)
+			continue;	/* publisher mid-write, a few stores */
+		if (__atomic_load_n(&slot->idx, __ATOMIC_RELAXED) != idx)
+			return false;	/* overwritten by a newer sample */
+		memcpy(sample, &slot->sample, sizeof(power_telemetry_sample_t));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		seq2 = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+		if (seq1 == seq2)
+			return true;
+	}
+}
+
+extern void power_telemetry_publish(int node_inx,
+				    power_telemetry_sample_t *sample)
+{
+	telemetry_store_t *cur_store;
+	telemetry_ring_t *ring;
+	telemetry_slot_t *slot;
+	power_telemetry_sample_t *prev = NULL;
+	uint32_t head;
+
+	if (node_inx < 0)
+		return;
+
+	slurm_mutex_lock(&publish_mutex);
+	cur_store = store;
+	if (!cur_store || (node_inx >= cur_store->ring_cnt)) {
+		cur_store = _store_replace(MAX(node_inx + 1, node_record_count),
+					   true);
+	}
+	ring = &cur_store->rings[node_inx];
+	head = ring->head;
+	if (head)
+		prev = &ring->slot[(head - 1) % POWER_TELEMETRY_DEPTH].sample;
+	slot = &ring->slot[head % POWER_TELEMETRY_DEPTH];
+
+	__atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	slot->idx = head;
+	memcpy(&slot->sample, sample, sizeof(power_telemetry_sample_t));
+	if (prev && !sample->power_time) {
+		slot->sample.power_time = prev->power_time;
+		slot->sample.socket_cnt = prev->socket_cnt;
+		memcpy(slot->sample.power, prev->power,
+		       sizeof(slot->sample.power));
+	}
+	if (prev && !sample->cache_time) {
+		slot->sample.cache_time = prev->cache_time;
+		slot->sample.cache_socket_cnt = prev->cache_socket_cnt;
+		memcpy(slot->sample.cache, prev->cache,
+		       sizeof(slot->sample.cache));
+	}
+	__atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+	_store_reclaim();
+	slurm_mutex_unlock(&publish_mutex);
+}
+
+extern int power_telemetry_latest(int node_inx,
+				  power_telemetry_sample_t *sample)
+{
+	if (power_telemetry_history(node_inx, sample, 1) == 1)
+		return SLURM_SUCCESS;
+	return ENOENT;
+}
+
+extern int power_telemetry_history(int node_inx,
+				   power_telemetry_sample_t *samples,
+				   int max_cnt)
+{
+	telemetry_store_t *cur_store = _store_get();
+	telemetry_ring_t *ring;
+	uint32_t head, idx;
+	int cnt = 0;
+
+	if (!cur_store || (node_inx < 0) || (node_inx >= cur_store->ring_cnt)) {
+		_store_put();
+		return 0;
+	}
+	ring = &cur_store->rings[node_inx];
+
+	while (cnt < max_cnt) {
+		head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		if ((head == 0) || (cnt >= MIN(head, POWER_TELEMETRY_DEPTH)))
+			break;
+		idx = head - 1 - cnt;
+		if (_slot_read(&ring->slot[idx % POWER_TELEMETRY_DEPTH], idx,
+			       &samples[cnt])) {
+			cnt++;
+		} else if (cnt == 0) {
+			continue;	/* lapped while reading, try newest */
+		} else {
+			break;		/* older history already overwritten */
+		}
+	}
+	_store_put();
+
+	return cnt;
+}
+
+extern uint32_t power_telemetry_sample_watts(power_telemetry_sample_t *sample)
+{
+	uint32_t watts = 0;
+	int i;
+
+	for (i = 0; i < sample->socket_cnt; i++) {
+		watts += sample->power[i].cpu_current_watts +
+			 sample->power[i].dram_current_watts;
+	}
+	return watts;
+}
+
+extern void power_telemetry_reset(void)
+{
+	slurm_mutex_lock(&publish_mutex);
+	if (store) {
+		_store_replace(0, false);
+		_store_reclaim();
+	}
+	slurm_mutex_unlock(&publish_mutex);
+}
+
+extern void power_telemetry_fini(void)
+{
+	slurm_mutex_lock(&publish_mutex);
+	_store_free(store);
+	store = NULL;
+	slurm_mutex_unlock(&publish_mutex);
+}
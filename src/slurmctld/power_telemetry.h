@@ -0,0 +1,116 @@
+/*****************************************************************************\
+ *  power_telemetry.h - Lock-free per-node power telemetry rings
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _POWER_TELEMETRY_H
+#define _POWER_TELEMETRY_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "slurm/slurm.h"
+
+#define POWER_TELEMETRY_DEPTH		8	/* samples kept per node */
+#define POWER_TELEMETRY_MAX_SOCKET	4	/* sockets kept per sample */
+
+typedef struct power_telemetry_sample {
+	uint32_t seq;			/* slurmd's sample sequence number */
+	uint64_t sample_usec;		/* slurmd's CLOCK_MONOTONIC time of
+					 * the sample, in microseconds */
+	time_t power_time;		/* sweep which set power, 0 if never */
+	time_t cache_time;		/* sweep which set cache, 0 if never */
+	uint16_t socket_cnt;		/* entries in power */
+	uint16_t cache_socket_cnt;	/* entries in cache */
+	power_current_data_t power[POWER_TELEMETRY_MAX_SOCKET];
+	cache_ref_t cache[POWER_TELEMETRY_MAX_SOCKET];
+} power_telemetry_sample_t;
+
+/*
+ * The telemetry store holds the last POWER_TELEMETRY_DEPTH samples of every
+ * node, indexed like node_record_table_ptr. It is independent of the
+ * slurmctld locks: publishers serialize on a private mutex and readers use
+ * a per-slot sequence count, retrying if a publisher overwrote the slot
+ * while they copied it. Readers never block publishers or each other.
+ */
+
+/*
+ * power_telemetry_publish - append a sample to a node's ring
+ * IN node_inx - index of the node in node_record_table_ptr
+ * IN sample - the new sample. If it has no power (or no cache) readings,
+ *	those of the previous sample are carried forward with their time.
+ * NOTE: No slurmctld locks are needed
+ */
+extern void power_telemetry_publish(int node_inx,
+				    power_telemetry_sample_t *sample);
+
+/*
+ * power_telemetry_latest - copy out a node's newest sample
+ * IN node_inx - index of the node in node_record_table_ptr
+ * OUT sample - consistent copy of the newest sample
+ * RET SLURM_SUCCESS, or ENOENT if the node has no samples
+ * NOTE: No slurmctld locks are needed
+ */
+extern int power_telemetry_latest(int node_inx,
+				  power_telemetry_sample_t *sample);
+
+/*
+ * power_telemetry_history - copy out a node's recent samples
+ * IN node_inx - index of the node in node_record_table_ptr
+ * OUT samples - newest first, at most max_cnt entries
+ * IN max_cnt - size of samples
+ * RET number of samples copied
+ * NOTE: No slurmctld locks are needed
+ */
+extern int power_telemetry_history(int node_inx,
+				   power_telemetry_sample_t *samples,
+				   int max_cnt);
+
+/*
+ * power_telemetry_sample_watts - sum the package and DRAM watts of a sample
+ */
+extern uint32_t power_telemetry_sample_watts(power_telemetry_sample_t *sample);
+
+/*
+ * power_telemetry_reset - drop every sample, e.g. when the node table is
+ *	rebuilt and indexes change. Readers still copying from the old store
+ *	finish safely; it is freed by the first publish after they return.
+ */
+extern void power_telemetry_reset(void);
+
+/* power_telemetry_fini - free the store at shutdown, no readers allowed */
+extern void power_telemetry_fini(void);
+
+#endif /* !_POWER_TELEMETRY_H */
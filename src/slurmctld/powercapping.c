@@ -36,6 +36,7 @@
  *  with SLURM; if not, write to the Free Software Foundation, Inc.,
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
 \*****************************************************************************/
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -63,6 +64,33 @@
 #define L_NODE_CUR	"CurrentPower"
 #define L_NUM_FREQ	"NumFreqChoices"
 #define L_CUR_POWER	"CurrentCorePower"
+#define L_CORES		"CoresCount"
+#define L_LAST_CORE	"LastCore"
+
+/*
+ * DVFS tables of the cpufreq layout. Most clusters have a few node types,
+ * so nodes with the same cores, frequency steps and per-core watts share
+ * one class, and the per-frequency watts of a set of nodes come from the
+ * count of its nodes in each class, O(classes x frequencies). The table
+ * only depends on configured keys: it is built on first use and again when
+ * the layouts configuration (layouts_conf_gen) or the node table changes.
+ */
+typedef struct dvfs_class {
+	uint32_t cores;			/* CoresCount */
+	uint32_t idle_core_watts;	/* IdleCoreWatts of a core */
+	uint32_t max_core_watts;	/* MaxCoreWatts of a core */
+	uint32_t num_freq;		/* NumFreqChoices */
+	uint32_t *freq;			/* Cpufreq<p>, p in 1..num_freq */
+	uint32_t *freq_watts;		/* Cpufreq<p>Watts of a core */
+} dvfs_class_t;
+
+static pthread_mutex_t dvfs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static dvfs_class_t *dvfs_class = NULL;
+static int dvfs_class_cnt = 0;
+static int *dvfs_node_class = NULL;	/* class of each node */
+static struct node_record *dvfs_node_table = NULL;
+static int dvfs_node_cnt = 0;
+static uint32_t dvfs_conf_gen = 0;
 
 static bool _powercap_enabled(void)
 {
@@ -103,27 +131,158 @@ bool power_layout_ready(void)
 {
 	static time_t last_error_time = (time_t) 0;
 	time_t now = time(NULL);
-	struct node_record *node_ptr;
-	uint32_t data[2];
-	int i;
-
-	for (i = 0, node_ptr = node_record_table_ptr; i < node_record_count;
-	     i++, node_ptr++) {
-		if (layouts_entity_get_mkv(L_NAME, node_ptr->name,
-		    "MaxWatts,IdleWatts", data, (sizeof(uint32_t) * 2),
-		    L_T_UINT32)) {
-			/* Limit error message frequency, once per minute */
-			if (difftime(now, last_error_time) < 60)
-				return false;
-			last_error_time = now;
-			error("%s: node %s is not in the layouts.d/power.conf file",
-			     __func__, node_ptr->name);
+	int max_key, idle_key, i;
+
+	max_key = layouts_key_handle(L_NAME, L_NODE_MAX);
+	idle_key = layouts_key_handle(L_NAME, L_NODE_IDLE);
+	if ((max_key < 0) || (idle_key < 0))
+		i = 0;	/* no node has the keys */
+	else if ((i = layouts_key_first_unset(max_key, NULL)) < 0)
+		i = layouts_key_first_unset(idle_key, NULL);
+	if ((i >= 0) && (i < node_record_count)) {
+		/* Limit error message frequency, once per minute */
+		if (difftime(now, last_error_time) < 60)
 			return false;
-		}
+		last_error_time = now;
+		error("%s: node %s is not in the layouts.d/power.conf file",
+		      __func__, node_record_table_ptr[i].name);
+		return false;
 	}
 	return true;
 }
 
+/* Sum a node key of the power layout over the nodes set in bitmap */
+static uint32_t _sum_node_watts(char *key, bitstr_t *bitmap)
+{
+	uint64_t sum = 0;
+
+	if (bit_ffs(bitmap) == -1)
+		return 0;
+	layouts_key_sum(layouts_key_handle(L_NAME, key), bitmap, &sum);
+	return (uint32_t) sum;
+}
+
+/* Read the DVFS class of a node, all zero if it has no DVFS keys */
+static void _dvfs_node_read(int node_inx, int *freq_handles, int handle_cnt,
+			    dvfs_class_t *class)
+{
+	char ename[128], keyname[128];
+	uint32_t core_data[2], last_core = 0;
+	int p;
+
+	memset(class, 0, sizeof(dvfs_class_t));
+	layouts_key_get(layouts_key_handle(L_NAME, L_NUM_FREQ), node_inx,
+			&class->num_freq);
+	class->num_freq = MIN(class->num_freq, handle_cnt);
+	layouts_key_get(layouts_key_handle(L_NAME, L_CORES), node_inx,
+			&class->cores);
+	layouts_key_get(layouts_key_handle(L_NAME, L_LAST_CORE), node_inx,
+			&last_core);
+
+	sprintf(ename, "virtualcore%u", last_core);
+	memset(core_data, 0, sizeof(core_data));
+	layouts_entity_get_mkv(L_NAME, ename, "IdleCoreWatts,MaxCoreWatts",
+			       core_data, sizeof(core_data), L_T_UINT32);
+	class->idle_core_watts = core_data[0];
+	class->max_core_watts = core_data[1];
+
+	class->freq = xmalloc(sizeof(uint32_t) * (class->num_freq + 1));
+	class->freq_watts = xmalloc(sizeof(uint32_t) * (class->num_freq + 1));
+	for (p = 1; p <= class->num_freq; p++) {
+		layouts_key_get(freq_handles[p], node_inx, &class->freq[p]);
+		sprintf(keyname, "Cpufreq%dWatts", p);
+		layouts_entity_get_kv(L_NAME, ename, keyname,
+				      &class->freq_watts[p], L_T_UINT32);
+	}
+}
+
+static bool _dvfs_class_match(dvfs_class_t *a, dvfs_class_t *b)
+{
+	size_t size = sizeof(uint32_t) * (a->num_freq + 1);
+
+	return ((a->cores == b->cores) &&
+		(a->idle_core_watts == b->idle_core_watts) &&
+		(a->max_core_watts == b->max_core_watts) &&
+		(a->num_freq == b->num_freq) &&
+		!memcmp(a->freq, b->freq, size) &&
+		!memcmp(a->freq_watts, b->freq_watts, size));
+}
+
+static void _dvfs_free(void)
+{
+	int c;
+
+	for (c = 0; c < dvfs_class_cnt; c++) {
+		xfree(dvfs_class[c].freq);
+		xfree(dvfs_class[c].freq_watts);
+	}
+	xfree(dvfs_class);
+	xfree(dvfs_node_class);
+	dvfs_class_cnt = 0;
+}
+
+/* Make the DVFS table current, dvfs_mutex must be held */
+static void _dvfs_build(void)
+{
+	uint32_t conf_gen = layouts_conf_gen(), max_freq = 0, num_freq;
+	char keyname[128];
+	dvfs_class_t class;
+	int *freq_handles;
+	int c, i, p;
+
+	if (dvfs_node_class && (dvfs_conf_gen == conf_gen) &&
+	    (dvfs_node_table == node_record_table_ptr) &&
+	    (dvfs_node_cnt == node_record_count))
+		return;
+
+	_dvfs_free();
+	dvfs_conf_gen = conf_gen;
+	dvfs_node_table = node_record_table_ptr;
+	dvfs_node_cnt = node_record_count;
+	dvfs_node_class = xmalloc(sizeof(int) * (dvfs_node_cnt + 1));
+
+	for (i = 0; i < dvfs_node_cnt; i++) {
+		num_freq = 0;
+		layouts_key_get(layouts_key_handle(L_NAME, L_NUM_FREQ), i,
+				&num_freq);
+		max_freq = MAX(max_freq, num_freq);
+	}
+	freq_handles = xmalloc(sizeof(int) * (max_freq + 1));
+	for (p = 1; p <= max_freq; p++) {
+		sprintf(keyname, "Cpufreq%d", p);
+		freq_handles[p] = layouts_key_handle(L_NAME, keyname);
+	}
+
+	for (i = 0; i < dvfs_node_cnt; i++) {
+		_dvfs_node_read(i, freq_handles, max_freq, &class);
+		for (c = 0; c < dvfs_class_cnt; c++) {
+			if (_dvfs_class_match(&dvfs_class[c], &class))
+				break;
+		}
+		if (c < dvfs_class_cnt) {
+			xfree(class.freq);
+			xfree(class.freq_watts);
+		} else {
+			xrealloc(dvfs_class,
+				 sizeof(dvfs_class_t) * (dvfs_class_cnt + 1));
+			dvfs_class[dvfs_class_cnt++] = class;
+		}
+		dvfs_node_class[i] = c;
+	}
+	xfree(freq_handles);
+	debug("%s: %d DVFS classes for %d nodes", __func__, dvfs_class_cnt,
+	      dvfs_node_cnt);
+}
+
+/* DVFS class of the first node of bitmap, dvfs_mutex must be held */
+static dvfs_class_t *_dvfs_first_class(bitstr_t *bitmap)
+{
+	int i = bit_ffs(bitmap);
+
+	if ((i < 0) || (i >= dvfs_node_cnt))
+		return NULL;
+	return &dvfs_class[dvfs_node_class[i]];
+}
 
 uint32_t powercap_get_cluster_max_watts(void)
 {
@@ -290,9 +449,7 @@ uint32_t powercap_get_cluster_current_max_watts(void)
 
 uint32_t powercap_get_node_bitmap_maxwatts(bitstr_t *idle_bitmap)
 {
-	uint32_t max_watts = 0, val;
-	struct node_record *node_ptr;
-	int i;
+	uint32_t max_watts = 0;
 	bitstr_t *tmp_bitmap = NULL;
 
 	if (!_powercap_enabled())
@@ -303,42 +460,28 @@ uint32_t powercap_get_node_bitmap_maxwatts(bitstr_t *idle_bitmap)
 	/* if no input bitmap, consider the current idle nodes 
 	 * bitmap as the input bitmap tagging nodes to consider 
 	 * as idle while computing the max watts of the cluster */
-	if (idle_bitmap == NULL) {
-		tmp_bitmap = bit_copy(idle_node_bitmap);
-		idle_bitmap = tmp_bitmap;
-	}
-
-	for (i = 0, node_ptr = node_record_table_ptr; i < node_record_count;
-	     i++, node_ptr++) {
-		/* non reserved node, evaluate the different cases */
-		if (bit_test(idle_bitmap, i)) {
-			 /* idle nodes, 2 cases : power save or not */
-			if (bit_test(power_node_bitmap, i)) {
-				layouts_entity_get_kv(L_NAME,
-						node_ptr->name, L_NODE_SAVE,
-						&val, L_T_UINT32);
-			} else {
-				layouts_entity_get_kv(L_NAME,
-						node_ptr->name, L_NODE_IDLE,
-						&val, L_T_UINT32);
-			}
-		} else {
-			/* non idle nodes, 2 cases : down or not */
-			if (!bit_test(up_node_bitmap, i)) {
-				layouts_entity_get_kv(L_NAME, 
-						node_ptr->name, L_NODE_DOWN,
-						&val, L_T_UINT32);
-			} else {
-				layouts_entity_get_kv(L_NAME,
-						node_ptr->name, L_NODE_MAX,
-						&val, L_T_UINT32);
-			}
-		}
-		max_watts += val;	
-	}
+	if (idle_bitmap == NULL)
+		idle_bitmap = idle_node_bitmap;
+
+	/* idle nodes, 2 cases : power save or not */
+	tmp_bitmap = bit_copy(idle_bitmap);
+	bit_and(tmp_bitmap, power_node_bitmap);
+	max_watts += _sum_node_watts(L_NODE_SAVE, tmp_bitmap);
+	bit_copybits(tmp_bitmap, idle_bitmap);
+	bit_and_not(tmp_bitmap, power_node_bitmap);
+	max_watts += _sum_node_watts(L_NODE_IDLE, tmp_bitmap);
+
+	/* non idle nodes, 2 cases : down or not */
+	bit_copybits(tmp_bitmap, idle_bitmap);
+	bit_not(tmp_bitmap);
+	bit_and_not(tmp_bitmap, up_node_bitmap);
+	max_watts += _sum_node_watts(L_NODE_DOWN, tmp_bitmap);
+	bit_copybits(tmp_bitmap, idle_bitmap);
+	bit_not(tmp_bitmap);
+	bit_and(tmp_bitmap, up_node_bitmap);
+	max_watts += _sum_node_watts(L_NODE_MAX, tmp_bitmap);
 
-	if (tmp_bitmap)
-		bit_free(tmp_bitmap);
+	FREE_NULL_BITMAP(tmp_bitmap);
 
 	return max_watts;
 }
@@ -366,23 +509,18 @@ uint32_t powercap_get_job_cap(struct job_record *job_ptr, time_t when,
 
 uint32_t powercap_get_cpufreq(bitstr_t *select_bitmap, int k)
 {
-	int i;
-	struct node_record *node_ptr;
-	char ename[128];
+	dvfs_class_t *class;
 	uint32_t cpufreq = 0;
 
 	if (!_powercap_enabled())
 		return cpufreq;
 
-	for (i = 0, node_ptr = node_record_table_ptr; i < node_record_count;
-	     i++, node_ptr++) {
-		if (bit_test(select_bitmap, i)) {
-			sprintf(ename, "Cpufreq%d", k);
-			layouts_entity_get_kv(L_NAME, node_ptr->name,
-						  ename, &cpufreq, L_T_UINT32);
-		}
-		break;
-	}
+	slurm_mutex_lock(&dvfs_mutex);
+	_dvfs_build();
+	class = _dvfs_first_class(select_bitmap);
+	if (class && (k > 0) && (k <= class->num_freq))
+		cpufreq = class->freq[k];
+	slurm_mutex_unlock(&dvfs_mutex);
 
 	return cpufreq;
 }
@@ -424,11 +562,8 @@ int *powercap_get_job_nodes_numfreq(bitstr_t *select_bitmap,
 				    uint32_t cpu_freq_min,
 				    uint32_t cpu_freq_max)
 {
-	uint16_t num_freq = 0;
-	int i, p, *allowed_freqs = NULL, new_num_freq = 0;
-	struct node_record *node_ptr;
-	char ename[128];
-	uint32_t cpufreq;
+	dvfs_class_t *class;
+	int p, *allowed_freqs = NULL, new_num_freq = 0;
 
 	if (!_powercap_enabled())
 		return NULL;
@@ -438,40 +573,27 @@ int *powercap_get_job_nodes_numfreq(bitstr_t *select_bitmap,
 		return allowed_freqs;
 	}
 
-	for (i = 0, node_ptr = node_record_table_ptr; i < node_record_count;
-	     i++, node_ptr++) {
-		if (bit_test(select_bitmap, i)) {
-			layouts_entity_get_kv(L_NAME, node_ptr->name,
-					L_NUM_FREQ, &num_freq, L_T_UINT16);
-			allowed_freqs = xmalloc(sizeof(int)*((int)num_freq+2));
-			allowed_freqs[0] = (int) num_freq;
-			for (p = num_freq; p > 0; p--) {
-				sprintf(ename, "Cpufreq%d", p);
-				layouts_entity_get_kv(L_NAME,
-					  	  node_ptr->name, ename,
-						  &cpufreq, L_T_UINT32);
-
-		/* In case a job is submitted with flags Low,High, etc on
-		 * --cpu-freq parameter then we consider the whole range
-		 * of available frequencies on nodes */
-				if (((cpu_freq_min <= cpufreq) &&
-				    (cpufreq <= cpu_freq_max)) ||
-				    ((cpu_freq_min & CPU_FREQ_RANGE_FLAG) ||
-				    (cpu_freq_max & CPU_FREQ_RANGE_FLAG))) {
-					new_num_freq++;
-					allowed_freqs[new_num_freq] = p;
-				}
-			}
-			break;
+	/* only the first selected node is considered */
+	slurm_mutex_lock(&dvfs_mutex);
+	_dvfs_build();
+	class = _dvfs_first_class(select_bitmap);
+	allowed_freqs = xmalloc(sizeof(int) *
+				((class ? class->num_freq : 0) + 2));
+	for (p = class ? class->num_freq : 0; p > 0; p--) {
+		/* In case a job is submitted with flags Low,High, etc
+		 * on --cpu-freq parameter then we consider the whole
+		 * range of available frequencies on nodes */
+		if (((cpu_freq_min <= class->freq[p]) &&
+		    (class->freq[p] <= cpu_freq_max)) ||
+		    ((cpu_freq_min & CPU_FREQ_RANGE_FLAG) ||
+		    (cpu_freq_max & CPU_FREQ_RANGE_FLAG))) {
+			new_num_freq++;
+			allowed_freqs[new_num_freq] = p;
 		}
 	}
+	slurm_mutex_unlock(&dvfs_mutex);
 
-	if (allowed_freqs) {
-		allowed_freqs[0] = new_num_freq;
-	} else {
-		allowed_freqs = xmalloc(sizeof(int) * 2);
-		/* allowed_freqs[0] = 0; Default value */
-	}
+	allowed_freqs[0] = new_num_freq;
 	return allowed_freqs;
 }
 
@@ -479,124 +601,122 @@ uint32_t powercap_get_node_bitmap_maxwatts_dvfs(bitstr_t *idle_bitmap,
 			  bitstr_t *select_bitmap, uint32_t *max_watts_dvfs,
 			  int* allowed_freqs, uint32_t num_cpus)
 {
-	uint32_t max_watts = 0, tmp_max_watts = 0, val = 0;
-	uint32_t *tmp_max_watts_dvfs = NULL;
-	struct node_record *node_ptr;
-	int i, p;
-	char ename[128], keyname[128];
-	bitstr_t *tmp_bitmap = NULL;
-	uint32_t data[5], core_data[4];
+	uint32_t max_watts = 0, base, cur;
+	int64_t tmp_max_watts = 0, *tmp_max_watts_dvfs = NULL, *base_sum;
+	int64_t core_cnt, freq_watts;
+	int i, i_first, i_last, c, p, f, cur_handle, idle_handle;
+	uint32_t *node_cnt, cpus;
+	bitstr_t *tmp_bitmap = NULL, *busy_bitmap = NULL;
+	dvfs_class_t *class;
 
 	if (!_powercap_enabled())
 		return 0;
 
 	if (max_watts_dvfs != NULL) {
-		tmp_max_watts_dvfs = 
-			  xmalloc(sizeof(uint32_t)*(allowed_freqs[0]+1));
+		tmp_max_watts_dvfs =
+			  xmalloc(sizeof(int64_t)*(allowed_freqs[0]+1));
 	}
 
 	/* if no input bitmap, consider the current idle nodes 
 	 * bitmap as the input bitmap tagging nodes to consider 
 	 * as idle while computing the max watts of the cluster */
 	if (idle_bitmap == NULL && select_bitmap == NULL) {
-		tmp_bitmap = bit_copy(idle_node_bitmap);
-		idle_bitmap = tmp_bitmap;
-		select_bitmap = tmp_bitmap;
+		idle_bitmap = idle_node_bitmap;
+		select_bitmap = idle_node_bitmap;
 	}
-	
-	for (i = 0, node_ptr = node_record_table_ptr; i < node_record_count;
-	     i++, node_ptr++) {
-		if (bit_test(idle_bitmap, i)) {
-			/* idle nodes, 2 cases : power save or not */
-			if (bit_test(power_node_bitmap, i)) {
-				layouts_entity_get_kv(L_NAME,
-						  node_ptr->name, L_NODE_SAVE,
-						  &val, L_T_UINT32);
-			} else {
-				layouts_entity_get_kv(L_NAME,
-						  node_ptr->name, L_NODE_IDLE,
-						  &val, L_T_UINT32);
-			}
-		
-		} else if (bit_test(select_bitmap, i)) {
-			layouts_entity_get_mkv(L_NAME, node_ptr->name,
-				"IdleWatts,MaxWatts,CoresCount,LastCore,CurrentPower",
-				data, (sizeof(uint32_t) * 5), L_T_UINT32);
-
-			/* tmp_max_watts = IdleWatts - cpus*IdleCoreWatts
-			 * + cpus*MaxCoreWatts */
-			sprintf(ename, "virtualcore%u", data[3]);
-			if (num_cpus == 0 || num_cpus > data[2])
-				num_cpus = data[2];
-			layouts_entity_get_mkv(L_NAME, ename,
-					       "IdleCoreWatts,MaxCoreWatts",
-					       core_data,
-					       (sizeof(uint32_t) * 2),
-					       L_T_UINT32);
-			if (data[4] == 0) {
-				tmp_max_watts += data[0] -
-					  num_cpus*core_data[0] +
-					  num_cpus*core_data[1];
-			} else if (data[4] > 0) {
-				tmp_max_watts += data[4] -
-					  num_cpus*core_data[0] +
-					  num_cpus*core_data[1];
-			} else if (num_cpus == data[2])
-				tmp_max_watts += data[1];
-
-			if (!tmp_max_watts_dvfs)
-				goto skip_dvfs;
-			for (p = 1; p < (allowed_freqs[0] + 1); p++) {
-				sprintf(keyname, 
-					"IdleCoreWatts,MaxCoreWatts,"
-					"Cpufreq%dWatts,CurrentCorePower",
-					allowed_freqs[p]);
-				layouts_entity_get_mkv(L_NAME, ename, keyname,
-					  core_data, (sizeof(uint32_t) * 4),
-					  L_T_UINT32);
-				if (num_cpus == data[2]) {
-					tmp_max_watts_dvfs[p] +=
-						  num_cpus*core_data[2];
-				} else {
-					if (data[4] == 0) {
-						tmp_max_watts_dvfs[p] +=
-						 	data[0] -
-							num_cpus*core_data[0] +
-							num_cpus*core_data[2];
-					} else {
-						tmp_max_watts_dvfs[p] +=
-							data[4] -
-							num_cpus*core_data[0] +
-							num_cpus*core_data[2];
-					}
-				}
-			}
-  skip_dvfs:		;
-		} else {
-			/* non-idle nodes, 2 cases : down or not */
-			if (!bit_test(up_node_bitmap, i)) {
-				layouts_entity_get_kv(L_NAME,
-						  node_ptr->name, L_NODE_DOWN,
-						  &val, L_T_UINT32);
+
+	/* idle nodes, 2 cases : power save or not */
+	tmp_bitmap = bit_copy(idle_bitmap);
+	bit_and(tmp_bitmap, power_node_bitmap);
+	max_watts += _sum_node_watts(L_NODE_SAVE, tmp_bitmap);
+	bit_copybits(tmp_bitmap, idle_bitmap);
+	bit_and_not(tmp_bitmap, power_node_bitmap);
+	max_watts += _sum_node_watts(L_NODE_IDLE, tmp_bitmap);
+
+	/* non-idle and non-selected nodes, 2 cases : down or not */
+	bit_copybits(tmp_bitmap, idle_bitmap);
+	bit_or(tmp_bitmap, select_bitmap);
+	bit_not(tmp_bitmap);
+	busy_bitmap = bit_copy(tmp_bitmap);
+	bit_and_not(tmp_bitmap, up_node_bitmap);
+	max_watts += _sum_node_watts(L_NODE_DOWN, tmp_bitmap);
+	bit_and(busy_bitmap, up_node_bitmap);
+	max_watts += _sum_node_watts(L_NODE_CUR, busy_bitmap);
+
+	/* selected non-idle nodes: sum the watts they start from per DVFS
+	 * class, the per-core terms then only depend on the class */
+	bit_copybits(busy_bitmap, select_bitmap);
+	bit_and_not(busy_bitmap, idle_bitmap);
+	slurm_mutex_lock(&dvfs_mutex);
+	_dvfs_build();
+	base_sum = xmalloc(sizeof(int64_t) * (dvfs_class_cnt + 1));
+	node_cnt = xmalloc(sizeof(uint32_t) * (dvfs_class_cnt + 1));
+	cur_handle = layouts_key_handle(L_NAME, L_NODE_CUR);
+	idle_handle = layouts_key_handle(L_NAME, L_NODE_IDLE);
+	i_first = bit_ffs(busy_bitmap);
+	if (i_first >= 0)
+		i_last = MIN(bit_fls(busy_bitmap), dvfs_node_cnt - 1);
+	else
+		i_last = -2;
+	for (i = i_first; i <= i_last; i++) {
+		if (!bit_test(busy_bitmap, i))
+			continue;
+		/* CurrentPower if known, IdleWatts otherwise */
+		cur = base = 0;
+		layouts_key_get(cur_handle, i, &cur);
+		if (cur == 0)
+			layouts_key_get(idle_handle, i, &base);
+		else
+			base = cur;
+		c = dvfs_node_class[i];
+		base_sum[c] += base;
+		node_cnt[c]++;
+	}
+
+	/* tmp_max_watts = IdleWatts - cpus*IdleCoreWatts + cpus*MaxCoreWatts,
+	 * per frequency Cpufreq<p>Watts replaces MaxCoreWatts and whole nodes
+	 * only count their cores */
+	for (c = 0, class = dvfs_class; c < dvfs_class_cnt; c++, class++) {
+		if (!node_cnt[c])
+			continue;
+		cpus = class->cores;
+		if ((num_cpus != 0) && (num_cpus < cpus))
+			cpus = num_cpus;
+		core_cnt = (int64_t) node_cnt[c] * cpus;
+		tmp_max_watts += base_sum[c] + core_cnt *
+				 ((int64_t) class->max_core_watts -
+				  class->idle_core_watts);
+
+		if (!tmp_max_watts_dvfs)
+			continue;
+		for (p = 1; p < (allowed_freqs[0] + 1); p++) {
+			f = allowed_freqs[p];
+			freq_watts = ((f > 0) && (f <= class->num_freq)) ?
+				     class->freq_watts[f] : 0;
+			if (cpus == class->cores) {
+				tmp_max_watts_dvfs[p] += core_cnt * freq_watts;
 			} else {
-				layouts_entity_get_kv(L_NAME,
-						  node_ptr->name, L_NODE_CUR,
-						  &val, L_T_UINT32);
+				tmp_max_watts_dvfs[p] += base_sum[c] +
+					core_cnt * (freq_watts -
+						    class->idle_core_watts);
 			}
 		}
-		max_watts += val;
-		val = 0;
 	}
+	slurm_mutex_unlock(&dvfs_mutex);
+	xfree(base_sum);
+	xfree(node_cnt);
+
 	if (max_watts_dvfs) {	
 		for (p = 1; p < allowed_freqs[0] + 1; p++) {
-			max_watts_dvfs[p] = max_watts + tmp_max_watts_dvfs[p];
+			max_watts_dvfs[p] = max_watts +
+					    (uint32_t) tmp_max_watts_dvfs[p];
 		}
 		xfree(tmp_max_watts_dvfs);
 	}
-	max_watts += tmp_max_watts;
+	max_watts += (uint32_t) tmp_max_watts;
 
-	if (tmp_bitmap)
-		bit_free(tmp_bitmap);
+	FREE_NULL_BITMAP(tmp_bitmap);
+	FREE_NULL_BITMAP(busy_bitmap);
 
 	return max_watts;
 }
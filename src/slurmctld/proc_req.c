@@ -92,6 +92,7 @@
 #include "src/slurmctld/read_config.h"
 #include "src/slurmctld/reservation.h"
 #include "src/slurmctld/sched_plugin.h"
+#include "src/slurmctld/power_shed.h"
 #include "src/slurmctld/slurmctld.h"
 #include "src/slurmctld/srun_comm.h"
 #include "src/slurmctld/state_save.h"
@@ -146,12 +147,16 @@ inline static void  _slurm_rpc_dump_jobs_user(slurm_msg_t * msg);
 inline static void  _slurm_rpc_dump_job_single(slurm_msg_t * msg);
 inline static void  _slurm_rpc_dump_licenses(slurm_msg_t * msg);
 inline static void  _slurm_rpc_dump_nodes(slurm_msg_t * msg);
+inline static void  _slurm_rpc_dump_node_power(slurm_msg_t * msg);
 inline static void  _slurm_rpc_dump_node_single(slurm_msg_t * msg);
 inline static void  _slurm_rpc_dump_partitions(slurm_msg_t * msg);
 inline static void  _slurm_rpc_dump_spank(slurm_msg_t * msg);
 inline static void  _slurm_rpc_dump_stats(slurm_msg_t * msg);
 inline static void  _slurm_rpc_end_time(slurm_msg_t * msg);
 inline static void  _slurm_rpc_event_log(slurm_msg_t * msg);
+inline static void  _slurm_rpc_power_watermark(slurm_msg_t * msg);
+inline static void  _slurm_rpc_power_sample(slurm_msg_t * msg,
+					    bool running_composite);
 inline static void  _slurm_rpc_epilog_complete(slurm_msg_t * msg,
 					       bool *run_scheduler,
 					       bool running_composite);
@@ -341,6 +346,9 @@ void slurmctld_req(slurm_msg_t *msg, connection_arg_t *arg)
 	case REQUEST_NODE_INFO_SINGLE:
 		_slurm_rpc_dump_node_single(msg);
 		break;
+	case REQUEST_NODE_POWER_INFO:
+		_slurm_rpc_dump_node_power(msg);
+		break;
 	case REQUEST_PARTITION_INFO:
 		_slurm_rpc_dump_partitions(msg);
 		break;
@@ -580,6 +588,12 @@ void slurmctld_req(slurm_msg_t *msg, connection_arg_t *arg)
 	case REQUEST_EVENT_LOG:
 		_slurm_rpc_event_log(msg);
 		break;
+	case REQUEST_POWER_WATERMARK:
+		_slurm_rpc_power_watermark(msg);
+		break;
+	case MESSAGE_POWER_SAMPLE:
+		_slurm_rpc_power_sample(msg, 0);
+		break;
 	default:
 		error("invalid RPC msg_type=%u", msg->msg_type);
 		slurm_send_rc_msg(msg, EINVAL);
@@ -1680,6 +1694,54 @@ static void _slurm_rpc_dump_nodes(slurm_msg_t * msg)
 	}
 }
 
+/* _slurm_rpc_dump_node_power - dump RPC for changed node power readings */
+static void _slurm_rpc_dump_node_power(slurm_msg_t * msg)
+{
+	DEF_TIMERS;
+	char *dump;
+	int dump_size;
+	slurm_msg_t response_msg;
+	node_power_info_request_msg_t *power_req_msg =
+		(node_power_info_request_msg_t *) msg->data;
+	/* Locks: Read node */
+	slurmctld_lock_t node_read_lock = {
+		NO_LOCK, NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
+	uid_t uid = g_slurm_auth_get_uid(msg->auth_cred,
+					 slurmctld_config.auth_info);
+
+	START_TIMER;
+	debug3("Processing RPC: REQUEST_NODE_POWER_INFO from uid=%d", uid);
+
+	if ((slurmctld_conf.private_data & PRIVATE_DATA_NODES) &&
+	    (!validate_operator(uid))) {
+		error("Security violation, REQUEST_NODE_POWER_INFO RPC from "
+		      "uid=%d", uid);
+		slurm_send_rc_msg(msg, ESLURM_ACCESS_DENIED);
+		return;
+	}
+
+	lock_slurmctld(node_read_lock);
+	pack_node_power(&dump, &dump_size, power_req_msg->watts_update_time,
+			power_req_msg->cache_update_time,
+			msg->protocol_version);
+	unlock_slurmctld(node_read_lock);
+	END_TIMER2("_slurm_rpc_dump_node_power");
+
+	/* init response_msg structure */
+	slurm_msg_t_init(&response_msg);
+	response_msg.flags = msg->flags;
+	response_msg.protocol_version = msg->protocol_version;
+	response_msg.address = msg->address;
+	response_msg.conn = msg->conn;
+	response_msg.msg_type = RESPONSE_NODE_POWER_INFO;
+	response_msg.data = dump;
+	response_msg.data_size = dump_size;
+
+	/* send message */
+	slurm_send_node_msg(msg->conn_fd, &response_msg);
+	xfree(dump);
+}
+
 /* _slurm_rpc_dump_node_single - done RPC state information for one node */
 static void _slurm_rpc_dump_node_single(slurm_msg_t * msg)
 {
@@ -2695,6 +2757,57 @@ static void _slurm_rpc_event_log(slurm_msg_t * msg)
 	slurm_send_rc_msg(msg, error_code);
 }
 
+/* _slurm_rpc_power_watermark - a node's power crossed its shed_node_watts
+ *	watermark, feed it to the shedding path ahead of the next sweep */
+static void _slurm_rpc_power_watermark(slurm_msg_t * msg)
+{
+	uid_t uid = g_slurm_auth_get_uid(msg->auth_cred,
+					 slurmctld_config.auth_info);
+	power_watermark_msg_t *watermark_msg;
+
+	watermark_msg = (power_watermark_msg_t *) msg->data;
+	if (!validate_slurm_user(uid)) {
+		error("Security violation, POWER_WATERMARK RPC from uid=%d",
+		      uid);
+		return;
+	}
+	debug2("%s: node %s at %u watts (watermark %u)", __func__,
+	       watermark_msg->node_name, watermark_msg->watts,
+	       watermark_msg->watermark);
+	power_shed_node_event(watermark_msg->node_name, watermark_msg->watts);
+}
+
+/* _slurm_rpc_power_sample - publish a power sample pushed by a node, on
+ *	its own or batched in a MESSAGE_COMPOSITE. No reply. */
+static void _slurm_rpc_power_sample(slurm_msg_t * msg,
+				    bool running_composite)
+{
+	/* Locks: Read node */
+	slurmctld_lock_t node_read_lock = {
+		NO_LOCK, NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
+	uid_t uid = g_slurm_auth_get_uid(msg->auth_cred,
+					 slurmctld_config.auth_info);
+	power_knob_sample_resp_msg_t *sample_msg;
+	int error_code;
+
+	sample_msg = (power_knob_sample_resp_msg_t *) msg->data;
+	if (!validate_slurm_user(uid)) {
+		error("Security violation, POWER_SAMPLE RPC from uid=%d", uid);
+		return;
+	}
+
+	/* _comp_msg_power_samples() already holds the node read lock */
+	if (!running_composite)
+		lock_slurmctld(node_read_lock);
+	error_code = update_node_record_power_sample(sample_msg);
+	if (!running_composite)
+		unlock_slurmctld(node_read_lock);
+	if (error_code) {
+		debug("%s: power sample from unknown node %s", __func__,
+		      sample_msg->node_name);
+	}
+}
+
 /* _slurm_rpc_node_registration - process RPC to determine if a node's
  *	actual configuration satisfies the configured specification */
 static void _slurm_rpc_node_registration(slurm_msg_t * msg,
@@ -5958,6 +6071,45 @@ static void _slurmctld_free_comp_msg_list(void *x)
 }
 
 
+/*
+ * Publish the power samples batched in a composite message, embedded
+ * composites included, and take them out of its list. Samples only need
+ * the node read lock, so they are kept away from the job and node write
+ * locks which the rest of the batch runs under. Embedded composites left
+ * empty are dropped too.
+ * IN/OUT locked - set once node_read_lock is held, the caller unlocks it
+ */
+static void _comp_msg_power_samples(composite_msg_t *comp_msg, bool *locked)
+{
+	/* Locks: Read node */
+	slurmctld_lock_t node_read_lock = {
+		NO_LOCK, NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
+	composite_msg_t *ncomp_msg;
+	slurm_msg_t *next_msg;
+	ListIterator itr;
+
+	if (!comp_msg->msg_list)
+		return;
+	itr = list_iterator_create(comp_msg->msg_list);
+	while ((next_msg = list_next(itr))) {
+		if (next_msg->msg_type == MESSAGE_COMPOSITE) {
+			ncomp_msg = (composite_msg_t *) next_msg->data;
+			_comp_msg_power_samples(ncomp_msg, locked);
+			if (!ncomp_msg->msg_list ||
+			    !list_count(ncomp_msg->msg_list))
+				list_delete_item(itr);
+		} else if (next_msg->msg_type == MESSAGE_POWER_SAMPLE) {
+			if (!*locked) {
+				lock_slurmctld(node_read_lock);
+				*locked = true;
+			}
+			_slurm_rpc_power_sample(next_msg, 1);
+			list_delete_item(itr);
+		}
+	}
+	list_iterator_destroy(itr);
+}
+
 static void  _slurm_rpc_composite_msg(slurm_msg_t *msg)
 {
 	static time_t config_update = 0;
@@ -5965,11 +6117,14 @@ static void  _slurm_rpc_composite_msg(slurm_msg_t *msg)
 	static int sched_timeout = 0;
 	static int active_rpc_cnt = 0;
 	struct timeval start_tv;
-	bool run_scheduler = false;
+	bool run_scheduler = false, samples_locked = false;
 	composite_msg_t *comp_msg, comp_resp_msg;
 	/* Locks: Read configuration, write job, write node */
 	slurmctld_lock_t job_write_lock = {
 		READ_LOCK, WRITE_LOCK, WRITE_LOCK, NO_LOCK, NO_LOCK };
+	/* Locks: Read node */
+	slurmctld_lock_t node_read_lock = {
+		NO_LOCK, NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
 
 	memset(&comp_resp_msg, 0, sizeof(composite_msg_t));
 	comp_resp_msg.msg_list = list_create(_slurmctld_free_comp_msg_list);
@@ -6008,14 +6163,20 @@ static void  _slurm_rpc_composite_msg(slurm_msg_t *msg)
 		config_update = slurmctld_conf.last_update;
 	}
 
-	_throttle_start(&active_rpc_cnt);
-	lock_slurmctld(job_write_lock);
-	gettimeofday(&start_tv, NULL);
-	_slurm_rpc_comp_msg_list(comp_msg, &run_scheduler,
-				 comp_resp_msg.msg_list, &start_tv,
-				 sched_timeout);
-	unlock_slurmctld(job_write_lock);
-	_throttle_fini(&active_rpc_cnt);
+	_comp_msg_power_samples(comp_msg, &samples_locked);
+	if (samples_locked)
+		unlock_slurmctld(node_read_lock);
+
+	if (comp_msg->msg_list && list_count(comp_msg->msg_list)) {
+		_throttle_start(&active_rpc_cnt);
+		lock_slurmctld(job_write_lock);
+		gettimeofday(&start_tv, NULL);
+		_slurm_rpc_comp_msg_list(comp_msg, &run_scheduler,
+					 comp_resp_msg.msg_list, &start_tv,
+					 sched_timeout);
+		unlock_slurmctld(job_write_lock);
+		_throttle_fini(&active_rpc_cnt);
+	}
 
 	if (list_count(comp_resp_msg.msg_list)) {
 		slurm_msg_t resp_msg;
@@ -6138,6 +6299,8 @@ static void  _slurm_rpc_comp_msg_list(composite_msg_t * comp_msg,
 			_slurm_rpc_node_registration(next_msg, 1);
 			break;
 		default:
+			/* MESSAGE_POWER_SAMPLE was taken out by
+			 * _comp_msg_power_samples() */
 			error("_slurm_rpc_comp_msg_list: invalid msg type");
 			break;
 		}
@@ -94,6 +94,8 @@
 #include "src/slurmctld/power_allocator_plugin.h"
 #include "src/slurmctld/power_analyzer_plugin.h"
 #include "src/slurmctld/power_schedule_slurmd_plugin.h"
+#include "src/slurmctld/power_budget.h"
+#include "src/slurmctld/power_telemetry.h"
 
 #define FEATURE_MAGIC	0x34dfd8b5
 
@@ -1033,8 +1035,11 @@ int read_slurm_conf(int recover, bool reconfig)
 	rehash_node();
 	slurm_topo_build_config();
 	route_g_reconfigure();
-	if (reconfig)
+	if (reconfig) {
 		power_g_reconfig();
+		power_telemetry_reset();	/* node indexes may change */
+		power_budget_reset();
+	}
 	cpu_freq_reconfig();
 
 	rehash_jobs();
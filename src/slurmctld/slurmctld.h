@@ -711,6 +711,18 @@ struct job_record {
 	uint32_t pelog_env_size;	/* element count in pelog_env */
 	uint8_t power_flags;		/* power management flags,
 					 * see SLURM_POWER_FLAGS_ */
+	uint32_t power_pkg_watts;	/* requested package watts per socket,
+					 * zero if none */
+	uint32_t power_dram_watts;	/* requested DRAM watts per socket,
+					 * zero if none */
+	uint32_t power_freq;		/* target CPU frequency in kHz for the
+					 * power allocator, zero if none */
+	uint32_t power_est_watts;	/* watts per node predicted by the
+					 * power analyzer when the job started,
+					 * zero if none */
+	double power_energy;		/* joules attributed from power_knob
+					 * telemetry, see power_energy.h
+					 * (Internal use only, don't save) */
 	time_t pre_sus_time;		/* time job ran prior to last suspend */
 	time_t preempt_time;		/* job preemption signal time */
 	bool preempt_in_progress;	/* Premption of other jobs in progress
@@ -1802,6 +1814,24 @@ extern void pack_all_node (char **buffer_ptr, int *buffer_size,
 			   uint16_t show_flags, uid_t uid,
 			   uint16_t protocol_version);
 
+/*
+ * pack_node_power - dump the power readings of nodes which changed since
+ *	the given times, in machine independent form (for network transmission)
+ * OUT buffer_ptr - pointer to the stored data
+ * OUT buffer_size - set to size of the buffer in bytes
+ * IN watts_since - include power readings taken at or after this time,
+ *	0 for all
+ * IN cache_since - likewise for PMC cache counts
+ * IN protocol_version - slurm protocol version of client
+ * NOTE: the caller must xfree the buffer at *buffer_ptr
+ * NOTE: change slurm_load_node_power() in api/node_info.c when data format
+ *	changes
+ * NOTE: READ lock_slurmctld node before entry
+ */
+extern void pack_node_power(char **buffer_ptr, int *buffer_size,
+			    time_t watts_since, time_t cache_since,
+			    uint16_t protocol_version);
+
 /* Pack all scheduling statistics */
 extern void pack_all_stat(int resp, char **buffer_ptr, int *buffer_size,
 			  uint16_t protocol_version);
@@ -2303,6 +2333,26 @@ extern void update_nodes_acct_gather_data(void);
 extern int update_node_record_acct_gather_data(
 	acct_gather_node_resp_msg_t *msg);
 
+/*
+ * update_node_record_power_knob_current_data - publish a node's power
+ *	readings to the telemetry store
+ * IN msg - node power data message
+ * RET 0 if no error, ENOENT if no such node
+ * NOTE: READ lock_slurmctld node before entry
+ */
+extern int update_node_record_power_knob_current_data(
+	power_knob_get_info_node_resp_msg_t *msg);
+
+/*
+ * update_node_record_power_sample - publish a sample pushed by a node
+ *	(MESSAGE_POWER_SAMPLE) to the telemetry store and the shedding path
+ * IN msg - node power and PMC sample
+ * RET 0 if no error, ENOENT if no such node
+ * NOTE: READ lock_slurmctld node before entry
+ */
+extern int update_node_record_power_sample(
+	power_knob_sample_resp_msg_t *msg);
+
 /*
  * update_part - create or update a partition's configuration data
  * IN part_desc - description of partition changes
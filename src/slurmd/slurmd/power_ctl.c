@@ -0,0 +1,811 @@
+/*****************************************************************************\
+ *  power_ctl.c - node local power budget enforcement for slurmd
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+/*
+ * slurmctld hands each node a power budget once (REQUEST_POWER_SCHEDULE_SLURMD)
+ * and the node keeps itself under it. A PI controller running every
+ * period_msec moves the sum of the package caps so that the measured node
+ * power (packages plus DRAM) tracks the budget. By default DRAM is left
+ * uncapped and absorbed by the package caps: more DRAM power leaves less
+ * for the packages. The package cap total is split between the sockets in
+ * proportion to their load, with sockets sitting at their cap weighted up
+ * so that watts migrate to where they are used.
+ *
+ * With PowerParameters=dram_shift_max the controlled total covers DRAM
+ * too. Each socket's share is split between a DRAM cap and a package cap
+ * by the socket's L3 miss ratio (l3_miss / all_cache_ref): memory bound
+ * sockets move watts to DRAM, compute bound ones back to the package.
+ * Every shift is logged.
+ *
+ * Only aggregate state travels upstream, in the RPC reply, and budget
+ * exceeded episodes are reported to slurmctld as events, at most one every
+ * CTL_EVENT_GAP seconds.
+ *
+ * Independently of any budget, PowerParameters=shed_node_watts starts a
+ * watch thread polling the node power every shed_poll_msec. Crossing the
+ * watermark upwards, and falling back under WATCH_REARM of it, is pushed
+ * to slurmctld at once (REQUEST_POWER_WATERMARK) so that its shedding path
+ * does not have to wait for the next power sweep.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "src/common/log.h"
+#include "src/common/macros.h"
+#include "src/common/power_knob.h"
+#include "src/common/read_config.h"
+#include "src/common/slurm_protocol_api.h"
+#include "src/common/timers.h"
+#include "src/common/xmalloc.h"
+#include "src/slurmd/common/log_ctld.h"
+#include "src/slurmd/slurmd/power_ctl.h"
+#include "src/slurmd/slurmd/slurmd.h"
+
+#define CTL_MAX_SOCKET		2	/* sockets the knob can cap */
+#define CTL_DEFAULT_PERIOD	250	/* msec */
+#define CTL_MIN_PERIOD		50	/* msec */
+#define CTL_MAX_PERIOD		10000	/* msec */
+#define CTL_KP			0.5	/* watts of cap per watt of error */
+#define CTL_KI			2.0	/* same, per second */
+#define CTL_MIN_SOCKET_WATTS	20	/* lowest package cap we set */
+#define CTL_MIN_STEP_WATTS	1	/* smaller cap changes are not pushed */
+#define CTL_UNCAPPED_WATTS	0x7fff	/* clamped to the package maximum */
+#define CTL_SATURATED		0.95	/* load/cap ratio of a capped socket */
+#define CTL_SATURATED_WEIGHT	1.25
+#define CTL_EXCEED_MSEC		1000	/* overshoot long enough to report */
+#define CTL_EVENT_GAP		30	/* seconds between reported events */
+#define WATCH_DEFAULT_POLL	200	/* msec */
+#define WATCH_MIN_POLL		20	/* msec */
+#define WATCH_REARM		0.95	/* of the watermark */
+#define SHIFT_EWMA		0.3	/* weight of a new miss ratio sample */
+#define SHIFT_DEFAULT_MIN	8	/* watts, lowest DRAM cap */
+#define SHIFT_DEFAULT_STEP	4	/* watts moved per shift */
+#define SHIFT_DEFAULT_HOLD	2000	/* msec between shifts of a socket */
+#define SHIFT_DEFAULT_HIGH	30	/* percent, memory bound at or above */
+#define SHIFT_DEFAULT_LOW	10	/* percent, compute bound at or below */
+
+enum {
+	SHIFT_PHASE_NONE,		/* not classified yet */
+	SHIFT_PHASE_COMPUTE,
+	SHIFT_PHASE_MEMORY
+};
+
+typedef struct {
+	double ratio;			/* smoothed L3 miss ratio, < 0 if
+					 * not sampled yet */
+	int phase;			/* SHIFT_PHASE_* */
+	uint32_t dram_cap;		/* watts */
+	struct timespec last;		/* last shift, CLOCK_MONOTONIC */
+} shift_socket_t;
+
+static pthread_mutex_t ctl_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ctl_cond;
+static pthread_cond_t report_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t ctl_thread = 0;
+static pthread_t report_thread = 0;
+static pthread_cond_t watch_cond;
+static pthread_t watch_thread = 0;
+static bool ctl_stop = false;
+static bool ctl_changed = false;
+
+/* Protected by ctl_mutex */
+static uint32_t node_watts = 0;		/* budget, 0 if not enforced */
+static uint32_t period_msec = CTL_DEFAULT_PERIOD;
+static uint32_t cap_watts = 0;		/* package caps in force */
+static uint64_t sum_watts = 0;		/* statistics since last report */
+static uint32_t sample_cnt = 0;
+static uint32_t peak_watts = 0;
+static uint32_t exceeded_cnt = 0;
+static uint32_t report_cnt = 0;		/* episodes not yet sent as events */
+static uint32_t report_watts = 0;	/* worst overshoot among them */
+
+/* Set by power_ctl_init() before the watch thread starts */
+static uint32_t watch_watts = 0;	/* watermark, 0 if not watched */
+static uint32_t watch_msec = WATCH_DEFAULT_POLL;
+
+/* Set by power_ctl_init(), DRAM budget shifting is off if shift_max is 0 */
+static uint32_t shift_min = SHIFT_DEFAULT_MIN;
+static uint32_t shift_max = 0;
+static uint32_t shift_step = SHIFT_DEFAULT_STEP;
+static uint32_t shift_hold_msec = SHIFT_DEFAULT_HOLD;
+static uint32_t shift_high = SHIFT_DEFAULT_HIGH;
+static uint32_t shift_low = SHIFT_DEFAULT_LOW;
+
+static double _ts_diff_sec(struct timespec *a, struct timespec *b)
+{
+	return (double) (a->tv_sec - b->tv_sec) +
+	       (double) (a->tv_nsec - b->tv_nsec) / 1e9;
+}
+
+/* dram_caps may be NULL to leave the DRAM caps as they are */
+static void _set_caps(uint32_t *caps, uint32_t *dram_caps,
+		      uint16_t socket_cnt)
+{
+	power_knob_cap_req_msg_t req;
+
+	memset(&req, 0, sizeof(req));
+	req.cap_info = caps[0];
+	req.cap_info2 = (socket_cnt > 1) ? caps[1] : caps[0];
+	if (dram_caps) {
+		req.dram_cap_info = dram_caps[0];
+		req.dram_cap_info2 = (socket_cnt > 1) ?
+				     dram_caps[1] : dram_caps[0];
+	}
+	power_knob_g_set_data(&req);
+}
+
+/* Give the watts back, the DRAM ones too if shifting capped DRAM */
+static void _release_caps(uint16_t socket_cnt, bool shifting)
+{
+	uint32_t caps[CTL_MAX_SOCKET], dram_caps[CTL_MAX_SOCKET];
+	int i;
+
+	for (i = 0; i < socket_cnt; i++) {
+		caps[i] = CTL_UNCAPPED_WATTS;
+		dram_caps[i] = NO_VAL;
+	}
+	_set_caps(caps, shifting ? dram_caps : NULL, socket_cnt);
+}
+
+/*
+ * Split the cap total between the sockets. Every socket gets min_watts,
+ * the rest goes by observed load.
+ */
+static void _split_caps(double total, double *load, uint32_t *last,
+			uint32_t min_watts, uint16_t socket_cnt,
+			uint32_t *caps)
+{
+	double weight[CTL_MAX_SOCKET], weight_sum = 0.0, spare;
+	int i;
+
+	for (i = 0; i < socket_cnt; i++) {
+		weight[i] = MAX(load[i], 1.0);
+		if (last[i] && (load[i] >= (double) last[i] * CTL_SATURATED))
+			weight[i] *= CTL_SATURATED_WEIGHT;
+		weight_sum += weight[i];
+	}
+
+	spare = total - (double) (min_watts * socket_cnt);
+	if (spare < 0.0)
+		spare = 0.0;
+	for (i = 0; i < socket_cnt; i++) {
+		caps[i] = min_watts +
+			  (uint32_t) (spare * weight[i] / weight_sum);
+	}
+}
+
+static void _shift_reset(shift_socket_t *shift, uint16_t socket_cnt,
+			 struct timespec *now)
+{
+	int i;
+
+	for (i = 0; i < socket_cnt; i++) {
+		shift[i].ratio = -1.0;
+		shift[i].phase = SHIFT_PHASE_NONE;
+		shift[i].dram_cap = (shift_min + shift_max) / 2;
+		shift[i].last = *now;
+	}
+}
+
+/*
+ * Move the DRAM cap of each socket towards the end of its range that the
+ * socket's phase calls for. The phase only flips once the smoothed miss
+ * ratio crosses the far threshold, so a ratio hovering around one of them
+ * does not make the watts oscillate, and a socket moves at most
+ * shift_step watts every shift_hold_msec.
+ */
+static void _shift_dram(shift_socket_t *shift, cache_ref_t *cache,
+			uint16_t socket_cnt, struct timespec *now)
+{
+	uint32_t target, old_cap;
+	double ratio;
+	int i;
+
+	for (i = 0; i < socket_cnt; i++) {
+		if (cache[i].all_cache_ref) {
+			ratio = (double) cache[i].l3_miss /
+				(double) cache[i].all_cache_ref;
+			ratio = MIN(ratio, 1.0);
+			if (shift[i].ratio < 0.0)
+				shift[i].ratio = ratio;
+			else
+				shift[i].ratio += SHIFT_EWMA *
+						  (ratio - shift[i].ratio);
+		}
+		if (shift[i].ratio < 0.0)
+			continue;
+
+		if (shift[i].ratio * 100.0 >= (double) shift_high)
+			shift[i].phase = SHIFT_PHASE_MEMORY;
+		else if (shift[i].ratio * 100.0 <= (double) shift_low)
+			shift[i].phase = SHIFT_PHASE_COMPUTE;
+		if (shift[i].phase == SHIFT_PHASE_MEMORY)
+			target = shift_max;
+		else if (shift[i].phase == SHIFT_PHASE_COMPUTE)
+			target = shift_min;
+		else
+			continue;
+
+		if ((shift[i].dram_cap == target) ||
+		    (_ts_diff_sec(now, &shift[i].last) * 1000.0 <
+		     (double) shift_hold_msec))
+			continue;
+		old_cap = shift[i].dram_cap;
+		if (target > old_cap)
+			shift[i].dram_cap = MIN(target, old_cap + shift_step);
+		else
+			shift[i].dram_cap = MAX(target, old_cap - shift_step);
+		shift[i].last = *now;
+		info("power_ctl: socket %d %s bound, l3 miss ratio %.3f, "
+		     "dram cap %u -> %u W", i,
+		     (shift[i].phase == SHIFT_PHASE_MEMORY) ?
+		     "memory" : "compute", shift[i].ratio, old_cap,
+		     shift[i].dram_cap);
+	}
+}
+
+static void *_report_loop(void *arg)
+{
+	char msg[128];
+	uint32_t cnt, watts, budget;
+	time_t last_event = 0;
+	struct timespec until;
+
+	slurm_mutex_lock(&ctl_mutex);
+	while (!ctl_stop) {
+		if (!report_cnt) {
+			pthread_cond_wait(&report_cond, &ctl_mutex);
+			continue;
+		}
+		if (time(NULL) < (last_event + CTL_EVENT_GAP)) {
+			/* let episodes accumulate into one event */
+			until.tv_sec = last_event + CTL_EVENT_GAP;
+			until.tv_nsec = 0;
+			pthread_cond_timedwait(&report_cond, &ctl_mutex,
+					       &until);
+			continue;
+		}
+
+		cnt = report_cnt;
+		watts = report_watts;
+		budget = node_watts;
+		report_cnt = 0;
+		report_watts = 0;
+		slurm_mutex_unlock(&ctl_mutex);
+
+		snprintf(msg, sizeof(msg),
+			 "node power budget %u W exceeded %u time(s), "
+			 "peak %u W", budget, cnt, watts);
+		(void) log_ctld(LOG_LEVEL_INFO, msg);
+		last_event = time(NULL);
+
+		slurm_mutex_lock(&ctl_mutex);
+	}
+	slurm_mutex_unlock(&ctl_mutex);
+
+	return NULL;
+}
+
+/*
+ * Velocity form PI controller on the cap total, packages only or packages
+ * plus DRAM when shifting. Clamping the output is all the anti-windup it
+ * needs: the integral lives in the output itself.
+ */
+static void *_ctl_loop(void *arg)
+{
+	power_current_data_t *power = NULL;
+	cache_ref_t *cache = NULL;
+	shift_socket_t shift[CTL_MAX_SOCKET];
+	struct timespec next, now, last;
+	uint32_t caps[CTL_MAX_SOCKET], last_caps[CTL_MAX_SOCKET];
+	uint32_t share[CTL_MAX_SOCKET], last_share[CTL_MAX_SOCKET];
+	uint32_t dram_caps[CTL_MAX_SOCKET], last_dram[CTL_MAX_SOCKET];
+	uint32_t budget = 0, period, watts, over_msec = 0, min_share;
+	double load[CTL_MAX_SOCKET], total, absorbed, err, prev_err = 0.0;
+	double cap_total = 0.0, floor_watts, dt, dram;
+	uint16_t knob_cnt = 0, socket_cnt;
+	bool episode = false, fresh = true, push, shifting;
+	int i;
+
+	power_knob_g_get_data(POWER_KNOB_DATA_SOCKET_CNT, &knob_cnt);
+	if (!knob_cnt) {
+		error("power_ctl: no power knob sockets, not enforcing budgets");
+		return NULL;
+	}
+	power = power_knob_current_alloc(knob_cnt);
+	socket_cnt = MIN(knob_cnt, CTL_MAX_SOCKET);
+	shifting = (shift_max != 0);
+	min_share = CTL_MIN_SOCKET_WATTS;
+	if (shifting) {
+		cache = power_knob_cache_alloc(knob_cnt);
+		min_share += shift_min;
+	}
+	floor_watts = (double) (min_share * socket_cnt);
+	memset(last_caps, 0, sizeof(last_caps));
+	memset(last_share, 0, sizeof(last_share));
+	memset(last_dram, 0, sizeof(last_dram));
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	last = next;
+	_shift_reset(shift, socket_cnt, &next);
+	slurm_mutex_lock(&ctl_mutex);
+	while (!ctl_stop) {
+		if (ctl_changed) {
+			ctl_changed = false;
+			if (!node_watts && budget) {
+				/* budget withdrawn, give the watts back */
+				_release_caps(socket_cnt, shifting);
+				memset(last_caps, 0, sizeof(last_caps));
+				memset(last_share, 0, sizeof(last_share));
+				memset(last_dram, 0, sizeof(last_dram));
+				cap_watts = 0;
+			}
+			budget = node_watts;
+			fresh = true;
+			prev_err = 0.0;
+			over_msec = 0;
+			episode = false;
+			clock_gettime(CLOCK_MONOTONIC, &next);
+			last = next;
+			_shift_reset(shift, socket_cnt, &next);
+		}
+		if (!budget) {
+			pthread_cond_wait(&ctl_cond, &ctl_mutex);
+			continue;
+		}
+
+		period = period_msec;
+		slurm_ts_add_msec(&next, period);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (!slurm_ts_before(&now, &next)) {
+			/* overran a whole period, resynchronize */
+			next = now;
+			slurm_ts_add_msec(&next, period);
+		}
+		while (!ctl_stop && !ctl_changed) {
+			if (pthread_cond_timedwait(&ctl_cond, &ctl_mutex,
+						   &next) == ETIMEDOUT)
+				break;
+		}
+		if (ctl_stop || ctl_changed)
+			continue;
+		slurm_mutex_unlock(&ctl_mutex);
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		dt = _ts_diff_sec(&now, &last);
+		last = now;
+
+		power_knob_g_get_data(POWER_KNOB_DATA_NODE_POWER, power);
+		total = 0.0;
+		absorbed = 0.0;		/* power the caps do not cover */
+		for (i = 0; i < knob_cnt; i++) {
+			dram = (double) power[i].dram_current_watts;
+			total += (double) power[i].cpu_current_watts + dram;
+			if (i >= socket_cnt) {
+				/* uncappable sockets only count */
+				absorbed += dram;
+				continue;
+			}
+			load[i] = (double) power[i].cpu_current_watts;
+			if (shifting)
+				load[i] += dram;
+			else
+				absorbed += dram;
+		}
+
+		err = (double) budget - total;
+		if (fresh) {
+			/* first period under this budget */
+			cap_total = (double) budget - absorbed;
+			fresh = false;
+		} else {
+			cap_total += CTL_KP * (err - prev_err) +
+				     CTL_KI * dt * err;
+		}
+		prev_err = err;
+		cap_total = MIN(cap_total, (double) budget);
+		cap_total = MAX(cap_total, floor_watts);
+
+		if (shifting) {
+			/* each socket share is DRAM cap plus package cap */
+			_split_caps(cap_total, load, last_share, min_share,
+				    socket_cnt, share);
+			if (power_knob_g_get_cache_data(
+				    CACHE_POWER_KNOB_DATA_NODE_POWER, cache) ==
+			    SLURM_SUCCESS)
+				_shift_dram(shift, cache, socket_cnt, &now);
+			for (i = 0; i < socket_cnt; i++) {
+				dram_caps[i] = MIN(shift[i].dram_cap,
+						   share[i] -
+						   CTL_MIN_SOCKET_WATTS);
+				caps[i] = share[i] - dram_caps[i];
+			}
+		} else {
+			_split_caps(cap_total, load, last_caps,
+				    CTL_MIN_SOCKET_WATTS, socket_cnt, caps);
+		}
+		push = false;
+		for (i = 0; i < socket_cnt; i++) {
+			if ((caps[i] >= last_caps[i] + CTL_MIN_STEP_WATTS) ||
+			    (caps[i] + CTL_MIN_STEP_WATTS <= last_caps[i]))
+				push = true;
+			if (shifting && (dram_caps[i] != last_dram[i]))
+				push = true;
+		}
+		if (push) {
+			_set_caps(caps, shifting ? dram_caps : NULL,
+				  socket_cnt);
+			memcpy(last_caps, caps, sizeof(last_caps));
+			if (shifting) {
+				memcpy(last_share, share, sizeof(last_share));
+				memcpy(last_dram, dram_caps,
+				       sizeof(last_dram));
+			}
+		} else {
+			/* keep the sampler at its fast rate */
+			power_knob_g_refresh();
+		}
+
+		watts = (uint32_t) (total + 0.5);
+		slurm_mutex_lock(&ctl_mutex);
+		if (ctl_changed)
+			continue;
+		cap_watts = 0;
+		for (i = 0; i < socket_cnt; i++)
+			cap_watts += last_caps[i];
+		sum_watts += watts;
+		sample_cnt++;
+		peak_watts = MAX(peak_watts, watts);
+
+		if (watts > budget + MAX(2, budget / 50)) {
+			over_msec += period;
+			if (!episode && (over_msec >= CTL_EXCEED_MSEC)) {
+				episode = true;
+				exceeded_cnt++;
+				report_cnt++;
+				pthread_cond_signal(&report_cond);
+			}
+			if (episode)
+				report_watts = MAX(report_watts, watts);
+		} else if (watts <= budget) {
+			over_msec = 0;
+			episode = false;
+		}
+	}
+	slurm_mutex_unlock(&ctl_mutex);
+
+	if (budget) {
+		/* give the watts back on the way out */
+		_release_caps(socket_cnt, shifting);
+	}
+	power_knob_current_destroy(power);
+	if (cache)
+		power_knob_cache_destroy(cache);
+	return NULL;
+}
+
+static void _send_watermark(uint32_t watts)
+{
+	power_watermark_msg_t req;
+	slurm_msg_t msg;
+
+	slurm_msg_t_init(&msg);
+	req.node_name = conf->node_name;
+	req.watts = watts;
+	req.watermark = watch_watts;
+	msg.msg_type = REQUEST_POWER_WATERMARK;
+	msg.data = &req;
+	if (slurm_send_only_controller_msg(&msg) < 0)
+		error("power_ctl: unable to send watermark event: %m");
+}
+
+static void *_watch_loop(void *arg)
+{
+	power_current_data_t *power = NULL;
+	struct timespec next, now;
+	uint32_t watts, rearm;
+	uint16_t knob_cnt = 0;
+	double total;
+	bool above = false;
+	int i;
+
+	power_knob_g_get_data(POWER_KNOB_DATA_SOCKET_CNT, &knob_cnt);
+	if (!knob_cnt) {
+		error("power_ctl: no power knob sockets, not watching power");
+		return NULL;
+	}
+	power = power_knob_current_alloc(knob_cnt);
+	rearm = (uint32_t) ((double) watch_watts * WATCH_REARM);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	slurm_mutex_lock(&ctl_mutex);
+	while (!ctl_stop) {
+		slurm_ts_add_msec(&next, watch_msec);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (!slurm_ts_before(&now, &next)) {
+			next = now;
+			slurm_ts_add_msec(&next, watch_msec);
+		}
+		while (!ctl_stop) {
+			if (pthread_cond_timedwait(&watch_cond, &ctl_mutex,
+						   &next) == ETIMEDOUT)
+				break;
+		}
+		if (ctl_stop)
+			break;
+		slurm_mutex_unlock(&ctl_mutex);
+
+		power_knob_g_refresh();
+		power_knob_g_get_data(POWER_KNOB_DATA_NODE_POWER, power);
+		total = 0.0;
+		for (i = 0; i < knob_cnt; i++) {
+			total += power[i].cpu_current_watts;
+			total += power[i].dram_current_watts;
+		}
+		watts = (uint32_t) (total + 0.5);
+
+		/* hysteresis keeps a node hovering at the mark quiet */
+		if (!above && (watts > watch_watts)) {
+			above = true;
+			_send_watermark(watts);
+		} else if (above && (watts < rearm)) {
+			above = false;
+			_send_watermark(watts);
+		}
+
+		slurm_mutex_lock(&ctl_mutex);
+	}
+	slurm_mutex_unlock(&ctl_mutex);
+
+	power_knob_current_destroy(power);
+	return NULL;
+}
+
+static int _start_threads(void)
+{
+	pthread_attr_t attr;
+	pthread_condattr_t cond_attr;
+
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&ctl_cond, &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+
+	slurm_attr_init(&attr);
+	if (pthread_create(&ctl_thread, &attr, _ctl_loop, NULL)) {
+		error("power_ctl: pthread_create: %m");
+		ctl_thread = 0;
+		slurm_attr_destroy(&attr);
+		pthread_cond_destroy(&ctl_cond);
+		return SLURM_ERROR;
+	}
+	if (pthread_create(&report_thread, &attr, _report_loop, NULL)) {
+		/* events are lost but the budget is still enforced */
+		error("power_ctl: pthread_create: %m");
+		report_thread = 0;
+	}
+	slurm_attr_destroy(&attr);
+
+	return SLURM_SUCCESS;
+}
+
+/* parse a "<key><value>" PowerParameters option, keep *value if absent */
+static void _read_param(char *power_params, char *key, long min_val,
+			long max_val, uint32_t *value)
+{
+	char *tmp, *end;
+	long val;
+
+	if (!(tmp = strstr(power_params, key)))
+		return;
+	val = strtol(tmp + strlen(key), &end, 10);
+	if ((end == tmp + strlen(key)) || (val < min_val) || (val > max_val))
+		error("PowerParameters: %s%ld invalid", key, val);
+	else
+		*value = (uint32_t) val;
+}
+
+static void _read_shift_params(char *power_params)
+{
+	_read_param(power_params, "dram_shift_max=", 0, 1000, &shift_max);
+	if (!shift_max)
+		return;
+	_read_param(power_params, "dram_shift_min=", 1, 1000, &shift_min);
+	_read_param(power_params, "dram_shift_step=", 1, 1000, &shift_step);
+	_read_param(power_params, "dram_shift_hold=", CTL_MIN_PERIOD,
+		    3600000, &shift_hold_msec);
+	_read_param(power_params, "dram_shift_high=", 1, 100, &shift_high);
+	_read_param(power_params, "dram_shift_low=", 0, 99, &shift_low);
+	if (shift_min >= shift_max) {
+		error("PowerParameters: dram_shift_min must be below "
+		      "dram_shift_max, not shifting DRAM power");
+		shift_max = 0;
+		return;
+	}
+	if (shift_low >= shift_high) {
+		error("PowerParameters: dram_shift_low must be below "
+		      "dram_shift_high, using %u and %u",
+		      SHIFT_DEFAULT_LOW, SHIFT_DEFAULT_HIGH);
+		shift_low = SHIFT_DEFAULT_LOW;
+		shift_high = SHIFT_DEFAULT_HIGH;
+	}
+	debug("power_ctl: dram caps %u-%u W, shifted %u W at most every "
+	      "%u msec, l3 miss ratio thresholds %u%%/%u%%", shift_min,
+	      shift_max, shift_step, shift_hold_msec, shift_low, shift_high);
+}
+
+extern void power_ctl_init(void)
+{
+	pthread_attr_t attr;
+	pthread_condattr_t cond_attr;
+	char *power_params, *tmp_ptr;
+	long val;
+
+	power_params = slurm_get_power_parameters();
+	if (!power_params)
+		return;
+	/*                                   1234567890123456 */
+	if ((tmp_ptr = strstr(power_params, "shed_node_watts="))) {
+		val = strtol(tmp_ptr + 16, NULL, 10);
+		if (val < 0)
+			error("PowerParameters: shed_node_watts=%ld invalid",
+			      val);
+		else
+			watch_watts = (uint32_t) val;
+	}
+	/*                                   123456789012345 */
+	if ((tmp_ptr = strstr(power_params, "shed_poll_msec="))) {
+		val = strtol(tmp_ptr + 15, NULL, 10);
+		if (val < WATCH_MIN_POLL)
+			error("PowerParameters: shed_poll_msec=%ld invalid",
+			      val);
+		else
+			watch_msec = (uint32_t) val;
+	}
+	_read_shift_params(power_params);
+	xfree(power_params);
+	if (!watch_watts)
+		return;
+
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&watch_cond, &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+
+	slurm_mutex_lock(&ctl_mutex);
+	slurm_attr_init(&attr);
+	if (pthread_create(&watch_thread, &attr, _watch_loop, NULL)) {
+		error("power_ctl: pthread_create: %m");
+		watch_thread = 0;
+		pthread_cond_destroy(&watch_cond);
+	} else {
+		debug("power_ctl: watching for %u W every %u msec",
+		      watch_watts, watch_msec);
+	}
+	slurm_attr_destroy(&attr);
+	slurm_mutex_unlock(&ctl_mutex);
+}
+
+extern int power_ctl_set_budget(uint32_t watts, uint32_t msec)
+{
+	int rc = SLURM_SUCCESS;
+
+	if (msec == 0)
+		msec = CTL_DEFAULT_PERIOD;
+	msec = MAX(msec, CTL_MIN_PERIOD);
+	msec = MIN(msec, CTL_MAX_PERIOD);
+
+	slurm_mutex_lock(&ctl_mutex);
+	if (!ctl_thread && !watts) {
+		slurm_mutex_unlock(&ctl_mutex);
+		return SLURM_SUCCESS;
+	}
+	if (!ctl_thread && !ctl_stop)
+		rc = _start_threads();
+	if ((watts != node_watts) || (msec != period_msec)) {
+		debug("power_ctl: node budget %u W, period %u msec",
+		      watts, msec);
+		node_watts = watts;
+		period_msec = msec;
+		ctl_changed = true;
+		if (ctl_thread)
+			pthread_cond_signal(&ctl_cond);
+	}
+	slurm_mutex_unlock(&ctl_mutex);
+
+	return rc;
+}
+
+extern void power_ctl_get_state(power_schedule_slurmd_resp_msg_t *resp)
+{
+	slurm_mutex_lock(&ctl_mutex);
+	resp->node_watts = node_watts;
+	resp->cap_watts = cap_watts;
+	resp->avg_watts = sample_cnt ? (uint32_t) (sum_watts / sample_cnt) : 0;
+	resp->peak_watts = peak_watts;
+	resp->exceeded_cnt = exceeded_cnt;
+	sum_watts = 0;
+	sample_cnt = 0;
+	peak_watts = 0;
+	exceeded_cnt = 0;
+	slurm_mutex_unlock(&ctl_mutex);
+}
+
+extern void power_ctl_fini(void)
+{
+	pthread_t ctl, report, watch;
+
+	slurm_mutex_lock(&ctl_mutex);
+	ctl = ctl_thread;
+	report = report_thread;
+	watch = watch_thread;
+	if (!ctl && !watch) {
+		slurm_mutex_unlock(&ctl_mutex);
+		return;
+	}
+	ctl_stop = true;
+	if (ctl)
+		pthread_cond_signal(&ctl_cond);
+	if (watch)
+		pthread_cond_signal(&watch_cond);
+	pthread_cond_signal(&report_cond);
+	slurm_mutex_unlock(&ctl_mutex);
+
+	if (ctl)
+		pthread_join(ctl, NULL);
+	if (report)
+		pthread_join(report, NULL);
+	if (watch)
+		pthread_join(watch, NULL);
+
+	slurm_mutex_lock(&ctl_mutex);
+	if (ctl)
+		pthread_cond_destroy(&ctl_cond);
+	if (watch)
+		pthread_cond_destroy(&watch_cond);
+	ctl_thread = 0;
+	report_thread = 0;
+	watch_thread = 0;
+	slurm_mutex_unlock(&ctl_mutex);
+}
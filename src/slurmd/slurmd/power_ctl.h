@@ -0,0 +1,73 @@
+/*****************************************************************************\
+ *  power_ctl.h - node local power budget enforcement for slurmd
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _SLURMD_POWER_CTL_H
+#define _SLURMD_POWER_CTL_H
+
+#include "slurm/slurm.h"
+
+/*
+ * power_ctl_init - read PowerParameters, including the DRAM budget
+ *	shifting ones, and start watching the node power against
+ *	shed_node_watts if it is set. Call once the power knob is configured.
+ */
+extern void power_ctl_init(void);
+
+/*
+ * power_ctl_set_budget - enforce a node power budget from now on
+ * IN node_watts - budget for the whole node (packages plus DRAM), 0 to
+ *	stop enforcing and release the package caps
+ * IN period_msec - control period, 0 for the default
+ * RET SLURM_SUCCESS or SLURM_ERROR if the controller could not start
+ *
+ * The controller thread is started on the first budget and keeps running
+ * until power_ctl_fini(). Only a changed budget needs to be sent again.
+ */
+extern int power_ctl_set_budget(uint32_t node_watts, uint32_t period_msec);
+
+/*
+ * power_ctl_get_state - report the controller state and reset the
+ *	statistics gathered since the previous report
+ * OUT resp - aggregate state to send upstream
+ */
+extern void power_ctl_get_state(power_schedule_slurmd_resp_msg_t *resp);
+
+/* power_ctl_fini - stop the controller and the watch thread, and release
+ *	the package caps, and the DRAM caps if budget shifting set them */
+extern void power_ctl_fini(void);
+
+#endif /* !_SLURMD_POWER_CTL_H */
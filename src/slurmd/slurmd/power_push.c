@@ -0,0 +1,235 @@
+/*****************************************************************************\
+ *  power_push.c - push mode power telemetry from slurmd
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+/*
+ * With PowerParameters=telemetry_push_msec, slurmd sends its power and PMC
+ * samples to slurmctld on its own clock instead of waiting to be swept.
+ * Each sample is a MESSAGE_POWER_SAMPLE with no reply. If message
+ * aggregation is enabled (MsgAggregationParams), the samples go through
+ * msg_aggr, so the collector nodes batch those of many nodes into one
+ * MESSAGE_COMPOSITE; otherwise each is sent straight to the controller.
+ * slurmctld publishes them to its telemetry store and its sweeps only
+ * query the nodes whose pushed samples went stale.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "src/common/log.h"
+#include "src/common/macros.h"
+#include "src/common/msg_aggr.h"
+#include "src/common/power_knob.h"
+#include "src/common/read_config.h"
+#include "src/common/slurm_protocol_api.h"
+#include "src/common/timers.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+#include "src/slurmd/slurmd/power_push.h"
+#include "src/slurmd/slurmd/slurmd.h"
+
+#define PUSH_MIN_MSEC	100
+
+static pthread_mutex_t push_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t push_cond;
+static pthread_t push_thread = 0;
+static bool push_stop = false;
+static uint32_t push_msec = 0;		/* 0 if not pushing */
+
+static pthread_mutex_t seq_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t sample_seq = 0;		/* shared by pushed and swept samples */
+
+extern void power_push_sample(power_knob_sample_resp_msg_t *msg,
+			      uint32_t req_seq)
+{
+	struct timespec now;
+	uint16_t socket_cnt = 0, cache_socket_cnt = 0;
+
+	power_knob_g_get_data(POWER_KNOB_DATA_SOCKET_CNT, &socket_cnt);
+	power_knob_g_get_cache_data(CACHE_POWER_KNOB_DATA_SOCKET_CNT,
+				    &cache_socket_cnt);
+
+	memset(msg, 0, sizeof(power_knob_sample_resp_msg_t));
+	msg->node_name = conf->node_name;
+	slurm_mutex_lock(&seq_mutex);
+	msg->seq = ++sample_seq;
+	slurm_mutex_unlock(&seq_mutex);
+	msg->req_seq = req_seq;
+
+	msg->socket_cnt = socket_cnt;
+	msg->power_info = power_knob_current_alloc(socket_cnt);
+	msg->cache_socket_cnt = cache_socket_cnt;
+	msg->perf_info = power_knob_cache_alloc(cache_socket_cnt);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	power_knob_g_get_data(POWER_KNOB_DATA_NODE_POWER, msg->power_info);
+	power_knob_g_get_cache_data(CACHE_POWER_KNOB_DATA_NODE_POWER,
+				    msg->perf_info);
+	msg->sample_usec = (uint64_t) now.tv_sec * 1000000 +
+			   now.tv_nsec / 1000;
+}
+
+static void _push_one(void)
+{
+	power_knob_sample_resp_msg_t *sample_msg;
+	slurm_msg_t *msg;
+
+	sample_msg = xmalloc(sizeof(power_knob_sample_resp_msg_t));
+	power_push_sample(sample_msg, 0);
+	/* freed with the message, which may outlive conf->node_name */
+	sample_msg->node_name = xstrdup(conf->node_name);
+
+	if (conf->msg_aggr_window_msgs > 1) {
+		/* message aggregation is enabled, it frees msg */
+		msg = xmalloc(sizeof(slurm_msg_t));
+		slurm_msg_t_init(msg);
+		msg->msg_type = MESSAGE_POWER_SAMPLE;
+		msg->protocol_version = SLURM_PROTOCOL_VERSION;
+		msg->data = sample_msg;
+		msg_aggr_add_msg(msg, 0, NULL);
+	} else {
+		slurm_msg_t req_msg;
+
+		slurm_msg_t_init(&req_msg);
+		req_msg.msg_type = MESSAGE_POWER_SAMPLE;
+		req_msg.data = sample_msg;
+		if (slurm_send_only_controller_msg(&req_msg) < 0)
+			debug("power_push: unable to send sample: %m");
+		slurm_free_power_knob_sample_resp_msg(sample_msg);
+	}
+}
+
+static void *_push_loop(void *arg)
+{
+	struct timespec next, now;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	slurm_mutex_lock(&push_mutex);
+	while (!push_stop) {
+		slurm_ts_add_msec(&next, push_msec);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (!slurm_ts_before(&now, &next)) {
+			/* overran a whole period, resynchronize */
+			next = now;
+			slurm_ts_add_msec(&next, push_msec);
+		}
+		while (!push_stop) {
+			if (pthread_cond_timedwait(&push_cond, &push_mutex,
+						   &next) == ETIMEDOUT)
+				break;
+		}
+		if (push_stop)
+			break;
+		slurm_mutex_unlock(&push_mutex);
+
+		_push_one();
+
+		slurm_mutex_lock(&push_mutex);
+	}
+	slurm_mutex_unlock(&push_mutex);
+
+	return NULL;
+}
+
+extern void power_push_init(void)
+{
+	pthread_attr_t attr;
+	pthread_condattr_t cond_attr;
+	char *power_params, *tmp_ptr;
+	long val;
+
+	power_params = slurm_get_power_parameters();
+	if (!power_params)
+		return;
+	/*                                   12345678901234567890 */
+	if ((tmp_ptr = strstr(power_params, "telemetry_push_msec="))) {
+		val = strtol(tmp_ptr + 20, NULL, 10);
+		if ((val != 0) && (val < PUSH_MIN_MSEC)) {
+			error("PowerParameters: telemetry_push_msec=%ld invalid",
+			      val);
+		} else
+			push_msec = (uint32_t) val;
+	}
+	xfree(power_params);
+	if (!push_msec)
+		return;
+
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&push_cond, &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+
+	slurm_mutex_lock(&push_mutex);
+	slurm_attr_init(&attr);
+	if (pthread_create(&push_thread, &attr, _push_loop, NULL)) {
+		error("power_push: pthread_create: %m");
+		push_thread = 0;
+		pthread_cond_destroy(&push_cond);
+	} else {
+		debug("power_push: pushing samples every %u msec%s",
+		      push_msec, (conf->msg_aggr_window_msgs > 1) ?
+		      " through message aggregation" : "");
+	}
+	slurm_attr_destroy(&attr);
+	slurm_mutex_unlock(&push_mutex);
+}
+
+extern void power_push_fini(void)
+{
+	pthread_t thread;
+
+	slurm_mutex_lock(&push_mutex);
+	thread = push_thread;
+	if (!thread) {
+		slurm_mutex_unlock(&push_mutex);
+		return;
+	}
+	push_stop = true;
+	pthread_cond_signal(&push_cond);
+	slurm_mutex_unlock(&push_mutex);
+
+	pthread_join(thread, NULL);
+
+	slurm_mutex_lock(&push_mutex);
+	push_thread = 0;
+	pthread_cond_destroy(&push_cond);
+	slurm_mutex_unlock(&push_mutex);
+}
@@ -0,0 +1,62 @@
+/*****************************************************************************\
+ *  power_push.h - push mode power telemetry from slurmd
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _SLURMD_POWER_PUSH_H
+#define _SLURMD_POWER_PUSH_H
+
+#include "slurm/slurm.h"
+
+/*
+ * power_push_sample - read socket power and PMC counts back to back
+ * OUT msg - filled in, node_name points at conf->node_name. Release the
+ *	arrays with power_knob_current_destroy() / power_knob_cache_destroy()
+ * IN req_seq - sweep sequence number answered, 0 for a pushed sample
+ */
+extern void power_push_sample(power_knob_sample_resp_msg_t *msg,
+			      uint32_t req_seq);
+
+/*
+ * power_push_init - read PowerParameters and, if telemetry_push_msec is
+ *	set, start pushing samples to slurmctld on that period. Call once
+ *	the power knob and message aggregation are configured.
+ */
+extern void power_push_init(void);
+
+/* power_push_fini - stop pushing samples */
+extern void power_push_fini(void);
+
+#endif /* !_SLURMD_POWER_PUSH_H */
@@ -95,6 +95,8 @@
 #include "src/bcast/file_bcast.h"
 
 #include "src/slurmd/slurmd/get_mach_stat.h"
+#include "src/slurmd/slurmd/power_ctl.h"
+#include "src/slurmd/slurmd/power_push.h"
 #include "src/slurmd/slurmd/slurmd.h"
 
 #include "src/slurmd/common/job_container_plugin.h"
@@ -214,10 +216,12 @@ static int _rpc_power_knob_get_info(slurm_msg_t *msg);
 static int _rpc_power_knob_get_cache_info(slurm_msg_t *msg);
 static int _rpc_power_knob_set(slurm_msg_t *msg);
 static int _rpc_power_knob_cap(slurm_msg_t *msg);
+static int _rpc_power_knob_sample(slurm_msg_t *msg);
+
+static int _rpc_power_cap_nodes(slurm_msg_t *msg);
 
 static int _rpc_power_schedule_slurmd(slurm_msg_t *msg);
 
-static int do_power_schedule_slurmd();
 
 
 static bool _pause_for_job_completion(uint32_t jobid, char *nodes,
@@ -453,6 +457,14 @@ slurmd_req(slurm_msg_t *msg)
 		slurm_free_power_knob_cap_req_msg(msg->data);
 		break;		
 
+	case REQUEST_POWER_KNOB_SAMPLE:
+		debug3("Processing RPC: REQUEST_POWER_KNOB_SAMPLE");
+		_rpc_power_knob_sample(msg);
+		break;
+	case REQUEST_POWER_CAP_SET_NODES:
+		debug3("Processing RPC: REQUEST_POWER_CAP_SET_NODES");
+		_rpc_power_cap_nodes(msg);
+		break;
 	case REQUEST_POWER_SCHEDULE_SLURMD:
 		debug3("Processing RPC: REQUEST_SCHEDULE_SLURMD_SET");
 		_rpc_power_schedule_slurmd(msg);
@@ -1595,6 +1607,8 @@ _rpc_launch_tasks(slurm_msg_t *msg)
 				      step_hset, msg->protocol_version);
 	debug3("_rpc_launch_tasks: return from _forkexec_slurmstepd");
 	_launch_complete_add(req->job_id);
+	if (errnum == SLURM_SUCCESS)
+		power_knob_g_refresh();	/* watch the step ramp up */
 
     done:
 	if (step_hset)
@@ -2373,6 +2387,8 @@ _rpc_batch_job(slurm_msg_t *msg, bool new_msg)
 
 	slurm_mutex_unlock(&launch_mutex);
 	_launch_complete_add(req->job_id);
+	if (rc == SLURM_SUCCESS)
+		power_knob_g_refresh();	/* watch the job ramp up */
 
 	/* On a busy system, slurmstepd may take a while to respond,
 	 * if the job was cancelled in the interim, run through the
@@ -3312,10 +3328,6 @@ _rpc_power_knob_set(slurm_msg_t *msg)
 
 }
 
-static int do_power_schedule_slurmd()
-{
-	debug ("INSIDE SCHEDULE SLURMD PLUGIN POWER CAP");
-}
 static int
 _rpc_power_knob_cap(slurm_msg_t *msg)
 {
@@ -3385,11 +3397,76 @@ _rpc_power_knob_cap(slurm_msg_t *msg)
 
 
 
+/*
+ * Take the node power budget from slurmctld and answer with the aggregate
+ * state of the local controller. Like REQUEST_POWER_CAP_SET_NODES, one
+ * request carries the budgets of many nodes and each node looks itself up
+ * in node_list. The budget is enforced by power_ctl.c between requests;
+ * resending an unchanged budget only polls the state.
+ */
 static int
 _rpc_power_schedule_slurmd(slurm_msg_t *msg)
 {
+	power_schedule_slurmd_req_msg_t *req = msg->data;
+	power_schedule_slurmd_resp_msg_t resp;
+	slurm_msg_t resp_msg;
+	int rc = SLURM_SUCCESS, inx;
+	uid_t req_uid = g_slurm_auth_get_uid(msg->auth_cred,
+					     slurm_get_auth_info());
+	static bool first_msg = true;
+
+	if (!_slurm_authorized_user(req_uid)) {
+		error("Security violation, power_schedule_slurmd RPC from "
+		      "uid %d", req_uid);
+		if (first_msg) {
+			error("Do you have SlurmUser configured as uid %d?",
+			      req_uid);
+		}
+		rc = ESLURM_USER_ID_MISSING;	/* or bad in this case */
+	}
+	first_msg = false;
 
-	debug("LINH _rpc_power_schedule slurmd running");
+	if (rc == SLURM_SUCCESS) {
+		inx = nodelist_find(req->node_list, conf->node_name);
+		if (inx < 0) {
+			error("%s: node %s not in %s", __func__,
+			      conf->node_name, req->node_list);
+			rc = ESLURM_INVALID_NODE_NAME;
+		} else if (req->watts_cnt == 1) {
+			inx = 0;
+		} else if (inx >= req->watts_cnt) {
+			error("%s: %u budgets for node %d of %s", __func__,
+			      req->watts_cnt, inx, req->node_list);
+			rc = EINVAL;
+		}
+	}
+	if (rc == SLURM_SUCCESS) {
+		rc = power_ctl_set_budget(req->node_watts[inx],
+					  req->period_msec);
+	}
+
+	if (rc != SLURM_SUCCESS) {
+		if (slurm_send_rc_msg(msg, rc) < 0)
+			error("Error responding to power schedule slurmd: %m");
+		return rc;
+	}
+
+	memset(&resp, 0, sizeof(power_schedule_slurmd_resp_msg_t));
+	power_ctl_get_state(&resp);
+
+	slurm_msg_t_copy(&resp_msg, msg);
+	resp_msg.msg_type = RESPONSE_POWER_SCHEDULE_SLURMD;
+	resp_msg.data     = &resp;
+	slurm_send_node_msg(msg->conn_fd, &resp_msg);
+
+	return rc;
+}
+
+
+static int
+_rpc_power_knob_get_info(slurm_msg_t *msg)
+{
+	debug("rpc_power_knob_get_info running");
 	int        rc = SLURM_SUCCESS;
 	uid_t req_uid = g_slurm_auth_get_uid(msg->auth_cred,
 					     slurm_get_auth_info());
@@ -3412,63 +3489,45 @@ _rpc_power_schedule_slurmd(slurm_msg_t *msg)
 			error("Error responding to power knob get info: %m");
 	} else {
 		slurm_msg_t resp_msg;
-		
 		power_knob_get_info_node_resp_msg_t power_msg;
 		uint16_t socket_cnt;
-		power_schedule_slurmd_req_msg_t *req = msg->data;
-		socket_cnt = 2;
-
-	    do_power_schedule_slurmd();
-
-		
-		debug3("    _rpc_power_schedule_slurmd setting the cap");
-	//	power_knob_g_set_data(req->cap_info);
+		power_knob_get_info_req_msg_t *req = msg->data;
 
-//NOTE  	power_knob_g_set_data(req);
-		
-//		debug3(" Receive set data 1 is %d",req->cap_info);
-//		
-//		debug3(" Receive set data 2 is %d",req->cap_info2);
-//		
-//		debug3("    _rpc_power_knob_cap end setting the cap");
+		power_knob_g_get_data(POWER_KNOB_DATA_SOCKET_CNT,&socket_cnt);
 
 		memset(&power_msg, 0, sizeof(power_knob_get_info_node_resp_msg_t));
 
 		power_msg.socket_cnt = socket_cnt;
 		power_msg.power_info = power_knob_current_alloc(socket_cnt);
 
-//		debug3("    _rpc_power_knob_cap getting the cap");
-//		power_knob_g_get_data(POWER_KNOB_DATA_NODE_POWER,power_msg.power_info);
-//		debug3("    _rpc_power_knob_cap geted the cap");
+		power_knob_g_get_data(POWER_KNOB_DATA_NODE_POWER,power_msg.power_info);
 
 		slurm_msg_t_copy(&resp_msg, msg);
 		resp_msg.msg_type = RESPONSE_POWER_KNOB_GET_INFO;
 		resp_msg.data     = &power_msg;
 
-		debug3("    _rpc_power_knob_cap sending");
 		slurm_send_node_msg(msg->conn_fd, &resp_msg);
-		debug3("    _rpc_power_knob_cap done sending");
 		
 		power_knob_current_destroy(power_msg.power_info);
 		
 	}
 	return rc;
-
 }
 
-
+/*
+ * Read socket power and PMC counts back to back and return both in a
+ * single reply, so the controller needs one round trip per node per sweep.
+ */
 static int
-_rpc_power_knob_get_info(slurm_msg_t *msg)
+_rpc_power_knob_sample(slurm_msg_t *msg)
 {
-	debug("rpc_power_knob_get_info running");
-	int        rc = SLURM_SUCCESS;
+	int rc = SLURM_SUCCESS;
 	uid_t req_uid = g_slurm_auth_get_uid(msg->auth_cred,
 					     slurm_get_auth_info());
-	int i;
 	static bool first_msg = true;
 
 	if (!_slurm_authorized_user(req_uid)) {
-		error("Security violation, power_knob_get_info RPC from uid %d",
+		error("Security violation, power_knob_sample RPC from uid %d",
 		      req_uid);
 		if (first_msg) {
 			error("Do you have SlurmUser configured as uid %d?",
@@ -3480,31 +3539,78 @@ _rpc_power_knob_get_info(slurm_msg_t *msg)
 
 	if (rc != SLURM_SUCCESS) {
 		if (slurm_send_rc_msg(msg, rc) < 0)
-			error("Error responding to power knob get info: %m");
+			error("Error responding to power knob sample: %m");
 	} else {
 		slurm_msg_t resp_msg;
-		power_knob_get_info_node_resp_msg_t power_msg;
-		uint16_t socket_cnt;
-		power_knob_get_info_req_msg_t *req = msg->data;
+		power_knob_sample_resp_msg_t sample_msg;
+		power_knob_sample_req_msg_t *req = msg->data;
 
-		power_knob_g_get_data(POWER_KNOB_DATA_SOCKET_CNT,&socket_cnt);
+		power_push_sample(&sample_msg, req->seq);
 
-		memset(&power_msg, 0, sizeof(power_knob_get_info_node_resp_msg_t));
+		slurm_msg_t_copy(&resp_msg, msg);
+		resp_msg.msg_type = RESPONSE_POWER_KNOB_SAMPLE;
+		resp_msg.data     = &sample_msg;
 
-		power_msg.socket_cnt = socket_cnt;
-		power_msg.power_info = power_knob_current_alloc(socket_cnt);
+		slurm_send_node_msg(msg->conn_fd, &resp_msg);
 
-		power_knob_g_get_data(POWER_KNOB_DATA_NODE_POWER,power_msg.power_info);
+		power_knob_current_destroy(sample_msg.power_info);
+		power_knob_cache_destroy(sample_msg.perf_info);
+	}
+	return rc;
+}
 
-		slurm_msg_t_copy(&resp_msg, msg);
-		resp_msg.msg_type = RESPONSE_POWER_KNOB_GET_INFO;
-		resp_msg.data     = &power_msg;
+/*
+ * Apply this node's entry of a cap request addressed to many nodes. The
+ * same request reaches every node through the forwarding tree, so each
+ * node looks itself up in node_list; the return codes travel back up the
+ * tree.
+ */
+static int
+_rpc_power_cap_nodes(slurm_msg_t *msg)
+{
+	int rc = SLURM_SUCCESS, inx;
+	uid_t req_uid = g_slurm_auth_get_uid(msg->auth_cred,
+					     slurm_get_auth_info());
+	power_cap_nodes_req_msg_t *req = msg->data;
+	power_knob_cap_req_msg_t cap_msg;
+	static bool first_msg = true;
 
-		slurm_send_node_msg(msg->conn_fd, &resp_msg);
-		
-		power_knob_current_destroy(power_msg.power_info);
-		
+	if (!_slurm_authorized_user(req_uid)) {
+		error("Security violation, power_cap_nodes RPC from uid %d",
+		      req_uid);
+		if (first_msg) {
+			error("Do you have SlurmUser configured as uid %d?",
+			      req_uid);
+		}
+		rc = ESLURM_USER_ID_MISSING;	/* or bad in this case */
 	}
+	first_msg = false;
+
+	if (rc == SLURM_SUCCESS) {
+		inx = nodelist_find(req->node_list, conf->node_name);
+		if (inx < 0) {
+			error("%s: node %s not in %s", __func__,
+			      conf->node_name, req->node_list);
+			rc = ESLURM_INVALID_NODE_NAME;
+		} else if (req->cap_cnt == 1) {
+			inx = 0;
+		} else if (inx >= req->cap_cnt) {
+			error("%s: %u caps for node %d of %s", __func__,
+			      req->cap_cnt, inx, req->node_list);
+			rc = EINVAL;
+		}
+	}
+	if (rc == SLURM_SUCCESS) {
+		memset(&cap_msg, 0, sizeof(cap_msg));
+		cap_msg.cap_info  = req->cap_info[inx];
+		cap_msg.cap_info2 = req->cap_info2[inx];
+		debug3("%s: package caps %u/%u W", __func__,
+		       cap_msg.cap_info, cap_msg.cap_info2);
+		rc = power_knob_g_set_data(&cap_msg);
+	}
+
+	if (slurm_send_rc_msg(msg, rc) < 0)
+		error("Error responding to power cap nodes: %m");
 	return rc;
 }
 
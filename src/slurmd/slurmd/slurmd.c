@@ -99,6 +99,8 @@
 
 #include "src/slurmd/common/core_spec_plugin.h"
 #include "src/slurmd/slurmd/get_mach_stat.h"
+#include "src/slurmd/slurmd/power_ctl.h"
+#include "src/slurmd/slurmd/power_push.h"
 #include "src/slurmd/common/job_container_plugin.h"
 #include "src/slurmd/common/proctrack.h"
 #include "src/slurmd/slurmd/req.h"
@@ -347,6 +349,7 @@ main (int argc, char **argv)
 	if (slurm_power_knob_init() < 0)
 		fatal("Unable to initialize power knob plugin.");
 	power_knob_g_conf_set();	
+	power_ctl_init();
 	file_bcast_init();
 
 	_create_msg_socket();
@@ -376,6 +379,7 @@ main (int argc, char **argv)
 	msg_aggr_sender_init(conf->hostname, conf->port,
 			     conf->msg_aggr_window_time,
 			     conf->msg_aggr_window_msgs);
+	power_push_init();
 	_msg_engine();
 
 	/*
@@ -1702,6 +1706,8 @@ cleanup:
 static int
 _slurmd_fini(void)
 {
+	power_push_fini();
+	power_ctl_fini();
 	node_features_g_fini();
 	core_spec_g_fini();
 	switch_g_node_fini();
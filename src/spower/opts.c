@@ -0,0 +1,171 @@
+/*****************************************************************************\
+ *  opts.c - spower command line option processing
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "src/common/parse_time.h"
+#include "src/common/proc_args.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+#include "src/spower/spower.h"
+
+#define OPT_LONG_USAGE 0x101
+
+static void  _help(void);
+static void  _usage(void);
+
+/*
+ * parse_command_line, fill in params data structure with data
+ */
+extern void parse_command_line(int argc, char **argv)
+{
+	int opt_char;
+	int option_index;
+	char *end_ptr;
+	static struct option long_options[] = {
+		{"count",	required_argument, 0,	'n'},
+		{"endtime",	required_argument, 0,	'E'},
+		{"file",	required_argument, 0,	'f'},
+		{"help",	no_argument,	   0,	'h'},
+		{"noheader",	no_argument,	   0,	'N'},
+		{"starttime",	required_argument, 0,	'S'},
+		{"usage",	no_argument,	   0,	OPT_LONG_USAGE},
+		{"version",	no_argument,	   0,	'V'},
+		{NULL,		0,		   0,	0}
+	};
+
+	params.count = 10;
+	while ((opt_char = getopt_long(argc, argv, "E:f:hn:NS:V", long_options,
+				       &option_index)) != -1) {
+		switch (opt_char) {
+		case (int)'E':
+			params.end = parse_time(optarg, 1);
+			if (!params.end) {
+				fprintf(stderr, "Invalid end time: %s\n",
+					optarg);
+				exit(1);
+			}
+			break;
+		case (int)'f':
+			xfree(params.file);
+			params.file = xstrdup(optarg);
+			break;
+		case (int)'h':
+			_help();
+			exit(0);
+			break;
+		case (int)'n':
+			params.count = strtoul(optarg, &end_ptr, 10);
+			if (end_ptr[0] || !params.count) {
+				fprintf(stderr, "Invalid count: %s\n", optarg);
+				exit(1);
+			}
+			break;
+		case (int)'N':
+			params.no_header = true;
+			break;
+		case (int)'S':
+			params.start = parse_time(optarg, 1);
+			if (!params.start) {
+				fprintf(stderr, "Invalid start time: %s\n",
+					optarg);
+				exit(1);
+			}
+			break;
+		case (int)'V':
+			print_slurm_version();
+			exit(0);
+			break;
+		case (int)OPT_LONG_USAGE:
+			_usage();
+			exit(0);
+			break;
+		default:
+			_usage();
+			exit(1);
+		}
+	}
+
+	if (optind >= argc) {
+		_usage();
+		exit(1);
+	}
+	if (!strcmp(argv[optind], "job") && (optind + 2 == argc)) {
+		params.command = SPOWER_CMD_JOB;
+		params.job_id = strtoul(argv[optind + 1], &end_ptr, 10);
+		if (end_ptr[0] || !params.job_id) {
+			fprintf(stderr, "Invalid job id: %s\n",
+				argv[optind + 1]);
+			exit(1);
+		}
+	} else if (!strcmp(argv[optind], "top") && (optind + 1 == argc)) {
+		params.command = SPOWER_CMD_TOP;
+	} else {
+		_usage();
+		exit(1);
+	}
+}
+
+static void _usage(void)
+{
+	printf("Usage: spower [-f file] [-S time] [-E time] "
+	       "{job <job_id> | top [-n count]}\n");
+}
+
+static void _help(void)
+{
+	printf ("\
+Usage: spower [OPTIONS] job <job_id>\n\
+       spower [OPTIONS] top\n\
+  job <job_id>         watts drawn by a job's nodes at each sample\n\
+  top                  nodes with the highest average watts\n\
+  -E, --endtime=time   ignore samples after this time\n\
+  -f, --file=path      telemetry store, default from slurm.conf\n\
+  -n, --count=count    nodes listed by top, default 10\n\
+  -N, --noheader       do not print a header line\n\
+  -S, --starttime=time ignore samples before this time\n\
+\nHelp options:\n\
+  --help               show this help message\n\
+  --usage              display brief usage message\n\
+  --version            display current version number\n");
+}
@@ -0,0 +1,295 @@
+/*****************************************************************************\
+ *  spower.c - report power telemetry written by the slurmctld power monitor
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slurm/slurm.h"
+#include "slurm/slurm_errno.h"
+#include "src/common/list.h"
+#include "src/common/log.h"
+#include "src/common/parse_time.h"
+#include "src/common/power_tsdb.h"
+#include "src/common/read_config.h"
+#include "src/common/xhash.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+#include "src/spower/spower.h"
+
+struct spower_parameters params;
+
+/* Watts of a job summed over its nodes for one sample time */
+typedef struct job_sample {
+	time_t   time;
+	uint32_t node_cnt;
+	uint32_t last_node;
+	uint64_t watts;
+	uint64_t cap_watts;
+} job_sample_t;
+
+typedef struct job_totals {
+	job_sample_t cur;
+	time_t   first_time;
+	time_t   last_time;
+	uint32_t sample_cnt;
+	uint64_t watts_sum;
+	uint64_t peak_watts;
+	double   joules;
+	uint64_t prev_watts;
+	time_t   prev_time;
+} job_totals_t;
+
+/* Watts of one node over the window */
+typedef struct node_totals {
+	char    *name;
+	time_t   last_time;
+	uint32_t sample_cnt;
+	uint64_t watts_sum;
+	uint64_t cur_watts;	/* all sockets of the current sample */
+	uint64_t peak_watts;
+} node_totals_t;
+
+static void _job_sample_done(job_totals_t *tot)
+{
+	char time_str[32];
+	job_sample_t *cur = &tot->cur;
+
+	if (!cur->node_cnt)
+		return;
+
+	slurm_make_time_str(&cur->time, time_str, sizeof(time_str));
+	printf("%-19s %6u %10"PRIu64" %10"PRIu64"\n", time_str,
+	       cur->node_cnt, cur->watts, cur->cap_watts);
+
+	if (!tot->sample_cnt)
+		tot->first_time = cur->time;
+	else if (cur->time > tot->prev_time) {
+		/* Trapezoid between consecutive samples */
+		tot->joules += (double) (tot->prev_watts + cur->watts) / 2.0 *
+			       (double) (cur->time - tot->prev_time);
+	}
+	tot->last_time = cur->time;
+	tot->sample_cnt++;
+	tot->watts_sum += cur->watts;
+	tot->peak_watts = MAX(tot->peak_watts, cur->watts);
+	tot->prev_watts = cur->watts;
+	tot->prev_time = cur->time;
+	memset(cur, 0, sizeof(job_sample_t));
+}
+
+static int _job_row(const power_tsdb_row_t *row, void *arg)
+{
+	job_totals_t *tot = (job_totals_t *) arg;
+	job_sample_t *cur = &tot->cur;
+
+	if (cur->node_cnt && (row->time != cur->time))
+		_job_sample_done(tot);
+	if (!cur->node_cnt || (row->node_inx != cur->last_node))
+		cur->node_cnt++;
+	cur->time = row->time;
+	cur->last_node = row->node_inx;
+	cur->watts += row->pkg_watts + row->dram_watts;
+	cur->cap_watts += row->pkg_cap_watts + row->dram_cap_watts;
+	return 0;
+}
+
+static int _report_job(power_tsdb_reader_t *reader,
+		       power_tsdb_query_t *query)
+{
+	job_totals_t tot;
+
+	memset(&tot, 0, sizeof(job_totals_t));
+	if (!params.no_header) {
+		printf("%-19s %6s %10s %10s\n", "TIME", "NODES", "WATTS",
+		       "CAP_WATTS");
+	}
+	if (power_tsdb_scan(reader, query, _job_row, &tot) != SLURM_SUCCESS)
+		return SLURM_ERROR;
+	_job_sample_done(&tot);
+
+	if (!tot.sample_cnt) {
+		fprintf(stderr, "No samples of job %u\n", params.job_id);
+		return SLURM_ERROR;
+	}
+	printf("\nJob %u: %u samples over %ld seconds, average %"PRIu64
+	       " W, peak %"PRIu64" W, energy %.0f J\n", params.job_id,
+	       tot.sample_cnt, (long) (tot.last_time - tot.first_time),
+	       tot.watts_sum / tot.sample_cnt, tot.peak_watts, tot.joules);
+	return SLURM_SUCCESS;
+}
+
+static const char *_node_id(void *item)
+{
+	return ((node_totals_t *) item)->name;
+}
+
+static void _node_free(void *item)
+{
+	node_totals_t *node = (node_totals_t *) item;
+
+	xfree(node->name);
+	xfree(node);
+}
+
+static void _node_sample_done(node_totals_t *node)
+{
+	if (!node->sample_cnt)
+		return;
+	node->watts_sum += node->cur_watts;
+	node->peak_watts = MAX(node->peak_watts, node->cur_watts);
+	node->cur_watts = 0;
+}
+
+static int _top_row(const power_tsdb_row_t *row, void *arg)
+{
+	xhash_t *nodes = (xhash_t *) arg;
+	node_totals_t *node;
+
+	if (!row->node_name)
+		return 0;	/* written before any node table */
+	if (!(node = xhash_get(nodes, row->node_name))) {
+		node = xmalloc(sizeof(node_totals_t));
+		node->name = xstrdup(row->node_name);
+		xhash_add(nodes, node);
+	}
+	if (!node->sample_cnt || (row->time != node->last_time)) {
+		_node_sample_done(node);
+		node->sample_cnt++;
+		node->last_time = row->time;
+	}
+	node->cur_watts += row->pkg_watts + row->dram_watts;
+	return 0;
+}
+
+static void _top_collect(void *item, void *arg)
+{
+	node_totals_t *node = (node_totals_t *) item;
+	List list = (List) arg;
+
+	_node_sample_done(node);
+	list_append(list, node);
+}
+
+static int _top_sort(void *x, void *y)
+{
+	node_totals_t *node1 = *(node_totals_t **) x;
+	node_totals_t *node2 = *(node_totals_t **) y;
+	uint64_t avg1 = node1->watts_sum / node1->sample_cnt;
+	uint64_t avg2 = node2->watts_sum / node2->sample_cnt;
+
+	if (avg1 > avg2)
+		return -1;
+	if (avg1 < avg2)
+		return 1;
+	return strcmp(node1->name, node2->name);
+}
+
+static int _report_top(power_tsdb_reader_t *reader,
+		       power_tsdb_query_t *query)
+{
+	xhash_t *nodes;
+	List list;
+	ListIterator iter;
+	node_totals_t *node;
+	uint32_t i = 0;
+
+	nodes = xhash_init(_node_id, _node_free, NULL, 0);
+	if (power_tsdb_scan(reader, query, _top_row, nodes) !=
+	    SLURM_SUCCESS) {
+		xhash_free_ptr(&nodes);
+		return SLURM_ERROR;
+	}
+
+	list = list_create(NULL);
+	xhash_walk(nodes, _top_collect, list);
+	list_sort(list, _top_sort);
+
+	if (!params.no_header) {
+		printf("%-20s %10s %10s %8s\n", "NODELIST", "AVG_WATTS",
+		       "PEAK_WATTS", "SAMPLES");
+	}
+	iter = list_iterator_create(list);
+	while ((node = list_next(iter)) && (i++ < params.count)) {
+		printf("%-20s %10"PRIu64" %10"PRIu64" %8u\n", node->name,
+		       node->watts_sum / node->sample_cnt, node->peak_watts,
+		       node->sample_cnt);
+	}
+	list_iterator_destroy(iter);
+	list_destroy(list);
+	xhash_free_ptr(&nodes);
+	return SLURM_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+	log_options_t opts = LOG_OPTS_STDERR_ONLY;
+	power_tsdb_reader_t *reader;
+	power_tsdb_query_t query;
+	int rc;
+
+	log_init(xbasename(argv[0]), opts, SYSLOG_FACILITY_USER, NULL);
+	parse_command_line(argc, argv);
+
+	/* slurm.conf is only read for the default path */
+	if (!params.file && !(params.file = power_tsdb_conf_path(NULL))) {
+		fprintf(stderr, "No telemetry_file in PowerParameters, "
+			"use --file\n");
+		exit(1);
+	}
+	if (!(reader = power_tsdb_open(params.file))) {
+		fprintf(stderr, "Unable to open power telemetry %s: %s\n",
+			params.file, slurm_strerror(errno));
+		exit(1);
+	}
+
+	memset(&query, 0, sizeof(power_tsdb_query_t));
+	query.start = params.start;
+	query.end = params.end;
+	if (params.command == SPOWER_CMD_JOB) {
+		query.job_id = params.job_id;
+		rc = _report_job(reader, &query);
+	} else
+		rc = _report_top(reader, &query);
+
+	power_tsdb_close(reader);
+	xfree(params.file);
+	exit(rc == SLURM_SUCCESS ? 0 : 1);
+}
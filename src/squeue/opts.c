@@ -1518,6 +1518,21 @@ extern int parse_long_format( char* format_long )
 							 field_size,
 							 right_justify,
 							 suffix );
+			else if (!xstrcasecmp(token, "powerpkg"))
+				job_format_add_power_pkg(params.format_list,
+							 field_size,
+							 right_justify,
+							 suffix );
+			else if (!xstrcasecmp(token, "powerdram"))
+				job_format_add_power_dram(params.format_list,
+							  field_size,
+							  right_justify,
+							  suffix );
+			else if (!xstrcasecmp(token, "powerfreq"))
+				job_format_add_power_freq(params.format_list,
+							  field_size,
+							  right_justify,
+							  suffix );
 			else if (!xstrcasecmp(token, "deadline"))
 				job_format_add_deadline(params.format_list,
 							field_size,
@@ -2067,6 +2067,51 @@ int _print_job_mcs_label(job_info_t * job, int width,
 	return SLURM_SUCCESS;
 }
 
+int _print_job_power_pkg(job_info_t * job, int width,
+			 bool right, char* suffix)
+{
+	if (job == NULL)
+		_print_str("POWER_PKG", width, right, true);
+	else if (job->power_pkg_watts == 0)
+		_print_str("N/A", width, right, true);
+	else
+		_print_int(job->power_pkg_watts, width, right, true);
+
+	if (suffix)
+		printf("%s", suffix);
+	return SLURM_SUCCESS;
+}
+
+int _print_job_power_dram(job_info_t * job, int width,
+			  bool right, char* suffix)
+{
+	if (job == NULL)
+		_print_str("POWER_DRAM", width, right, true);
+	else if (job->power_dram_watts == 0)
+		_print_str("N/A", width, right, true);
+	else
+		_print_int(job->power_dram_watts, width, right, true);
+
+	if (suffix)
+		printf("%s", suffix);
+	return SLURM_SUCCESS;
+}
+
+int _print_job_power_freq(job_info_t * job, int width,
+			  bool right, char* suffix)
+{
+	if (job == NULL)
+		_print_str("POWER_FREQ", width, right, true);
+	else if (job->power_freq == 0)
+		_print_str("N/A", width, right, true);
+	else
+		_print_int(job->power_freq, width, right, true);
+
+	if (suffix)
+		printf("%s", suffix);
+	return SLURM_SUCCESS;
+}
+
 /*****************************************************************************
  * Job Step Print Functions
  *****************************************************************************/
@@ -292,6 +292,12 @@ int job_format_add_function(List list, int width, bool right_justify,
 	job_format_add_function(list,wid,right,suffix,_print_job_tres)
 #define job_format_add_mcs_label(list,wid,right,suffix) \
 	job_format_add_function(list,wid,right,suffix,_print_job_mcs_label)
+#define job_format_add_power_pkg(list,wid,right,suffix) \
+	job_format_add_function(list,wid,right,suffix,_print_job_power_pkg)
+#define job_format_add_power_dram(list,wid,right,suffix) \
+	job_format_add_function(list,wid,right,suffix,_print_job_power_dram)
+#define job_format_add_power_freq(list,wid,right,suffix) \
+	job_format_add_function(list,wid,right,suffix,_print_job_power_freq)
 
 
 /*****************************************************************************
@@ -494,6 +500,12 @@ int _print_job_tres(job_info_t * job, int width,
 		    bool right_justify, char *suffix);
 int _print_job_mcs_label(job_info_t * job, int width,
 			 bool right_justify, char* suffix);
+int _print_job_power_pkg(job_info_t * job, int width,
+			 bool right_justify, char* suffix);
+int _print_job_power_dram(job_info_t * job, int width,
+			  bool right_justify, char* suffix);
+int _print_job_power_freq(job_info_t * job, int width,
+			  bool right_justify, char* suffix);
 
 /*****************************************************************************
  * Step Print Format Functions
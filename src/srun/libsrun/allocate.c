@@ -875,6 +875,9 @@ job_desc_msg_create_from_opts (void)
 
 	if (opt.power_flags)
 		j->power_flags = opt.power_flags;
+	j->power_pkg_watts = opt.power_pkg_watts;
+	j->power_dram_watts = opt.power_dram_watts;
+	j->power_freq = opt.power_freq;
 	if (opt.mcs_label)
 		j->mcs_label = opt.mcs_label;
 	j->wait_all_nodes = 1;
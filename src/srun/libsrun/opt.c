@@ -204,6 +204,9 @@
 #define LONG_OPT_MCS_LABEL       0x165
 #define LONG_OPT_DEADLINE        0x166
 #define LONG_OPT_DELAY_BOOT      0x167
+#define LONG_OPT_POWER_PKG       0x168
+#define LONG_OPT_POWER_DRAM      0x169
+#define LONG_OPT_POWER_FREQ      0x16a
 
 extern char **environ;
 
@@ -557,6 +560,9 @@ static void _opt_default(void)
 	opt.nice = NO_VAL;
 	opt.priority = 0;
 	opt.power_flags = 0;
+	opt.power_pkg_watts = NO_VAL;
+	opt.power_dram_watts = NO_VAL;
+	opt.power_freq = NO_VAL;
 	opt.mcs_label = NULL;
 	opt.delay_boot = NO_VAL;
 }
@@ -1022,6 +1028,9 @@ static void _set_options(const int argc, char **argv)
 		{"ntasks-per-socket",required_argument, 0, LONG_OPT_NTASKSPERSOCKET},
 		{"open-mode",        required_argument, 0, LONG_OPT_OPEN_MODE},
 		{"power",            required_argument, 0, LONG_OPT_POWER},
+		{"power-dram",       required_argument, 0, LONG_OPT_POWER_DRAM},
+		{"power-freq",       required_argument, 0, LONG_OPT_POWER_FREQ},
+		{"power-pkg",        required_argument, 0, LONG_OPT_POWER_PKG},
 		{"priority",         required_argument, 0, LONG_OPT_PRIORITY},
 		{"profile",          required_argument, 0, LONG_OPT_PROFILE},
 		{"prolog",           required_argument, 0, LONG_OPT_PROLOG},
@@ -1801,6 +1810,17 @@ static void _set_options(const int argc, char **argv)
 		case LONG_OPT_POWER:
 			opt.power_flags = power_flags_id(optarg);
 			break;
+		case LONG_OPT_POWER_PKG:
+			opt.power_pkg_watts = _get_int(optarg, "power-pkg",
+						       false);
+			break;
+		case LONG_OPT_POWER_DRAM:
+			opt.power_dram_watts = _get_int(optarg, "power-dram",
+							false);
+			break;
+		case LONG_OPT_POWER_FREQ:
+			opt.power_freq = _get_int(optarg, "power-freq", false);
+			break;
 		case LONG_OPT_THREAD_SPEC:
 			opt.core_spec = _get_int(optarg, "thread_spec", true) |
 				CORE_SPEC_THREAD;
@@ -2693,6 +2713,12 @@ static void _opt_list(void)
 	if (opt.resv_port_cnt != NO_VAL)
 		info("resv_port_cnt     : %d", opt.resv_port_cnt);
 	info("power             : %s", power_flags_str(opt.power_flags));
+	if (opt.power_pkg_watts != NO_VAL)
+		info("power_pkg_watts   : %u", opt.power_pkg_watts);
+	if (opt.power_dram_watts != NO_VAL)
+		info("power_dram_watts  : %u", opt.power_dram_watts);
+	if (opt.power_freq != NO_VAL)
+		info("power_freq        : %u", opt.power_freq);
 	str = print_commandline(opt.argc, opt.argv);
 	info("remote command    : `%s'", str);
 	if (opt.mcs_label)
@@ -2855,6 +2881,9 @@ static void _help(void)
 "  -O, --overcommit            overcommit resources\n"
 "  -p, --partition=partition   partition requested\n"
 "      --power=flags           power management options\n"
+"      --power-pkg=watts       package watts per socket for the power budget\n"
+"      --power-dram=watts      DRAM watts per socket for the power budget\n"
+"      --power-freq=khz        target CPU frequency for the power allocator\n"
 "      --priority=value        set the priority of the job to value\n"
 "      --prolog=program        run \"program\" before launching job step\n"
 "      --profile=value         enable acct_gather_profile for detailed data\n"
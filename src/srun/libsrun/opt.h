@@ -239,6 +239,9 @@ typedef struct srun_options {
 	uint32_t cpu_freq_max;  /* Maximum cpu frequency  */
 	uint32_t cpu_freq_gov;  /* cpu frequency governor */
 	uint8_t power_flags;	/* Power management options	*/
+	uint32_t power_pkg_watts; /* --power-pkg, package watts/socket */
+	uint32_t power_dram_watts; /* --power-dram, DRAM watts/socket	*/
+	uint32_t power_freq;	/* --power-freq, target kHz	*/
 	char *mcs_label;	/* mcs label if mcs plugin in use */
 	time_t deadline; 	/* --deadline                   */
 	uint32_t job_flags;	/* --gres-flags */
@@ -0,0 +1,317 @@
+/*****************************************************************************\
+ *  power_bench-tst.c - measure power sweeps and cap convergence
+ *****************************************************************************
+ *  Copyright (C) "The PomPP research team" supported by the JST,
+ *  CREST research program. <http://www.hal.ipc.i.u-tokyo.ac.jp/research/pompp/>
+ *  Written by Ryuichi Sakamoto <r-sakamoto@hal.ipc.i.u-tokyo.ac.jp>
+ *
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+/*
+ * Scale test of power management, meant for a --enable-multiple-slurmd
+ * build with many virtual nodes on one host, e.g.
+ *
+ *	NodeName=vn[1-256] NodeHostname=localhost Port=17001-17256
+ *	PowerKnobType=power_knob/emulated
+ *	PowerParameters=emulated_lag_msec=300,emulated_noise=2
+ *
+ * Run as SlurmUser, the sample and budget RPCs are privileged:
+ *
+ *	power_bench-tst -w vn[1-256] -s 50 -c 150
+ *
+ * Sweeps use the same forwarding tree and sample RPC as the slurmctld
+ * power monitor, so the wall clock and the CPU time of this process per
+ * sweep are what the controller pays for one. With -c every node is then
+ * given a power budget, enforced by its slurmd, and swept until its power
+ * is within the tolerance of the budget.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "slurm/slurm.h"
+#include "src/common/forward.h"
+#include "src/common/hostlist.h"
+#include "src/common/log.h"
+#include "src/common/macros.h"
+#include "src/common/slurm_protocol_api.h"
+#include "src/common/xmalloc.h"
+
+typedef struct bench_sweep {
+	uint32_t wall_usec;
+	uint32_t cpu_usec;
+	int fail_cnt;
+	uint32_t *node_watts;	/* indexed like the hostlist, NO_VAL if the
+				 * node did not answer */
+} bench_sweep_t;
+
+static uint64_t _now_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t _cpu_usec(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return (uint64_t) (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 +
+	       ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+static int _cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* Print min, average, 95th percentile and max of cnt values */
+static void _print_dist(char *what, uint32_t *val, int cnt)
+{
+	uint64_t sum = 0;
+	int i, p95;
+
+	if (cnt == 0) {
+		printf("%-22s no samples\n", what);
+		return;
+	}
+	qsort(val, cnt, sizeof(uint32_t), _cmp_u32);
+	for (i = 0; i < cnt; i++)
+		sum += val[i];
+	p95 = MIN((cnt * 95) / 100, cnt - 1);
+	printf("%-22s min %8u  avg %8"PRIu64"  p95 %8u  max %8u\n", what,
+	       val[0], sum / cnt, val[p95], val[cnt - 1]);
+}
+
+static List _tree_send(hostlist_t hl, uint16_t msg_type, void *data)
+{
+	slurm_msg_t msg;
+
+	slurm_msg_t_init(&msg);
+	msg.msg_type = msg_type;
+	msg.data = data;
+	return start_msg_tree(hl, &msg, 0);
+}
+
+/* One sweep of every node, as the power monitor does it */
+static void _sweep(hostlist_t hl, int node_cnt, bench_sweep_t *sweep)
+{
+	power_knob_sample_req_msg_t req;
+	power_knob_sample_resp_msg_t *resp;
+	ret_data_info_t *ret_data_info;
+	ListIterator itr;
+	List ret_list;
+	uint64_t wall, cpu;
+	int i, inx;
+	static uint32_t seq = 0;
+
+	for (i = 0; i < node_cnt; i++)
+		sweep->node_watts[i] = NO_VAL;
+
+	wall = _now_usec();
+	cpu = _cpu_usec();
+	memset(&req, 0, sizeof(req));
+	req.seq = ++seq;
+	ret_list = _tree_send(hl, REQUEST_POWER_KNOB_SAMPLE, &req);
+	if (ret_list) {
+		itr = list_iterator_create(ret_list);
+		while ((ret_data_info = list_next(itr))) {
+			if (ret_data_info->type != RESPONSE_POWER_KNOB_SAMPLE)
+				continue;
+			inx = hostlist_find(hl, ret_data_info->node_name);
+			if ((inx < 0) || (inx >= node_cnt))
+				continue;
+			resp = ret_data_info->data;
+			sweep->node_watts[inx] = 0;
+			for (i = 0; i < resp->socket_cnt; i++) {
+				sweep->node_watts[inx] +=
+					resp->power_info[i].cpu_current_watts +
+					resp->power_info[i].dram_current_watts;
+			}
+		}
+		list_iterator_destroy(itr);
+		FREE_NULL_LIST(ret_list);
+	}
+	sweep->wall_usec = _now_usec() - wall;
+	sweep->cpu_usec = _cpu_usec() - cpu;
+
+	sweep->fail_cnt = 0;
+	for (i = 0; i < node_cnt; i++) {
+		if (sweep->node_watts[i] == NO_VAL)
+			sweep->fail_cnt++;
+	}
+}
+
+/* Send a node budget to every node, RET nodes which failed */
+static int _set_budget(hostlist_t hl, uint32_t node_watts)
+{
+	power_schedule_slurmd_req_msg_t req;
+	ret_data_info_t *ret_data_info;
+	ListIterator itr;
+	List ret_list;
+	int fail_cnt = hostlist_count(hl);
+
+	memset(&req, 0, sizeof(req));
+	req.node_watts = node_watts;
+	ret_list = _tree_send(hl, REQUEST_POWER_SCHEDULE_SLURMD, &req);
+	if (ret_list) {
+		itr = list_iterator_create(ret_list);
+		while ((ret_data_info = list_next(itr))) {
+			if (ret_data_info->type ==
+			    RESPONSE_POWER_SCHEDULE_SLURMD)
+				fail_cnt--;
+		}
+		list_iterator_destroy(itr);
+		FREE_NULL_LIST(ret_list);
+	}
+	return fail_cnt;
+}
+
+static void _usage(void)
+{
+	printf("Usage: power_bench-tst -w nodelist [-s sweeps] "
+	       "[-c cap_watts] [-t tolerance_pct] [-T timeout_sec] "
+	       "[-p period_msec]\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	log_options_t opts = LOG_OPTS_STDERR_ONLY;
+	char *nodes = NULL;
+	int sweeps = 20, tolerance = 5, timeout = 60, period_msec = 250;
+	uint32_t cap = 0, limit;
+	bench_sweep_t sweep;
+	hostlist_t hl;
+	uint32_t *wall, *cpu, *conv, *conv_usec;
+	uint64_t start;
+	int opt, node_cnt, i, s, conv_cnt, fail_total = 0;
+
+	while ((opt = getopt(argc, argv, "c:p:s:t:T:w:")) != -1) {
+		switch (opt) {
+		case 'c':
+			cap = atoi(optarg);
+			break;
+		case 'p':
+			period_msec = atoi(optarg);
+			break;
+		case 's':
+			sweeps = atoi(optarg);
+			break;
+		case 't':
+			tolerance = atoi(optarg);
+			break;
+		case 'T':
+			timeout = atoi(optarg);
+			break;
+		case 'w':
+			nodes = optarg;
+			break;
+		default:
+			_usage();
+			exit(1);
+		}
+	}
+	if (!nodes || (sweeps < 1) || (period_msec < 1)) {
+		_usage();
+		exit(1);
+	}
+
+	log_init(argv[0], opts, SYSLOG_FACILITY_USER, NULL);
+	hl = hostlist_create(nodes);
+	hostlist_uniq(hl);
+	node_cnt = hostlist_count(hl);
+	printf("%d nodes, tree width %u\n", node_cnt,
+	       slurm_get_tree_width());
+
+	sweep.node_watts = xmalloc(sizeof(uint32_t) * node_cnt);
+	wall = xmalloc(sizeof(uint32_t) * sweeps);
+	cpu = xmalloc(sizeof(uint32_t) * sweeps);
+	for (s = 0; s < sweeps; s++) {
+		_sweep(hl, node_cnt, &sweep);
+		wall[s] = sweep.wall_usec;
+		cpu[s] = sweep.cpu_usec;
+		fail_total += sweep.fail_cnt;
+	}
+	printf("\n%d sweeps, %d node samples missing\n", sweeps, fail_total);
+	_print_dist("sweep latency (usec)", wall, sweeps);
+	_print_dist("sweep cpu (usec)", cpu, sweeps);
+	xfree(wall);
+	xfree(cpu);
+
+	if (cap) {
+		/* Time from sending the budget until a node's power first
+		 * falls within tolerance of it */
+		limit = cap + (cap * tolerance) / 100;
+		conv = xmalloc(sizeof(uint32_t) * node_cnt);
+		conv_usec = xmalloc(sizeof(uint32_t) * node_cnt);
+		conv_cnt = 0;
+		start = _now_usec();
+		i = _set_budget(hl, cap);
+		if (i)
+			printf("\n%d nodes did not take the budget\n", i);
+		while ((conv_cnt < node_cnt) &&
+		       (_now_usec() - start < (uint64_t) timeout * 1000000)) {
+			_sweep(hl, node_cnt, &sweep);
+			for (i = 0; i < node_cnt; i++) {
+				if (conv[i] || (sweep.node_watts[i] == NO_VAL)
+				    || (sweep.node_watts[i] > limit))
+					continue;
+				conv[i] = 1;
+				conv_usec[conv_cnt++] =
+					(uint32_t) ((_now_usec() - start) /
+						    1000);
+			}
+			if (conv_cnt < node_cnt)
+				usleep(period_msec * 1000);
+		}
+		printf("\nbudget %u W: %d of %d nodes within %d%% in %d sec\n",
+		       cap, conv_cnt, node_cnt, tolerance, timeout);
+		_print_dist("convergence (msec)", conv_usec, conv_cnt);
+		_set_budget(hl, 0);
+		xfree(conv);
+		xfree(conv_usec);
+	}
+
+	xfree(sweep.node_watts);
+	hostlist_destroy(hl);
+	exit(0);
+}
@@ -147,6 +147,26 @@ main(int argc, char *argv[])
 		TEST(bit_ffs(bs) == 1048575, "bitstring");
 		bit_free(bs);
 	}
+	note("Testing bit_get_word");
+	{
+		bitstr_t *bs = bit_alloc(300);
+
+		TEST(bit_get_word(bs, 0) == 0, "empty bitstring");
+		bit_set(bs, 3);
+		bit_set(bs, 63);
+		bit_set(bs, 64);
+		bit_set(bs, 299);
+		TEST(bit_get_word(bs, 0) == ((1ULL << 63) | (1ULL << 3)),
+		     "first word");
+		TEST(bit_get_word(bs, 64) == 1, "second word");
+		TEST(bit_get_word(bs, 128) == 0, "empty word");
+		TEST(bit_get_word(bs, 256) == (1ULL << 43), "last word");
+		bit_not(bs);
+		TEST(bit_get_word(bs, 256) == ((1ULL << 43) - 1),
+		     "bits past the end cleared");
+		TEST(bit_get_word(bs, 320) == 0, "word past the end");
+		bit_free(bs);
+	}
 	note("Testing bit_fmt");
 	{
 		char tmpstr[1024];
@@ -0,0 +1,64 @@
+/* Test of src/common/power_knob_perf.c
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <src/common/power_knob_perf.h>
+#include <testsuite/dejagnu.h>
+
+#define TEST(_tst, _msg) do {		\
+	if (! (_tst))			\
+		fail( _msg );		\
+	else				\
+		pass( _msg );		\
+} while (0)
+
+int
+main(int argc, char *argv[])
+{
+#ifdef __linux__
+	pmc_perf_event_t events[2] = {
+		{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+		{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+	};
+	pmc_perf_group_t *group;
+	uint64_t first[2], second[2];
+	volatile char *buf;
+	int i;
+
+	note("Testing argument checks");
+	TEST(pmc_perf_group_open(0, -1, events, 0) == NULL, "no events");
+	TEST(pmc_perf_group_open(0, -1, events, PMC_PERF_MAX_EVENTS + 1)
+	     == NULL, "too many events");
+	TEST(pmc_perf_group_read(NULL, first) != 0, "read of NULL group");
+	pmc_perf_group_close(NULL);
+
+	note("Testing software event group");
+	group = pmc_perf_group_open(0, -1, events, 2);
+	if (!group) {
+		/* perf_event_paranoid or a container may forbid this */
+		note("perf_event_open unavailable, skipping");
+		TEST((errno == EACCES) || (errno == EPERM) ||
+		     (errno == ENOSYS) || (errno == ENOENT) ||
+		     (errno == EOPNOTSUPP), "open failure reported in errno");
+		totals();
+		return failed;
+	}
+	TEST(pmc_perf_group_read(group, first) == 0, "first read");
+
+	buf = malloc(1 << 22);
+	for (i = 0; i < (1 << 22); i += 4096)
+		buf[i] = (char) i;
+	free((void *) buf);
+
+	TEST(pmc_perf_group_read(group, second) == 0, "second read");
+	TEST(second[0] > first[0], "task clock advances");
+	TEST(second[1] >= first[1], "page faults do not go backwards");
+	pmc_perf_group_close(group);
+#else
+	note("perf_event_open is Linux only, skipping");
+#endif
+	totals();
+	return failed;
+}
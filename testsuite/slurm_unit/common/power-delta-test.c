@@ -0,0 +1,211 @@
+/* Test of src/common/power_delta.c
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <src/common/pack.h>
+#include <src/common/power_delta.h>
+#include <src/common/xmalloc.h>
+#include <src/common/xstring.h>
+#include <testsuite/dejagnu.h>
+
+#define TEST(_tst, _msg) do {		\
+	if (! (_tst))			\
+		fail( _msg );		\
+	else				\
+		pass( _msg );		\
+} while (0)
+
+#define NODES	6
+#define SOCKETS	2
+
+/* Encode value against prev and decode it back */
+static int _round_trip(uint64_t value, uint64_t prev, int *len)
+{
+	uint8_t buf[POWER_DELTA_MAX_BYTES];
+	const uint8_t *end;
+	uint64_t out = ~value;
+
+	*len = power_delta_put(buf, value, prev) - buf;
+	end = power_delta_get(buf, buf + *len, prev, &out);
+	return (end == buf + *len) && (out == value);
+}
+
+static void _fill_node(node_power_info_t *node, const char *name, int seed,
+		       int watts, int cache)
+{
+	int s;
+
+	memset(node, 0, sizeof(node_power_info_t));
+	node->name = xstrdup(name);
+	if (watts) {
+		node->watts_update_time = 1500000000 + seed;
+		node->socket_cnt = SOCKETS;
+		node->power = xmalloc(sizeof(power_current_data_t) * SOCKETS);
+		for (s = 0; s < SOCKETS; s++) {
+			node->power[s].enable_monitor = 1;
+			node->power[s].cpu_current_watts = 80 + seed - s * 3;
+			node->power[s].dram_current_watts = 12 + s;
+			node->power[s].cpu_current_frequency = 2400000 - seed;
+			node->power[s].dram_current_frequency = 1600000;
+			node->power[s].poll_time = 1500000000 + seed;
+			node->power[s].cpu_current_cap_watts = 120 - seed;
+			node->power[s].dram_current_cap_watts = 0;
+		}
+	}
+	if (cache) {
+		node->cache_update_time = 1500000000 + seed * 2;
+		node->cache_socket_cnt = SOCKETS;
+		node->cache = xmalloc(sizeof(cache_ref_t) * SOCKETS);
+		for (s = 0; s < SOCKETS; s++) {
+			node->cache[s].cache_mode = 3;
+			node->cache[s].all_cache_ref = 1000000007ULL * seed;
+			node->cache[s].l1_miss = 5000 * seed + s;
+			node->cache[s].l2_miss = 700 * seed;
+			/* counters may run backwards after a reset */
+			node->cache[s].l3_miss = (seed & 1) ? 3 : UINT64_MAX;
+			node->cache[s].poll_time = 1500000000 + seed * 2;
+		}
+	}
+}
+
+static void _free_nodes(node_power_info_t *nodes, uint32_t cnt)
+{
+	uint32_t i;
+
+	for (i = 0; i < cnt; i++) {
+		xfree(nodes[i].name);
+		xfree(nodes[i].power);
+		xfree(nodes[i].cache);
+	}
+	xfree(nodes);
+}
+
+static int _same_node(node_power_info_t *a, node_power_info_t *b)
+{
+	if (strcmp(a->name, b->name) ||
+	    (a->watts_update_time != b->watts_update_time) ||
+	    (a->cache_update_time != b->cache_update_time))
+		return 0;
+	if (a->watts_update_time &&
+	    ((a->socket_cnt != b->socket_cnt) ||
+	     memcmp(a->power, b->power,
+		    sizeof(power_current_data_t) * a->socket_cnt)))
+		return 0;
+	if (a->cache_update_time &&
+	    ((a->cache_socket_cnt != b->cache_socket_cnt) ||
+	     memcmp(a->cache, b->cache,
+		    sizeof(cache_ref_t) * a->cache_socket_cnt)))
+		return 0;
+	return 1;
+}
+
+/* Pack cnt records, unpack them and compare.
+ * RET 1 if every record came back unchanged */
+static int _nodes_round_trip(node_power_info_t *nodes, uint32_t cnt)
+{
+	node_power_info_t *out = NULL;
+	uint32_t out_cnt = ~cnt, i;
+	Buf buffer = init_buf(0);
+	int rc, same = 1;
+
+	power_delta_pack_nodes(nodes, cnt, buffer);
+	set_buf_offset(buffer, 0);
+	rc = power_delta_unpack_nodes(&out, &out_cnt, buffer);
+	free_buf(buffer);
+	if ((rc != SLURM_SUCCESS) || (out_cnt != cnt))
+		return 0;
+	for (i = 0; i < cnt; i++) {
+		if (!_same_node(&nodes[i], &out[i]))
+			same = 0;
+	}
+	_free_nodes(out, out_cnt);
+	return same;
+}
+
+int
+main(int argc, char *argv[])
+{
+	node_power_info_t *nodes, *out = NULL;
+	uint8_t buf[POWER_DELTA_MAX_BYTES + 1];
+	uint64_t value;
+	uint32_t out_cnt, blob_len, name_len, len;
+	char *names = NULL, *blob = NULL;
+	Buf buffer;
+	int n;
+
+	note("Testing zigzag varint deltas");
+	TEST(_round_trip(0, 0, &n) && (n == 1), "zero delta in one byte");
+	TEST(_round_trip(63, 0, &n) && (n == 1), "+63 in one byte");
+	TEST(_round_trip(0, 64, &n) && (n == 1), "-64 in one byte");
+	TEST(_round_trip(64, 0, &n) && (n == 2), "+64 in two bytes");
+	TEST(_round_trip(100, 101, &n) && (n == 1), "-1 in one byte");
+	TEST(_round_trip(UINT64_MAX, 0, &n) && (n == 1),
+	     "wrap around to -1 in one byte");
+	TEST(_round_trip(1ULL << 63, 0, &n) && (n == POWER_DELTA_MAX_BYTES),
+	     "largest delta in POWER_DELTA_MAX_BYTES");
+	TEST(_round_trip(1500000000, 0, &n), "time stamp from zero");
+
+	n = power_delta_put(buf, 1ULL << 40, 0) - buf;
+	TEST(power_delta_get(buf, buf + n - 1, 0, &value) == NULL,
+	     "truncated value rejected");
+	TEST(power_delta_get(buf, buf, 0, &value) == NULL,
+	     "empty input rejected");
+	memset(buf, 0xff, sizeof(buf));
+	TEST(power_delta_get(buf, buf + sizeof(buf), 0, &value) == NULL,
+	     "over-long value rejected");
+
+	note("Testing node record packing");
+	TEST(_nodes_round_trip(NULL, 0), "empty node set");
+
+	nodes = xmalloc(sizeof(node_power_info_t) * NODES);
+	_fill_node(&nodes[0], "tux7", 1, 1, 1);
+	TEST(_nodes_round_trip(nodes, 1), "single node");
+
+	/* non-contiguous names, with and without power or PMC changes */
+	_free_nodes(nodes, 1);
+	nodes = xmalloc(sizeof(node_power_info_t) * NODES);
+	_fill_node(&nodes[0], "tux1", 1, 1, 1);
+	_fill_node(&nodes[1], "tux3", 2, 1, 0);
+	_fill_node(&nodes[2], "tux4", 3, 0, 1);
+	_fill_node(&nodes[3], "tux9", 4, 0, 0);
+	_fill_node(&nodes[4], "tux12", 5, 1, 1);
+	_fill_node(&nodes[5], "tux30", 6, 1, 1);
+	nodes[5].socket_cnt = 1;	/* fewer sockets than the previous */
+	TEST(_nodes_round_trip(nodes, NODES), "non-contiguous node set");
+
+	note("Testing damaged input");
+	buffer = init_buf(0);
+	power_delta_pack_nodes(nodes, NODES, buffer);
+	set_buf_offset(buffer, 0);
+	unpack32(&len, buffer);
+	unpackstr_xmalloc(&names, &name_len, buffer);
+	unpackmem_xmalloc(&blob, &blob_len, buffer);
+	free_buf(buffer);
+	TEST(names && !strcmp(names, "tux[1,3-4,9,12,30]"),
+	     "names packed as one ranged expression");
+	buffer = init_buf(0);
+	pack32(len, buffer);
+	packstr(names, buffer);
+	packmem(blob, blob_len - 1, buffer);	/* last byte dropped */
+	set_buf_offset(buffer, 0);
+	TEST(power_delta_unpack_nodes(&out, &out_cnt, buffer) != SLURM_SUCCESS,
+	     "truncated records rejected");
+	TEST((out == NULL) && (out_cnt == 0), "no records on error");
+	free_buf(buffer);
+	xfree(names);
+	xfree(blob);
+
+	buffer = init_buf(0);
+	pack32(NODES + 1, buffer);
+	packstr("tux[1,3-4,9,12,30]", buffer);
+	packmem("\0\0\0\0\0\0\0", 8, buffer);
+	set_buf_offset(buffer, 0);
+	TEST(power_delta_unpack_nodes(&out, &out_cnt, buffer) != SLURM_SUCCESS,
+	     "record count not matching the names rejected");
+	free_buf(buffer);
+
+	_free_nodes(nodes, NODES);
+	totals();
+	return failed;
+}
@@ -0,0 +1,238 @@
+/* Test of the remote power requests of src/slurmctld/power_monitor.c
+ *
+ * The node sweeps and the slurmctld locks are replaced by the stubs below,
+ * so this covers the SYNC_MODE_BLOCK and SYNC_MODE_NON_BLOCK plumbing only.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <src/common/bitstring.h>
+#include <src/common/xmalloc.h>
+#include <src/slurmctld/locks.h>
+#include <src/slurmctld/power_monitor.h>
+/* dejagnu.h defines a wait() of its own, slurmctld.h has <sys/wait.h> */
+#define wait dejagnu_wait
+#include <testsuite/dejagnu.h>
+#undef wait
+
+#define TEST(_tst, _msg) do {		\
+	if (! (_tst))			\
+		fail( _msg );		\
+	else				\
+		pass( _msg );		\
+} while (0)
+
+#define NODES		8
+#define NODE_WATTS	100
+#define JOB_ID		1234
+
+List job_list = NULL;
+slurmctld_config_t slurmctld_config;
+
+static pthread_mutex_t stub_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stub_cond = PTHREAD_COND_INITIALIZER;
+static struct job_record test_job;
+static int lock_depth = 0;		/* slurmctld locks held */
+static int locked_sweeps = 0;		/* sweeps run with a lock held */
+static int hold_sweeps = 0;		/* sweeps wait while set */
+static int done_cnt = 0;		/* completed callbacks */
+static bitstr_t *last_sweep_bitmap = NULL;
+
+/* Stubs of slurmctld functions used by power_monitor.c */
+extern void lock_slurmctld(slurmctld_lock_t lock_levels)
+{
+	slurm_mutex_lock(&stub_mutex);
+	lock_depth++;
+	slurm_mutex_unlock(&stub_mutex);
+}
+
+extern void unlock_slurmctld(slurmctld_lock_t lock_levels)
+{
+	slurm_mutex_lock(&stub_mutex);
+	lock_depth--;
+	slurm_mutex_unlock(&stub_mutex);
+}
+
+struct job_record *find_job_record(uint32_t job_id)
+{
+	if (job_id == JOB_ID)
+		return &test_job;
+	return NULL;
+}
+
+extern power_sweep_t *power_collect_sweep(bitstr_t *node_bitmap,
+					  uint16_t flags, int timeout)
+{
+	power_sweep_t *sweep = xmalloc(sizeof(power_sweep_t));
+
+	slurm_mutex_lock(&stub_mutex);
+	if (lock_depth)
+		locked_sweeps++;
+	while (hold_sweeps)
+		pthread_cond_wait(&stub_cond, &stub_mutex);
+	last_sweep_bitmap = node_bitmap;
+	slurm_mutex_unlock(&stub_mutex);
+
+	sweep->node_cnt = NODES;
+	if (node_bitmap) {
+		sweep->node_bitmap = bit_copy(node_bitmap);
+	} else {
+		sweep->node_bitmap = bit_alloc(NODES);
+		bit_set_all(sweep->node_bitmap);
+	}
+	sweep->fail_bitmap = bit_alloc(NODES);
+	return sweep;
+}
+
+extern int power_collect_set_caps(bitstr_t *node_bitmap, uint32_t *cap,
+				  uint32_t *cap2, int timeout,
+				  bitstr_t **fail_bitmap)
+{
+	return 0;
+}
+
+extern void power_collect_store(power_sweep_t *sweep)
+{
+}
+
+extern uint32_t power_sweep_node_watts(power_sweep_t *sweep, int node_inx)
+{
+	if (bit_test(sweep->node_bitmap, node_inx))
+		return NODE_WATTS;
+	return 0;
+}
+
+extern void power_sweep_free(power_sweep_t *sweep)
+{
+	if (sweep) {
+		FREE_NULL_BITMAP(sweep->node_bitmap);
+		FREE_NULL_BITMAP(sweep->fail_bitmap);
+		xfree(sweep);
+	}
+}
+
+extern void power_energy_update(void)
+{
+}
+
+typedef struct {
+	int called;
+	int rc;
+	uint32_t total_power;
+	int node_cnt;
+} cb_result_t;
+
+static void _callback(power_monitor_result_t *result, void *arg)
+{
+	cb_result_t *cb = arg;
+
+	slurm_mutex_lock(&stub_mutex);
+	if (cb) {
+		cb->called++;
+		cb->rc = result->rc;
+		cb->total_power = result->total_power;
+		cb->node_cnt = bit_set_count(result->node_bitmap);
+	}
+	done_cnt++;
+	pthread_cond_broadcast(&stub_cond);
+	slurm_mutex_unlock(&stub_mutex);
+}
+
+static void _hold(int hold)
+{
+	slurm_mutex_lock(&stub_mutex);
+	hold_sweeps = hold;
+	pthread_cond_broadcast(&stub_cond);
+	slurm_mutex_unlock(&stub_mutex);
+}
+
+static void _wait_done(int cnt)
+{
+	slurm_mutex_lock(&stub_mutex);
+	while (done_cnt < cnt)
+		pthread_cond_wait(&stub_cond, &stub_mutex);
+	slurm_mutex_unlock(&stub_mutex);
+}
+
+static void _job_nodes(void)
+{
+	test_job.job_id = JOB_ID;
+	test_job.node_bitmap = bit_alloc(NODES);
+	bit_set(test_job.node_bitmap, 1);
+	bit_set(test_job.node_bitmap, 3);
+	bit_set(test_job.node_bitmap, 5);
+}
+
+int
+main(int argc, char *argv[])
+{
+	cb_result_t cb;
+	uint32_t total_power = 0;
+	int i, rc;
+
+	note("Testing argument checks");
+	TEST(get_remote_job_power(JOB_ID + 1, &total_power, SYNC_MODE_BLOCK,
+				  NULL, NULL) == ESLURM_INVALID_JOB_ID,
+	     "unknown job rejected");
+	TEST(get_remote_job_power(JOB_ID, &total_power, SYNC_MODE_BLOCK,
+				  NULL, NULL) == EINVAL,
+	     "job without nodes rejected");
+	_job_nodes();
+	TEST(get_remote_job_frequency(JOB_ID + 1, SYNC_MODE_NON_BLOCK,
+				      _callback, NULL) == ESLURM_INVALID_JOB_ID,
+	     "unknown job rejected by frequency request");
+	TEST(get_remote_job_power(JOB_ID, &total_power, 2, NULL, NULL)
+	     == EINVAL, "bad sync mode rejected");
+	TEST(lock_depth == 0, "job lock released after rejection");
+
+	note("Testing SYNC_MODE_BLOCK");
+	rc = get_remote_job_power(JOB_ID, &total_power, SYNC_MODE_BLOCK,
+				  NULL, NULL);
+	TEST(rc == SLURM_SUCCESS, "job power request");
+	TEST(total_power == 3 * NODE_WATTS, "job power total");
+	TEST(last_sweep_bitmap && (last_sweep_bitmap != test_job.node_bitmap),
+	     "job bitmap copied");
+	TEST(get_remote_job_frequency(JOB_ID, SYNC_MODE_BLOCK, NULL, NULL)
+	     == SLURM_SUCCESS, "job frequency request");
+	total_power = 0;
+	TEST(get_remote_nodes_power(NULL, &total_power, SYNC_MODE_BLOCK,
+				    NULL, NULL) == SLURM_SUCCESS,
+	     "all nodes power request");
+	TEST(total_power == NODES * NODE_WATTS, "all nodes power total");
+	TEST(locked_sweeps == 0, "no slurmctld lock held while sweeping");
+
+	note("Testing SYNC_MODE_NON_BLOCK");
+	memset(&cb, 0, sizeof(cb));
+	_hold(1);
+	rc = get_remote_job_power(JOB_ID, NULL, SYNC_MODE_NON_BLOCK,
+				  _callback, &cb);
+	TEST(rc == SLURM_SUCCESS, "job power request queued");
+	/* The job may end before the request runs */
+	FREE_NULL_BITMAP(test_job.node_bitmap);
+	TEST(cb.called == 0, "callback not called before the sweep");
+	_hold(0);
+	_wait_done(1);
+	TEST(cb.called == 1, "callback called once");
+	TEST(cb.rc == SLURM_SUCCESS, "callback result code");
+	TEST(cb.node_cnt == 3, "callback node count");
+	TEST(cb.total_power == 3 * NODE_WATTS, "callback power total");
+
+	note("Testing the pending request limit");
+	_hold(1);
+	for (i = 0; i < POWER_MONITOR_MAX_PENDING; i++) {
+		if (get_remote_nodes_power(NULL, NULL, SYNC_MODE_NON_BLOCK,
+					   _callback, NULL) != SLURM_SUCCESS)
+			break;
+	}
+	TEST(i == POWER_MONITOR_MAX_PENDING, "requests up to the limit");
+	TEST(get_remote_nodes_power(NULL, NULL, SYNC_MODE_NON_BLOCK,
+				    _callback, NULL) == EAGAIN,
+	     "request over the limit refused");
+	_hold(0);
+	_wait_done(1 + POWER_MONITOR_MAX_PENDING);
+	TEST(locked_sweeps == 0, "no slurmctld lock held by workers");
+
+	totals();
+	return failed;
+}
@@ -0,0 +1,141 @@
+/* Test of src/plugins/power_allocator/dynamic/power_solver.c
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <src/plugins/power_allocator/dynamic/power_solver.h>
+#include <testsuite/dejagnu.h>
+
+#define TEST(_tst, _msg) do {		\
+	if (! (_tst))			\
+		fail( _msg );		\
+	else				\
+		pass( _msg );		\
+} while (0)
+
+#define SAMPLES	8
+
+static void _set_job(power_solver_job_t *job, uint32_t node_cnt,
+		     double weight, uint32_t min_watts, uint32_t max_watts)
+{
+	memset(job, 0, sizeof(power_solver_job_t));
+	job->node_cnt = node_cnt;
+	job->weight = weight;
+	job->min_watts = min_watts;
+	job->max_watts = max_watts;
+}
+
+/* The rounding down of each job loses less than a watt per node */
+static int _near_budget(uint64_t total, uint64_t budget, uint32_t node_cnt)
+{
+	return (total <= budget) && (total + node_cnt >= budget);
+}
+
+int
+main(int argc, char *argv[])
+{
+	power_solver_job_t jobs[3];
+	double watts[SAMPLES], perf[SAMPLES], e;
+	uint64_t total;
+	int i;
+
+	note("Testing power_solver_waterfill bounds");
+	_set_job(&jobs[0], 2, 1.0, 100, 300);
+	_set_job(&jobs[1], 1, 0.5, 80, 250);
+	total = power_solver_waterfill(jobs, 2, 200);
+	TEST((jobs[0].watts == 100) && (jobs[1].watts == 80),
+	     "budget below the floors gives every job its floor");
+	TEST(total == 280, "floor total reported");
+
+	_set_job(&jobs[0], 2, 1.0, 100, 300);
+	_set_job(&jobs[1], 1, 0.5, 80, 250);
+	total = power_solver_waterfill(jobs, 2, 10000);
+	TEST((jobs[0].watts == 300) && (jobs[1].watts == 250),
+	     "budget above the ceilings gives every job its ceiling");
+	TEST(total == 850, "ceiling total reported");
+
+	note("Testing power_solver_waterfill interior");
+	_set_job(&jobs[0], 1, 1.0, 50, 300);
+	_set_job(&jobs[1], 1, 0.5, 50, 300);
+	total = power_solver_waterfill(jobs, 2, 300);
+	TEST(_near_budget(total, 300, 2), "interior total fits the budget");
+	TEST((abs((int) jobs[0].watts - 200) <= 1) &&
+	     (abs((int) jobs[1].watts - 100) <= 1),
+	     "watts proportional to the weights");
+
+	_set_job(&jobs[0], 1, 1.0, 0, 150);
+	_set_job(&jobs[1], 1, 0.5, 0, 400);
+	total = power_solver_waterfill(jobs, 2, 400);
+	TEST(_near_budget(total, 400, 2), "clamped total fits the budget");
+	TEST((jobs[0].watts == 150) && (abs((int) jobs[1].watts - 250) <= 1),
+	     "ceiling of one job leaves the rest to the other");
+
+	_set_job(&jobs[0], 1, 1.0, 120, 400);
+	_set_job(&jobs[1], 1, 0.2, 120, 400);
+	total = power_solver_waterfill(jobs, 2, 400);
+	TEST(_near_budget(total, 400, 2), "floored total fits the budget");
+	TEST((jobs[1].watts == 120) && (abs((int) jobs[0].watts - 280) <= 1),
+	     "floor of one job leaves the rest to the other");
+
+	/* with no floor at all the marginal value has no natural upper
+	 * bound, a small budget must still be met */
+	_set_job(&jobs[0], 1, 1.0, 0, 1000);
+	_set_job(&jobs[1], 1, 1.0, 0, 1000);
+	_set_job(&jobs[2], 1, 1.0, 0, 1000);
+	total = power_solver_waterfill(jobs, 3, 90);
+	TEST(_near_budget(total, 90, 3), "zero floors and a small budget");
+	TEST((abs((int) jobs[0].watts - 30) <= 1) &&
+	     (abs((int) jobs[2].watts - 30) <= 1),
+	     "zero floors split evenly");
+
+	_set_job(&jobs[0], 4, 1.0, 0, 1000);
+	_set_job(&jobs[1], 1, 1.0, 0, 1000);
+	total = power_solver_waterfill(jobs, 2, 500);
+	TEST(_near_budget(total, 500, 5), "node counts weigh the budget");
+	TEST((abs((int) jobs[0].watts - 100) <= 1) &&
+	     (abs((int) jobs[1].watts - 100) <= 1),
+	     "same watts per node for the same weight");
+
+	_set_job(&jobs[0], 1, 0.0, 0, 1000);
+	_set_job(&jobs[1], 1, 1.0, 0, 1000);
+	power_solver_waterfill(jobs, 2, 500);
+	TEST((jobs[0].weight == POWER_SOLVER_MIN_WEIGHT) && jobs[0].watts,
+	     "zero weight raised to the minimum");
+
+	note("Testing power_solver_elasticity");
+	for (i = 0; i < SAMPLES; i++) {
+		watts[i] = 100.0 + 20.0 * i;
+		perf[i] = 3.0 * pow(watts[i], 0.6);
+	}
+	e = power_solver_elasticity(watts, perf, SAMPLES, 0.5);
+	TEST(fabs(e - 0.6) < 1e-6, "exact power law slope");
+
+	TEST(power_solver_elasticity(watts, perf, 2, 0.42) == 0.42,
+	     "too few samples give the prior");
+	for (i = 0; i < SAMPLES; i++)
+		watts[i] = 200.0;
+	TEST(power_solver_elasticity(watts, perf, SAMPLES, 0.42) == 0.42,
+	     "constant watts give the prior");
+
+	for (i = 0; i < SAMPLES; i++) {
+		watts[i] = 100.0 + 20.0 * i;
+		perf[i] = pow(watts[i], 2.0);
+	}
+	TEST(power_solver_elasticity(watts, perf, SAMPLES, 0.5) == 1.0,
+	     "slope clamped to 1");
+	for (i = 0; i < SAMPLES; i++)
+		perf[i] = 1000.0 / watts[i];
+	TEST(power_solver_elasticity(watts, perf, SAMPLES, 0.5) ==
+	     POWER_SOLVER_MIN_WEIGHT, "negative slope clamped to the minimum");
+
+	for (i = 0; i < SAMPLES; i++)
+		perf[i] = 3.0 * pow(watts[i], 0.6);
+	watts[1] = 0.0;
+	perf[4] = -1.0;
+	e = power_solver_elasticity(watts, perf, SAMPLES, 0.5);
+	TEST(fabs(e - 0.6) < 1e-6, "non positive samples skipped");
+
+	totals();
+	return failed;
+}
@@ -0,0 +1,214 @@
+/* Test of src/common/power_tsdb.c
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <src/common/power_tsdb.h>
+#include <src/common/xmalloc.h>
+#include <src/common/xstring.h>
+#include <testsuite/dejagnu.h>
+
+#define TEST(_tst, _msg) do {		\
+	if (! (_tst))			\
+		fail( _msg );		\
+	else				\
+		pass( _msg );		\
+} while (0)
+
+#define NODES	16
+#define SOCKETS	2
+#define SWEEPS	100
+
+typedef struct {
+	int rows;
+	uint64_t watts;
+	uint64_t l3_miss;
+	int bad_name;
+} totals_t;
+
+static int _count(const power_tsdb_row_t *row, void *arg)
+{
+	totals_t *tot = arg;
+	char name[16];
+
+	snprintf(name, sizeof(name), "n%u", row->node_inx);
+	if (!row->node_name || strcmp(row->node_name, name))
+		tot->bad_name++;
+	tot->rows++;
+	tot->watts += row->pkg_watts + row->dram_watts;
+	tot->l3_miss += row->l3_miss;
+	return 0;
+}
+
+static int _stop(const power_tsdb_row_t *row, void *arg)
+{
+	return (++(*(int *) arg) == 5);
+}
+
+int
+main(int argc, char *argv[])
+{
+	char path[] = "/tmp/power-tsdb-test.XXXXXX";
+	char *names[NODES], name_buf[NODES][16];
+	power_tsdb_row_t rows[NODES * SOCKETS];
+	power_tsdb_writer_t *writer;
+	power_tsdb_reader_t *reader;
+	power_tsdb_query_t query;
+	totals_t tot;
+	uint64_t expect_watts = 0;
+	uint32_t blk[4];
+	char *old_path = NULL;
+	int fd, i, j, s, n;
+	off_t size, off;
+
+	fd = mkstemp(path);
+	close(fd);
+	unlink(path);
+
+	for (i = 0; i < NODES; i++) {
+		snprintf(name_buf[i], sizeof(name_buf[i]), "n%d", i);
+		names[i] = name_buf[i];
+	}
+
+	note("Testing writer");
+	writer = power_tsdb_writer_open(path, 512, 60, 0);
+	TEST(writer != NULL, "writer open");
+	if (!writer) {
+		totals();
+		return failed;
+	}
+	power_tsdb_set_nodes(writer, names, NODES);
+	for (s = 0; s < SWEEPS; s++) {
+		n = 0;
+		for (i = 0; i < NODES; i++) {
+			for (j = 0; j < SOCKETS; j++, n++) {
+				memset(&rows[n], 0, sizeof(rows[n]));
+				rows[n].time = 1000000 + s * 10;
+				rows[n].node_inx = i;
+				rows[n].socket = j;
+				/* nodes 0-3 run job 7 in the second half */
+				rows[n].job_id = ((i < 4) && (s >= 50)) ? 7 : 0;
+				rows[n].pkg_watts = 50 + i + (s % 7);
+				rows[n].dram_watts = 10 + j;
+				rows[n].pkg_cap_watts = 120;
+				rows[n].l3_miss = (uint64_t) 1 << 40 | s;
+				expect_watts += rows[n].pkg_watts +
+						rows[n].dram_watts;
+			}
+		}
+		power_tsdb_append(writer, rows, n);
+	}
+	power_tsdb_writer_close(writer);
+
+	note("Testing full scan");
+	reader = power_tsdb_open(path);
+	TEST(reader != NULL, "reader open");
+	memset(&query, 0, sizeof(query));
+	memset(&tot, 0, sizeof(tot));
+	TEST(power_tsdb_scan(reader, &query, _count, &tot) == 0, "scan");
+	TEST(tot.rows == NODES * SOCKETS * SWEEPS, "every row read back");
+	TEST(tot.watts == expect_watts, "watts read back");
+	TEST(tot.bad_name == 0, "node names resolved");
+
+	note("Testing queries");
+	memset(&tot, 0, sizeof(tot));
+	query.job_id = 7;
+	power_tsdb_scan(reader, &query, _count, &tot);
+	TEST(tot.rows == 4 * SOCKETS * 50, "job filter");
+
+	memset(&query, 0, sizeof(query));
+	memset(&tot, 0, sizeof(tot));
+	query.start = 1000000 + 10 * 10;
+	query.end = 1000000 + 19 * 10;
+	power_tsdb_scan(reader, &query, _count, &tot);
+	TEST(tot.rows == NODES * SOCKETS * 10, "time window");
+
+	memset(&query, 0, sizeof(query));
+	memset(&tot, 0, sizeof(tot));
+	query.node_name = "n3";
+	power_tsdb_scan(reader, &query, _count, &tot);
+	TEST(tot.rows == SOCKETS * SWEEPS, "node filter");
+
+	memset(&query, 0, sizeof(query));
+	memset(&tot, 0, sizeof(tot));
+	query.min_watts = 1000;
+	power_tsdb_scan(reader, &query, _count, &tot);
+	TEST(tot.rows == 0, "watts filter");
+
+	memset(&query, 0, sizeof(query));
+	n = 0;
+	power_tsdb_scan(reader, &query, _stop, &n);
+	TEST(n == 5, "callback stops the scan");
+	power_tsdb_close(reader);
+
+	note("Testing incomplete tail");
+	fd = open(path, O_RDWR);
+	size = lseek(fd, 0, SEEK_END);
+	TEST(ftruncate(fd, size - 3) == 0, "truncate");
+	close(fd);
+	reader = power_tsdb_open(path);
+	memset(&tot, 0, sizeof(tot));
+	power_tsdb_scan(reader, &query, _count, &tot);
+	power_tsdb_close(reader);
+	TEST((tot.rows > 0) && (tot.rows < NODES * SOCKETS * SWEEPS),
+	     "rows before a torn block still read");
+
+	writer = power_tsdb_writer_open(path, 0, 60, 0);
+	TEST(writer != NULL, "reopen drops the torn block");
+	power_tsdb_set_nodes(writer, names, NODES);
+	power_tsdb_append(writer, rows, NODES * SOCKETS);
+	power_tsdb_writer_close(writer);
+	reader = power_tsdb_open(path);
+	n = tot.rows;
+	memset(&tot, 0, sizeof(tot));
+	power_tsdb_scan(reader, &query, _count, &tot);
+	power_tsdb_close(reader);
+	TEST(tot.rows == n + NODES * SOCKETS, "append after recovery");
+
+	note("Testing damaged row count");
+	/* file header then blocks: magic, type, col_cnt, byte_len, row_cnt */
+	n = tot.rows;
+	fd = open(path, O_RDWR);
+	size = lseek(fd, 0, SEEK_END);
+	for (off = 16; off + 16 <= size; off += blk[2]) {
+		if (pread(fd, blk, sizeof(blk), off) != sizeof(blk))
+			break;
+		if ((blk[1] & 0xffff) == 1)	/* row block */
+			break;
+	}
+	blk[3] = 0xffffffff;
+	TEST(pwrite(fd, blk, sizeof(blk), off) == sizeof(blk), "rewrite");
+	close(fd);
+	reader = power_tsdb_open(path);
+	memset(&tot, 0, sizeof(tot));
+	power_tsdb_scan(reader, &query, _count, &tot);
+	power_tsdb_close(reader);
+	TEST((tot.rows > 0) && (tot.rows < n), "block with bad row count skipped");
+	unlink(path);
+
+	note("Testing rotation");
+	xstrfmtcat(old_path, "%s.1", path);
+	/* the size is checked before each write, fill the file first */
+	for (i = 0; i < 2; i++) {
+		writer = power_tsdb_writer_open(path, 0, 60, 1024);
+		power_tsdb_set_nodes(writer, names, NODES);
+		for (s = 0; s < 10; s++)
+			power_tsdb_append(writer, rows, NODES * SOCKETS);
+		power_tsdb_writer_close(writer);
+	}
+	TEST(access(old_path, R_OK) == 0, "full file moved aside");
+	reader = power_tsdb_open(path);
+	memset(&tot, 0, sizeof(tot));
+	power_tsdb_scan(reader, &query, _count, &tot);
+	power_tsdb_close(reader);
+	TEST(tot.rows == NODES * SOCKETS * 10, "new file holds the latest rows");
+	TEST(tot.bad_name == 0, "node names in the new file");
+	unlink(old_path);
+	xfree(old_path);
+
+	unlink(path);
+	totals();
+	return failed;
+}